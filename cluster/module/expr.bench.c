@@ -0,0 +1,253 @@
+/*
+OpenIO SDS conscience central server
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+/* Compare the cost of the interpreted and the compiled evaluations of the
+ * score expressions, on a set of services carrying the usual tags. The
+ * interpreted evaluation uses accessors similar to the conscience's. */
+
+#include <math.h>
+
+#include <metautils/lib/metautils.h>
+#include "expr.h"
+
+static guint iterations = 100;
+static guint services = 10000;
+static const char *expression =
+		"root(3,((num stat.cpu)*(num stat.io)*(num stat.space)))";
+
+static GPtrArray *
+_make_tags(guint i)
+{
+	GPtrArray *tags = g_ptr_array_new();
+	service_tag_set_value_boolean(
+			service_info_ensure_tag(tags, NAME_TAGNAME_UP), TRUE);
+	service_tag_set_value_string(
+			service_info_ensure_tag(tags, "tag.loc"), "rack.host.vol");
+	service_tag_set_value_string(
+			service_info_ensure_tag(tags, "tag.vol"), "/var/lib/oio/sds");
+	service_tag_set_value_float(
+			service_info_ensure_tag(tags, "stat.cpu"), 10 + (i * 7) % 90);
+	service_tag_set_value_i64(
+			service_info_ensure_tag(tags, "stat.io"), 10 + (i * 13) % 90);
+	service_tag_set_value_i64(
+			service_info_ensure_tag(tags, "stat.space"), 10 + (i * 17) % 90);
+	return tags;
+}
+
+static int
+_interpret(struct expr_s *expr, GPtrArray *tags, double *pD)
+{
+	gchar *getField(const char *b, const char *f) {
+		char str_name[128];
+		g_snprintf(str_name, sizeof(str_name), "%s.%s", b, f);
+		struct service_tag_s *pTag = service_info_get_tag(tags, str_name);
+		if (!pTag)
+			return NULL;
+		switch (pTag->type) {
+		case STVT_I64:
+			return g_strdup_printf("%"G_GINT64_FORMAT, pTag->value.i);
+		case STVT_REAL:
+			return g_strdup_printf("%f", pTag->value.r);
+		case STVT_BOOL:
+			return g_strdup_printf("%d", pTag->value.b ? 1 : 0);
+		case STVT_STR:
+			return g_strdup(pTag->value.s);
+		case STVT_BUF:
+			return g_strdup(pTag->value.buf);
+		}
+		return NULL;
+	}
+	gchar *getStat(const char *f) { return getField("stat", f); }
+	gchar *getTag(const char *f) { return getField("tag", f); }
+	accessor_f *getAcc(const char *b) {
+		if (!strcmp(b, "stat"))
+			return getStat;
+		if (!strcmp(b, "tag"))
+			return getTag;
+		return NULL;
+	}
+	return expr_evaluate(pD, expr, getAcc);
+}
+
+static int
+_run(struct expr_program_s *prog, GPtrArray *tags, double *pD)
+{
+	const guint max = expr_program_count_vars(prog);
+	double vars[max + 1];
+	guint8 defined[max + 1];
+	for (guint i = 0; i < max; i++) {
+		struct service_tag_s *pTag = service_info_get_tag(
+				tags, expr_program_get_var(prog, i));
+		defined[i] = pTag != NULL;
+		if (!pTag)
+			continue;
+		switch (pTag->type) {
+		case STVT_I64:
+			vars[i] = pTag->value.i;
+			break;
+		case STVT_REAL:
+			vars[i] = pTag->value.r;
+			break;
+		case STVT_BOOL:
+			vars[i] = pTag->value.b;
+			break;
+		case STVT_STR:
+			vars[i] = strtod(pTag->value.s, NULL);
+			break;
+		case STVT_BUF:
+			vars[i] = strtod(pTag->value.buf, NULL);
+			break;
+		}
+	}
+	return expr_program_run(prog, vars, defined, pD);
+}
+
+static void
+cli_action(void)
+{
+	struct expr_s *expr = NULL;
+	if (expr_parse(expression, &expr)) {
+		GRID_ERROR("Failed to parse [%s]", expression);
+		grid_main_set_status(1);
+		return;
+	}
+	struct expr_program_s *prog = expr_compile(expr);
+	if (!prog) {
+		GRID_ERROR("Expression [%s] cannot be compiled", expression);
+		grid_main_set_status(1);
+		expr_clean(expr);
+		return;
+	}
+
+	GPtrArray **tags = g_malloc0(services * sizeof(GPtrArray*));
+	for (guint i = 0; i < services; i++)
+		tags[i] = _make_tags(i);
+
+	/* Check the compiled expression computes the same scores */
+	guint mismatches = 0;
+	for (guint i = 0; i < services; i++) {
+		double d0 = 0, d1 = 0;
+		int rc0 = _interpret(expr, tags[i], &d0);
+		int rc1 = _run(prog, tags[i], &d1);
+		if (rc0 != rc1 || (!rc0 && floor(d0) != floor(d1)))
+			mismatches++;
+	}
+
+	gint64 start = oio_ext_monotonic_time();
+	for (guint it = 0; it < iterations; it++) {
+		for (guint i = 0; i < services; i++) {
+			double d = 0;
+			_interpret(expr, tags[i], &d);
+		}
+	}
+	const gint64 interpreted = oio_ext_monotonic_time() - start;
+
+	start = oio_ext_monotonic_time();
+	for (guint it = 0; it < iterations; it++) {
+		for (guint i = 0; i < services; i++) {
+			double d = 0;
+			_run(prog, tags[i], &d);
+		}
+	}
+	const gint64 compiled = oio_ext_monotonic_time() - start;
+
+	const gdouble evals = (gdouble) iterations * services;
+	GRID_NOTICE("[%s] %u services x %u iterations, %u mismatches",
+			expression, services, iterations, mismatches);
+	GRID_NOTICE("interpreted: %.3fs, %.1fns per service",
+			interpreted / (gdouble) G_TIME_SPAN_SECOND,
+			interpreted * 1000.0 / evals);
+	GRID_NOTICE("compiled: %.3fs, %.1fns per service",
+			compiled / (gdouble) G_TIME_SPAN_SECOND,
+			compiled * 1000.0 / evals);
+	if (mismatches)
+		grid_main_set_status(1);
+
+	for (guint i = 0; i < services; i++) {
+		g_ptr_array_foreach(tags[i], (GFunc)service_tag_destroy, NULL);
+		g_ptr_array_free(tags[i], TRUE);
+	}
+	g_free(tags);
+	expr_program_free(prog);
+	expr_clean(expr);
+}
+
+static struct grid_main_option_s *
+cli_get_options(void)
+{
+	static struct grid_main_option_s cli_options[] = {
+		{"iterations", OT_UINT, {.u=&iterations},
+			"Number of times all the services are scored."},
+		{"services", OT_UINT, {.u=&services},
+			"Number of services to score."},
+		{NULL, 0, {.i=0}, NULL}
+	};
+	return cli_options;
+}
+
+static void
+cli_set_defaults(void)
+{
+	oio_log_init_level(GRID_LOGLVL_NOTICE);
+}
+
+static void
+cli_specific_fini(void)
+{
+	/* no op */
+}
+
+static void
+cli_specific_stop(void)
+{
+	/* no op */
+}
+
+static const gchar *
+cli_usage(void)
+{
+	return "[EXPRESSION]\n\n"
+			"    EXPRESSION\n"
+			"        The score expression to evaluate, defaults to the\n"
+			"        expression of the rawx services.\n";
+}
+
+static gboolean
+cli_configure(int argc, char **argv)
+{
+	if (argc > 0)
+		expression = argv[0];
+	return TRUE;
+}
+
+struct grid_main_callbacks cli_callbacks =
+{
+	.options = cli_get_options,
+	.action = cli_action,
+	.set_defaults = cli_set_defaults,
+	.specific_fini = cli_specific_fini,
+	.configure = cli_configure,
+	.usage = cli_usage,
+	.specific_stop = cli_specific_stop,
+};
+
+int
+main(int argc, char **args)
+{
+	return grid_main_cli(argc, args, &cli_callbacks);
+}
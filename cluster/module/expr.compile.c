@@ -0,0 +1,352 @@
+/*
+OpenIO SDS conscience central server
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <math.h>
+
+#include <metautils/lib/metautils.h>
+#include "expr.h"
+
+/* The program is a sequence of operations of a stack machine working on
+ * doubles. Each operation pops its operands and pushes its result, the
+ * semantics of each operation mimic the ones of expr_evaluate(). */
+
+enum expr_op_e
+{
+	OP_CONST, OP_VAR,
+	OP_CEIL, OP_FLOOR, OP_NOT,
+	OP_CMP, OP_EQ, OP_NEQ, OP_LT, OP_LE, OP_GT, OP_GE,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+	OP_AND, OP_XOR, OP_OR,
+	OP_ROOT,
+};
+
+struct expr_op_s
+{
+	enum expr_op_e op;
+	union {
+		double num;
+		guint var;
+	} arg;
+};
+
+struct expr_program_s
+{
+	GArray *ops;  /* <struct expr_op_s> */
+	GPtrArray *vars;  /* <gchar*> e.g. "stat.cpu" */
+	guint max_depth;
+};
+
+static void
+_emit(struct expr_program_s *prog, enum expr_op_e op)
+{
+	struct expr_op_s o = {.op = op};
+	g_array_append_val(prog->ops, o);
+}
+
+static void
+_emit_num(struct expr_program_s *prog, guint depth, double num)
+{
+	struct expr_op_s o = {.op = OP_CONST, .arg.num = num};
+	g_array_append_val(prog->ops, o);
+	prog->max_depth = MAX(prog->max_depth, depth + 1);
+}
+
+static void
+_emit_var(struct expr_program_s *prog, guint depth, struct expr_s *pE)
+{
+	gchar *name = g_strdup_printf("%s.%s",
+			pE->expr.acc.base, pE->expr.acc.field);
+	guint i;
+	for (i = 0; i < prog->vars->len; i++) {
+		if (!strcmp(name, prog->vars->pdata[i]))
+			break;
+	}
+	if (i < prog->vars->len)
+		g_free(name);
+	else
+		g_ptr_array_add(prog->vars, name);
+
+	struct expr_op_s o = {.op = OP_VAR, .arg.var = i};
+	g_array_append_val(prog->ops, o);
+	prog->max_depth = MAX(prog->max_depth, depth + 1);
+}
+
+static enum expr_op_e
+_binary_op(enum expr_type_e type)
+{
+	switch (type) {
+		case BIN_NUMCMP_ET: return OP_CMP;
+		case BIN_NUMEQ_ET: return OP_EQ;
+		case BIN_NUMNEQ_ET: return OP_NEQ;
+		case BIN_NUMLT_ET: return OP_LT;
+		case BIN_NUMLE_ET: return OP_LE;
+		case BIN_NUMGT_ET: return OP_GT;
+		case BIN_NUMGE_ET: return OP_GE;
+		case BIN_NUMADD_ET: return OP_ADD;
+		case BIN_NUMSUB_ET: return OP_SUB;
+		case BIN_NUMMUL_ET: return OP_MUL;
+		case BIN_NUMDIV_ET: return OP_DIV;
+		case BIN_NUMMOD_ET: return OP_MOD;
+		case BIN_NUMAND_ET: return OP_AND;
+		case BIN_NUMXOR_ET: return OP_XOR;
+		case BIN_NUMOR_ET: return OP_OR;
+		case BIN_ROOT_ET: return OP_ROOT;
+		default: g_assert_not_reached();
+	}
+	return OP_CONST;
+}
+
+/* Emit the operations computing <pE> at the given stack depth. Only the
+ * string manipulations of the accessors cannot be compiled, the string
+ * constants are folded. */
+static gboolean
+_compile(struct expr_program_s *prog, struct expr_s *pE, guint depth)
+{
+	if (!pE)
+		return FALSE;
+	CHK_TYPE(pE->type, return FALSE);
+
+	switch (pE->type) {
+	case VAL_NUM_ET:
+		_emit_num(prog, depth, pE->expr.num);
+		return TRUE;
+
+	case VAL_STR_ET:
+		_emit_num(prog, depth, strlen(pE->expr.str));
+		return TRUE;
+
+	case ACC_ET:
+		/* Its numeric value would be the length of the string */
+		return FALSE;
+
+	case UN_NUMSUP_ET:
+	case UN_NUMINF_ET:
+	case UN_NUMNOT_ET:
+		if (!_compile(prog, pE->expr.unary, depth))
+			return FALSE;
+		_emit(prog, pE->type == UN_NUMSUP_ET ? OP_CEIL :
+				(pE->type == UN_NUMINF_ET ? OP_FLOOR : OP_NOT));
+		return TRUE;
+
+	case UN_STRNUM_ET: {
+		struct expr_s *pUnary = pE->expr.unary;
+		if (!pUnary)
+			return FALSE;
+		if (pUnary->type == VAL_STR_ET) {
+			char *pEnd = NULL;
+			double d = strtod(pUnary->expr.str, &pEnd);
+			if (pEnd == pUnary->expr.str)
+				return FALSE;
+			_emit_num(prog, depth, d);
+			return TRUE;
+		}
+		if (pUnary->type == ACC_ET) {
+			if (!pUnary->expr.acc.base || !pUnary->expr.acc.field)
+				return FALSE;
+			_emit_var(prog, depth, pUnary);
+			return TRUE;
+		}
+		return _compile(prog, pUnary, depth);
+	}
+
+	case UN_STRLEN_ET:
+		if (!pE->expr.unary || pE->expr.unary->type != VAL_STR_ET)
+			return FALSE;
+		_emit_num(prog, depth, strlen(pE->expr.unary->expr.str));
+		return TRUE;
+
+	case BIN_STRCMP_ET: {
+		struct expr_s *p1 = pE->expr.bin.p1, *p2 = pE->expr.bin.p2;
+		if (!p1 || !p2 || p1->type != VAL_STR_ET || p2->type != VAL_STR_ET)
+			return FALSE;
+		_emit_num(prog, depth, !strcmp(p1->expr.str, p2->expr.str));
+		return TRUE;
+	}
+
+	case BIN_NUMCMP_ET:
+	case BIN_NUMEQ_ET:
+	case BIN_NUMNEQ_ET:
+	case BIN_NUMLT_ET:
+	case BIN_NUMLE_ET:
+	case BIN_NUMGT_ET:
+	case BIN_NUMGE_ET:
+	case BIN_NUMADD_ET:
+	case BIN_NUMSUB_ET:
+	case BIN_NUMMUL_ET:
+	case BIN_NUMDIV_ET:
+	case BIN_NUMMOD_ET:
+	case BIN_NUMAND_ET:
+	case BIN_NUMXOR_ET:
+	case BIN_NUMOR_ET:
+	case BIN_ROOT_ET:
+		if (!_compile(prog, pE->expr.bin.p1, depth))
+			return FALSE;
+		if (!_compile(prog, pE->expr.bin.p2, depth + 1))
+			return FALSE;
+		_emit(prog, _binary_op(pE->type));
+		return TRUE;
+
+	case NB_ET:
+		break;
+	}
+	return FALSE;
+}
+
+struct expr_program_s *
+expr_compile(struct expr_s *pE)
+{
+	struct expr_program_s *prog = g_malloc0(sizeof(*prog));
+	prog->ops = g_array_new(FALSE, FALSE, sizeof(struct expr_op_s));
+	prog->vars = g_ptr_array_new_with_free_func(g_free);
+	if (!_compile(prog, pE, 0)) {
+		expr_program_free(prog);
+		return NULL;
+	}
+	return prog;
+}
+
+void
+expr_program_free(struct expr_program_s *prog)
+{
+	if (!prog)
+		return;
+	g_array_free(prog->ops, TRUE);
+	g_ptr_array_free(prog->vars, TRUE);
+	g_free(prog);
+}
+
+guint
+expr_program_count_vars(const struct expr_program_s *prog)
+{
+	EXTRA_ASSERT(prog != NULL);
+	return prog->vars->len;
+}
+
+const char *
+expr_program_get_var(const struct expr_program_s *prog, guint i)
+{
+	EXTRA_ASSERT(prog != NULL);
+	EXTRA_ASSERT(i < prog->vars->len);
+	return prog->vars->pdata[i];
+}
+
+int
+expr_program_run(const struct expr_program_s *prog,
+		const double *vars, const guint8 *defined, double *pResult)
+{
+	if (!prog || !pResult)
+		return EXPR_EVAL_ERROR;
+
+	/* No short-circuit in the expressions: an undefined variable makes the
+	 * whole expression undefined. */
+	for (guint i = 0; i < prog->vars->len; i++) {
+		if (!defined[i])
+			return EXPR_EVAL_UNDEF;
+	}
+
+	double stack[prog->max_depth + 1];
+	guint sp = 0;
+	const struct expr_op_s *ops = (const struct expr_op_s *) prog->ops->data;
+	for (guint i = 0; i < prog->ops->len; i++) {
+		const struct expr_op_s *o = ops + i;
+		double *top = stack + sp - 1;
+		switch (o->op) {
+		case OP_CONST:
+			stack[sp++] = o->arg.num;
+			continue;
+		case OP_VAR:
+			stack[sp++] = vars[o->arg.var];
+			continue;
+		case OP_CEIL:
+			*top = ceil(*top);
+			continue;
+		case OP_FLOOR:
+			*top = floor(*top);
+			continue;
+		case OP_NOT:
+			*top = ((int) *top) ? 0 : 1;
+			continue;
+		default:
+			break;
+		}
+
+		/* Binary operations */
+		const double d1 = top[-1], d2 = top[0];
+		double *res = top - 1;
+		sp--;
+		switch (o->op) {
+		case OP_CMP:
+			*res = CMP(d1, d2);
+			break;
+		case OP_EQ:
+			*res = CMP(d1, d2) == 0;
+			break;
+		case OP_NEQ:
+			*res = CMP(d1, d2) != 0;
+			break;
+		case OP_LT:
+			*res = CMP(d1, d2) < 0;
+			break;
+		case OP_LE:
+			*res = CMP(d1, d2) <= 0;
+			break;
+		case OP_GT:
+			*res = CMP(d1, d2) > 0;
+			break;
+		case OP_GE:
+			*res = CMP(d1, d2) >= 0;
+			break;
+		case OP_ADD:
+		case OP_OR:
+			*res = d1 + d2;
+			break;
+		case OP_SUB:
+			*res = d1 - d2;
+			break;
+		case OP_MUL:
+			*res = d1 * d2;
+			break;
+		case OP_DIV:
+			*res = CMP(d2, 0) ? d1 / d2 : 0;
+			break;
+		case OP_MOD:
+			if (d1 < 0 || d2 < 0 || !(int) d2)
+				*res = 0;
+			else
+				*res = (double) ((int) d1 % (int) d2);
+			break;
+		case OP_AND:
+			*res = (d1 > 0.0 || d1 < 0.0) && (d2 > 0.0 || d2 < 0.0);
+			break;
+		case OP_XOR:
+			*res = (int) d1 ^ (int) d2;
+			break;
+		case OP_ROOT:
+			if (!CMP(d1, 0))
+				return EXPR_EVAL_UNDEF;
+			*res = CMP(d2, 0) ? pow(d2, 1 / d1) : 0.0;
+			break;
+		default:
+			return EXPR_EVAL_ERROR;
+		}
+	}
+
+	EXTRA_ASSERT(sp == 1);
+	*pResult = stack[0];
+	return EXPR_EVAL_DEF;
+}
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS metautils
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -85,4 +85,24 @@ int expr_parse(const char *pBuf, struct expr_s **pE);
 
 int expr_evaluate(double *pResult, struct expr_s *pExpr, env_f pEnv);
 
+/* An expression compiled once for all, evaluated on doubles without any
+ * string conversion. The accessors become variables named "base.field",
+ * whose values are provided by the caller at each evaluation. */
+struct expr_program_s;
+
+/* Returns NULL if the expression cannot be compiled, i.e. when it
+ * manipulates the accessors as strings: use expr_evaluate() instead. */
+struct expr_program_s *expr_compile(struct expr_s *pE);
+
+void expr_program_free(struct expr_program_s *prog);
+
+guint expr_program_count_vars(const struct expr_program_s *prog);
+
+const char *expr_program_get_var(const struct expr_program_s *prog, guint i);
+
+/* <vars> and <defined> have one entry per variable of the program.
+ * Same return codes as expr_evaluate(). */
+int expr_program_run(const struct expr_program_s *prog,
+		const double *vars, const guint8 *defined, double *pResult);
+
 #endif /*OIO_SDS__metautils__lib__expr_h*/
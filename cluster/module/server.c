@@ -1,7 +1,7 @@
 /*
 OpenIO SDS conscience central server
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -83,6 +83,10 @@ static time_t persistence_period = 30;
 static const guint8 header[] = { 0x30, 0x80 };
 static const guint8 footer[] = { 0x00, 0x00 };
 
+/* Identifies this run of the conscience, the generation numbers of the
+ * service types are meaningless to the clients of another run. */
+static gint64 epoch = 0;
+
 /* ------------------------------------------------------------------------- */
 
 # ifndef LIMIT_LENGTH_SRVDESCR
@@ -107,6 +111,12 @@ struct conscience_srv_s {
 	time_t tags_mtime;
 	time_t lock_mtime;
 
+	/* The generation of the service type when the service last changed,
+	 * and a digest of what the clients are sent: the score, the lock and
+	 * the tags. */
+	gint64 generation;
+	guint64 signature;
+
 	/*a ring by service type */
 	struct conscience_srv_s *next;
 	struct conscience_srv_s *prev;
@@ -119,6 +129,8 @@ struct conscience_srvtype_s
 {
 	gchar *score_expr_str;
 	struct expr_s *score_expr;
+	/* <score_expr> compiled, NULL if it cannot be compiled */
+	struct expr_program_s *score_prog;
 	GHashTable *services_ht;  /**<Maps (addr_info_t*) to (conscience_srv_s*)*/
 
 	GRWLock rw_lock;
@@ -130,9 +142,27 @@ struct conscience_srvtype_s
 
 	struct conscience_srv_s services_ring;
 
+	/* Bumped each time a service appears, disappears or changes. The
+	 * recently removed services are kept in <removed>, so that the clients
+	 * knowing a generation not older than <removed_floor> can be sent only
+	 * the changes since then. */
+	gint64 generation;
+	gint64 removed_floor;
+	GArray *removed;  /* <struct conscience_removed_s> */
+
 	gchar type_name[LIMIT_LENGTH_SRVTYPE];
 };
 
+struct conscience_removed_s
+{
+	gint64 generation;
+	addr_info_t addr;
+};
+
+# ifndef LIMIT_REMOVED_SERVICES
+#  define LIMIT_REMOVED_SERVICES 1024
+# endif
+
 typedef gboolean (service_callback_f) (struct conscience_srv_s * srv, gpointer udata);
 
 static void
@@ -167,6 +197,63 @@ conscience_srv_destroy(struct conscience_srv_s *service)
 	g_free(service);
 }
 
+/* Get the numeric value of a tag, as "num base.field" would do in the
+ * score expression, but without the string round-trip. */
+static gboolean
+_srv_get_tag_number(struct conscience_srv_s *service, const char *name,
+		double *pD)
+{
+	/* Only the "stat" and "tag" accessors are known */
+	if (!g_str_has_prefix(name, "stat.") && !g_str_has_prefix(name, "tag."))
+		return FALSE;
+	struct service_tag_s *pTag = service_info_get_tag(service->tags, name);
+	if (!pTag)
+		return FALSE;
+
+	const char *str = NULL;
+	switch (pTag->type) {
+	case STVT_I64:
+		*pD = pTag->value.i;
+		return TRUE;
+	case STVT_REAL:
+		*pD = pTag->value.r;
+		return TRUE;
+	case STVT_BOOL:
+		*pD = pTag->value.b ? 1 : 0;
+		return TRUE;
+	case STVT_STR:
+		str = pTag->value.s;
+		break;
+	case STVT_BUF:
+		str = pTag->value.buf;
+		break;
+	}
+	if (!str)
+		return FALSE;
+	char *pEnd = NULL;
+	*pD = strtod(str, &pEnd);
+	return pEnd != str;
+}
+
+static int
+_srv_run_score_program(struct conscience_srv_s *service, double *pD)
+{
+	const struct expr_program_s *prog = service->srvtype->score_prog;
+	const guint max = expr_program_count_vars(prog);
+	double vars[max + 1];
+	guint8 defined[max + 1];
+	for (guint i = 0; i < max; i++) {
+		const char *name = expr_program_get_var(prog, i);
+		defined[i] = _srv_get_tag_number(service, name, vars + i);
+		if (!defined[i]) {
+			GRID_DEBUG("[%s/%s/] Undefined tag wanted: %s",
+					nsinfo->name, service->srvtype->type_name, name);
+			return EXPR_EVAL_UNDEF;
+		}
+	}
+	return expr_program_run(prog, vars, defined, pD);
+}
+
 static gboolean
 conscience_srv_compute_score(struct conscience_srv_s *service)
 {
@@ -223,8 +310,12 @@ conscience_srv_compute_score(struct conscience_srv_s *service)
 		return TRUE;
 
 	gdouble d = 0.0;
-	if (expr_evaluate(&d, srvtype->score_expr, getAcc))
+	if (srvtype->score_prog) {
+		if (_srv_run_score_program(service, &d))
+			return FALSE;
+	} else if (expr_evaluate(&d, srvtype->score_expr, getAcc)) {
 		return FALSE;
+	}
 
 	gint32 current = isnan(d) ? 0 : floor(d);
 
@@ -307,11 +398,46 @@ _conscience_srv_serialize(struct conscience_srv_s *srv)
 	return gba;
 }
 
+static void
+conscience_srv_touch(struct conscience_srv_s *srv)
+{
+	srv->generation = ++ srv->srvtype->generation;
+}
+
+/* FNV-1a of what the clients know of the service. The "stat." tags are
+ * part of it, so that the changes sent to the proxies carry them. */
+static guint64
+_conscience_srv_signature(struct conscience_srv_s *srv)
+{
+	guint64 h = 14695981039346656037ULL;
+	void _hash(const void *b, gsize l) {
+		for (const guint8 *p = b; l > 0; ++p, --l)
+			h = (h ^ *p) * 1099511628211ULL;
+	}
+
+	_hash(&srv->score.value, sizeof(srv->score.value));
+	_hash(&srv->locked, sizeof(srv->locked));
+	for (guint i = 0; i < srv->tags->len; i++) {
+		const struct service_tag_s *tag = srv->tags->pdata[i];
+		gchar value[256] = "";
+		service_tag_to_string(tag, value, sizeof(value));
+		_hash(tag->name, strlen(tag->name) + 1);
+		_hash(value, strlen(value) + 1);
+	}
+	return h;
+}
+
 static void
 _conscience_srv_prepare_cache(struct conscience_srv_s *srv)
 {
 	conscience_srv_clean_udata(srv);
 	srv->cache = _conscience_srv_serialize(srv);
+
+	const guint64 signature = _conscience_srv_signature(srv);
+	if (signature != srv->signature) {
+		srv->signature = signature;
+		conscience_srv_touch(srv);
+	}
 }
 
 static guint
@@ -340,12 +466,32 @@ conscience_srvtype_set_type_expression(struct conscience_srvtype_s * srvtype,
 		g_free(srvtype->score_expr_str);
 	if (srvtype->score_expr)
 		expr_clean(srvtype->score_expr);
+	expr_program_free(srvtype->score_prog);
 
 	srvtype->score_expr_str = g_strdup(expr_str);
 	srvtype->score_expr = pE;
+	srvtype->score_prog = expr_compile(pE);
+	if (!srvtype->score_prog)
+		GRID_INFO("[NS=%s][SRVTYPE=%s] score expression [%s] not compiled, "
+				"it will be interpreted", nsinfo ? nsinfo->name : "",
+				srvtype->type_name, expr_str);
 	return TRUE;
 }
 
+/* Recompute the score of all the unlocked services of the type, in one pass
+ * on its ring of services. Call it with the type's lock held. */
+static void
+conscience_srvtype_compute_scores(struct conscience_srvtype_s *srvtype)
+{
+	EXTRA_ASSERT(srvtype != NULL);
+	const struct conscience_srv_s *beacon = &(srvtype->services_ring);
+	for (struct conscience_srv_s *srv = beacon->next;
+			srv && srv != beacon; srv = srv->next) {
+		if (!srv->locked && conscience_srv_compute_score(srv))
+			_conscience_srv_prepare_cache(srv);
+	}
+}
+
 static void
 conscience_srvtype_init(struct conscience_srvtype_s *srvtype)
 {
@@ -367,6 +513,8 @@ conscience_srvtype_create(const char *type)
 
 	srvtype->services_ht = g_hash_table_new_full(hash_service_id,
 			addr_info_equal, NULL, NULL);
+	srvtype->removed = g_array_new(FALSE, FALSE,
+			sizeof(struct conscience_removed_s));
 
 	if (type)
 		g_strlcpy(srvtype->type_name, type, sizeof(srvtype->type_name));
@@ -391,6 +539,10 @@ conscience_srvtype_flush(struct conscience_srvtype_s *srvtype)
 		counter++;
 	}
 
+	/* No delta can be computed across a flush */
+	g_array_set_size(srvtype->removed, 0);
+	srvtype->removed_floor = ++ srvtype->generation;
+
 	GRID_DEBUG("Service type [%s] flushed, [%u] services removed",
 		srvtype->type_name, counter);
 }
@@ -405,8 +557,11 @@ conscience_srvtype_destroy(struct conscience_srvtype_s *srvtype)
 
 	if (srvtype->services_ht)
 		g_hash_table_destroy(srvtype->services_ht);
+	if (srvtype->removed)
+		g_array_free(srvtype->removed, TRUE);
 	if (srvtype->score_expr)
 		expr_clean(srvtype->score_expr);
+	expr_program_free(srvtype->score_prog);
 	if (srvtype->score_expr_str) {
 		*(srvtype->score_expr_str) = '\0';
 		g_free(srvtype->score_expr_str);
@@ -432,7 +587,21 @@ conscience_srvtype_remove_srv(struct conscience_srvtype_s *srvtype,
 		srv->prev->next = srv->next;
 		srv->next->prev = srv->prev;
 		srv->next = srv->prev = NULL;
+
+		struct conscience_removed_s removed = {};
+		removed.generation = ++ srvtype->generation;
+		memcpy(&removed.addr, &srv->addr, sizeof(addr_info_t));
+		g_array_append_val(srvtype->removed, removed);
 		conscience_srv_destroy(srv);
+
+		/* Forget the oldest half, the clients that knew nothing newer
+		 * will receive the full list. */
+		if (srvtype->removed->len > LIMIT_REMOVED_SERVICES) {
+			const guint half = srvtype->removed->len / 2;
+			srvtype->removed_floor = g_array_index(srvtype->removed,
+					struct conscience_removed_s, half - 1).generation;
+			g_array_remove_range(srvtype->removed, 0, half);
+		}
 	}
 }
 
@@ -452,6 +621,7 @@ conscience_srvtype_register_srv(struct conscience_srvtype_s *srvtype,
 	service->score.timestamp = 0;
 	service->score.value = -1;
 	service->srvtype = srvtype;
+	conscience_srv_touch(service);
 
 	/*build the service description once for all*/
 	gsize desc_size = g_snprintf(service->description, sizeof(service->description),
@@ -674,6 +844,53 @@ conscience_run_srvtypes(const gchar *type, service_callback_f * callback, gpoint
 	return err;
 }
 
+/* Run <callback> on the services of <type> changed since the generation
+ * <since>, and collect in <removed> the services removed since then. When
+ * no delta can be computed from <since>, all the services are run and
+ * <delta> is set to FALSE. */
+static GError *
+conscience_run_srvtype_changes(const gchar *type, gint64 since,
+		service_callback_f *callback, gpointer udata,
+		GSList **removed, gint64 *generation, gboolean *delta)
+{
+	struct conscience_srvtype_s *srvtype =
+		conscience_get_srvtype(type, FALSE);
+	if (!srvtype)
+		return BADSRVTYPE(type);
+
+	gboolean rc = TRUE;
+	g_rw_lock_reader_lock(&(srvtype->rw_lock));
+	*generation = srvtype->generation;
+	*delta = since > 0 && since >= srvtype->removed_floor
+		&& since <= srvtype->generation;
+	if (!*delta) {
+		rc = conscience_srvtype_run_all(srvtype, callback, udata);
+	} else {
+		const struct conscience_srv_s *beacon = &(srvtype->services_ring);
+		for (struct conscience_srv_s *srv = beacon->next;
+				rc && srv && srv != beacon; srv = srv->next) {
+			if (srv->generation > since)
+				rc = callback(srv, udata);
+		}
+		for (guint i = srvtype->removed->len; i > 0; i--) {
+			const struct conscience_removed_s *rm = &g_array_index(
+					srvtype->removed, struct conscience_removed_s, i - 1);
+			if (rm->generation <= since)
+				break;
+			struct service_info_s *si = g_malloc0(sizeof(*si));
+			memcpy(&si->addr, &rm->addr, sizeof(addr_info_t));
+			g_strlcpy(si->type, srvtype->type_name, sizeof(si->type));
+			g_strlcpy(si->ns_name, nsname, sizeof(si->ns_name));
+			*removed = g_slist_prepend(*removed, si);
+		}
+	}
+	g_rw_lock_reader_unlock(&(srvtype->rw_lock));
+
+	if (!rc)
+		return SYSERR("Configuration error with [%s]", type);
+	return NULL;
+}
+
 /* ------------------------------------------------------------------------- */
 
 static volatile gboolean hub_running = FALSE;
@@ -1136,6 +1353,24 @@ _conscience_srv_serialize_full(struct conscience_srv_s *srv)
 	return gba;
 }
 
+/* A client knowing a generation of this run of the conscience may receive
+ * only the changes since that generation. Returns 0 to ask for a full
+ * list, e.g. when the generation was numbered by another run. */
+static gint64
+_cs_request_since(MESSAGE request)
+{
+	gint64 since = 0, since_epoch = 0;
+	GError *err = metautils_message_extract_strint64(
+			request, NAME_MSGKEY_EPOCH, &since_epoch);
+	if (!err)
+		err = metautils_message_extract_strint64(
+				request, NAME_MSGKEY_GENERATION, &since);
+	if (err || since_epoch != epoch)
+		since = 0;
+	g_clear_error(&err);
+	return since;
+}
+
 static gboolean
 _prepare_full(struct conscience_srv_s *srv, gpointer u)
 {
@@ -1187,21 +1422,41 @@ _cs_dispatch_SRV(struct gridd_reply_ctx_s *reply,
 	const gboolean full = metautils_message_extract_flag(
 			reply->request, NAME_MSGKEY_FULL, FALSE);
 
+	const gint64 since = _cs_request_since(reply->request);
+
 	GByteArray *gba = g_byte_array_sized_new(8192);
 	g_byte_array_append(gba, header, 2);
 
-	GError *err = conscience_run_srvtypes(strtype,
-			full ? _prepare_full : _prepare_cached, gba);
+	GSList *removed = NULL;
+	gint64 generation = 0;
+	gboolean delta = FALSE;
+	GError *err = conscience_run_srvtype_changes(strtype, since,
+			full ? _prepare_full : _prepare_cached, gba,
+			&removed, &generation, &delta);
 
 	if (err) {
 		g_byte_array_free(gba, TRUE);
 		reply->send_error(0, err);
 	} else {
+		gchar tmp[32];
+		g_snprintf(tmp, sizeof(tmp), "%"G_GINT64_FORMAT, epoch);
+		reply->add_header(NAME_MSGKEY_EPOCH, metautils_gba_from_string(tmp));
+		g_snprintf(tmp, sizeof(tmp), "%"G_GINT64_FORMAT, generation);
+		reply->add_header(NAME_MSGKEY_GENERATION,
+				metautils_gba_from_string(tmp));
+		if (delta) {
+			reply->add_header(NAME_MSGKEY_DELTA,
+					metautils_gba_from_string("1"));
+			if (removed)
+				reply->add_header(NAME_MSGKEY_REMOVED,
+						service_info_marshall_gba(removed, NULL));
+		}
 		g_byte_array_append(gba, footer, 2);
 		reply->add_body(gba);
 		reply->send_reply(200, "OK");
 	}
 
+	g_slist_free_full(removed, (GDestroyNotify) service_info_clean);
 	return 1;
 }
 
@@ -1425,10 +1680,10 @@ _task_expire (gpointer p UNUSED)
 	for (gchar **ptype=typev; typev && *ptype ;++ptype) {
 		struct conscience_srvtype_s *srvtype = conscience_get_srvtype(*ptype, FALSE);
 		EXTRA_ASSERT(srvtype != NULL);
-		g_rw_lock_reader_lock(&srvtype->rw_lock);
+		g_rw_lock_writer_lock(&srvtype->rw_lock);
 		guint count = conscience_srvtype_zero_expired(srvtype,
 				service_expiration_notifier, NULL);
-		g_rw_lock_reader_unlock(&srvtype->rw_lock);
+		g_rw_lock_writer_unlock(&srvtype->rw_lock);
 
 		if (count)
 			GRID_NOTICE("Expired [%u] [%s] services", count, *ptype);
@@ -1776,7 +2031,13 @@ _configure_srvtype(GError ** err, const gchar * type, const gchar * what, const
 				srvtype->score_variation_bound);
 		return TRUE;
 	} else if (0 == g_ascii_strcasecmp(what, KEY_SCORE_EXPR)) {
-		if (conscience_srvtype_set_type_expression(srvtype, err, value)) {
+		g_rw_lock_writer_lock(&srvtype->rw_lock);
+		gboolean rc = conscience_srvtype_set_type_expression(
+				srvtype, err, value);
+		if (rc)
+			conscience_srvtype_compute_scores(srvtype);
+		g_rw_lock_writer_unlock(&srvtype->rw_lock);
+		if (rc) {
 			GRID_INFO("[NS=%s][SRVTYPE=%s] score expression set to [%s]",
 					nsinfo->name, srvtype->type_name, value);
 			return TRUE;
@@ -2033,6 +2294,7 @@ _cs_set_defaults(void)
 
 	nsinfo = g_malloc0 (sizeof(struct namespace_info_s));
 	namespace_info_init (nsinfo);
+	epoch = oio_ext_real_time();
 }
 
 static void
@@ -0,0 +1,275 @@
+/*
+OpenIO SDS core library
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <core/ec.h>
+
+#include <string.h>
+
+#ifdef HAVE_LIBERASURECODE
+#include <erasurecode.h>
+#endif
+
+#include <core/oiostr.h>
+#include <core/oiolog.h>
+
+#include "internals.h"
+
+struct oio_ec_s
+{
+	int desc;
+	guint k;
+	guint m;
+};
+
+#ifdef HAVE_LIBERASURECODE
+
+/* Extract the raw value of a parameter of the chunk method, e.g. the
+ * algorithm in "ec/algo=liberasurecode_rs_vand,k=6,m=3". */
+static gchar *
+_chunk_method_param(const char *chunk_method, const char *key)
+{
+	const char *params = strchr(chunk_method, '/');
+	if (!params)
+		return NULL;
+	gchar *result = NULL;
+	gchar **tokens = g_strsplit(params + 1, ",", -1);
+	const size_t keylen = strlen(key);
+	for (gchar **pt = tokens; !result && *pt; ++pt) {
+		if (!strncmp(*pt, key, keylen) && (*pt)[keylen] == '=')
+			result = g_strdup(*pt + keylen + 1);
+	}
+	g_strfreev(tokens);
+	return result;
+}
+
+struct _ec_algo_s
+{
+	const char *name;
+	ec_backend_id_t id;
+	int hd;
+};
+
+/* The names are the ones known by PyECLib, so that the chunk methods
+ * are interpreted the same way by all the SDKs. */
+static const struct _ec_algo_s _algorithms[] = {
+	{"liberasurecode_rs_vand", EC_BACKEND_LIBERASURECODE_RS_VAND, 0},
+	{"jerasure_rs_vand", EC_BACKEND_JERASURE_RS_VAND, 0},
+	{"jerasure_rs_cauchy", EC_BACKEND_JERASURE_RS_CAUCHY, 0},
+	{"isa_l_rs_vand", EC_BACKEND_ISA_L_RS_VAND, 0},
+	{"isa_l_rs_cauchy", EC_BACKEND_ISA_L_RS_CAUCHY, 0},
+	{"flat_xor_hd_3", EC_BACKEND_FLAT_XOR_HD, 3},
+	{"flat_xor_hd_4", EC_BACKEND_FLAT_XOR_HD, 4},
+	{"shss", EC_BACKEND_SHSS, 0},
+	{NULL, EC_BACKEND_NULL, 0},
+};
+
+gboolean
+oio_ec_available(void)
+{
+	return TRUE;
+}
+
+GError *
+oio_ec_create(const char *chunk_method, struct oio_ec_s **out)
+{
+	EXTRA_ASSERT(chunk_method != NULL);
+	EXTRA_ASSERT(out != NULL);
+	*out = NULL;
+
+	gchar *raw_k = _chunk_method_param(chunk_method, "k");
+	gchar *raw_m = _chunk_method_param(chunk_method, "m");
+	gchar *algo = _chunk_method_param(chunk_method, "algo");
+	gint64 k = 0, m = 0;
+	GError *err = NULL;
+
+	if (!raw_k || !oio_str_is_number(raw_k, &k) || k <= 0)
+		err = BADREQ("Invalid k in chunk method [%s]", chunk_method);
+	else if (!raw_m || !oio_str_is_number(raw_m, &m) || m <= 0)
+		err = BADREQ("Invalid m in chunk method [%s]", chunk_method);
+	else if (!algo)
+		err = BADREQ("No algorithm in chunk method [%s]", chunk_method);
+
+	const struct _ec_algo_s *pa = _algorithms;
+	if (!err) {
+		for (; pa->name && strcmp(pa->name, algo); ++pa) {}
+		if (!pa->name)
+			err = NEWERROR(CODE_NOT_IMPLEMENTED,
+					"Unsupported EC algorithm [%s]", algo);
+	}
+
+	if (!err) {
+		struct ec_args args = {0};
+		args.k = k;
+		args.m = m;
+		args.hd = pa->hd ? pa->hd : m;
+		args.ct = CHKSUM_NONE;
+		int desc = liberasurecode_instance_create(pa->id, &args);
+		if (desc <= 0) {
+			err = NEWERROR(CODE_NOT_IMPLEMENTED,
+					"EC backend [%s] unavailable (%d)", algo, desc);
+		} else {
+			struct oio_ec_s *ec = g_malloc0(sizeof(struct oio_ec_s));
+			ec->desc = desc;
+			ec->k = k;
+			ec->m = m;
+			*out = ec;
+		}
+	}
+
+	g_free(raw_k);
+	g_free(raw_m);
+	g_free(algo);
+	return err;
+}
+
+void
+oio_ec_destroy(struct oio_ec_s *ec)
+{
+	if (!ec)
+		return;
+	if (ec->desc > 0)
+		liberasurecode_instance_destroy(ec->desc);
+	g_free(ec);
+}
+
+gsize
+oio_ec_fragment_size(struct oio_ec_s *ec, gsize len)
+{
+	EXTRA_ASSERT(ec != NULL);
+	if (!len)
+		return 0;
+	int rc = liberasurecode_get_fragment_size(ec->desc, len);
+	if (rc < 0)
+		return 0;
+	/* liberasurecode doesn't count the header of the fragment */
+	return rc + sizeof(fragment_header_t);
+}
+
+GError *
+oio_ec_encode(struct oio_ec_s *ec, const guint8 *data, gsize len,
+		GByteArray **out)
+{
+	EXTRA_ASSERT(ec != NULL);
+	EXTRA_ASSERT(data != NULL);
+	EXTRA_ASSERT(out != NULL);
+
+	char **data_frags = NULL, **parity_frags = NULL;
+	uint64_t frag_len = 0;
+	int rc = liberasurecode_encode(ec->desc, (const char *) data, len,
+			&data_frags, &parity_frags, &frag_len);
+	if (rc != 0)
+		return SYSERR("EC encoding failed (%d)", rc);
+
+	for (guint i = 0; i < ec->k; i++)
+		out[i] = g_byte_array_append(g_byte_array_sized_new(frag_len),
+				(guint8 *) data_frags[i], frag_len);
+	for (guint i = 0; i < ec->m; i++)
+		out[ec->k + i] = g_byte_array_append(g_byte_array_sized_new(frag_len),
+				(guint8 *) parity_frags[i], frag_len);
+
+	liberasurecode_encode_cleanup(ec->desc, data_frags, parity_frags);
+	return NULL;
+}
+
+GError *
+oio_ec_decode(struct oio_ec_s *ec, guint8 **fragments, guint count,
+		gsize fragment_size, GByteArray *out)
+{
+	EXTRA_ASSERT(ec != NULL);
+	EXTRA_ASSERT(fragments != NULL);
+	EXTRA_ASSERT(out != NULL);
+
+	if (count < ec->k)
+		return NEWERROR(CODE_UNAVAILABLE,
+				"Not enough fragments (%u/%u)", count, ec->k);
+
+	char *data = NULL;
+	uint64_t data_len = 0;
+	int rc = liberasurecode_decode(ec->desc, (char **) fragments, count,
+			fragment_size, 1, &data, &data_len);
+	if (rc != 0)
+		return SYSERR("EC decoding failed (%d)", rc);
+
+	g_byte_array_append(out, (guint8 *) data, data_len);
+	liberasurecode_decode_cleanup(ec->desc, data);
+	return NULL;
+}
+
+#else /* HAVE_LIBERASURECODE */
+
+gboolean
+oio_ec_available(void)
+{
+	return FALSE;
+}
+
+GError *
+oio_ec_create(const char *chunk_method, struct oio_ec_s **out)
+{
+	EXTRA_ASSERT(out != NULL);
+	*out = NULL;
+	return NEWERROR(CODE_NOT_IMPLEMENTED,
+			"Built without liberasurecode, cannot manage [%s]", chunk_method);
+}
+
+void
+oio_ec_destroy(struct oio_ec_s *ec)
+{
+	g_free(ec);
+}
+
+gsize
+oio_ec_fragment_size(struct oio_ec_s *ec UNUSED, gsize len UNUSED)
+{
+	return 0;
+}
+
+GError *
+oio_ec_encode(struct oio_ec_s *ec UNUSED, const guint8 *data UNUSED,
+		gsize len UNUSED, GByteArray **out UNUSED)
+{
+	return NEWERROR(CODE_NOT_IMPLEMENTED, "Built without liberasurecode");
+}
+
+GError *
+oio_ec_decode(struct oio_ec_s *ec UNUSED, guint8 **fragments UNUSED,
+		guint count UNUSED, gsize fragment_size UNUSED,
+		GByteArray *out UNUSED)
+{
+	return NEWERROR(CODE_NOT_IMPLEMENTED, "Built without liberasurecode");
+}
+
+#endif /* HAVE_LIBERASURECODE */
+
+guint
+oio_ec_get_k(struct oio_ec_s *ec)
+{
+	return ec ? ec->k : 0;
+}
+
+guint
+oio_ec_get_m(struct oio_ec_s *ec)
+{
+	return ec ? ec->m : 0;
+}
+
+guint
+oio_ec_get_quorum(struct oio_ec_s *ec)
+{
+	return ec ? ec->k + MIN(1U, ec->m) : 0;
+}
@@ -0,0 +1,80 @@
+/*
+OpenIO SDS core library
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#ifndef OIO_SDS__sdk__ec_h
+# define OIO_SDS__sdk__ec_h 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/* Size of the segments of data encoded at once. It MUST match the value used
+ * by the other SDKs (cf. EC_SEGMENT_SIZE in oio.common.storage_method) because
+ * it rules the layout of the fragments in the chunks. */
+#ifndef OIO_EC_SEGMENT_SIZE
+# define OIO_EC_SEGMENT_SIZE 1048576
+#endif
+
+/* How many segments are fetched at once when a range is downloaded */
+#ifndef OIO_EC_DOWNLOAD_SEGMENTS
+# define OIO_EC_DOWNLOAD_SEGMENTS 8
+#endif
+
+/* Erasure coding in-process, with liberasurecode. Each segment of data is
+ * encoded in k+m fragments, each fragment with its own header. The chunk #i
+ * of a metachunk is the concatenation of the fragments #i of all the
+ * segments of the metachunk. */
+struct oio_ec_s;
+
+/* Tells if the library has been built with the support of liberasurecode */
+gboolean oio_ec_available (void);
+
+/* Prepare a codec for the given chunk method, e.g.
+ * "ec/algo=liberasurecode_rs_vand,k=6,m=3" */
+GError * oio_ec_create (const char *chunk_method, struct oio_ec_s **out);
+
+void oio_ec_destroy (struct oio_ec_s *ec);
+
+guint oio_ec_get_k (struct oio_ec_s *ec);
+
+guint oio_ec_get_m (struct oio_ec_s *ec);
+
+/* How many chunks of a metachunk must be stored for its upload to succeed:
+ * k, plus the minimal parity PyECLib requires (one fragment), the same rule
+ * as ECStorageMethod.quorum in oio.common.storage_method. */
+guint oio_ec_get_quorum (struct oio_ec_s *ec);
+
+/* Size of each fragment (header included) of a segment of <len> bytes */
+gsize oio_ec_fragment_size (struct oio_ec_s *ec, gsize len);
+
+/* Encode a segment of <len> bytes. On success, <out> is filled with k+m
+ * new arrays, the k data fragments followed by the m parity fragments. */
+GError * oio_ec_encode (struct oio_ec_s *ec, const guint8 *data, gsize len,
+		GByteArray **out);
+
+/* Rebuild a segment from at least k of its fragments, each of them being
+ * <fragment_size> bytes long. The data is appended to <out>. */
+GError * oio_ec_decode (struct oio_ec_s *ec, guint8 **fragments, guint count,
+		gsize fragment_size, GByteArray *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*OIO_SDS__sdk__ec_h*/
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS core library
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -34,9 +34,12 @@ License along with this library.
 #include <curl/multi.h>
 
 #include <core/client_variables.h>
+#include <core/oiocfg.h>
 #include <core/oioext.h>
 #include <core/oiolog.h>
 
+#include "ec.h"
+
 #include "internals.h"
 #include "http_internals.h"
 
@@ -75,6 +78,13 @@ struct http_put_dest_s
 
 	GBytes *buffer;
 
+	/* Erasure coding only: the fragments waiting to be sent, the index of the
+	 * fragments sent to this destination and the checksum of all of them. */
+	GQueue *fragments; /* <GBytes*> */
+	GChecksum *checksum;
+	gchar *hash;
+	guint fragment;
+
 	/* HTTP error code (valid if success == 1) */
 	gint64 bytes_sent;
 	guint http_code;
@@ -107,6 +117,16 @@ struct http_put_s
 	gint64 remaining_length;
 
 	GQueue *buffer_tail; /* <GBytes*> */
+	gint64 buffered; /* bytes in <buffer_tail> */
+
+	/* Erasure coding only: the data is encoded segment per segment, then each
+	 * destination receives its own fragment of each segment. The checksum and
+	 * the size of the whole metachunk are sent as trailers. */
+	struct oio_ec_s *ec;
+	GByteArray *segment;
+	GChecksum *checksum;
+	gchar *hash;
+	gint64 size;
 
 	enum http_whole_put_state_e state;
 };
@@ -167,6 +187,26 @@ http_put_create(gint64 content_length, gint64 soft_length)
 	return p;
 }
 
+GError *
+http_put_set_ec(struct http_put_s *p, struct oio_ec_s *ec)
+{
+	EXTRA_ASSERT(p != NULL);
+	EXTRA_ASSERT(ec != NULL);
+	EXTRA_ASSERT(p->state == HTTP_WHOLE_BEGIN);
+#if LIBCURL_VERSION_NUM >= 0x074000
+	EXTRA_ASSERT(p->content_length < 0);
+	p->ec = ec;
+	p->segment = g_byte_array_sized_new(OIO_EC_SEGMENT_SIZE);
+	p->checksum = g_checksum_new(G_CHECKSUM_MD5);
+	p->size = 0;
+	return NULL;
+#else
+	(void) p, (void) ec;
+	return NEWERROR(CODE_NOT_IMPLEMENTED,
+			"libcurl too old to send trailers, EC uploads require 7.64.0");
+#endif
+}
+
 struct http_put_dest_s *
 http_put_add_dest(struct http_put_s *p, const char *url, gpointer u)
 {
@@ -188,11 +228,27 @@ http_put_add_dest(struct http_put_s *p, const char *url, gpointer u)
 	dest->http_code = 0;
 	dest->state = HTTP_SINGLE_BEGIN;
 
+	if (p->ec) {
+		dest->fragments = g_queue_new();
+		dest->checksum = g_checksum_new(G_CHECKSUM_MD5);
+		dest->fragment = g_slist_length(p->dests);
+	}
+
 	p->dests = g_slist_append(p->dests, dest);
 
 	return dest;
 }
 
+void
+http_put_dest_set_fragment(struct http_put_dest_s *dest, guint idx)
+{
+	EXTRA_ASSERT(dest != NULL);
+	EXTRA_ASSERT(dest->http_put->ec != NULL);
+	EXTRA_ASSERT(idx < oio_ec_get_k(dest->http_put->ec)
+			+ oio_ec_get_m(dest->http_put->ec));
+	dest->fragment = idx;
+}
+
 void
 http_put_dest_add_header(struct http_put_dest_s *dest,
 		const char *key, const char *val_fmt, ...)
@@ -242,6 +298,11 @@ http_put_dest_destroy(gpointer destination)
 		g_bytes_unref(dest->buffer);
 		dest->buffer = NULL;
 	}
+	if (dest->fragments)
+		g_queue_free_full(dest->fragments, (GDestroyNotify)g_bytes_unref);
+	if (dest->checksum)
+		g_checksum_free(dest->checksum);
+	g_free(dest->hash);
 
 	g_free(dest);
 }
@@ -259,6 +320,11 @@ http_put_destroy(struct http_put_s *p)
 		g_queue_free_full(p->buffer_tail, (GDestroyNotify)g_bytes_unref);
 		p->buffer_tail = NULL;
 	}
+	if (p->segment)
+		g_byte_array_free(p->segment, TRUE);
+	if (p->checksum)
+		g_checksum_free(p->checksum);
+	g_free(p->hash);
 	g_free(p);
 }
 
@@ -281,6 +347,7 @@ http_put_feed (struct http_put_s *p, GBytes *b)
 	EXTRA_ASSERT (len <= 0 || p->remaining_length < 0 || len <= p->remaining_length);
 
 	g_queue_push_tail (p->buffer_tail, b);
+	p->buffered += len;
 
 	if (!len) { /* marker for end of stream */
 		p->remaining_length = 0;
@@ -289,6 +356,13 @@ http_put_feed (struct http_put_s *p, GBytes *b)
 	}
 }
 
+gint64
+http_put_buffered_bytes (struct http_put_s *p)
+{
+	EXTRA_ASSERT (p != NULL);
+	return p->buffered;
+}
+
 gboolean
 http_put_done (struct http_put_s *p)
 {
@@ -336,6 +410,19 @@ http_put_get_http_code(struct http_put_s *p, gpointer k)
 	return 0;
 }
 
+const char *
+http_put_get_fragments_hash(struct http_put_s *p, gpointer k)
+{
+	EXTRA_ASSERT(p != NULL);
+	EXTRA_ASSERT(k != NULL);
+	for (GSList *l=p->dests; l ;l=l->next) {
+		struct http_put_dest_s *dest = l->data;
+		if (dest && dest->user_data == k)
+			return dest->hash;
+	}
+	return NULL;
+}
+
 void
 http_put_get_md5(struct http_put_s *p, guint8 *buffer, gsize size)
 {
@@ -440,6 +527,26 @@ cb_header(char *ptr, size_t size, size_t nmemb, void *raw_dest)
 	return len;
 }
 
+#if LIBCURL_VERSION_NUM >= 0x074000
+static int
+cb_trailers(struct curl_slist **list, struct http_put_dest_s *dest)
+{
+	struct http_put_s *p = dest->http_put;
+	if (!p->hash || !dest->hash)
+		return CURL_TRAILERFUNC_ABORT;
+
+	gchar tmp[256];
+	g_snprintf(tmp, sizeof(tmp), "%s: %"G_GINT64_FORMAT,
+			RAWX_HEADER_METACHUNK_SIZE, p->size);
+	*list = curl_slist_append(*list, tmp);
+	g_snprintf(tmp, sizeof(tmp), "%s: %s", RAWX_HEADER_METACHUNK_HASH, p->hash);
+	*list = curl_slist_append(*list, tmp);
+	g_snprintf(tmp, sizeof(tmp), "%s: %s", RAWX_HEADER_CHUNK_HASH, dest->hash);
+	*list = curl_slist_append(*list, tmp);
+	return CURL_TRAILERFUNC_OK;
+}
+#endif
+
 static void
 _start_upload(struct http_put_s *p)
 {
@@ -470,6 +577,16 @@ _start_upload(struct http_put_s *p)
 		curl_easy_setopt(dest->handle, CURLOPT_READFUNCTION,
 				(curl_read_callback)cb_read);
 		curl_easy_setopt(dest->handle, CURLOPT_READDATA, dest);
+#if LIBCURL_VERSION_NUM >= 0x074000
+		if (p->ec) {
+			http_put_dest_add_header(dest, "Trailer", "%s, %s, %s",
+					RAWX_HEADER_METACHUNK_SIZE, RAWX_HEADER_METACHUNK_HASH,
+					RAWX_HEADER_CHUNK_HASH);
+			curl_easy_setopt(dest->handle, CURLOPT_TRAILERFUNCTION,
+					(curl_trailer_callback)cb_trailers);
+			curl_easy_setopt(dest->handle, CURLOPT_TRAILERDATA, dest);
+		}
+#endif
 		curl_easy_setopt(dest->handle, CURLOPT_WRITEFUNCTION,
 				(curl_write_callback)cb_write);
 		curl_easy_setopt(dest->handle, CURLOPT_HTTPHEADER, dest->curl_headers);
@@ -522,6 +639,10 @@ _manage_curl_events (struct http_put_s *p)
 			dest->handle = NULL;
 			g_bytes_unref(dest->buffer);
 			dest->buffer = NULL;
+			if (dest->fragments) {
+				while (!g_queue_is_empty(dest->fragments))
+					g_bytes_unref(g_queue_pop_head(dest->fragments));
+			}
 		}
 	}
 }
@@ -538,14 +659,102 @@ _count_up_dests (struct http_put_s *p)
 	return count;
 }
 
-GError *
-http_put_step (struct http_put_s *p)
+static void
+_ec_pop_fragments(struct http_put_s *p)
 {
-	int rc;
-	guint count_up = 0, count_waiting_for_data = 0;
+	for (GSList *l=p->dests; l ;l=l->next) {
+		struct http_put_dest_s *d = l->data;
+		if (d->state < HTTP_SINGLE_FINISHED && !d->buffer)
+			d->buffer = g_queue_pop_head(d->fragments);
+	}
+}
 
-	EXTRA_ASSERT (p != NULL);
+static GError *
+_ec_encode_one_segment(struct http_put_s *p, gsize len)
+{
+	const guint nb = oio_ec_get_k(p->ec) + oio_ec_get_m(p->ec);
+	GByteArray *fragments[nb];
+
+	GError *err = oio_ec_encode(p->ec, p->segment->data, len, fragments);
+	if (err)
+		return err;
+	g_byte_array_remove_range(p->segment, 0, len);
+
+	for (GSList *l=p->dests; l ;l=l->next) {
+		struct http_put_dest_s *d = l->data;
+		GByteArray *frag = fragments[d->fragment];
+		if (d->state < HTTP_SINGLE_FINISHED) {
+			g_checksum_update(d->checksum, frag->data, frag->len);
+			g_queue_push_tail(d->fragments, g_bytes_new(frag->data, frag->len));
+		}
+	}
+	for (guint i = 0; i < nb; i++)
+		g_byte_array_free(fragments[i], TRUE);
+	return NULL;
+}
+
+/* Consume the data fed until at least one full segment is ready, then
+ * encode it and dispatch the fragments to the destinations. At the end of
+ * the stream, the last (partial) segment is encoded too, then each
+ * destination gets its EOF marker. */
+static GError *
+_ec_encode_segments(struct http_put_s *p)
+{
+	GBytes *buf;
+	while (NULL != (buf = g_queue_pop_head(p->buffer_tail))) {
+		gsize len = 0;
+		gconstpointer b = g_bytes_get_data(buf, &len);
+
+		if (p->hash) {
+			/* Already terminated, e.g. several EOF markers */
+			g_bytes_unref(buf);
+			continue;
+		}
 
+		if (!len) {
+			g_bytes_unref(buf);
+			GError *err = NULL;
+			if (p->segment->len > 0)
+				err = _ec_encode_one_segment(p, p->segment->len);
+			if (err)
+				return err;
+			p->hash = g_ascii_strup(g_checksum_get_string(p->checksum), -1);
+			for (GSList *l=p->dests; l ;l=l->next) {
+				struct http_put_dest_s *d = l->data;
+				d->hash = g_ascii_strup(g_checksum_get_string(d->checksum), -1);
+				if (d->state < HTTP_SINGLE_FINISHED)
+					g_queue_push_tail(d->fragments, g_bytes_new_static("", 0));
+			}
+			return NULL;
+		}
+
+		p->buffered -= len;
+		g_checksum_update(p->checksum, b, len);
+		g_byte_array_append(p->segment, b, len);
+		p->size += len;
+		g_bytes_unref(buf);
+
+		if (p->segment->len >= OIO_EC_SEGMENT_SIZE) {
+			while (p->segment->len >= OIO_EC_SEGMENT_SIZE) {
+				GError *err = _ec_encode_one_segment(p, OIO_EC_SEGMENT_SIZE);
+				if (err)
+					return err;
+			}
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+/* Everything a step does before waiting for the I/O: manage the finished
+ * requests, dispatch the data, start or unpause the requests.
+ * Returns in <up> how many requests are still running. */
+static GError *
+_step_prepare (struct http_put_s *p, guint *up)
+{
+	guint count_up = 0, count_waiting_for_data = 0;
+
+	*up = 0;
 	if (!p->dests) {
 		GRID_TRACE("%s Empty upload detected", __FUNCTION__);
 		p->state = HTTP_WHOLE_FINISHED;
@@ -563,6 +772,8 @@ http_put_step (struct http_put_s *p)
 	_manage_curl_events(p);
 
 	/* Ensure the data-pipe doesn't become empty and maybe call for more */
+	if (p->ec)
+		_ec_pop_fragments(p);
 	for (GSList *l=p->dests; l ;l=l->next) {
 		struct http_put_dest_s *d = l->data;
 		if (d->state == HTTP_SINGLE_FINISHED)
@@ -572,9 +783,17 @@ http_put_step (struct http_put_s *p)
 			count_waiting_for_data ++;
 	}
 	EXTRA_ASSERT(count_waiting_for_data <= count_up);
-	if (count_waiting_for_data == count_up) {
+	if (p->ec) {
+		if (count_waiting_for_data == count_up) {
+			GError *err = _ec_encode_segments(p);
+			if (err)
+				return err;
+			_ec_pop_fragments(p);
+		}
+	} else if (count_waiting_for_data == count_up) {
 		GBytes *buf = g_queue_pop_head (p->buffer_tail);
 		if (buf) {
+			p->buffered -= g_bytes_get_size (buf);
 			for (GSList *l=p->dests; l ;l=l->next) {
 				struct http_put_dest_s *d = l->data;
 				if (d->buffer) {
@@ -615,42 +834,80 @@ http_put_step (struct http_put_s *p)
 
 	GRID_TRACE("%s Uploads: %u total, %u up (%u wanted to data)",
 			__FUNCTION__, count_dests, count_up, count_waiting_for_data);
+	*up = count_up;
+	return NULL;
+}
 
-	if (count_up) {
-		int maxfd = -1;
-		long timeout = 0;
-		struct timeval tv = {1,0};
-		fd_set fdread = {}, fdwrite = {}, fdexcep = {};
-
-		curl_multi_timeout (p->mhandle, &timeout);
-
-		/* timeout not set, libcurl recommend to wait for a few seconds */
-		if (timeout < 0)
-			timeout = 1000;
-
-		/* No need to wait if actions are ready */
-		if (timeout > 0) {
-			tv.tv_sec = timeout / 1000;
-			tv.tv_usec = (timeout * 1000) % 1000000;
-			curl_multi_fdset(p->mhandle, &fdread, &fdwrite, &fdexcep, &maxfd);
-
-retry:
-			rc = select(maxfd+1, &fdread, &fdwrite, &fdexcep, &tv);
-			if (rc < 0) {
-				if (errno == EINTR) goto retry;
-				return SYSERR("select() error: (%d) %s", errno, strerror(errno));
-			}
-		}
-	}
+static void
+_step_perform (struct http_put_s *p)
+{
+	int rc = 0;
+	if (!p->dests || p->state == HTTP_WHOLE_FINISHED)
+		return;
 
 	/* Do the I/O things now */
 	curl_multi_perform(p->mhandle, &rc);
 
-	if (!(count_up = _count_up_dests (p))) {
+	if (!_count_up_dests (p)) {
 		GRID_TRACE("%s uploads finishing", __FUNCTION__);
 		_manage_curl_events(p);
 		p->state = HTTP_WHOLE_FINISHED;
 	}
+}
+
+GError *
+http_put_step (struct http_put_s *p)
+{
+	EXTRA_ASSERT (p != NULL);
+	return http_put_step_many (&p, 1);
+}
+
+GError *
+http_put_step_many (struct http_put_s **pv, guint count)
+{
+	int rc, maxfd = -1;
+	long timeout = -1;
+	gboolean any_up = FALSE;
+	fd_set fdread = {}, fdwrite = {}, fdexcep = {};
+
+	EXTRA_ASSERT (pv != NULL);
+
+	for (guint i = 0; i < count; ++i) {
+		struct http_put_s *p = pv[i];
+		guint up = 0;
+		GError *err = _step_prepare (p, &up);
+		if (err)
+			return err;
+		if (!up)
+			continue;
+
+		long t = 0;
+		int fd = -1;
+		curl_multi_timeout (p->mhandle, &t);
+		/* timeout not set, libcurl recommend to wait for a few seconds */
+		if (t < 0)
+			t = 1000;
+		timeout = (timeout < 0) ? t : MIN(timeout, t);
+		curl_multi_fdset(p->mhandle, &fdread, &fdwrite, &fdexcep, &fd);
+		maxfd = MAX(maxfd, fd);
+		any_up = TRUE;
+	}
+
+	/* No need to wait if actions are ready */
+	if (any_up && timeout > 0) {
+		struct timeval tv;
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = (timeout * 1000) % 1000000;
+retry:
+		rc = select(maxfd+1, &fdread, &fdwrite, &fdexcep, &tv);
+		if (rc < 0) {
+			if (errno == EINTR) goto retry;
+			return SYSERR("select() error: (%d) %s", errno, strerror(errno));
+		}
+	}
+
+	for (guint i = 0; i < count; ++i)
+		_step_perform (pv[i]);
 
 	return NULL;
 }
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS core library
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -45,6 +45,19 @@ struct http_put_s * http_put_create (gint64 content_length,
 struct http_put_dest_s *http_put_add_dest(struct http_put_s *p,
 		const char *url, gpointer k);
 
+struct oio_ec_s;
+
+/* Turn the upload into an erasure-coded upload: the data fed is encoded
+ * segment per segment and each destination receives its own fragments, then
+ * the hashes and the size of the metachunk as trailers. Must be called
+ * before any destination is added, on a streamed upload. */
+GError * http_put_set_ec (struct http_put_s *p, struct oio_ec_s *ec);
+
+/* With EC, set which fragment of each segment is sent to the destination.
+ * By default, the destinations receive the fragments in their order of
+ * addition. */
+void http_put_dest_set_fragment (struct http_put_dest_s *dest, guint idx);
+
 /* Add a header for this destination. */
 void http_put_dest_add_header(struct http_put_dest_s *dest, const char *key,
 		const char *fmt, ...) __attribute__ ((format (printf, 3, 4)));
@@ -53,13 +66,24 @@ void http_put_feed (struct http_put_s *p, GBytes *b);
 
 GError * http_put_step (struct http_put_s *p);
 
+/* Same as http_put_step() on several uploads at once, with a single wait
+ * for all their I/O */
+GError * http_put_step_many (struct http_put_s **pv, guint count);
+
 gboolean http_put_done (struct http_put_s *p);
 
 gint64 http_put_expected_bytes (struct http_put_s *p);
 
+/* How many bytes have been fed and are still waiting to be sent */
+gint64 http_put_buffered_bytes (struct http_put_s *p);
+
 /* Get the number of failed requests. */
 guint http_put_get_failure_number(struct http_put_s *p);
 
+/* With EC, get the hexadecimal MD5 of the fragments sent to the destination
+ * represented by its user_data, once the upload is finished. */
+const char * http_put_get_fragments_hash (struct http_put_s *p, gpointer k);
+
 /* Compute the md5 of the whole buffer so it must be called after run function.
  * @param p http put handle
  * @param buffer will be filled with the hash
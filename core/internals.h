@@ -198,6 +198,7 @@ enum {
 	HTTP_CODE_CREATED            = 201,
 	HTTP_CODE_ACCEPTED           = 202,
 	HTTP_CODE_NO_CONTENT         = 204,
+	HTTP_CODE_PARTIAL_CONTENT    = 206,
 	HTTP_CODE_BAD_REQUEST        = 400,
 	HTTP_CODE_FORBIDDEN          = 403,
 	HTTP_CODE_NOT_FOUND          = 404,
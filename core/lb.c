@@ -54,6 +54,10 @@ struct oio_lb_pool_vtable_s
 			const oio_location_t * known,
 			oio_lb_on_id_f on_id, gboolean *flawed);
 
+	GError* (*poll_sets) (struct oio_lb_pool_s *self, guint count,
+			const oio_location_t * avoids,
+			oio_lb_on_set_id_f on_id, gboolean *flawed);
+
 	struct oio_lb_item_s* (*get_item) (struct oio_lb_pool_s *self,
 			const char *id);
 };
@@ -101,6 +105,14 @@ oio_lb_pool__patch(struct oio_lb_pool_s *self,
 	CFG_CALL(self, patch)(self, avoids, known, on_id, flawed);
 }
 
+GError*
+oio_lb_pool__poll_sets(struct oio_lb_pool_s *self, guint count,
+		const oio_location_t * avoids,
+		oio_lb_on_set_id_f on_id, gboolean *flawed)
+{
+	CFG_CALL(self, poll_sets)(self, count, avoids, on_id, flawed);
+}
+
 struct oio_lb_item_s *
 oio_lb_pool__get_item(struct oio_lb_pool_s *self,
 		const char *id)
@@ -253,6 +265,9 @@ struct _slot_item_s
 	struct _lb_item_s *item;
 	oio_weight_acc_t acc_weight;
 	generation_t generation;
+	/* For each level, how many items of the slot share the location of the
+	 * item. Computed when the slot is rehashed, level 0 is not used. */
+	guint32 leafs[OIO_LB_LOC_LEVELS];
 };
 
 /* Set of services matching the same macro "everything-but-the-location"
@@ -270,10 +285,6 @@ struct oio_lb_slot_s
 	 * of services at the same location is rather small.*/
 	GArray *items;
 
-	/* Total number of items per location, for each level.
-	 * We do not use level 0 at the moment. */
-	GData *items_by_loc[OIO_LB_LOC_LEVELS];
-
 	/* Total number of different locations for each level. */
 	guint locs_by_level[OIO_LB_LOC_LEVELS];
 
@@ -294,12 +305,25 @@ struct oio_lb_slot_s
 	guint64 jump;
 };
 
+/* An immutable copy of the slots of the world, with their own copy of the
+ * items. The pollers work on a snapshot they hold a reference on, so that
+ * the reloads of the world never block them. */
+struct oio_lb_snapshot_s
+{
+	GTree *slots;  /* <gchar*> -> <struct oio_lb_slot_s*> */
+	GTree *items;  /* <gchar*> -> <struct _lb_item_s*> */
+	guint16 abs_max_dist;
+	volatile gint refcount;
+};
+
 /* All the load-balancing information:
  * - all the services in the 'world'
  * - all the slots that gather services with the same characteristics
  * - generation of the services in the 'world' (incr by 1 at each reload)
  * - absolute maximum distance between services in the 'world'
- */
+ * - the last snapshot of the slots published for the pollers
+ * The lock protects the slots and the items being updated, the pollers only
+ * work on the snapshot. */
 struct oio_lb_world_s
 {
 	GRWLock lock;
@@ -307,6 +331,10 @@ struct oio_lb_world_s
 	GTree *items;
 	generation_t generation;
 	guint16 abs_max_dist;
+
+	/* Only held to swap the snapshot or to take a reference on it */
+	GMutex snapshot_lock;
+	struct oio_lb_snapshot_s *snapshot;
 };
 
 /* A pool describes a preset configuration for the polling of several services.
@@ -342,8 +370,18 @@ struct oio_lb_pool_LOCAL_s
 	gboolean nearby_mode : 16;
 };
 
+struct _loc_counter_s
+{
+	guint32 key;
+	guint16 level;
+	guint16 count;  /* 0 for a free entry */
+};
+
 struct polling_ctx_s
 {
+	/* The view of the world the poll is performed on. */
+	struct oio_lb_snapshot_s *snapshot;
+
 	/* Locations that should be avoided. */
 	const oio_location_t * avoids;
 	/* Locations that have already been selected
@@ -357,8 +395,10 @@ struct polling_ctx_s
 	/* Number of services to select. */
 	guint n_targets;
 
-	/* Count how often each location has been chosen. */
-	GData *counters[OIO_LB_LOC_LEVELS];
+	/* Count how often each location has been chosen, for each level.
+	 * An open-addressed table sized for all the selections to come. */
+	struct _loc_counter_s *counters;
+	guint32 counters_mask;
 
 	/* Result from the selection of services.
 	 * Array<struct oio_lb_selected_item_s *> */
@@ -396,6 +436,10 @@ static GError *_local__patch(struct oio_lb_pool_s *self,
 		const oio_location_t * known,
 		oio_lb_on_id_f on_id, gboolean *flawed);
 
+static GError *_local__poll_sets(struct oio_lb_pool_s *self, guint count,
+		const oio_location_t * avoids,
+		oio_lb_on_set_id_f on_id, gboolean *flawed);
+
 static struct oio_lb_item_s *_local__get_item(struct oio_lb_pool_s *self,
 		const char *id);
 
@@ -404,6 +448,7 @@ static struct oio_lb_pool_vtable_s vtable_LOCAL =
 	.destroy = _local__destroy,
 	.poll = _local__poll,
 	.patch = _local__patch,
+	.poll_sets = _local__poll_sets,
 	.get_item = _local__get_item
 };
 
@@ -470,6 +515,21 @@ oio_lb_world__count_slot_items_unlocked(struct oio_lb_world_s *self,
 	return len;
 }
 
+static struct oio_lb_slot_s *
+_snapshot_get_slot(struct oio_lb_snapshot_s *snap, const char *name)
+{
+	EXTRA_ASSERT (snap != NULL);
+	EXTRA_ASSERT (oio_str_is_set(name));
+	return g_tree_lookup (snap->slots, name);
+}
+
+static guint
+_snapshot_count_slot_items(struct oio_lb_snapshot_s *snap, const char *name)
+{
+	struct oio_lb_slot_s *slot = _snapshot_get_slot(snap, name);
+	return slot ? slot->items->len : 0;
+}
+
 #define CSLOT(p) ((const struct _slot_item_s*)(p))
 #define CITEM(p) CSLOT(p)->item
 #define TAB_ITEM(t,i)  g_array_index ((t), struct _slot_item_s, i)
@@ -507,19 +567,6 @@ djb_hash_buf(const guint8 * b, register gsize bs)
 	return h;
 }
 
-/** Gets the number of elements in a GData. */
-static guint
-oio_ext_gdatalist_length(GData **datalist)
-{
-	guint counter = 0;
-	void _datalist_count(GQuark key_id UNUSED,
-			gpointer data UNUSED, gpointer udata UNUSED) {
-		counter++;
-	}
-	g_datalist_foreach(datalist, _datalist_count, NULL);
-	return counter;
-}
-
 uint32_t
 key_from_loc_level(oio_location_t loc, int level)
 {
@@ -618,19 +665,59 @@ _warn_dirty_poll(const char *fmt, ...)
 	}
 }
 
+/* Minimal size of the table of location counters of a poll, so that the
+ * probe sequences remain short. */
+static guint32
+_loc_counters_size(guint n_targets)
+{
+	guint32 size = 16;
+	while (size < 4 * OIO_LB_LOC_LEVELS * n_targets)
+		size <<= 1;
+	return size;
+}
+
+static struct _loc_counter_s *
+_loc_counter_get(struct polling_ctx_s *ctx, const int level,
+		const guint32 key, const gboolean create)
+{
+	guint32 i = ((key ^ (level * 0x9E3779B9u)) * 2654435761u) & ctx->counters_mask;
+	for (;; i = (i + 1) & ctx->counters_mask) {
+		struct _loc_counter_s *c = ctx->counters + i;
+		if (!c->count) {
+			if (!create)
+				return NULL;
+			c->key = key;
+			c->level = level;
+			return c;
+		}
+		if (c->key == key && c->level == level)
+			return c;
+	}
+}
+
+static void
+_loc_counters_incr(struct polling_ctx_s *ctx, oio_location_t loc)
+{
+	for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
+		struct _loc_counter_s *c =
+			_loc_counter_get(ctx, level, key_from_loc_level(loc, level), TRUE);
+		c->count ++;
+	}
+}
+
 static gboolean
-_item_is_too_popular(struct polling_ctx_s *ctx, const oio_location_t item,
-		struct oio_lb_slot_s *slot)
+_item_is_too_popular(struct polling_ctx_s *ctx, struct oio_lb_slot_s *slot,
+		const guint i)
 {
+	const struct _slot_item_s *si = &SLOT_ITEM(slot, i);
 	for (int level = 1; level <= 3; level++) {
-		GQuark key = key_from_loc_level(item, level);
+		const guint32 key = key_from_loc_level(si->item->location, level);
 		// How many different items there is under this level
-		guint32 n_leafs = GPOINTER_TO_UINT(
-				g_datalist_id_get_data(&(slot->items_by_loc[level]), key));
+		guint32 n_leafs = si->leafs[level];
 		if (unlikely(n_leafs == 0)) {
 			_warn_dirty_poll("BUG: %s: LB reload not followed by rehash, "
 					"item %"OIO_LOC_FORMAT" not found at level %d",
-					__FUNCTION__, item, level);
+					__FUNCTION__, si->item->location, level);
 			n_leafs = 1;
 		} else if (unlikely(n_leafs > slot->items->len)) {
 			_warn_dirty_poll("BUG: %s: LB reload not followed by rehash, "
@@ -640,8 +727,8 @@ _item_is_too_popular(struct polling_ctx_s *ctx, const oio_location_t item,
 			n_leafs = slot->items->len;
 		}
 		// How often the location has been chosen
-		guint32 popularity = GPOINTER_TO_UINT(
-				g_datalist_id_get_data(ctx->counters + level, key));
+		const struct _loc_counter_s *c = _loc_counter_get(ctx, level, key, FALSE);
+		const guint32 popularity = c ? c->count : 0;
 		// Maximum number of elements with this location that we can take
 		guint32 max = 1 + (ctx->n_targets - 1) / (slot->items->len / n_leafs);
 
@@ -690,9 +777,6 @@ _slot_destroy (struct oio_lb_slot_s *slot)
 		g_array_free (slot->items, TRUE);
 		slot->items = NULL;
 	}
-	for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
-		g_datalist_clear(&(slot->items_by_loc[level]));
-	}
 	oio_str_clean (&slot->name);
 	slot->world = NULL;
 	g_free (slot);
@@ -711,17 +795,33 @@ _slot_needs_rehash (const struct oio_lb_slot_s * const slot)
 	return BOOL(slot->flag_dirty_order) || BOOL(slot->flag_dirty_weights);
 }
 
+/* The items being sorted by location, the items sharing a location at a
+ * given level are contiguous: count them and tell each item the size of its
+ * group, for each level. */
 static void
-_level_datalist_incr_loc(GData **counters, oio_location_t loc)
+_slot_count_leafs(struct oio_lb_slot_s *slot)
 {
+	const guint max = slot->items->len;
 	for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
-		GData **counter = counters + level;
-		GQuark key = key_from_loc_level(loc, level);
-		// Will be 0 (NULL) if key does not exist
-		guint32 count = GPOINTER_TO_UINT(
-				g_datalist_id_get_data(counter, key));
-		count++;
-		g_datalist_id_set_data(counter, key, GUINT_TO_POINTER(count));
+		guint locs = 0;
+		for (guint start = 0; start < max; ) {
+			const guint32 key = key_from_loc_level(
+					SLOT_ITEM(slot, start).item->location, level);
+			guint end = start + 1;
+			while (end < max && key == key_from_loc_level(
+						SLOT_ITEM(slot, end).item->location, level))
+				end++;
+			for (guint i = start; i < end; i++)
+				SLOT_ITEM(slot, i).leafs[level] = end - start;
+			GRID_TRACE2("%0*"G_GINT64_MODIFIER"X prefix has %u services",
+					4 * (OIO_LB_LOC_LEVELS - level),
+					SLOT_ITEM(slot, start).item->location
+						>> (level * OIO_LB_BITS_PER_LOC_LEVEL),
+					end - start);
+			start = end;
+			locs ++;
+		}
+		slot->locs_by_level[level] = locs;
 	}
 }
 
@@ -732,34 +832,7 @@ _slot_rehash (struct oio_lb_slot_s *slot)
 		slot->flag_dirty_order = 0;
 		slot->flag_dirty_weights = 1;
 		g_array_sort(slot->items, _compare_stored_items_by_location);
-
-		for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
-			g_datalist_clear(&(slot->items_by_loc[level]));
-			// No need to call g_datalist_init()
-		}
-		for (guint i = 0; i < slot->items->len; i++) {
-			struct _slot_item_s *si = &SLOT_ITEM(slot, i);
-			_level_datalist_incr_loc(slot->items_by_loc, si->item->location);
-		}
-		for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
-			slot->locs_by_level[level] =
-					oio_ext_gdatalist_length(&(slot->items_by_loc[level]));
-		}
-
-# ifdef HAVE_EXTRA_DEBUG
-		if (unlikely(GRID_TRACE_ENABLED())) {
-			void _display(GQuark k, gpointer data, gpointer u) {
-				guint level = GPOINTER_TO_UINT(u);
-				oio_location_t loc = (GPOINTER_TO_UINT(k) - 1);
-				GRID_TRACE("%0*lX prefix has %u services",
-						4 * (OIO_LB_LOC_LEVELS - level),
-						loc, GPOINTER_TO_UINT(data));
-			}
-			for (int i = 1; i < OIO_LB_LOC_LEVELS; i++)
-				g_datalist_foreach(
-						&slot->items_by_loc[i], _display, GUINT_TO_POINTER(i));
-		}
-#endif
+		_slot_count_leafs(slot);
 	}
 
 	if (slot->flag_dirty_weights) {
@@ -796,6 +869,94 @@ _slot_rehash (struct oio_lb_slot_s *slot)
 	}
 }
 
+/* -- Snapshots of the world ----------------------------------------------- */
+
+static void
+_snapshot_unref(struct oio_lb_snapshot_s *snap)
+{
+	if (!snap || !g_atomic_int_dec_and_test(&snap->refcount))
+		return;
+	/* The slots first, they reference the items */
+	g_tree_destroy(snap->slots);
+	g_tree_destroy(snap->items);
+	g_free(snap);
+}
+
+/* Build a snapshot of the slots of the world, as they are now. The caller
+ * must hold the lock of the world. The slots of the snapshot are rehashed,
+ * even if the slots of the world are not. */
+static struct oio_lb_snapshot_s *
+_snapshot_build(struct oio_lb_world_s *world)
+{
+	struct oio_lb_snapshot_s *snap = g_malloc0(sizeof(*snap));
+	snap->refcount = 1;
+	snap->abs_max_dist = world->abs_max_dist;
+	snap->slots = g_tree_new_full(oio_str_cmp3, NULL,
+			g_free, (GDestroyNotify) _slot_destroy);
+	/* The keys are the IDs embedded in the items */
+	snap->items = g_tree_new_full(oio_str_cmp3, NULL, NULL, g_free);
+
+	gboolean _on_slot(gchar *name, struct oio_lb_slot_s *slot,
+			gpointer u UNUSED) {
+		struct oio_lb_slot_s *copy = g_malloc0(sizeof(*copy));
+		copy->world = world;
+		copy->name = g_strdup(name);
+		copy->generation = slot->generation;
+		copy->jump = OIO_LB_SHUFFLE_JUMP;
+		copy->items = g_array_sized_new(FALSE, TRUE,
+				sizeof(struct _slot_item_s), slot->items->len);
+
+		for (guint i = 0; i < slot->items->len; i++) {
+			struct _slot_item_s si = SLOT_ITEM(slot, i);
+			struct _lb_item_s *item = g_tree_lookup(snap->items, si.item->id);
+			if (!item) {
+				item = g_memdup(si.item, sizeof(struct _lb_item_s));
+				item->refcount = 0;
+				g_tree_replace(snap->items, item->id, item);
+			}
+			++ item->refcount;
+			si.item = item;
+			g_array_append_vals(copy->items, &si, 1);
+		}
+
+		copy->flag_dirty_order = 1;
+		copy->flag_dirty_weights = 1;
+		_slot_rehash(copy);
+		g_tree_replace(snap->slots, g_strdup(name), copy);
+		return FALSE;
+	}
+	g_tree_foreach(world->slots, (GTraverseFunc)_on_slot, NULL);
+	return snap;
+}
+
+/* Replace the snapshot used by the pollers. The caller must hold the lock of
+ * the world as a writer. The pollers still working on the previous snapshot
+ * keep it alive until they release it. */
+static void
+_world_publish(struct oio_lb_world_s *self)
+{
+	struct oio_lb_snapshot_s *snap = _snapshot_build(self);
+	g_mutex_lock(&self->snapshot_lock);
+	struct oio_lb_snapshot_s *old = self->snapshot;
+	self->snapshot = snap;
+	g_mutex_unlock(&self->snapshot_lock);
+	_snapshot_unref(old);
+}
+
+/* Get a reference on the current snapshot. The world lock is not involved,
+ * so a reload in progress never delays the poll. */
+static struct oio_lb_snapshot_s *
+_world_get_snapshot(struct oio_lb_world_s *self)
+{
+	g_mutex_lock(&self->snapshot_lock);
+	struct oio_lb_snapshot_s *snap = self->snapshot;
+	g_atomic_int_inc(&snap->refcount);
+	g_mutex_unlock(&self->snapshot_lock);
+	return snap;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static guint
 _count_similar_target_slots(struct oio_lb_pool_LOCAL_s *lb,
 		const char *target)
@@ -854,7 +1015,7 @@ _accept_item(struct oio_lb_slot_s *slot, const guint16 distance,
 				ctx->check_distance? distance : 1))
 			return NULL;
 		// Check the item has not been chosen too much already
-		if (ctx->check_popularity && _item_is_too_popular(ctx, loc, slot))
+		if (ctx->check_popularity && _item_is_too_popular(ctx, slot, i))
 			return NULL;
 	}
 	GRID_TRACE("Accepting item %s (0x%"OIO_LOC_FORMAT") from slot %s",
@@ -872,7 +1033,7 @@ _accept_item(struct oio_lb_slot_s *slot, const guint16 distance,
 
 	*(ctx->next_polled) = loc;
 
-	_level_datalist_incr_loc(ctx->counters, loc);
+	_loc_counters_incr(ctx, loc);
 
 	return selected;
 }
@@ -969,8 +1130,7 @@ _local_target__poll(struct oio_lb_pool_LOCAL_s *lb,
 	 * The other slots are fallbacks. */
 	guint n_targets = _count_similar_target_slots(lb, target);
 	for (const char *name = target; *name; name += 1+strlen(name)) {
-		struct oio_lb_slot_s *slot = oio_lb_world__get_slot_unlocked(
-				lb->world, name);
+		struct oio_lb_slot_s *slot = _snapshot_get_slot(ctx->snapshot, name);
 		if (!slot) {
 			GRID_DEBUG ("Slot [%s] not ready", name);
 		} else if ((selected =
@@ -997,8 +1157,7 @@ _local__poll (struct oio_lb_pool_s *self,
 }
 
 static struct oio_lb_selected_item_s*
-_local_target__is_satisfied(struct oio_lb_pool_LOCAL_s *lb,
-		const char *target, struct polling_ctx_s *ctx,
+_local_target__is_satisfied(const char *target, struct polling_ctx_s *ctx,
 		gboolean strict)
 {
 	struct oio_lb_selected_item_s *selected = NULL;
@@ -1018,8 +1177,7 @@ _local_target__is_satisfied(struct oio_lb_pool_LOCAL_s *lb,
 	/* Iterate over the slots of the target to find if one of the
 	** already known locations is inside, and thus satisfies the target. */
 	for (const char *name = target; *name; name += strlen(name)+1) {
-		struct oio_lb_slot_s *slot = oio_lb_world__get_slot_unlocked(
-				lb->world, name);
+		struct oio_lb_slot_s *slot = _snapshot_get_slot(ctx->snapshot, name);
 		if (!slot) {
 			GRID_DEBUG ("Slot [%s] not ready", name);
 			continue;
@@ -1068,7 +1226,7 @@ _match_known_services_with_targets(struct oio_lb_pool_LOCAL_s *lb,
 	EXTRA_ASSERT(unmatched != NULL);
 	for (gchar **ptarget = lb->targets; *ptarget; ++ptarget) {
 		struct oio_lb_selected_item_s *selected = NULL;
-		selected = _local_target__is_satisfied(lb, *ptarget, ctx, TRUE);
+		selected = _local_target__is_satisfied(*ptarget, ctx, TRUE);
 		if (selected) {
 			++(ctx->next_polled);
 			g_ptr_array_add(ctx->selection, selected);
@@ -1082,12 +1240,13 @@ _match_known_services_with_targets(struct oio_lb_pool_LOCAL_s *lb,
 
 static gboolean
 _match_item_with_targets(struct oio_lb_pool_LOCAL_s *lb,
-		struct oio_lb_selected_item_s *selected)
+		struct oio_lb_snapshot_s *snap, struct oio_lb_selected_item_s *selected)
 {
 	for (gchar **ptarget = lb->targets; *ptarget; ++ptarget) {
 		// Lookup only the first slot of each target.
-		struct oio_lb_slot_s *slot = oio_lb_world__get_slot_unlocked(
-				lb->world, *ptarget);
+		struct oio_lb_slot_s *slot = _snapshot_get_slot(snap, *ptarget);
+		if (!slot)
+			continue;
 		guint pos = _search_first_at_location(slot->items,
 				selected->item->location, OIO_LOC_PROX_VOLUME,
 				0, slot->items->len-1);
@@ -1103,17 +1262,14 @@ _match_item_with_targets(struct oio_lb_pool_LOCAL_s *lb,
 static void
 _debug_service_selection(struct polling_ctx_s *ctx)
 {
-	// FIXME: there is similar code in _slot_rehash()
-	void _display(GQuark k, gpointer data, gpointer u) {
-		guint level = GPOINTER_TO_UINT(u);
-		oio_location_t loc = (GPOINTER_TO_UINT(k) - 1);
+	for (guint32 j = 0; j <= ctx->counters_mask; j++) {
+		const struct _loc_counter_s *c = ctx->counters + j;
+		if (!c->count)
+			continue;
+		oio_location_t loc = c->key - 1;
 		GRID_DEBUG("%0*" G_GINT64_MODIFIER "X selected %u times",
-				4 * (OIO_LB_LOC_LEVELS - level),
-				loc, GPOINTER_TO_UINT(data));
+				4 * (OIO_LB_LOC_LEVELS - c->level), loc, c->count);
 	}
-	for (int level = 1; level < OIO_LB_LOC_LEVELS; level++)
-		g_datalist_foreach(&(ctx->counters[level]),
-				_display, GUINT_TO_POINTER(level));
 	guint i = 0;
 	void _display_selected(gpointer element, gpointer udata UNUSED) {
 		struct oio_lb_selected_item_s *sel = element;
@@ -1128,22 +1284,15 @@ _debug_service_selection(struct polling_ctx_s *ctx)
 	g_ptr_array_foreach(ctx->selection, _display_selected, NULL);
 }
 
+/* Perform one selection on the given snapshot. The selected items are
+ * forwarded to <on_id> (with <udata>) only if the whole selection
+ * succeeded. */
 static GError*
-_local__patch(struct oio_lb_pool_s *self,
+_local__patch_snapshot(struct oio_lb_pool_LOCAL_s *lb,
+		struct oio_lb_snapshot_s *snap, const guint count_targets,
 		const oio_location_t *avoids, const oio_location_t *known,
-		oio_lb_on_id_f on_id, gboolean *flawed)
+		oio_lb_on_id_f on_id, gpointer udata, gboolean *flawed)
 {
-	struct oio_lb_pool_LOCAL_s *lb = (struct oio_lb_pool_LOCAL_s *) self;
-	EXTRA_ASSERT(lb != NULL);
-	EXTRA_ASSERT(lb->vtable == &vtable_LOCAL);
-	EXTRA_ASSERT(lb->world != NULL);
-	EXTRA_ASSERT(lb->targets != NULL);
-	EXTRA_ASSERT(lb->min_dist >= 1);
-
-	/* Count the expected targets to build a temp storage for
-	 * polled locations */
-	guint count_targets = oio_lb_world__count_pool_targets(self);
-
 	/* Copy the array of known locations because we don't know
 	 * if its allocated length is big enough */
 	oio_location_t polled[count_targets+1];
@@ -1164,12 +1313,13 @@ _local__patch(struct oio_lb_pool_s *self,
 	 * (resp. low), because we want services far from (resp. close to)
 	 * each other. Then we reduce (resp. increase) the distance and thus
 	 * have more chances to find services matching the other criteria. */
-	guint16 max_dist = MIN(lb->world->abs_max_dist, lb->initial_dist);
+	guint16 max_dist = MIN(snap->abs_max_dist, lb->initial_dist);
 	guint16 start_dist = lb->nearby_mode? lb->min_dist : max_dist;
 	guint16 end_dist = (lb->nearby_mode? max_dist + 1 : lb->min_dist - 1);
 	guint16 reached_dist = start_dist;
 
 	struct polling_ctx_s ctx = {
+		.snapshot = snap,
 		.avoids = avoids,
 		.polled = (const oio_location_t *) polled,
 		.next_polled = polled,
@@ -1182,11 +1332,12 @@ _local__patch(struct oio_lb_pool_s *self,
 			(GDestroyNotify)oio_lb_selected_item_free),
 	};
 
-	for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
-		g_datalist_init(&ctx.counters[level]);
-	}
+	const guint32 counters_size = _loc_counters_size(count_targets);
+	struct _loc_counter_s counters[counters_size];
+	memset(counters, 0, sizeof(counters));
+	ctx.counters = counters;
+	ctx.counters_mask = counters_size - 1;
 
-	g_rw_lock_reader_lock(&lb->world->lock);
 	gchar *unmatched_targets[count_targets+1];
 	_match_known_services_with_targets(lb, &ctx, unmatched_targets);
 
@@ -1195,7 +1346,7 @@ _local__patch(struct oio_lb_pool_s *self,
 	GError *err = NULL;
 	for (gchar **ptarget = unmatched_targets; *ptarget; ++ptarget) {
 		struct oio_lb_selected_item_s *selected = NULL;
-		selected = _local_target__is_satisfied(lb, *ptarget, &ctx, FALSE);
+		selected = _local_target__is_satisfied(*ptarget, &ctx, FALSE);
 		guint16 dist;
 		for (dist = start_dist; !selected && dist != end_dist; dist += incr) {
 			selected = _local_target__poll(lb, *ptarget, dist, &ctx);
@@ -1213,15 +1364,13 @@ _local__patch(struct oio_lb_pool_s *self,
 					"from [%s], %u/%u services polled, %u known services, "
 					"%u services in slot", *ptarget, count,
 					count_targets - count_known_targets, count_known_targets,
-					oio_lb_world__count_slot_items_unlocked(
-						lb->world, *ptarget));
+					_snapshot_count_slot_items(snap, *ptarget));
 			break;
 		}
 		++ctx.next_polled;
 		++count;
 		g_ptr_array_add(ctx.selection, selected);
 	}
-	g_rw_lock_reader_unlock(&lb->world->lock);
 
 	void _set_dists(gpointer element, guint cur) {
 		struct oio_lb_selected_item_s *sel = element;
@@ -1244,12 +1393,7 @@ _local__patch(struct oio_lb_pool_s *self,
 		_debug_service_selection(&ctx);
 	}
 
-	for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
-		g_datalist_clear(&ctx.counters[level]);
-	}
-	if (err != NULL) {
-		GRID_WARN("%s", err->message);
-	} else {
+	if (!err) {
 		if (flawed) {
 			GRID_DEBUG(
 					"nearby_mode=%d, reached_dist=%u, "
@@ -1260,18 +1404,110 @@ _local__patch(struct oio_lb_pool_s *self,
 					(!lb->nearby_mode && reached_dist <= lb->warn_dist) ||
 					ctx.fallback_used;
 		}
-		void _forward(struct oio_lb_selected_item_s *sel, gpointer u UNUSED) {
+		void _forward(struct oio_lb_selected_item_s *sel, gpointer u) {
 			if (sel->item)
-				on_id(sel, NULL);
+				on_id(sel, u);
 			// Do not forward "known" items (sel->item == NULL)
 		}
-		// FIXME(FVE): change signature, specify last parameter
-		g_ptr_array_foreach(ctx.selection, (GFunc)_forward, NULL);
+		g_ptr_array_foreach(ctx.selection, (GFunc)_forward, udata);
 	}
 	g_ptr_array_free(ctx.selection, TRUE);
 	return err;
 }
 
+static GError*
+_local__patch(struct oio_lb_pool_s *self,
+		const oio_location_t *avoids, const oio_location_t *known,
+		oio_lb_on_id_f on_id, gboolean *flawed)
+{
+	struct oio_lb_pool_LOCAL_s *lb = (struct oio_lb_pool_LOCAL_s *) self;
+	EXTRA_ASSERT(lb != NULL);
+	EXTRA_ASSERT(lb->vtable == &vtable_LOCAL);
+	EXTRA_ASSERT(lb->world != NULL);
+	EXTRA_ASSERT(lb->targets != NULL);
+	EXTRA_ASSERT(lb->min_dist >= 1);
+
+	/* Count the expected targets to build a temp storage for
+	 * polled locations */
+	guint count_targets = oio_lb_world__count_pool_targets(self);
+
+	struct oio_lb_snapshot_s *snap = _world_get_snapshot(lb->world);
+	GError *err = _local__patch_snapshot(lb, snap, count_targets,
+			avoids, known, on_id, NULL, flawed);
+	_snapshot_unref(snap);
+	if (err)
+		GRID_WARN("%s", err->message);
+	return err;
+}
+
+/* Perform <count> independent selections on the same snapshot. To spread
+ * the load, each selection first avoids the services of the previous one,
+ * and falls back to the caller's avoids only when that is not satisfiable
+ * (i.e. on small platforms). */
+static GError*
+_local__poll_sets(struct oio_lb_pool_s *self, guint count,
+		const oio_location_t *avoids,
+		oio_lb_on_set_id_f on_id, gboolean *flawed)
+{
+	struct oio_lb_pool_LOCAL_s *lb = (struct oio_lb_pool_LOCAL_s *) self;
+	EXTRA_ASSERT(lb != NULL);
+	EXTRA_ASSERT(lb->vtable == &vtable_LOCAL);
+	EXTRA_ASSERT(lb->world != NULL);
+	EXTRA_ASSERT(lb->targets != NULL);
+	EXTRA_ASSERT(lb->min_dist >= 1);
+
+	const guint count_targets = oio_lb_world__count_pool_targets(self);
+
+	guint count_avoids = 0;
+	while (avoids && avoids[count_avoids])
+		count_avoids++;
+	oio_location_t spread[count_avoids + count_targets + 1];
+	memset(spread, 0, sizeof(spread));
+	if (count_avoids)
+		memcpy(spread, avoids, count_avoids * sizeof(oio_location_t));
+
+	guint set = 0, count_spread = 0;
+	void _on_id(struct oio_lb_selected_item_s *sel, gpointer u UNUSED) {
+		if (count_spread < count_targets)
+			spread[count_avoids + count_spread++] = sel->item->location;
+		on_id(set, sel);
+	}
+
+	if (flawed)
+		*flawed = FALSE;
+
+	GError *err = NULL;
+	struct oio_lb_snapshot_s *snap = _world_get_snapshot(lb->world);
+	for (; !err && set < count; set++) {
+		gboolean set_flawed = FALSE;
+		gboolean spreading = count_spread > 0;
+		count_spread = 0;
+		if (spreading) {
+			err = _local__patch_snapshot(lb, snap, count_targets,
+					spread, NULL, _on_id, NULL, &set_flawed);
+			if (err && err->code == CODE_POLICY_NOT_SATISFIABLE) {
+				GRID_DEBUG("Cannot avoid the previous selection: %s",
+						err->message);
+				g_clear_error(&err);
+				spreading = FALSE;
+			}
+		}
+		if (!spreading)
+			err = _local__patch_snapshot(lb, snap, count_targets,
+					avoids, NULL, _on_id, NULL, &set_flawed);
+		spread[count_avoids + count_spread] = 0;
+
+		if (err) {
+			g_prefix_error(&err, "selection %u/%u: ", set + 1, count);
+			GRID_WARN("%s", err->message);
+		} else if (flawed) {
+			*flawed = *flawed || set_flawed;
+		}
+	}
+	_snapshot_unref(snap);
+	return err;
+}
+
 struct oio_lb_item_s *
 _local__get_item(struct oio_lb_pool_s *self,
 		const char *id)
@@ -1461,6 +1697,8 @@ oio_lb_local__create_world (void)
 			g_free, (GDestroyNotify) _slot_destroy);
 	self->items = g_tree_new_full (oio_str_cmp3, NULL,
 			g_free, g_free);
+	g_mutex_init(&self->snapshot_lock);
+	self->snapshot = _snapshot_build(self);
 
 	/* See at the end of oio_lb_world__feed_slot_unlocked()
 	 * for an explanation. */
@@ -1497,6 +1735,7 @@ oio_lb_world__flush(struct oio_lb_world_s *self)
 				g_free, g_free);
 	}
 	_oio_service_id_cache_flush();
+	_world_publish(self);
 
 	g_rw_lock_writer_unlock(&self->lock);
 }
@@ -1517,6 +1756,9 @@ oio_lb_world__destroy (struct oio_lb_world_s *self)
 	}
 	g_rw_lock_writer_unlock(&self->lock);
 	g_rw_lock_clear(&self->lock);
+	_snapshot_unref(self->snapshot);
+	self->snapshot = NULL;
+	g_mutex_clear(&self->snapshot_lock);
 	g_free (self);
 
 	_oio_service_id_cache_flush();
@@ -1549,9 +1791,6 @@ _world_create_slot (struct oio_lb_world_s *self, const char *name)
 		slot->world = self;
 		slot->name = g_strdup(name);
 		slot->items = g_array_new(FALSE, TRUE, sizeof(struct _slot_item_s));
-		for (int level = 1; level < OIO_LB_LOC_LEVELS; level++) {
-			g_datalist_init(&(slot->items_by_loc[level]));
-		}
 		slot->jump = OIO_LB_SHUFFLE_JUMP;
 		GRID_INFO("Creating service slot [%s]", name);
 		g_rw_lock_writer_lock(&self->lock);
@@ -1865,7 +2104,8 @@ _world_rehash_slots(struct oio_lb_world_s *self)
 		return FALSE;
 	}
 	WRITER_LOCK_DO(&self->lock,
-			g_tree_foreach(self->slots, (GTraverseFunc)_on_slot_rehash, self));
+			g_tree_foreach(self->slots, (GTraverseFunc)_on_slot_rehash, self);
+			_world_publish(self));
 }
 
 static void
@@ -1937,6 +2177,8 @@ oio_lb_world__purge_old_generations(struct oio_lb_world_s *self)
 	_world_purge_slot_items(self, 0);
 	_world_purge_slots(self, 0);
 
+	WRITER_LOCK_DO(&self->lock, _world_publish(self));
+
 	/* it is currently highly probable a service that disappeared will come
 	 * back soon. So we don't purge the items yet. */
 }
@@ -2013,6 +2255,24 @@ oio_lb__poll_pool(struct oio_lb_s *lb, const char *name,
 	return res;
 }
 
+GError*
+oio_lb__poll_pool_many(struct oio_lb_s *lb, const char *name,
+		guint count, const oio_location_t *avoids,
+		oio_lb_on_set_id_f on_id, gboolean *flawed)
+{
+	EXTRA_ASSERT(lb != NULL);
+	EXTRA_ASSERT(name != NULL);
+	GError *res = NULL;
+	g_rw_lock_reader_lock(&lb->lock);
+	struct oio_lb_pool_s *pool = g_hash_table_lookup(lb->pools, name);
+	if (pool)
+		res = oio_lb_pool__poll_sets(pool, count, avoids, on_id, flawed);
+	else
+		res = BADREQ("pool [%s] not found", name);
+	g_rw_lock_reader_unlock(&lb->lock);
+	return res;
+}
+
 GError*
 oio_lb__patch_with_pool(struct oio_lb_s *lb, const char *name,
 		const oio_location_t *avoids, const oio_location_t *known,
@@ -2066,14 +2326,13 @@ _unique_slotnames(gchar **targets)
 }
 
 static GPtrArray *
-_unique_services(struct oio_lb_pool_LOCAL_s *lb, gchar **slots, oio_location_t pin)
+_unique_services(struct oio_lb_snapshot_s *snap, gchar **slots, oio_location_t pin)
 {
 	pin = oio_location_mask_after(pin, OIO_LOC_DIST_HOST);
 
 	GTree *t = g_tree_new_full(oio_str_cmp3, NULL, NULL, NULL);
 	for (gchar **pname = slots; *pname; ++pname) {
-		struct oio_lb_slot_s *slot =
-			oio_lb_world__get_slot_unlocked(lb->world, *pname);
+		struct oio_lb_slot_s *slot = _snapshot_get_slot(snap, *pname);
 		if (!slot)
 			continue;
 		if (slot->flag_dirty_order) {
@@ -2138,7 +2397,7 @@ _local__poll_around(struct oio_lb_pool_s *self,
 	GPtrArray *selection = g_ptr_array_new_with_free_func(
 			(GDestroyNotify)oio_lb_selected_item_free);
 
-	g_rw_lock_reader_lock(&lb->world->lock);
+	struct oio_lb_snapshot_s *snap = _world_get_snapshot(lb->world);
 
 	// First we collect all the unique targets names in the pool
 	GPtrArray *suspects = NULL;
@@ -2147,7 +2406,7 @@ _local__poll_around(struct oio_lb_pool_s *self,
 #ifdef HAVE_EXTRA_DEBUG
 		count_slots = g_strv_length(slotnames);
 #endif
-		suspects = _unique_services(lb, slotnames, pin);
+		suspects = _unique_services(snap, slotnames, pin);
 		g_free(slotnames);
 	} while (0);
 
@@ -2161,7 +2420,7 @@ _local__poll_around(struct oio_lb_pool_s *self,
 		oio_str_randomize(slot + sizeof(PREFIX_SLOT_SKEW) - 1,
 				sizeof(SUFFIX_SLOT_SKEW) - 1, HEXA);
 
-		guint16 max_dist = MIN(lb->world->abs_max_dist, lb->initial_dist);
+		guint16 max_dist = MIN(snap->abs_max_dist, lb->initial_dist);
 		guint i = max_suspects > 1
 			? oio_ext_rand_int_range(0, max_suspects) : 0;
 		if (mode == 1) {
@@ -2169,7 +2428,7 @@ _local__poll_around(struct oio_lb_pool_s *self,
 			// OSEF the weight -> the other chunks will respect a weighted random
 			struct oio_lb_selected_item_s *selected = \
 					_item_select(suspects->pdata[i]);
-			if (!_match_item_with_targets(lb, selected)) {
+			if (!_match_item_with_targets(lb, snap, selected)) {
 				selected->expected_slot = g_strdup("rawx");
 				selected->final_slot = g_strdup(slot);
 			}
@@ -2185,7 +2444,7 @@ _local__poll_around(struct oio_lb_pool_s *self,
 						_item_select(suspects->pdata[i]);
 				// FIXME(FVE): this is broken since we may match several times
 				// the same target (which should be matched only once).
-				if (!_match_item_with_targets(lb, selected)) {
+				if (!_match_item_with_targets(lb, snap, selected)) {
 					selected->expected_slot = g_strdup("rawx");
 					selected->final_slot = g_strdup(slot);
 				}
@@ -2198,7 +2457,7 @@ _local__poll_around(struct oio_lb_pool_s *self,
 		}
 	}
 
-	g_rw_lock_reader_unlock(&lb->world->lock);
+	_snapshot_unref(snap);
 
 	const guint nb_locals = selection->len;
 	GRID_TRACE("%s pin=%" G_GINT64_MODIFIER "x mode=%d targets=%u slots=%u suspects=%u locals=%u",
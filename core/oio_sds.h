@@ -1,6 +1,6 @@
 /*
 OpenIO SDS core library
-Copyright (C) 2015-2018 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -63,6 +63,23 @@ enum oio_sds_config_e
 	/** Define the chunk size in bytes.
 	 * Expects an <int64_t>. If 0, use the default size. */
 	OIOSDS_CFG_FLAG_CHUNKSIZE = 6,
+
+	/** How many ranges of a replicated content are downloaded at once.
+	 * Expects an integer, 1 for sequential downloads. */
+	OIOSDS_CFG_DOWNLOAD_PREFETCH = 7,
+
+	/** The percentile of the recent download latencies beyond which a
+	 * range is also requested to another replica. Expects an integer
+	 * between 0 (disabled) and 99. */
+	OIOSDS_CFG_DOWNLOAD_HEDGE_PERCENTILE = 8,
+
+	/** Read-only: fills an <int64_t> with how many hedged requests have
+	 * been fired by the downloads. */
+	OIOSDS_CFG_STAT_HEDGE_FIRED = 9,
+
+	/** Read-only: fills an <int64_t> with how many hedged requests have
+	 * completed before the request they doubled. */
+	OIOSDS_CFG_STAT_HEDGE_WON = 10,
 };
 
 /**
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS core library
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -146,6 +146,14 @@ extern "C" {
 #  define RAWX_HEADER_CHUNK_SIZE RAWX_HEADER_PREFIX "chunk-size"
 # endif
 
+# ifndef RAWX_HEADER_METACHUNK_HASH
+#  define RAWX_HEADER_METACHUNK_HASH RAWX_HEADER_PREFIX "metachunk-hash"
+# endif
+
+# ifndef RAWX_HEADER_METACHUNK_SIZE
+#  define RAWX_HEADER_METACHUNK_SIZE RAWX_HEADER_PREFIX "metachunk-size"
+# endif
+
 # ifndef RAWX_HEADER_CONTENT_CHUNK_METHOD
 #  define RAWX_HEADER_CONTENT_CHUNK_METHOD RAWX_HEADER_PREFIX "content-chunk-method"
 # endif
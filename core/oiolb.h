@@ -1,6 +1,6 @@
 /*
 OpenIO SDS load-balancing
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -64,6 +64,12 @@ void oio_lb_selected_item_free(struct oio_lb_selected_item_s *item);
  */
 typedef void (*oio_lb_on_id_f) (struct oio_lb_selected_item_s*, gpointer);
 
+/* Signature for callbacks from `oio_lb_pool__poll_sets`: the index of the
+ * selection the service belongs to, then the service selected, owned by the
+ * load-balancer. */
+typedef void (*oio_lb_on_set_id_f) (guint set,
+		struct oio_lb_selected_item_s*);
+
 struct oio_lb_pool_s;
 
 /* Destroy the load-balancing pool pointed by <self>. */
@@ -84,6 +90,15 @@ GError *oio_lb_pool__patch(struct oio_lb_pool_s *self,
 		const oio_location_t *known,
 		oio_lb_on_id_f on_id, gboolean *flawed);
 
+/* Perform <count> independent selections, as oio_lb_pool__poll() would do,
+ * but on the same view of the world and without the setup cost of each
+ * call. The services of a selection are avoided by the next one, unless
+ * this makes the selection impossible. <on_id> is called only for
+ * the selections that succeeded, the first error stops the polling. */
+GError *oio_lb_pool__poll_sets(struct oio_lb_pool_s *self, guint count,
+		const oio_location_t *avoids,
+		oio_lb_on_set_id_f on_id, gboolean *flawed);
+
 /* Get an item from its ID. Returns NULL if the ID is isn't known.
  * The result must be freed with g_free(). */
 struct oio_lb_item_s *oio_lb_pool__get_item(struct oio_lb_pool_s *self,
@@ -101,7 +116,10 @@ gchar* oio_lb_resolve_service_id(const gchar* service_id, gboolean upgrade_to_tl
  * you in slots. Services are tuples like <location,score,id>.
  * A slot is a partition of the world that is identified by a name. It holds
  * services. For the sake of simplicity, slots are not exposed but only
- * accessed through the world. */
+ * accessed through the world.
+ * The pools poll an immutable snapshot of the slots, published when the
+ * world is flushed, purged or rehashed: the services fed in the meantime are
+ * not visible to the pollers yet. */
 struct oio_lb_world_s;
 
 /* Constructor of worlds, a.k.a. a cosmogony */
@@ -204,6 +222,11 @@ void oio_lb__delete_pool(struct oio_lb_s *lb, const char *name);
 GError *oio_lb__poll_pool(struct oio_lb_s *lb, const char *name,
 		const oio_location_t * avoids, oio_lb_on_id_f on_id, gboolean *flawed);
 
+/** Calls oio_lb_pool__poll_sets() on the pool `name`. Thread-safe. */
+GError *oio_lb__poll_pool_many(struct oio_lb_s *lb, const char *name,
+		guint count, const oio_location_t *avoids,
+		oio_lb_on_set_id_f on_id, gboolean *flawed);
+
 /** Calls oio_lb_pool__poll() on the pool `name`. Focus on the
  * provided location.
  * Thread-safe. */
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS core library
-Copyright (C) 2015-2018 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -33,10 +33,27 @@ License along with this library.
 
 #include "http_put.h"
 #include "http_del.h"
+#include "ec.h"
 #include "http_internals.h"
 #include "internals.h"
 
 
+/* How many latencies are kept to compute the hedging threshold, and how
+ * many are necessary before hedging */
+#define OIO_SDS_DL_LATENCIES 128
+#define OIO_SDS_DL_LATENCIES_MIN 16
+
+/* The latencies are kept apart for each class of range size, because a
+ * large range is expected to last longer than a small one. */
+#define OIO_SDS_DL_SIZE_CLASSES 6
+
+struct oio_sds_dl_latencies_s
+{
+	gint64 latencies[OIO_SDS_DL_LATENCIES];
+	guint count;
+	guint next;
+};
+
 struct oio_sds_s
 {
 	gchar *ns;
@@ -54,6 +71,17 @@ struct oio_sds_s
 	GMutex curl_lock;
 	CURL *curl_handle;
 	gint64 chunk_size;
+
+	struct {
+		guint prefetch;
+		guint hedge_percentile;
+		/* the most recent latencies of the ranges downloaded, per class of
+		 * range size (cf. _dl_size_class()) */
+		GMutex lock;
+		struct oio_sds_dl_latencies_s classes[OIO_SDS_DL_SIZE_CLASSES];
+		guint64 hedge_fired;
+		guint64 hedge_won;
+	} download;
 };
 
 struct oio_error_s;
@@ -312,9 +340,16 @@ _chunk_method_is_EC(const char *chunk_method)
 	return oio_str_prefixed(chunk_method, STGPOL_DSPREFIX_EC, "/");
 }
 
+/* The EC contents are encoded and decoded in-process when the SDK has been
+ * built with liberasurecode and a libcurl able to send trailers. An ecd
+ * service is required otherwise. */
 static int
 _chunk_method_needs_ecd(const char *chunk_method)
 {
+#if LIBCURL_VERSION_NUM >= 0x074000
+	if (oio_ec_available())
+		return FALSE;
+#endif
 	return oio_str_prefixed(chunk_method, STGPOL_DSPREFIX_EC, "/");
 }
 
@@ -484,6 +519,9 @@ oio_sds_init (struct oio_sds_s **out, const char *ns)
 	(*out)->admin = FALSE;
 	g_mutex_init(&((*out)->curl_lock));
 	(*out)->chunk_size = 0;
+	(*out)->download.prefetch = oio_sds_download_prefetch;
+	(*out)->download.hedge_percentile = oio_sds_download_hedge_percentile;
+	g_mutex_init(&((*out)->download.lock));
 
 	return NULL;
 }
@@ -498,6 +536,7 @@ oio_sds_free (struct oio_sds_s *sds)
 	if (sds->curl_handle)
 		curl_easy_cleanup (sds->curl_handle);
 	g_mutex_clear(&(sds->curl_lock));
+	g_mutex_clear(&(sds->download.lock));
 	g_slice_free (struct oio_sds_s, sds);
 }
 
@@ -546,6 +585,34 @@ oio_sds_configure (struct oio_sds_s *sds, enum oio_sds_config_e what,
 				return EINVAL;
 			sds->chunk_size = *(int64_t *)pv;
 			return 0;
+		case OIOSDS_CFG_DOWNLOAD_PREFETCH:
+			if (vlen != sizeof(int))
+				return EINVAL;
+			if (*(int*)pv < 1)
+				return ERANGE;
+			sds->download.prefetch = *(int*)pv;
+			return 0;
+		case OIOSDS_CFG_DOWNLOAD_HEDGE_PERCENTILE:
+			if (vlen != sizeof(int))
+				return EINVAL;
+			if (*(int*)pv < 0 || *(int*)pv > 99)
+				return ERANGE;
+			sds->download.hedge_percentile = *(int*)pv;
+			return 0;
+		case OIOSDS_CFG_STAT_HEDGE_FIRED:
+			if (vlen != sizeof(int64_t))
+				return EINVAL;
+			g_mutex_lock(&sds->download.lock);
+			*(int64_t*)pv = sds->download.hedge_fired;
+			g_mutex_unlock(&sds->download.lock);
+			return 0;
+		case OIOSDS_CFG_STAT_HEDGE_WON:
+			if (vlen != sizeof(int64_t))
+				return EINVAL;
+			g_mutex_lock(&sds->download.lock);
+			*(int64_t*)pv = sds->download.hedge_won;
+			g_mutex_unlock(&sds->download.lock);
+			return 0;
 		default:
 			return EBADSLT;
 	}
@@ -659,6 +726,9 @@ struct _download_ctx_s
 
 	struct metachunk_s **metachunks;
 	GSList *chunks;
+
+	/* Lazily created for the EC contents without ecd */
+	struct oio_ec_s *ec;
 };
 
 static void
@@ -857,6 +927,224 @@ _download_range_from_metachunk_ec(struct _download_ctx_s *dl,
 	return NULL;
 }
 
+struct _ec_fetch_s
+{
+	struct chunk_s *chunk;
+	CURL *handle;
+	struct oio_headers_s headers;
+	GByteArray *data;
+	gsize expected;
+	gboolean ok;
+};
+
+static size_t
+_ec_fetch_write(char *data, size_t s, size_t n, struct _ec_fetch_s *f)
+{
+	const size_t total = s * n;
+	const size_t room = f->expected - MIN(f->expected, f->data->len);
+	if (total > room)
+		GRID_WARN("server gave us more data than expected "
+				"(%"G_GSIZE_FORMAT"/%"G_GSIZE_FORMAT")", total, room);
+	g_byte_array_append(f->data, (guint8 *) data, MIN(total, room));
+	return total;
+}
+
+static void
+_ec_fetch_start(CURLM *mh, struct _ec_fetch_s *f, gsize offset, gsize size)
+{
+	gchar str_range[64] = "";
+	g_snprintf(str_range, sizeof(str_range),
+			"bytes=%"G_GSIZE_FORMAT"-%"G_GSIZE_FORMAT,
+			offset, offset + size - 1);
+	GRID_TRACE("%s Range:%s %s", __FUNCTION__, str_range, f->chunk->url);
+
+	f->ok = FALSE;
+	f->expected = size;
+	f->data = g_byte_array_sized_new(size);
+	oio_headers_common(&f->headers);
+	oio_headers_add(&f->headers, "Range", str_range);
+
+	f->handle = _curl_get_handle_blob();
+	curl_easy_setopt(f->handle, CURLOPT_PRIVATE, f);
+	curl_easy_setopt(f->handle, CURLOPT_HTTPHEADER, f->headers.headers);
+	curl_easy_setopt(f->handle, CURLOPT_CUSTOMREQUEST, "GET");
+	curl_easy_setopt(f->handle, CURLOPT_URL, f->chunk->url);
+	curl_easy_setopt(f->handle, CURLOPT_WRITEFUNCTION, _ec_fetch_write);
+	curl_easy_setopt(f->handle, CURLOPT_WRITEDATA, f);
+	curl_multi_add_handle(mh, f->handle);
+}
+
+static void
+_ec_fetch_clean(CURLM *mh, struct _ec_fetch_s *f)
+{
+	if (f->handle) {
+		curl_multi_remove_handle(mh, f->handle);
+		curl_easy_cleanup(f->handle);
+		f->handle = NULL;
+	}
+	oio_headers_clear(&f->headers);
+	if (f->data) {
+		g_byte_array_free(f->data, TRUE);
+		f->data = NULL;
+	}
+	f->ok = FALSE;
+}
+
+/* Fetch in parallel the same range of fragments from <k> chunks among
+ * <nb>. A failed chunk is replaced by the next one available. On success,
+ * exactly <k> fetches are marked as <ok>, with their data. */
+static GError *
+_ec_fetch_fragments(struct _ec_fetch_s *fetches, guint nb, guint k,
+		gsize offset, gsize size)
+{
+	CURLM *mh = curl_multi_init();
+	guint next = 0, running = 0, ok = 0;
+
+	for (; next < nb && running < k; ++next, ++running)
+		_ec_fetch_start(mh, fetches + next, offset, size);
+
+	while (running > 0 && ok < k) {
+		int still = 0, left = 0;
+		curl_multi_perform(mh, &still);
+
+		CURLMsg *msg;
+		while ((msg = curl_multi_info_read(mh, &left))) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			struct _ec_fetch_s *f = NULL;
+			long code = 0;
+			const CURLcode rc = msg->data.result;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&f);
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+			curl_multi_remove_handle(mh, f->handle);
+			curl_easy_cleanup(f->handle);
+			f->handle = NULL;
+			running --;
+
+			if (rc == CURLE_OK && code / 100 == 2
+					&& f->data->len == f->expected) {
+				f->ok = TRUE;
+				ok ++;
+			} else {
+				GRID_INFO("EC fragment download error [%s]: (%d) %s code=%ld",
+						f->chunk->url, rc, curl_easy_strerror(rc), code);
+				_ec_fetch_clean(mh, f);
+				if (next < nb) {
+					_ec_fetch_start(mh, fetches + next, offset, size);
+					next ++;
+					running ++;
+				}
+			}
+		}
+
+		if (running > 0 && ok < k) {
+			int numfds = 0;
+			curl_multi_wait(mh, NULL, 0, 1000, &numfds);
+		}
+	}
+
+	/* Abort what could still be running */
+	for (guint i = 0; i < nb; ++i) {
+		if (fetches[i].handle)
+			_ec_fetch_clean(mh, fetches + i);
+	}
+	curl_multi_cleanup(mh);
+
+	if (ok < k)
+		return ERRPTF("Too many failures: %u/%u fragments", ok, k);
+	return NULL;
+}
+
+/* Same as _download_range_from_metachunk_ec() but without any ecd: the
+ * fragments of the segments covered by the range are fetched from k chunks
+ * at once, by batches of segments, then decoded in-process. */
+static GError *
+_download_range_from_metachunk_ec_native(struct _download_ctx_s *dl,
+		const struct oio_sds_dl_range_s *range, struct metachunk_s *meta)
+{
+	GRID_TRACE("%s", __FUNCTION__);
+	GError *err = NULL;
+
+	if (!dl->ec && (err = oio_ec_create(dl->chunk_method, &dl->ec)))
+		return err;
+
+	const guint k = oio_ec_get_k(dl->ec);
+	const gsize seg_size = OIO_EC_SEGMENT_SIZE;
+	const gsize frag_size = oio_ec_fragment_size(dl->ec, seg_size);
+	const gsize nb_segments = (meta->size + seg_size - 1) / seg_size;
+	const gsize last_frag_size = oio_ec_fragment_size(dl->ec,
+			meta->size - (nb_segments - 1) * seg_size);
+
+	/* The data fragments come first, they are cheaper to decode */
+	GSList *chunks = g_slist_sort(g_slist_copy(meta->chunks),
+			(GCompareFunc)_compare_chunks);
+	const guint nb = g_slist_length(chunks);
+	struct _ec_fetch_s *fetches = g_malloc0(nb * sizeof(struct _ec_fetch_s));
+
+	gsize offset = range->offset, remaining = range->size;
+	const gsize first = range->offset / seg_size;
+	const gsize last = (range->offset + range->size - 1) / seg_size;
+	GByteArray *decoded = g_byte_array_sized_new(seg_size);
+
+	for (gsize s0 = first; !err && s0 <= last; s0 += OIO_EC_DOWNLOAD_SEGMENTS) {
+		const gsize s1 = MIN(last, s0 + OIO_EC_DOWNLOAD_SEGMENTS - 1);
+		const gsize size = (s1 - s0) * frag_size
+			+ (s1 == nb_segments - 1 ? last_frag_size : frag_size);
+
+		guint i = 0;
+		for (GSList *l = chunks; l; l = l->next, ++i) {
+			memset(fetches + i, 0, sizeof(struct _ec_fetch_s));
+			fetches[i].chunk = l->data;
+		}
+		err = _ec_fetch_fragments(fetches, nb, k, s0 * frag_size, size);
+
+		for (gsize s = s0; !err && s <= s1; ++s) {
+			guint8 *fragments[k];
+			guint count = 0;
+			for (i = 0; i < nb && count < k; ++i) {
+				if (fetches[i].ok)
+					fragments[count++] = fetches[i].data->data
+						+ (s - s0) * frag_size;
+			}
+
+			g_byte_array_set_size(decoded, 0);
+			err = oio_ec_decode(dl->ec, fragments, count,
+					s == nb_segments - 1 ? last_frag_size : frag_size, decoded);
+			if (err)
+				break;
+
+			const gsize skip = offset - s * seg_size;
+			if (skip >= decoded->len) {
+				err = SYSERR("Segment %"G_GSIZE_FORMAT" too short", s);
+				break;
+			}
+			const gsize len = MIN(remaining, decoded->len - skip);
+			int sent = dl->dst->data.hook.cb(dl->dst->data.hook.ctx,
+					decoded->data + skip, len);
+			if ((gsize)sent != len) {
+				err = SYSERR("user callback failed: %d/%"G_GSIZE_FORMAT
+						" bytes sent", sent, len);
+				break;
+			}
+			dl->dst->out_size += len;
+			offset += len;
+			remaining -= len;
+		}
+
+		for (i = 0; i < nb; ++i) {
+			if (fetches[i].data)
+				g_byte_array_free(fetches[i].data, TRUE);
+			oio_headers_clear(&fetches[i].headers);
+		}
+	}
+
+	g_byte_array_free(decoded, TRUE);
+	g_free(fetches);
+	g_slist_free(chunks);
+	EXTRA_ASSERT(err != NULL || remaining == 0);
+	return err;
+}
+
 /* The range is relative to the metachunk, not the whole content */
 static GError *
 _download_range_from_metachunk (struct _download_ctx_s *dl,
@@ -875,9 +1163,363 @@ _download_range_from_metachunk (struct _download_ctx_s *dl,
 
 	if (_chunk_method_needs_ecd(dl->chunk_method))
 		return _download_range_from_metachunk_ec(dl, range, meta);
+	if (_chunk_method_is_EC(dl->chunk_method))
+		return _download_range_from_metachunk_ec_native(dl, range, meta);
 	return _download_range_from_metachunk_replicated (dl, range, meta);
 }
 
+/* A request for a piece, to one of the replicas */
+struct _dl_req_s
+{
+	struct _dl_piece_s *piece;
+	struct chunk_s *chunk;
+	CURL *handle;
+	struct oio_headers_s headers;
+	GByteArray *data;
+	gint64 start;
+	gboolean hedge;
+	gboolean overflow; /* more bytes than the range received */
+};
+
+/* A range of a metachunk, downloaded from any of its replicas. At most two
+ * requests run at once: the main one, and its hedge. */
+struct _dl_piece_s
+{
+	struct metachunk_s *meta;
+	gsize offset; /* relative to the metachunk */
+	gsize size;
+	guint next_replica;
+	guint tried;
+	struct _dl_req_s *reqs[2];
+	GByteArray *data; /* set when the piece is downloaded */
+};
+
+static gint
+_cmp_latency(gconstpointer p0, gconstpointer p1)
+{
+	return CMP(*(const gint64*)p0, *(const gint64*)p1);
+}
+
+/* The class of a range size: below 64KiB, then by powers of 4 */
+static guint
+_dl_size_class(gsize size)
+{
+	guint c = 0;
+	for (gsize s = size >> 16; s > 0 && c < OIO_SDS_DL_SIZE_CLASSES - 1; s >>= 2)
+		c ++;
+	return c;
+}
+
+static void
+_dl_record_latency(struct oio_sds_s *sds, gsize size, gint64 latency)
+{
+	g_mutex_lock(&sds->download.lock);
+	struct oio_sds_dl_latencies_s *c =
+		sds->download.classes + _dl_size_class(size);
+	c->latencies[c->next] = latency;
+	c->next = (c->next + 1) % OIO_SDS_DL_LATENCIES;
+	if (c->count < OIO_SDS_DL_LATENCIES)
+		c->count ++;
+	g_mutex_unlock(&sds->download.lock);
+}
+
+/* The latency beyond which a request for a range of `size` bytes deserves a
+ * hedge, or -1 if hedging is disabled or if too few downloads of that size
+ * occured to know. */
+static gint64
+_dl_hedge_threshold(struct oio_sds_s *sds, gsize size)
+{
+	const guint pct = sds->download.hedge_percentile;
+	if (!pct)
+		return -1;
+
+	gint64 tab[OIO_SDS_DL_LATENCIES];
+	g_mutex_lock(&sds->download.lock);
+	struct oio_sds_dl_latencies_s *c =
+		sds->download.classes + _dl_size_class(size);
+	const guint count = c->count;
+	memcpy(tab, c->latencies, count * sizeof(gint64));
+	g_mutex_unlock(&sds->download.lock);
+
+	if (count < OIO_SDS_DL_LATENCIES_MIN)
+		return -1;
+	qsort(tab, count, sizeof(gint64), _cmp_latency);
+	return tab[(count * pct) / 100];
+}
+
+static size_t
+_dl_req_write(char *data, size_t s, size_t n, struct _dl_req_s *req)
+{
+	const size_t total = s * n;
+	const size_t room = req->piece->size - MIN(req->piece->size, req->data->len);
+	if (total > room) {
+		/* The server ignored the range, or sent more than asked. Keeping a
+		 * part of the data would deliver garbage: fail the request. */
+		GRID_WARN("server gave us more data than expected "
+				"(%"G_GSIZE_FORMAT"/%"G_GSIZE_FORMAT") [%s]",
+				total, room, req->chunk->url);
+		req->overflow = TRUE;
+		return 0;
+	}
+	g_byte_array_append(req->data, (guint8 *) data, total);
+	return total;
+}
+
+/* Tells if the request brought exactly the range of its piece. A 200 carries
+ * the whole chunk, it only matches a piece covering the whole chunk. */
+static gboolean
+_dl_req_complete(struct _dl_req_s *req, CURLcode rc, long code)
+{
+	struct _dl_piece_s *piece = req->piece;
+	if (rc != CURLE_OK || req->overflow || req->data->len != piece->size)
+		return FALSE;
+	if (code == HTTP_CODE_PARTIAL_CONTENT)
+		return TRUE;
+	return code == HTTP_CODE_OK
+		&& piece->offset == 0 && piece->size == piece->meta->size;
+}
+
+static void
+_dl_req_free(CURLM *mh, struct _dl_req_s *req)
+{
+	if (!req)
+		return;
+	if (req->handle) {
+		curl_multi_remove_handle(mh, req->handle);
+		curl_easy_cleanup(req->handle);
+	}
+	oio_headers_clear(&req->headers);
+	if (req->data)
+		g_byte_array_free(req->data, TRUE);
+	g_free(req);
+}
+
+static void
+_dl_piece_free(CURLM *mh, struct _dl_piece_s *piece)
+{
+	_dl_req_free(mh, piece->reqs[0]);
+	_dl_req_free(mh, piece->reqs[1]);
+	if (piece->data)
+		g_byte_array_free(piece->data, TRUE);
+	g_free(piece);
+}
+
+static gboolean
+_dl_piece_has_replica(struct _dl_piece_s *piece)
+{
+	return piece->tried < g_slist_length(piece->meta->chunks);
+}
+
+/* Start a request for the piece on the next replica not tried yet */
+static GError *
+_dl_piece_start(CURLM *mh, struct _dl_piece_s *piece, gboolean hedge)
+{
+	const guint n = g_slist_length(piece->meta->chunks);
+	if (piece->tried >= n)
+		return ERRPTF("Too many failures");
+	EXTRA_ASSERT(!piece->reqs[0] || !piece->reqs[1]);
+
+	struct _dl_req_s *req = g_malloc0(sizeof(struct _dl_req_s));
+	req->piece = piece;
+	req->chunk = g_slist_nth_data(piece->meta->chunks, piece->next_replica % n);
+	req->hedge = hedge;
+	req->start = oio_ext_monotonic_time();
+	req->data = g_byte_array_sized_new(piece->size);
+	piece->next_replica ++;
+	piece->tried ++;
+	piece->reqs[piece->reqs[0] ? 1 : 0] = req;
+
+	gchar str_range[64] = "";
+	g_snprintf(str_range, sizeof(str_range),
+			"bytes=%"G_GSIZE_FORMAT"-%"G_GSIZE_FORMAT,
+			piece->offset, piece->offset + piece->size - 1);
+	GRID_TRACE("%s Range:%s %s%s", __FUNCTION__, str_range, req->chunk->url,
+			hedge ? " (hedge)" : "");
+	oio_headers_common(&req->headers);
+	oio_headers_add(&req->headers, "Range", str_range);
+
+	req->handle = _curl_get_handle_blob();
+	curl_easy_setopt(req->handle, CURLOPT_PRIVATE, req);
+	curl_easy_setopt(req->handle, CURLOPT_HTTPHEADER, req->headers.headers);
+	curl_easy_setopt(req->handle, CURLOPT_CUSTOMREQUEST, "GET");
+	curl_easy_setopt(req->handle, CURLOPT_URL, req->chunk->url);
+	curl_easy_setopt(req->handle, CURLOPT_WRITEFUNCTION, _dl_req_write);
+	curl_easy_setopt(req->handle, CURLOPT_WRITEDATA, req);
+	curl_multi_add_handle(mh, req->handle);
+	return NULL;
+}
+
+/* Consume the completion of the requests: a successful request completes
+ * its piece and cancels its sibling, a failed one is replaced on another
+ * replica (unless its sibling is still running). */
+static GError *
+_dl_manage_events(struct _download_ctx_s *dl, CURLM *mh)
+{
+	CURLMsg *msg;
+	int left = 0;
+
+	while ((msg = curl_multi_info_read(mh, &left))) {
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+
+		struct _dl_req_s *req = NULL;
+		long code = 0;
+		const CURLcode rc = msg->data.result;
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&req);
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+		struct _dl_piece_s *piece = req->piece;
+
+		if (_dl_req_complete(req, rc, code)) {
+			_dl_record_latency(dl->sds, piece->size,
+					oio_ext_monotonic_time() - req->start);
+			if (req->hedge) {
+				g_mutex_lock(&dl->sds->download.lock);
+				dl->sds->download.hedge_won ++;
+				g_mutex_unlock(&dl->sds->download.lock);
+			}
+			piece->data = req->data;
+			req->data = NULL;
+			_dl_req_free(mh, piece->reqs[0]);
+			_dl_req_free(mh, piece->reqs[1]);
+			piece->reqs[0] = piece->reqs[1] = NULL;
+		} else {
+			GRID_INFO("Download error [%s]: (%d) %s code=%ld got=%u/%"
+					G_GSIZE_FORMAT, req->chunk->url, rc, curl_easy_strerror(rc),
+					code, req->data->len, piece->size);
+			if (piece->reqs[0] == req)
+				piece->reqs[0] = piece->reqs[1];
+			piece->reqs[1] = NULL;
+			_dl_req_free(mh, req);
+			if (!piece->reqs[0]) {
+				GError *err = _dl_piece_start(mh, piece, FALSE);
+				if (err)
+					return err;
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Download a range of a replicated content by pieces, several pieces at
+ * once, possibly from several metachunks, the pieces being delivered in
+ * order to the application. A piece whose download lasts too long is
+ * requested to another replica, the first complete reply wins. */
+static GError *
+_download_range_parallel (struct _download_ctx_s *dl,
+		struct oio_sds_dl_range_s *range)
+{
+	GRID_TRACE ("%s %"G_GSIZE_FORMAT"+%"G_GSIZE_FORMAT,
+			__FUNCTION__, range->offset, range->size);
+
+	struct oio_sds_s *sds = dl->sds;
+	const guint prefetch = MAX(1, sds->download.prefetch);
+	const gsize piece_max = MAX(64 * 1024, oio_sds_download_buffer / prefetch);
+	GQueue pending = G_QUEUE_INIT, active = G_QUEUE_INIT;
+
+	/* Split the range in pieces, and spread them on the replicas unless the
+	 * best replica is explicitely preferred. */
+	gsize offset = range->offset, remaining = range->size;
+	guint idx = 0;
+	for (struct metachunk_s **p = dl->metachunks; *p && remaining > 0; ++p) {
+		struct metachunk_s *mc = *p;
+		if (offset < mc->offset || offset >= mc->offset + mc->size)
+			continue;
+		gsize inner = offset - mc->offset;
+		gsize todo = MIN(remaining, mc->size - inner);
+		while (todo > 0) {
+			struct _dl_piece_s *piece = g_malloc0(sizeof(struct _dl_piece_s));
+			piece->meta = mc;
+			piece->offset = inner;
+			piece->size = MIN(todo, piece_max);
+			piece->next_replica = sds->no_shuffle ? 0 : idx++;
+			g_queue_push_tail(&pending, piece);
+			inner += piece->size;
+			offset += piece->size;
+			todo -= piece->size;
+			remaining -= piece->size;
+		}
+	}
+	EXTRA_ASSERT(remaining == 0);
+
+	CURLM *mh = curl_multi_init();
+	GError *err = NULL;
+
+	while (!err && !(g_queue_is_empty(&active) && g_queue_is_empty(&pending))) {
+		/* Start as many pieces as allowed */
+		while (!err && g_queue_get_length(&active) < prefetch
+				&& !g_queue_is_empty(&pending)) {
+			struct _dl_piece_s *piece = g_queue_pop_head(&pending);
+			g_queue_push_tail(&active, piece);
+			err = _dl_piece_start(mh, piece, FALSE);
+		}
+		if (err)
+			break;
+
+		int still = 0;
+		curl_multi_perform(mh, &still);
+		if (NULL != (err = _dl_manage_events(dl, mh)))
+			break;
+
+		/* Fire the hedged requests */
+		long wait_ms = 1000;
+		if (sds->download.hedge_percentile > 0) {
+			const gint64 now = oio_ext_monotonic_time();
+			gint64 thresholds[OIO_SDS_DL_SIZE_CLASSES];
+			for (guint i = 0; i < OIO_SDS_DL_SIZE_CLASSES; i++)
+				thresholds[i] = G_MININT64;
+			for (GList *l = active.head; !err && l; l = l->next) {
+				struct _dl_piece_s *piece = l->data;
+				if (piece->data || !piece->reqs[0] || piece->reqs[1]
+						|| !_dl_piece_has_replica(piece))
+					continue;
+				gint64 *pth = thresholds + _dl_size_class(piece->size);
+				if (*pth == G_MININT64)
+					*pth = _dl_hedge_threshold(sds, piece->size);
+				const gint64 threshold = *pth;
+				if (threshold <= 0)
+					continue;
+				const gint64 elapsed = now - piece->reqs[0]->start;
+				if (elapsed < threshold) {
+					wait_ms = MIN(wait_ms, 1 + (threshold - elapsed) / G_TIME_SPAN_MILLISECOND);
+				} else {
+					err = _dl_piece_start(mh, piece, TRUE);
+					g_mutex_lock(&sds->download.lock);
+					sds->download.hedge_fired ++;
+					g_mutex_unlock(&sds->download.lock);
+				}
+			}
+		}
+
+		/* Deliver, in order, the pieces downloaded */
+		while (!err && !g_queue_is_empty(&active)) {
+			struct _dl_piece_s *piece = g_queue_peek_head(&active);
+			if (!piece->data)
+				break;
+			g_queue_pop_head(&active);
+			int sent = dl->dst->data.hook.cb(dl->dst->data.hook.ctx,
+					piece->data->data, piece->data->len);
+			if (sent < 0 || (guint)sent != piece->data->len)
+				err = SYSERR("user callback failed: %d/%u bytes sent",
+						sent, piece->data->len);
+			else
+				dl->dst->out_size += piece->data->len;
+			_dl_piece_free(mh, piece);
+		}
+
+		if (!err && !g_queue_is_empty(&active)) {
+			int numfds = 0;
+			curl_multi_wait(mh, NULL, 0, wait_ms, &numfds);
+		}
+	}
+
+	while (!g_queue_is_empty(&active))
+		_dl_piece_free(mh, g_queue_pop_head(&active));
+	while (!g_queue_is_empty(&pending))
+		_dl_piece_free(mh, g_queue_pop_head(&pending));
+	curl_multi_cleanup(mh);
+	return err;
+}
+
 /* The range is relative to the whole content */
 static GError *
 _download_range (struct _download_ctx_s *dl, struct oio_sds_dl_range_s *range)
@@ -885,6 +1527,10 @@ _download_range (struct _download_ctx_s *dl, struct oio_sds_dl_range_s *range)
 	GRID_TRACE ("%s %"G_GSIZE_FORMAT"+%"G_GSIZE_FORMAT,
 			__FUNCTION__, range->offset, range->size);
 
+	if (!_chunk_method_is_EC(dl->chunk_method) && (dl->sds->download.prefetch > 1
+				|| dl->sds->download.hedge_percentile > 0))
+		return _download_range_parallel (dl, range);
+
 	struct oio_sds_dl_range_s r0 = *range;
 
 	for (struct metachunk_s **p = dl->metachunks; *p; ++p) {
@@ -1023,6 +1669,7 @@ _download_to_hook (struct oio_sds_s *sds, struct oio_sds_dl_src_s *src,
 			err = _download (&dl);
 			_metachunk_cleanv (dl.metachunks);
 		}
+		oio_ec_destroy(dl.ec);
 	}
 
 	/* cleanup and exit */
@@ -1168,6 +1815,16 @@ oio_sds_download_to_file (struct oio_sds_s *sds, struct oio_url_s *url,
 
 /* Upload ------------------------------------------------------------------- */
 
+/* A metachunk being uploaded, with its own set of PUT requests */
+struct _metachunk_ul_s
+{
+	struct metachunk_s *mc;
+	struct http_put_s *put;
+	GSList *http_dests;
+	size_t local_done;
+	GChecksum *checksum_chunk;
+};
+
 struct oio_sds_ul_s
 {
 	gboolean started;
@@ -1194,39 +1851,57 @@ struct oio_sds_ul_s
 	gchar *stgpol;
 	gchar *chunk_method;
 	gchar *mime_type;
+	struct oio_ec_s *ec; /* EC without ecd */
 
-	/* current upload */
-	struct metachunk_s *mc;
-	struct http_put_s *put;
-	GSList *http_dests;
-	size_t local_done;
-	GChecksum *checksum_chunk;
+	/* current upload, still accepting data */
+	struct _metachunk_ul_s cur;
+
+	/* <struct _metachunk_ul_s*>, completely fed and still sending their
+	 * data, in the order of their position in the content. */
+	GQueue *pipeline;
 };
 
 static void
 _assert_no_upload (struct oio_sds_ul_s *ul)
 {
 	g_assert (NULL != ul);
-	g_assert (NULL == ul->mc);
-	g_assert (NULL == ul->put);
-	g_assert (NULL == ul->http_dests);
-	g_assert (NULL == ul->checksum_chunk);
-	g_assert (0 == ul->local_done);
+	g_assert (NULL == ul->cur.mc);
+	g_assert (NULL == ul->cur.put);
+	g_assert (NULL == ul->cur.http_dests);
+	g_assert (NULL == ul->cur.checksum_chunk);
+	g_assert (0 == ul->cur.local_done);
+}
+
+static void
+_metachunk_ul_reset (struct _metachunk_ul_s *u)
+{
+	if (u->checksum_chunk)
+		g_checksum_free (u->checksum_chunk);
+	u->checksum_chunk = NULL;
+	_metachunk_clean (u->mc);
+	u->mc = NULL;
+	http_put_destroy (u->put);
+	u->put = NULL;
+	g_slist_free (u->http_dests);
+	u->http_dests = NULL;
+	u->local_done = 0;
+}
+
+static void
+_metachunk_ul_free (struct _metachunk_ul_s *u)
+{
+	_metachunk_ul_reset (u);
+	g_free (u);
 }
 
 static void
 _sds_upload_reset (struct oio_sds_ul_s *ul)
 {
-	if (ul->checksum_chunk)
-		g_checksum_free (ul->checksum_chunk);
-	ul->checksum_chunk = NULL;
-	_metachunk_clean (ul->mc);
-	ul->mc = NULL;
-	http_put_destroy (ul->put);
-	ul->put = NULL;
-	g_slist_free (ul->http_dests);
-	ul->http_dests = NULL;
-	ul->local_done = 0;
+	_metachunk_ul_reset (&ul->cur);
+	if (ul->pipeline) {
+		while (!g_queue_is_empty (ul->pipeline))
+			_metachunk_ul_free (g_queue_pop_head (ul->pipeline));
+	}
 }
 
 static void
@@ -1266,9 +1941,9 @@ oio_sds_upload_init (struct oio_sds_s *sds, struct oio_sds_ul_dst_s *dst)
 	ul->sds = sds;
 	ul->dst = dst;
 	ul->checksum_content = g_checksum_new (G_CHECKSUM_MD5);
-	ul->checksum_chunk = NULL;
 	ul->buffer_tail = g_queue_new ();
 	ul->metachunk_ready = g_queue_new ();
+	ul->pipeline = g_queue_new ();
 
 	if (dst->chunk_size > 0) {
 		ul->chunk_size = dst->chunk_size;
@@ -1329,7 +2004,9 @@ oio_sds_upload_clean (struct oio_sds_ul_s *ul)
 	oio_str_clean (&ul->stgpol);
 	oio_str_clean (&ul->chunk_method);
 	oio_str_clean (&ul->mime_type);
+	oio_ec_destroy (ul->ec);
 	_sds_upload_reset (ul);
+	g_queue_free (ul->pipeline);
 
 	g_free (ul);
 }
@@ -1339,17 +2016,34 @@ oio_sds_upload_done (struct oio_sds_ul_s *ul)
 {
 #ifdef HAVE_EXTRA_DEBUG
 	EXTRA_ASSERT (ul != NULL);
-	if (ul->finished)
+	if (ul->finished) {
 		_assert_no_upload (ul);
+		g_assert (g_queue_is_empty (ul->pipeline));
+	}
 #endif
 	return !ul || ul->finished;
 }
 
+/* How many bytes have been fed to the metachunk uploads, not yet sent */
+static gint64
+_sds_upload_buffered (struct oio_sds_ul_s *ul)
+{
+	gint64 total = 0;
+	if (ul->cur.put)
+		total += http_put_buffered_bytes (ul->cur.put);
+	for (GList *l = ul->pipeline->head; l; l = l->next) {
+		struct _metachunk_ul_s *u = l->data;
+		total += http_put_buffered_bytes (u->put);
+	}
+	return total;
+}
+
 int
 oio_sds_upload_greedy (struct oio_sds_ul_s *ul)
 {
 	return NULL != ul && !ul->finished && ul->ready_for_data
-		&& g_queue_is_empty(ul->buffer_tail);
+		&& g_queue_is_empty(ul->buffer_tail)
+		&& _sds_upload_buffered(ul) < oio_sds_upload_pipeline_buffer;
 }
 
 int
@@ -1445,8 +2139,11 @@ oio_sds_upload_prepare (struct oio_sds_ul_s *ul, size_t size)
 	gint64 k = 1;
 
 	/* Verify either we are doing erasure coding or not */
-	if (!err && oio_sds_upload_needs_ecd(ul)) {
-		if (oio_str_is_set(ul->sds->ecd)) {
+	if (!err && _chunk_method_is_EC(ul->chunk_method)) {
+		if (!oio_sds_upload_needs_ecd(ul)) {
+			if (!ul->ec)
+				err = oio_ec_create(ul->chunk_method, &ul->ec);
+		} else if (oio_str_is_set(ul->sds->ecd)) {
 			GRID_DEBUG("using ecd gateway");
 		} else {
 			err = NEWERROR(CODE_NOT_IMPLEMENTED,
@@ -1520,52 +2217,60 @@ oio_sds_upload_feed (struct oio_sds_ul_s *ul,
 }
 
 static void
-_finish_metachunk_upload(struct oio_sds_ul_s *ul)
+_finish_metachunk_upload(struct oio_sds_ul_s *ul, struct _metachunk_ul_s *u)
 {
 	EXTRA_ASSERT(ul != NULL);
-	EXTRA_ASSERT(ul->mc != NULL);
+	EXTRA_ASSERT(u->mc != NULL);
 
-	ul->mc->size = ul->local_done;
+	u->mc->size = u->local_done;
 
-	for (GSList *l = ul->mc->chunks; l; l = l->next) {
+	for (GSList *l = u->mc->chunks; l; l = l->next) {
 		struct chunk_s *c = l->data;
-		EXTRA_ASSERT (c->position.meta == ul->mc->meta);
-		c->size = ul->mc->size;
-		c->flag_success = 2 == (http_put_get_http_code(ul->put, c) / 100);
+		EXTRA_ASSERT (c->position.meta == u->mc->meta);
+		c->size = u->mc->size;
+		c->flag_success = 2 == (http_put_get_http_code(u->put, c) / 100);
 	}
 
-	if (ul->checksum_chunk) {
-		const char *h = g_checksum_get_string (ul->checksum_chunk);
-		for (GSList *l = ul->mc->chunks; l; l = l->next) {
+	if (u->checksum_chunk) {
+		const char *h = g_checksum_get_string (u->checksum_chunk);
+		for (GSList *l = u->mc->chunks; l; l = l->next) {
 			struct chunk_s *c = l->data;
-			g_strlcpy (c->hexhash, h, sizeof(c->hexhash));
+			/* Each EC chunk holds its own fragments */
+			const char *hc = ul->ec ? http_put_get_fragments_hash(u->put, c) : h;
+			g_strlcpy (c->hexhash, hc ? hc : h, sizeof(c->hexhash));
 			oio_str_upper (c->hexhash);
 		}
 	}
 }
 
 static GError *
-_sds_upload_finish (struct oio_sds_ul_s *ul)
+_sds_upload_finish (struct oio_sds_ul_s *ul, struct _metachunk_ul_s *u)
 {
 	GRID_TRACE("%s (%p)", __FUNCTION__, ul);
-	EXTRA_ASSERT(ul->mc != NULL);
+	EXTRA_ASSERT(u->mc != NULL);
 	GError *err = NULL;
 
-	guint failures = http_put_get_failure_number (ul->put);
-	guint total = g_slist_length (ul->http_dests);
+	guint failures = http_put_get_failure_number (u->put);
+	guint total = g_slist_length (u->http_dests);
 	GRID_TRACE("%s uploads %u/%u failed", __FUNCTION__, failures, total);
 
 	if (failures >= total) {
 		err = ERRPTF("No upload succeeded");
+	} else if (ul->ec && total - failures < oio_ec_get_quorum(ul->ec)) {
+		err = ERRPTF("Too many failures: %u/%u fragments uploaded,"
+				" %u required", total - failures, total,
+				oio_ec_get_quorum(ul->ec));
 	} else {
-		const gboolean is_ec = _chunk_method_is_EC(ul->chunk_method);
+		/* Only the ecd reports no detail about the chunks */
+		const gboolean is_ec = _chunk_method_is_EC(ul->chunk_method)
+			&& !ul->ec;
 
-		_finish_metachunk_upload(ul);
+		_finish_metachunk_upload(ul, u);
 
 		/* TODO: in case of EC, we may wanna read response headers */
 
 		/* store the structure in holders for further commit/abort */
-		for (GSList *l = ul->mc->chunks; l; l = l->next) {
+		for (GSList *l = u->mc->chunks; l; l = l->next) {
 			struct chunk_s *chunk = l->data;
 			if (is_ec || chunk->flag_success) {
 				ul->chunks_done = g_slist_prepend (ul->chunks_done, chunk);
@@ -1574,17 +2279,58 @@ _sds_upload_finish (struct oio_sds_ul_s *ul)
 			}
 		}
 
-		ul->metachunk_done = g_list_append (ul->metachunk_done, ul->mc);
+		ul->metachunk_done = g_list_append (ul->metachunk_done, u->mc);
 		GRID_TRACE("%s > metachunks +1 -> %u (%"G_GSIZE_FORMAT")", __FUNCTION__,
 				g_list_length(ul->metachunk_done),
-				ul->mc->size);
-		ul->mc = NULL;
+				u->mc->size);
+		u->mc = NULL;
 	}
 
-	_sds_upload_reset (ul);
+	_metachunk_ul_reset (u);
 	return err;
 }
 
+/* Finish, in order, the metachunks whose upload is over. A metachunk whose
+ * upload is over waits for the completion of the metachunks before it. */
+static GError *
+_sds_upload_collect (struct oio_sds_ul_s *ul)
+{
+	while (!g_queue_is_empty (ul->pipeline)) {
+		struct _metachunk_ul_s *u = g_queue_peek_head (ul->pipeline);
+		if (!http_put_done (u->put))
+			break;
+		g_queue_pop_head (ul->pipeline);
+		GError *err = _sds_upload_finish (ul, u);
+		_metachunk_ul_free (u);
+		if (err)
+			return err;
+	}
+	return NULL;
+}
+
+/* The current metachunk has received all its data, it lets room for the
+ * next one while it sends the remaining data. */
+static void
+_sds_upload_flush (struct oio_sds_ul_s *ul)
+{
+	EXTRA_ASSERT (ul->cur.put != NULL);
+	http_put_feed (ul->cur.put, g_bytes_new_static ("", 0));
+	ul->cur.mc->size = ul->cur.local_done;
+	g_queue_push_tail (ul->pipeline, g_memdup (&ul->cur, sizeof(ul->cur)));
+	memset (&ul->cur, 0, sizeof(ul->cur));
+}
+
+/* The last metachunk whose position and size are known */
+static struct metachunk_s *
+_sds_upload_last_metachunk (struct oio_sds_ul_s *ul)
+{
+	if (!g_queue_is_empty (ul->pipeline))
+		return ((struct _metachunk_ul_s*) g_queue_peek_tail (ul->pipeline))->mc;
+	if (ul->metachunk_done)
+		return (g_list_last (ul->metachunk_done))->data;
+	return NULL;
+}
+
 static void
 _sds_upload_add_headers(struct oio_sds_ul_s *ul, struct http_put_dest_s *dest)
 {
@@ -1636,51 +2382,70 @@ _sds_upload_renew (struct oio_sds_ul_s *ul)
 
 	struct oio_error_s *err = NULL;
 
-	EXTRA_ASSERT (NULL == ul->put);
-	EXTRA_ASSERT (NULL == ul->http_dests);
-	EXTRA_ASSERT (NULL == ul->checksum_chunk);
+	EXTRA_ASSERT (NULL == ul->cur.put);
+	EXTRA_ASSERT (NULL == ul->cur.http_dests);
+	EXTRA_ASSERT (NULL == ul->cur.checksum_chunk);
 
 	ul->started = TRUE;
 
 	/* ensure we have a new destination (metachunk) */
-	if (!ul->mc) {
+	if (!ul->cur.mc) {
 		if (g_queue_is_empty (ul->metachunk_ready)) {
 			if (NULL != (err = oio_sds_upload_prepare (ul, 1)))
 				return (GError*) err;
 		}
-		ul->mc = g_queue_pop_head (ul->metachunk_ready);
+		ul->cur.mc = g_queue_pop_head (ul->metachunk_ready);
 	}
-	EXTRA_ASSERT (NULL != ul->mc);
+	EXTRA_ASSERT (NULL != ul->cur.mc);
 
 	/* patch the metachunk characteristics (position now known) */
-	if (ul->metachunk_done) {
-		struct metachunk_s *last = (g_list_last (ul->metachunk_done))->data;
-		ul->mc->offset = last->offset + last->size;
-		ul->mc->meta = last->meta + 1;
+	struct metachunk_s *last = _sds_upload_last_metachunk (ul);
+	if (last) {
+		ul->cur.mc->offset = last->offset + last->size;
+		ul->cur.mc->meta = last->meta + 1;
 	} else if (BOOL(ul->dst->partial)) {
-		ul->mc->offset = ul->dst->offset;
-		ul->mc->meta = ul->dst->meta_pos;
+		ul->cur.mc->offset = ul->dst->offset;
+		ul->cur.mc->meta = ul->dst->meta_pos;
 	} else {
-		ul->mc->offset = 0;
-		ul->mc->meta = 0;
+		ul->cur.mc->offset = 0;
+		ul->cur.mc->meta = 0;
 	}
 
 	/* then patch each chunk with the same meta-position */
-	for (GSList *l = ul->mc->chunks; l; l = l->next) {
+	for (GSList *l = ul->cur.mc->chunks; l; l = l->next) {
 		struct chunk_s *c = l->data;
-		c->position.meta = ul->mc->meta;
+		c->position.meta = ul->cur.mc->meta;
+	}
+
+	/* Each EC chunk receives the fragments matching its position */
+	if (ul->ec) {
+		const guint n = oio_ec_get_k(ul->ec) + oio_ec_get_m(ul->ec);
+		for (GSList *l = ul->cur.mc->chunks; l; l = l->next) {
+			struct chunk_s *c = l->data;
+			if (c->position.intra >= n)
+				return SYSERR("Invalid EC chunk position %u/%u",
+						c->position.intra, n);
+		}
 	}
 
 	/* Initiate the PolyPut (c) with all its targets */
-	ul->put = http_put_create (-1, ul->chunk_size);
+	ul->cur.put = http_put_create (-1, ul->chunk_size);
+	if (ul->ec) {
+		GError *e = http_put_set_ec(ul->cur.put, ul->ec);
+		if (e) {
+			http_put_destroy (ul->cur.put);
+			ul->cur.put = NULL;
+			return e;
+		}
+	}
 	if (oio_sds_upload_needs_ecd(ul)) {
 		// TODO: allow getting ecd from proxy
 		char ecd[128] = {0};
 		g_snprintf(ecd, sizeof(ecd), "http://%s/", ul->sds->ecd);
-		struct http_put_dest_s *dest = http_put_add_dest(ul->put, ecd, ul->mc);
+		struct http_put_dest_s *dest = http_put_add_dest(ul->cur.put, ecd, ul->cur.mc);
 		_sds_upload_add_headers(ul, dest);
 		int chunks_nb = 0;
-		for (GSList *l = ul->mc->chunks; l; l = l->next, chunks_nb++) {
+		for (GSList *l = ul->cur.mc->chunks; l; l = l->next, chunks_nb++) {
 			struct chunk_s *chunk = l->data;
 			char key[64] = {0};
 			g_snprintf(key, sizeof(key), "%s%s-%u",
@@ -1690,12 +2455,15 @@ _sds_upload_renew (struct oio_sds_ul_s *ul)
 		http_put_dest_add_header (dest, RAWX_HEADER_CHUNKS_NB,
 				"%d", chunks_nb);
 		http_put_dest_add_header (dest, RAWX_HEADER_CHUNK_POS,
-				"%u", ul->mc->meta);
-		ul->http_dests = g_slist_append (ul->http_dests, dest);
+				"%u", ul->cur.mc->meta);
+		ul->cur.http_dests = g_slist_append (ul->cur.http_dests, dest);
 	} else {
-		for (GSList *l = ul->mc->chunks; l; l = l->next) {
+		for (GSList *l = ul->cur.mc->chunks; l; l = l->next) {
 			struct chunk_s *c = l->data;
-			struct http_put_dest_s *dest = http_put_add_dest (ul->put, c->url, c);
+			struct http_put_dest_s *dest = http_put_add_dest (ul->cur.put, c->url, c);
+
+			if (ul->ec)
+				http_put_dest_set_fragment(dest, c->position.intra);
 
 			_sds_upload_add_headers(ul, dest);
 
@@ -1707,19 +2475,35 @@ _sds_upload_renew (struct oio_sds_ul_s *ul)
 			http_put_dest_add_header (dest, RAWX_HEADER_CHUNK_POS,
 					"%s", strpos);
 
-			ul->http_dests = g_slist_append (ul->http_dests, dest);
+			ul->cur.http_dests = g_slist_append (ul->cur.http_dests, dest);
 		}
 	}
 
-	ul->checksum_chunk = g_checksum_new (G_CHECKSUM_MD5);
+	ul->cur.checksum_chunk = g_checksum_new (G_CHECKSUM_MD5);
 	GRID_TRACE("%s (%p) upload ready!", __FUNCTION__, ul);
 	return NULL;
 }
 
+/* Run the I/O of all the metachunks being uploaded */
+static GError *
+_sds_upload_step_puts (struct oio_sds_ul_s *ul)
+{
+	const guint count = g_queue_get_length (ul->pipeline) + BOOL(ul->cur.put);
+	if (!count)
+		return NULL;
+
+	struct http_put_s *puts[count];
+	guint i = 0;
+	for (GList *l = ul->pipeline->head; l; l = l->next)
+		puts[i++] = ((struct _metachunk_ul_s*) l->data)->put;
+	if (ul->cur.put)
+		puts[i++] = ul->cur.put;
+	return http_put_step_many (puts, count);
+}
+
 struct oio_error_s *
 oio_sds_upload_step (struct oio_sds_ul_s *ul)
 {
-	static const char *end = "";
 	GRID_TRACE("%s (%p)", __FUNCTION__, ul);
 	EXTRA_ASSERT (ul != NULL);
 
@@ -1728,29 +2512,24 @@ oio_sds_upload_step (struct oio_sds_ul_s *ul)
 		return NULL;
 	}
 
-	if (ul->put) {
-		/* maybe finish the previous upload */
-		gsize max = http_put_expected_bytes (ul->put);
-		GRID_TRACE("%s (%p) upload running, expecting %"G_GSIZE_FORMAT" bytes",
-				__FUNCTION__, ul, max);
-		if (0 == max) {
-			GError *err;
-			while (!http_put_done(ul->put)) {
-				GBytes *empty = g_bytes_new_static (end, 0);
-				http_put_feed (ul->put, empty);
-				if (NULL != (err = http_put_step (ul->put)))
-					return (struct oio_error_s*) err;
-			}
-			if (NULL != (err = _sds_upload_finish (ul)))
-				return (struct oio_error_s*) err;
-			_assert_no_upload (ul);
-			return NULL;
-		}
-	} else {
-		/* No upload running ... */
-		EXTRA_ASSERT (NULL == ul->http_dests);
-		EXTRA_ASSERT (NULL == ul->checksum_chunk);
-		EXTRA_ASSERT (0 == ul->local_done);
+	/* Save the metachunks completely uploaded */
+	GError *err = _sds_upload_collect (ul);
+	if (NULL != err)
+		return (struct oio_error_s*) err;
+
+	/* maybe the current metachunk has been fully fed */
+	if (ul->cur.put && 0 == http_put_expected_bytes (ul->cur.put)) {
+		GRID_TRACE("%s (%p) metachunk complete, %u pending", __FUNCTION__, ul,
+				g_queue_get_length (ul->pipeline));
+		_sds_upload_flush (ul);
+		_assert_no_upload (ul);
+	}
+
+	if (!ul->cur.put) {
+		/* No upload accepting data ... */
+		EXTRA_ASSERT (NULL == ul->cur.http_dests);
+		EXTRA_ASSERT (NULL == ul->cur.checksum_chunk);
+		EXTRA_ASSERT (0 == ul->cur.local_done);
 
 		/* Check if we need to start a new one */
 		GRID_TRACE("%s (%p) No upload currently running", __FUNCTION__, ul);
@@ -1758,16 +2537,16 @@ oio_sds_upload_step (struct oio_sds_ul_s *ul)
 			/* no need to start an upload now */
 			if (!ul->ready_for_data) {
 				GRID_TRACE("%s (%p) not expecting data anymore, finishing", __FUNCTION__, ul);
-				ul->finished = TRUE;
+				ul->finished = g_queue_is_empty (ul->pipeline);
 			} else {
 				GRID_TRACE("%s (%p) No data pending, nothing to do", __FUNCTION__, ul);
 			}
-		} else {
+		} else if (g_queue_get_length (ul->pipeline) < oio_sds_upload_pipeline_depth) {
 			/* maybe we received the termination buffer */
 			GBytes *buf = g_queue_pop_head (ul->buffer_tail);
 			if (0 >= g_bytes_get_size (buf) && ul->started) {
 				ul->ready_for_data = FALSE;
-				ul->finished = TRUE;
+				ul->finished = g_queue_is_empty (ul->pipeline);
 				g_bytes_unref (buf);
 			} else {
 				/* XXX JFS: if no upload at all has ever been started and we
@@ -1775,26 +2554,21 @@ oio_sds_upload_step (struct oio_sds_ul_s *ul)
 				 * we need at least one empty chunk to be able to rebuid the
 				 * content. So we re-enqueue the buffer and let the PUT happen. */
 				g_queue_push_head (ul->buffer_tail, buf);
-				GError *err = _sds_upload_renew (ul);
+				err = _sds_upload_renew (ul);
 				if (NULL != err) {
 					GRID_TRACE("%s (%p) Failed to renew the upload", __FUNCTION__, ul);
 					return (struct oio_error_s*) err;
 				}
 			}
 		}
-		return NULL;
-	}
-
-	EXTRA_ASSERT (ul->put != NULL);
-	EXTRA_ASSERT (0 != http_put_expected_bytes (ul->put));
-
-	/* An upload is really running, maybe feed it */
-	if (!g_queue_is_empty (ul->buffer_tail)) {
+	} else if (!g_queue_is_empty (ul->buffer_tail)) {
+		/* An upload is really running, maybe feed it */
+		EXTRA_ASSERT (0 != http_put_expected_bytes (ul->cur.put));
 		GRID_TRACE("%s (%p) Data ready!", __FUNCTION__, ul);
 		GBytes *buf = g_queue_pop_head (ul->buffer_tail);
 
 		gsize len = g_bytes_get_size (buf);
-		gsize max = http_put_expected_bytes (ul->put);
+		gsize max = http_put_expected_bytes (ul->cur.put);
 		EXTRA_ASSERT (max != 0);
 
 		/* the upload still wants more bytes */
@@ -1816,22 +2590,18 @@ oio_sds_upload_step (struct oio_sds_ul_s *ul)
 		gsize l = 0;
 		const void *b = g_bytes_get_data (buf, &l);
 		if (l) {
-			if (ul->checksum_chunk)
-				g_checksum_update (ul->checksum_chunk, b, l);
+			if (ul->cur.checksum_chunk)
+				g_checksum_update (ul->cur.checksum_chunk, b, l);
 			g_checksum_update (ul->checksum_content, b, l);
-			ul->local_done += l;
+			ul->cur.local_done += l;
 		}
 
 		/* then feed the upload with the chunk of data */
-		http_put_feed (ul->put, buf);
+		http_put_feed (ul->cur.put, buf);
 	}
 
 	/* Now do the I/O things */
-	GError *err = http_put_step (ul->put);
-	if (NULL != err)
-		return (struct oio_error_s*) err;
-
-	return NULL;
+	return (struct oio_error_s*) _sds_upload_step_puts (ul);
 }
 
 static void
@@ -1865,7 +2635,7 @@ oio_sds_upload_commit (struct oio_sds_ul_s *ul)
 	GRID_TRACE("%s (%p) append=%u", __FUNCTION__, ul, ul->dst->append);
 	EXTRA_ASSERT (ul != NULL);
 
-	if (ul->put && !http_put_done (ul->put))
+	if (ul->cur.put || !g_queue_is_empty (ul->pipeline))
 		return (struct oio_error_s *) SYSERR("RAWX upload not completed");
 
 	gint64 size = ul->dst->offset;
@@ -1918,7 +2688,26 @@ struct oio_error_s *
 oio_sds_upload_abort (struct oio_sds_ul_s *ul)
 {
 	EXTRA_ASSERT (ul != NULL);
-	_chunks_remove(ul->chunks_failed, ul->chunks_done);
+
+	/* The metachunks still in the pipeline have been (at least partially)
+	 * uploaded: stop the transfers, then remove their chunks too. */
+	GSList *pending = NULL;
+	for (GList *l = ul->pipeline->head; l; l = l->next) {
+		struct _metachunk_ul_s *u = l->data;
+		pending = g_slist_concat (pending, u->mc->chunks);
+		u->mc->chunks = NULL;
+	}
+	if (ul->cur.put && ul->cur.mc) {
+		pending = g_slist_concat (pending, ul->cur.mc->chunks);
+		ul->cur.mc->chunks = NULL;
+	}
+	_sds_upload_reset (ul);
+
+	GSList *all = g_slist_concat (g_slist_copy (ul->chunks_done), pending);
+	_chunks_remove(ul->chunks_failed, all);
+	for (GSList *l = pending; l; l = l->next)
+		g_free (l->data);
+	g_slist_free (all);
 	return NULL;
 }
 
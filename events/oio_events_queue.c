@@ -87,6 +87,28 @@ oio_events_queue__start (struct oio_events_queue_s *self)
 	EVTQ_CALL(self,start)(self);
 }
 
+GError *
+oio_events_queue__set_spool (struct oio_events_queue_s *self,
+		const char *dir)
+{
+	EXTRA_ASSERT(dir != NULL);
+	if (!VTABLE_HAS(self,struct oio_events_queue_abstract_s*,set_spool))
+		return BADREQ("Events spool not supported");
+	EVTQ_CALL(self,set_spool)(self,dir);
+}
+
+GError *
+oio_events_queue__set_spool_named (struct oio_events_queue_s *self,
+		const char *basedir, const char *name)
+{
+	EXTRA_ASSERT(basedir != NULL);
+	EXTRA_ASSERT(name != NULL);
+	gchar *dir = g_build_filename(basedir, name, NULL);
+	GError *err = oio_events_queue__set_spool(self, dir);
+	g_free(dir);
+	return err;
+}
+
 static const char *
 _has_prefix (const char *cfg, const char *prefix)
 {
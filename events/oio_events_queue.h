@@ -43,6 +43,18 @@ void oio_events_queue__set_buffering (struct oio_events_queue_s *self,
 
 GError * oio_events_queue__start (struct oio_events_queue_s *self);
 
+/* Make the queue save the events in a spool under <dir>, before sending
+ * them. The events still in the spool are replayed. Must be called before
+ * oio_events_queue__start(). */
+GError * oio_events_queue__set_spool (struct oio_events_queue_s *self,
+		const char *dir);
+
+/* Same as oio_events_queue__set_spool() with <basedir>/<name>, where <name>
+ * tells apart the queues of a service: a spool is open by a single queue,
+ * and several queues may send to the same tube. */
+GError * oio_events_queue__set_spool_named (struct oio_events_queue_s *self,
+		const char *basedir, const char *name);
+
 /* -------------------------------------------------------------------------- */
 
 struct oio_url_s;
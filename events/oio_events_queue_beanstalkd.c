@@ -20,6 +20,7 @@ License along with this library.
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <poll.h>
 #include <sys/uio.h>
 #include <sys/types.h>
@@ -38,6 +39,7 @@ License along with this library.
 #include "oio_events_queue_internals.h"
 #include "oio_events_queue_beanstalkd.h"
 #include "oio_events_queue_buffer.h"
+#include "oio_events_spool.h"
 
 #define EXPO_BACKOFF(DELAY,TRY,MAX_TRIES) \
 	g_usleep((1 << MIN(TRY, MAX_TRIES)) * DELAY); \
@@ -45,6 +47,12 @@ License along with this library.
 
 #define NETERR(FMT,...) NEWERROR(CODE_NETWORK_ERROR, FMT, ##__VA_ARGS__)
 
+/* Large enough for "put <prio> <delay> <ttr> <size>\r\n" */
+#define PUT_HEADER_SIZE 64
+
+/* How many events are loaded at once from the spool */
+#define SPOOL_BATCH 1024
+
 static void _q_destroy (struct oio_events_queue_s *self);
 static void _q_send (struct oio_events_queue_s *self, gchar *msg);
 static void _q_send_overwritable(struct oio_events_queue_s *self, gchar *key, gchar *msg);
@@ -52,6 +60,7 @@ static gboolean _q_is_stalled (struct oio_events_queue_s *self);
 static gint64 _q_get_health(struct oio_events_queue_s *self);
 static void _q_set_buffering (struct oio_events_queue_s *self, gint64 v);
 static GError * _q_start (struct oio_events_queue_s *self);
+static GError * _q_set_spool (struct oio_events_queue_s *self, const char *dir);
 
 static struct oio_events_queue_vtable_s vtable_BEANSTALKD =
 {
@@ -61,7 +70,8 @@ static struct oio_events_queue_vtable_s vtable_BEANSTALKD =
 	.is_stalled = _q_is_stalled,
 	.get_health = _q_get_health,
 	.set_buffering = _q_set_buffering,
-	.start = _q_start
+	.start = _q_start,
+	.set_spool = _q_set_spool
 };
 
 struct _queue_BEANSTALKD_s
@@ -77,6 +87,17 @@ struct _queue_BEANSTALKD_s
 	volatile gboolean running;
 
 	struct oio_events_queue_buffer_s buffer;
+
+	/* When set, the events are appended to the spool and only a wake-up
+	 * (an empty event) is pushed in the queue, when none is pending. */
+	struct oio_events_spool_s *spool;
+	volatile gint spool_notified;
+
+	/* The events whose append to the spool failed, only kept in memory.
+	 * Those not sent when the worker exits are reported as lost. */
+	GMutex unspooled_lock;
+	GHashTable *unspooled;
+	volatile gint unspooled_count;
 };
 
 #ifdef HAVE_EXTRA_DEBUG
@@ -93,6 +114,32 @@ static _queue_BEANSTALKD_intercept_error_f intercept_errors = NULL;
 static _queue_BEANSTALKD_intercept_running_f intercept_running = NULL;
 #endif
 
+static GQuark gq_events_put = 0;
+static GQuark gq_events_requeued = 0;
+static GQuark gq_events_dropped = 0;
+static GQuark gq_events_window = 0;
+static GQuark gq_events_rate = 0;
+static GQuark gq_spool_bytes_in = 0;
+static GQuark gq_spool_bytes_written = 0;
+static GQuark gq_spool_drained = 0;
+static GQuark gq_spool_backlog = 0;
+static GQuark gq_spool_rate = 0;
+
+static void __attribute__ ((constructor))
+_constructor (void)
+{
+	gq_events_put = g_quark_from_static_string("counter event.beanstalkd.put");
+	gq_events_requeued = g_quark_from_static_string("counter event.beanstalkd.requeued");
+	gq_events_dropped = g_quark_from_static_string("counter event.beanstalkd.dropped");
+	gq_events_window = g_quark_from_static_string("gauge event.beanstalkd.window");
+	gq_events_rate = g_quark_from_static_string("gauge event.beanstalkd.rate");
+	gq_spool_bytes_in = g_quark_from_static_string("counter event.spool.bytes_in");
+	gq_spool_bytes_written = g_quark_from_static_string("counter event.spool.bytes_written");
+	gq_spool_drained = g_quark_from_static_string("counter event.spool.drained");
+	gq_spool_backlog = g_quark_from_static_string("gauge event.spool.backlog");
+	gq_spool_rate = g_quark_from_static_string("gauge event.spool.rate");
+}
+
 /* -------------------------------------------------------------------------- */
 
 static gboolean
@@ -121,6 +168,8 @@ oio_events_queue_factory__create_beanstalkd (
 	self->tube = g_strdup(tube);
 	self->endpoint = g_strdup (endpoint);
 	self->running = FALSE;
+	g_mutex_init(&self->unspooled_lock);
+	self->unspooled = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	oio_events_queue_buffer_init(&(self->buffer));
 
@@ -140,7 +189,7 @@ _q_set_buffering(struct oio_events_queue_s *self, gint64 v)
 }
 
 static GError *
-_match_common_error(gchar *buf)
+_match_common_error(const gchar *buf)
 {
 	if (g_str_has_prefix(buf, "JOB_TOO_BIG"))
 		return SYSERR("Job too big");
@@ -212,37 +261,85 @@ _send_and_read_reply (int fd, struct iovec *iov, unsigned int iovcount,
 	return NULL;
 }
 
-static GError *
-_put_job (int fd, gchar *msg, size_t msglen)
+static gsize
+_put_header(gchar *dst, gsize msglen)
 {
-	gchar buf[256];
-
-	/* send the request */
-	gsize len = g_snprintf (buf, sizeof(buf),
+	return g_snprintf (dst, PUT_HEADER_SIZE,
 			"put %u %u %u %"G_GSIZE_FORMAT"\r\n",
 			oio_events_beanstalkd_default_prio,
 			(guint) oio_events_beanstalkd_default_delay,
 			(guint) oio_events_beanstalkd_default_ttr,
 			msglen);
-	struct iovec iov[3] = {};
-	iov[0].iov_base = buf;
-	iov[0].iov_len = len;
-	iov[1].iov_base = msg;
-	iov[1].iov_len = msglen;
-	iov[2].iov_base = "\r\n";
-	iov[2].iov_len = 2;
-	GError *err = _send_and_read_reply(fd, iov, 3, buf, sizeof(buf));
-	if (err) return err;
+}
+
+/* Send a put command for each event of <msgv>, without waiting for any
+ * reply. The commands are written with as few syscalls as possible. */
+static GError *
+_put_jobs (int fd, gchar **msgv, guint count)
+{
+	const guint max = MIN(count, IOV_MAX / 3);
+	struct iovec *iov = g_malloc0(3 * max * sizeof(struct iovec));
+	gchar *headers = g_malloc(max * PUT_HEADER_SIZE);
+
+	GError *err = NULL;
+	for (guint done = 0; !err && done < count;) {
+		const guint n = MIN(max, count - done);
+		for (guint i = 0; i < n; ++i) {
+			const gsize msglen = strlen(msgv[done + i]);
+			gchar *header = headers + i * PUT_HEADER_SIZE;
+			iov[3*i].iov_base = header;
+			iov[3*i].iov_len = _put_header(header, msglen);
+			iov[3*i+1].iov_base = msgv[done + i];
+			iov[3*i+1].iov_len = msglen;
+			iov[3*i+2].iov_base = "\r\n";
+			iov[3*i+2].iov_len = 2;
+		}
+		if (!_send(fd, iov, 3 * n))
+			err = NETERR("Send error: (%d) %s", errno, strerror(errno));
+		done += n;
+	}
+
+	g_free(headers);
+	g_free(iov);
+	return err;
+}
 
+static GError *
+_check_put_reply (const gchar *reply)
+{
 	/* No need to retry, the event has been saved ... or explicitely
 	 * dropped. */
 	const char * const replies_ok[] = { "INSERTED", "BURIED", "DRAINING", NULL };
 	for (const char * const *pmsg = replies_ok; *pmsg ;++pmsg) {
-		if (g_str_has_prefix(buf, *pmsg))
+		if (g_str_has_prefix(reply, *pmsg))
 			return NULL;
 	}
 
-	return _match_common_error(buf);
+	return _match_common_error(reply);
+}
+
+/* Append to <dst> the bytes available on <fd>, waiting for the first ones
+ * at most the configured timeout. */
+static GError *
+_read_replies (int fd, GString *dst)
+{
+	const int timeout =
+		oio_events_beanstalkd_timeout / G_TIME_SPAN_MILLISECOND;
+
+	gchar buf[4096];
+	GError *err = NULL;
+	int r = sock_to_read (fd, timeout, buf, sizeof(buf), &err);
+	if (r < 0) {
+		g_prefix_error(&err, "Read error: ");
+		return err;
+	}
+	if (r == 0) {
+		g_clear_error(&err);
+		return NETERR("EOF");
+	}
+
+	g_string_append_len(dst, buf, r);
+	return NULL;
 }
 
 static GError *
@@ -375,6 +472,17 @@ struct _running_ctx_s {
 	guint attempts_check;
 	guint attempts_put;
 	int fd;
+
+	/* The events sent and not acknowledged yet, in the order of the puts */
+	GQueue inflight;
+	/* The bytes received and not parsed yet */
+	GString *replies;
+
+	/* Sampling of the throughput */
+	guint64 acked;
+	guint64 acked_last;
+	gint64 last_stats;
+	struct oio_events_spool_stats_s spool_last;
 };
 
 static gboolean
@@ -419,85 +527,300 @@ _event_dropped(const char *msg, const size_t msglen)
 			(int)msglen, (int)MIN(msglen,2048), msg);
 }
 
+/* Tells if <msg> was kept in memory only, then forgets it. To be called
+ * before <msg> is freed. */
+static gboolean
+_q_forget_unspooled(struct _queue_BEANSTALKD_s *q, gchar *msg)
+{
+	if (g_atomic_int_get(&q->unspooled_count) <= 0)
+		return FALSE;
+	g_mutex_lock(&q->unspooled_lock);
+	const gboolean found = g_hash_table_remove(q->unspooled, msg);
+	g_mutex_unlock(&q->unspooled_lock);
+	if (found)
+		g_atomic_int_add(&q->unspooled_count, -1);
+	return found;
+}
+
+/* Remembers <msg> is kept in memory only. To be called before <msg> is
+ * pushed, the worker may send it at once. */
+static void
+_q_keep_unspooled(struct _queue_BEANSTALKD_s *q, gchar *msg)
+{
+	g_mutex_lock(&q->unspooled_lock);
+	g_hash_table_add(q->unspooled, msg);
+	g_mutex_unlock(&q->unspooled_lock);
+	g_atomic_int_inc(&q->unspooled_count);
+}
+
+static void
+_q_close(struct _running_ctx_s *ctx)
+{
+	sock_set_linger(ctx->fd, 1, 1);
+	metautils_pclose (&ctx->fd);
+	g_string_set_size(ctx->replies, 0);
+}
+
+/* Match the complete lines received with the events in flight, in order.
+ * The events to be retried are prepended to <retry>, so that the list is
+ * in the reverse order of the puts. */
+static void
+_q_consume_replies(struct _queue_BEANSTALKD_s *q, struct _running_ctx_s *ctx,
+		gboolean *failed, GSList **retry, guint *dropped)
+{
+	gchar *line = ctx->replies->str;
+	while (!g_queue_is_empty(&ctx->inflight)) {
+		gchar *eol = strchr(line, '\n');
+		if (!eol)
+			break;
+		*eol = '\0';
+		if (eol > line && eol[-1] == '\r')
+			eol[-1] = '\0';
+
+		gchar *msg = g_queue_pop_head(&ctx->inflight);
+		GError *err = _check_put_reply(line);
+#ifdef HAVE_EXTRA_DEBUG
+		if (intercept_errors)
+			(*intercept_errors) (err);
+#endif
+		if (!err) {
+			ctx->acked ++;
+			_q_forget_unspooled(q, msg);
+			g_free(msg);
+		} else {
+			*failed = TRUE;
+			if (CODE_IS_RETRY(err->code)) {
+				GRID_NOTICE("Beanstalkd recoverable error with [%s]: (%d) %s",
+						q->endpoint, err->code, err->message);
+				*retry = g_slist_prepend(*retry, msg);
+			} else {
+				GRID_WARN("Beanstalkd unrecoverable error with [%s]: (%d) %s",
+						q->endpoint, err->code, err->message);
+				_event_dropped(msg, strlen(msg));
+				_q_forget_unspooled(q, msg);
+				g_free(msg);
+				++ *dropped;
+			}
+			g_clear_error(&err);
+		}
+		line = eol + 1;
+	}
+	g_string_erase(ctx->replies, 0, line - ctx->replies->str);
+}
+
 /**
- * Poll the next messge and manage it.
+ * Send the queued events, as long as the window of the puts waiting for a
+ * reply is not full, then consume the replies already received (waiting
+ * for one at least).
+ * Upon an error, the replies to the puts still in flight are consumed
+ * before closing the connection, so that only the events that have not been
+ * acknowledged are requeued.
  * Returns TRUE if the loop might continue or FALSE it the loop should
  * pause a bit.
  */
 static gboolean
-_q_manage_message(struct _queue_BEANSTALKD_s *q, struct _running_ctx_s *ctx)
+_q_manage_message(struct _queue_BEANSTALKD_s *q, struct _running_ctx_s *ctx,
+		gboolean fill)
 {
 	EXTRA_ASSERT(ctx->fd >= 0);
 
-	gboolean rc = TRUE;
-	gchar* msg = g_async_queue_timeout_pop (q->queue, 200 * G_TIME_SPAN_MILLISECOND);
-	if (!msg) goto exit;
-	if (!*msg) goto exit;
+	const guint window = MAX(1U, oio_events_beanstalkd_window);
+	GPtrArray *batch = g_ptr_array_new();
+	while (fill && ctx->inflight.length + batch->len < window) {
+		gchar *msg = NULL;
+		if (g_queue_is_empty(&ctx->inflight) && !batch->len)
+			msg = g_async_queue_timeout_pop (q->queue, 200 * G_TIME_SPAN_MILLISECOND);
+		else
+			msg = g_async_queue_try_pop (q->queue);
+		if (!msg)
+			break;
+		if (!*msg) {
+			/* A wake-up, the spool has something to send */
+			g_free(msg);
+			break;
+		}
+		g_ptr_array_add(batch, msg);
+	}
+
+	/* Forward the events as beanstalkd jobs */
+	GError *err = NULL;
+	if (batch->len > 0) {
+		err = _put_jobs(ctx->fd, (gchar**) batch->pdata, batch->len);
+		for (guint i = 0; i < batch->len; ++i)
+			g_queue_push_tail(&ctx->inflight, batch->pdata[i]);
+	}
+	g_ptr_array_free(batch, TRUE);
+
+	if (g_queue_is_empty(&ctx->inflight))
+		return TRUE;
+
+	const guint64 acked = ctx->acked;
+	gboolean failed = FALSE;
+	GSList *retry = NULL;
+	guint dropped = 0;
+	while (!err) {
+		err = _read_replies(ctx->fd, ctx->replies);
+		if (!err)
+			_q_consume_replies(q, ctx, &failed, &retry, &dropped);
+		if (!failed || g_queue_is_empty(&ctx->inflight))
+			break;
+	}
 
-	/* forward the event as a beanstalkd job */
-	const size_t msglen = strlen(msg);
-	GError *err = _put_job (ctx->fd, msg, msglen);
+	guint requeued = 0;
+	if (err) {
 #ifdef HAVE_EXTRA_DEBUG
-	if (intercept_errors)
-		(*intercept_errors) (err);
+		if (intercept_errors)
+			(*intercept_errors) (err);
 #endif
-
-	if (!err) {
-		ctx->attempts_put = 0;
-	} else {
-		if (CODE_IS_RETRY(err->code) || CODE_IS_NETWORK_ERROR(err->code)) {
-			GRID_NOTICE("Beanstalkd recoverable error with [%s]: (%d) %s",
-					q->endpoint, err->code, err->message);
-			g_async_queue_push_front(q->queue, msg);
-			msg = NULL;
-			rc = FALSE;
-		} else {
-			GRID_WARN("Beanstalkd unrecoverable error with [%s]: (%d) %s",
-					q->endpoint, err->code, err->message);
-			_event_dropped(msg, msglen);
-			ctx->attempts_put = 0;
+		GRID_NOTICE("Beanstalkd recoverable error with [%s]: (%d) %s",
+				q->endpoint, err->code, err->message);
+		g_clear_error(&err);
+		/* None of the events still in flight is known as saved */
+		while (!g_queue_is_empty(&ctx->inflight)) {
+			g_async_queue_push_front(q->queue, g_queue_pop_tail(&ctx->inflight));
+			++ requeued;
 		}
-		g_clear_error (&err);
-		sock_set_linger(ctx->fd, 1, 1);
-		metautils_pclose (&ctx->fd);
+	}
+	for (GSList *l = retry; l; l = l->next) {
+		g_async_queue_push_front(q->queue, l->data);
+		++ requeued;
+	}
+	g_slist_free(retry);
+
+	if (ctx->acked > acked || requeued > 0 || dropped > 0) {
+		oio_stats_add(
+				gq_events_put, ctx->acked - acked,
+				gq_events_requeued, requeued,
+				gq_events_dropped, dropped,
+				0, 0);
 	}
 
-exit:
-	oio_str_clean (&msg);
-	return rc;
+	if (requeued > 0 || failed)
+		_q_close(ctx);
+	if (requeued > 0)
+		return FALSE;
+	ctx->attempts_put = 0;
+	return TRUE;
+}
+
+static void
+_q_flush_event(struct _queue_BEANSTALKD_s *q, gchar *msg,
+		guint *spooled, guint *lost)
+{
+	if (q->spool && !_q_forget_unspooled(q, msg)) {
+		++ *spooled;
+	} else {
+		_event_dropped(msg, strlen(msg));
+		++ *lost;
+	}
+	g_free(msg);
 }
 
 /**
- * Drain the queue of pending events.
- * In addition, print a warning that some events have been lost.
+ * Drain the queue of pending events, and forget the events still in flight.
+ * In addition, print a warning that some events have been lost, i.e. those
+ * not kept in the spool. Returns how many.
  */
-static void
-_q_flush_pending(struct _queue_BEANSTALKD_s *q)
+static guint
+_q_flush_pending(struct _queue_BEANSTALKD_s *q, struct _running_ctx_s *ctx)
 {
-	guint count = 0;
+	guint spooled = 0, lost = 0;
+	while (!g_queue_is_empty(&ctx->inflight))
+		_q_flush_event(q, g_queue_pop_head(&ctx->inflight), &spooled, &lost);
 	while (0 < g_async_queue_length(q->queue)) {
 		gchar *msg = g_async_queue_try_pop(q->queue);
-		if (msg) {
-			_event_dropped(msg, strlen(msg));
-			oio_str_clean(&msg);
-			++ count;
-		}
+		if (msg && *msg)
+			_q_flush_event(q, msg, &spooled, &lost);
+		else
+			g_free(msg);
 	}
-	if (count > 0)
-		GRID_WARN("%u events lost", count);
+	if (spooled > 0)
+		GRID_INFO("%u events left in the spool", spooled);
+	if (lost > 0) {
+		oio_stats_add(gq_events_dropped, lost, 0, 0, 0, 0, 0, 0);
+		GRID_WARN("%u events lost", lost);
+	}
+	return lost;
+}
+
+/* Once all the events loaded from the spool have been sent, acknowledge
+ * them and load the next ones. */
+static void
+_q_maybe_refill(struct _queue_BEANSTALKD_s *q, struct _running_ctx_s *ctx)
+{
+	if (!q->spool || !g_queue_is_empty(&ctx->inflight)
+			|| g_async_queue_length(q->queue) > 0)
+		return;
+
+	GError *err = oio_events_spool_ack(q->spool);
+	if (err) {
+		GRID_WARN("Events spool error: (%d) %s", err->code, err->message);
+		g_clear_error(&err);
+	}
+
+	/* Cleared before the read, so that an event appended after the read
+	 * wakes the worker up. */
+	g_atomic_int_set(&q->spool_notified, 0);
+	GPtrArray *batch = g_ptr_array_new();
+	oio_events_spool_read(q->spool, batch, SPOOL_BATCH);
+	g_async_queue_lock(q->queue);
+	for (guint i = 0; i < batch->len; ++i)
+		g_async_queue_push_unlocked(q->queue, batch->pdata[i]);
+	g_async_queue_unlock(q->queue);
+	g_ptr_array_free(batch, TRUE);
+}
+
+/* Publish the occupancy of the window, the throughput of the puts and the
+ * activity of the spool, at most once per second. */
+static void
+_q_maybe_stats(struct _queue_BEANSTALKD_s *q, struct _running_ctx_s *ctx)
+{
+	const gint64 elapsed = ctx->now - ctx->last_stats;
+	if (elapsed < G_TIME_SPAN_SECOND)
+		return;
+	const guint64 rate = ctx->last_stats <= 0 ? 0 :
+		((ctx->acked - ctx->acked_last) * G_TIME_SPAN_SECOND) / elapsed;
+	oio_stats_set(
+			gq_events_window, ctx->inflight.length,
+			gq_events_rate, rate,
+			0, 0, 0, 0);
+
+	if (q->spool) {
+		struct oio_events_spool_stats_s st = {};
+		oio_events_spool_get_stats(q->spool, &st);
+		const guint64 drained = st.drained - ctx->spool_last.drained;
+		oio_stats_add(
+				gq_spool_bytes_in, st.bytes_in - ctx->spool_last.bytes_in,
+				gq_spool_bytes_written,
+				st.bytes_written - ctx->spool_last.bytes_written,
+				gq_spool_drained, drained,
+				0, 0);
+		oio_stats_set(
+				gq_spool_backlog, st.backlog,
+				gq_spool_rate, ctx->last_stats <= 0 ? 0 :
+					(drained * G_TIME_SPAN_SECOND) / elapsed,
+				0, 0, 0, 0);
+		ctx->spool_last = st;
+	}
+
+	ctx->acked_last = ctx->acked;
+	ctx->last_stats = ctx->now;
+}
+
+static gboolean
+_q_check_due(struct _running_ctx_s *ctx)
+{
+	return oio_events_beanstalkd_check_period > 0 &&
+		ctx->last_check < OLDEST(ctx->now, oio_events_beanstalkd_check_period);
 }
 
-/**
- * Do a pseudo-periodic check of the backend.
- * A STAT command is sent when a delay (since the last command) is reached.
- */
 static gboolean
 _q_maybe_check(struct _queue_BEANSTALKD_s *q, struct _running_ctx_s *ctx)
 {
 	EXTRA_ASSERT(ctx->fd >= 0);
 
-	if (oio_events_beanstalkd_check_period <= 0 ||
-			ctx->last_check >= OLDEST(ctx->now, oio_events_beanstalkd_check_period))
+	/* The reply to the STAT would be mixed with the replies to the puts */
+	if (!_q_check_due(ctx) || !g_queue_is_empty(&ctx->inflight))
 		return TRUE;
 
 	GError *err = _check_server(q, ctx->fd);
@@ -523,6 +846,8 @@ _q_run (struct _queue_BEANSTALKD_s *q)
 {
 	struct _running_ctx_s ctx = {};
 	ctx.fd = -1;
+	g_queue_init(&ctx.inflight);
+	ctx.replies = g_string_sized_new(1024);
 
 	/* Loop until the (asked) end or until there is no event */
 	while (_is_running(q)) {
@@ -544,14 +869,24 @@ _q_run (struct _queue_BEANSTALKD_s *q)
 			continue;
 		}
 
-		if (!_q_manage_message(q, &ctx)) {
+		_q_maybe_refill(q, &ctx);
+
+		/* Let the window drain when a check is expected */
+		if (!_q_manage_message(q, &ctx, !_q_check_due(&ctx))) {
 			EXPO_BACKOFF(100 * G_TIME_SPAN_MILLISECOND, ctx.attempts_put, 5);
 		}
+
+		_q_maybe_stats(q, &ctx);
 	}
 
-	/* Exit phase */
+	/* Exit phase. The events in the spool will be replayed at the next
+	 * start, only the buffered events have to be saved, and the events the
+	 * spool refused have to be sent. */
+	if (q->spool)
+		_flush_buffered(q, TRUE);
 	const gint64 deadline_exit = oio_ext_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
-	while (!_q_is_empty(q)) {
+	while ((!q->spool || g_atomic_int_get(&q->unspooled_count) > 0)
+			&& (!_q_is_empty(q) || !g_queue_is_empty(&ctx.inflight))) {
 		ctx.now = oio_ext_monotonic_time();
 		GRID_WARN("exiting...");
 
@@ -566,17 +901,18 @@ _q_run (struct _queue_BEANSTALKD_s *q)
 			continue;
 		}
 
-		if (!_q_manage_message(q, &ctx)) {
+		if (!_q_manage_message(q, &ctx, TRUE)) {
 			g_usleep(100 * G_TIME_SPAN_MILLISECOND);
 		}
 	}
 
-	_q_flush_pending(q);
+	_q_flush_pending(q, &ctx);
 
 	/* close the socket to the beanstalkd */
 	if (ctx.fd >= 0)
 		sock_set_linger(ctx.fd, 1, 1);
 	metautils_pclose (&ctx.fd);
+	g_string_free(ctx.replies, TRUE);
 
 	return NULL;
 }
@@ -612,6 +948,26 @@ _q_start (struct oio_events_queue_s *self)
 	return err;
 }
 
+static GError *
+_q_set_spool (struct oio_events_queue_s *self, const char *dir)
+{
+	struct _queue_BEANSTALKD_s *q = (struct _queue_BEANSTALKD_s*) self;
+	g_assert(q->vtable == &vtable_BEANSTALKD);
+	g_assert_null(q->worker);
+	g_assert_null(q->spool);
+
+	/* <dir> is dedicated to the queue, and the spool is named after the
+	 * destination of the events. The spool refuses to be open twice. */
+	gchar *name = g_strdup_printf("%s@%s", q->tube, q->endpoint);
+	gchar *path = g_build_filename(dir, name, NULL);
+	GError *err = oio_events_spool_open(path, &q->spool);
+	if (!err)
+		GRID_INFO("Events spooled in [%s]", path);
+	g_free(path);
+	g_free(name);
+	return err;
+}
+
 static void
 _q_destroy (struct oio_events_queue_s *self)
 {
@@ -631,6 +987,9 @@ _q_destroy (struct oio_events_queue_s *self)
 	oio_str_clean (&q->endpoint);
 	oio_str_clean (&q->tube);
 	oio_events_queue_buffer_clean(&(q->buffer));
+	oio_events_spool_close(q->spool);
+	g_hash_table_destroy(q->unspooled);
+	g_mutex_clear(&q->unspooled_lock);
 
 	q->vtable = NULL;
 	g_free (q);
@@ -641,6 +1000,21 @@ _q_send (struct oio_events_queue_s *self, gchar *msg)
 {
 	struct _queue_BEANSTALKD_s *q = (struct _queue_BEANSTALKD_s*) self;
 	EXTRA_ASSERT (q != NULL && q->vtable == &vtable_BEANSTALKD);
+
+	if (q->spool) {
+		GError *err = oio_events_spool_append(q->spool, msg, strlen(msg));
+		if (!err) {
+			g_free(msg);
+			if (g_atomic_int_compare_and_exchange(&q->spool_notified, 0, 1))
+				g_async_queue_push (q->queue, g_strdup(""));
+			return;
+		}
+		GRID_WARN("Events spool error, event kept in memory: (%d) %s",
+				err->code, err->message);
+		g_clear_error(&err);
+		_q_keep_unspooled(q, msg);
+	}
+
 	g_async_queue_push (q->queue, msg);
 }
 
@@ -656,6 +1030,15 @@ _q_is_stalled (struct oio_events_queue_s *self)
 {
 	struct _queue_BEANSTALKD_s *q = (struct _queue_BEANSTALKD_s*) self;
 	EXTRA_ASSERT (q != NULL && q->vtable == &vtable_BEANSTALKD);
+
+	if (q->spool) {
+		if (oio_events_spool_max_size <= 0)
+			return FALSE;
+		struct oio_events_spool_stats_s st = {};
+		oio_events_spool_get_stats(q->spool, &st);
+		return st.backlog_size >= (guint64) oio_events_spool_max_size;
+	}
+
 	const int l = g_async_queue_length (q->queue);
 	if (l <= 0)
 		return FALSE;
@@ -53,6 +53,7 @@ static gint64 _q_get_health(struct oio_events_queue_s *self);
 
 static void _q_set_buffering (struct oio_events_queue_s *self, gint64 v);
 static GError * _q_start (struct oio_events_queue_s *self);
+static GError * _q_set_spool (struct oio_events_queue_s *self, const char *dir);
 
 static struct oio_events_queue_vtable_s vtable_FANOUT =
 {
@@ -62,7 +63,8 @@ static struct oio_events_queue_vtable_s vtable_FANOUT =
 	.is_stalled = _q_is_stalled,
 	.get_health = _q_get_health,
 	.set_buffering = _q_set_buffering,
-	.start = _q_start
+	.start = _q_start,
+	.set_spool = _q_set_spool
 };
 
 struct _queue_FANOUT_s
@@ -222,6 +224,20 @@ _q_start (struct oio_events_queue_s *self)
 	return err;
 }
 
+static GError *
+_q_set_spool (struct oio_events_queue_s *self, const char *dir)
+{
+	struct _queue_FANOUT_s *q = (struct _queue_FANOUT_s*) self;
+	g_assert(q->vtable == &vtable_FANOUT);
+	g_assert_null(q->worker);
+
+	/* Each output has its own spool in <dir>, named after its endpoint */
+	GError *err = NULL;
+	for (guint i=0; !err && i<q->output_nb ;++i)
+		err = oio_events_queue__set_spool(q->output_tab[i], dir);
+	return err;
+}
+
 static void
 _q_destroy (struct oio_events_queue_s *self)
 {
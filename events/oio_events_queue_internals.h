@@ -34,6 +34,7 @@ struct oio_events_queue_vtable_s
 	gint64 (*get_health) (struct oio_events_queue_s *self);
 	void (*set_buffering) (struct oio_events_queue_s *self, gint64 v);
 	GError * (*start) (struct oio_events_queue_s *self);
+	GError * (*set_spool) (struct oio_events_queue_s *self, const char *dir);
 };
 
 struct oio_events_queue_abstract_s
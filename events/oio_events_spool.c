@@ -0,0 +1,483 @@
+/*
+OpenIO SDS event queue
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <glib.h>
+
+#include <core/oio_core.h>
+#include <events/events_variables.h>
+
+#include "oio_events_spool.h"
+
+#define SEGMENT_SUFFIX ".seg"
+#define ACK_NAME "ack"
+#define LOCK_NAME "lock"
+
+#define SEG(sp,i) ((struct spool_segment_s*)g_ptr_array_index((sp)->segments,(i)))
+
+#define RECORD_HEADER sizeof(struct spool_record_s)
+#define RECORD_SIZE(len) (RECORD_HEADER + (((gsize)(len) + 7) & ~((gsize)7)))
+
+/* A record is an header followed by the event, padded to keep the headers
+ * aligned. A header with a zero size marks the end of the records of the
+ * segment. */
+struct spool_record_s
+{
+	guint32 size;
+	guint32 sum;
+};
+
+struct spool_segment_s
+{
+	guint64 seq;
+	guint8 *base;
+	gsize size;
+};
+
+struct spool_ack_s
+{
+	guint64 seq;
+	guint64 offset;
+};
+
+struct oio_events_spool_s
+{
+	GMutex lock;
+	gchar *path;
+	int fd_ack;
+	int fd_lock;  /* holds an exclusive flock() while the spool is open */
+
+	/* The segments, from the one holding the last acknowledgement to the
+	 * one being written */
+	GPtrArray *segments;
+	gsize ack_offset;
+	guint read_index;
+	gsize read_offset;
+	gsize write_offset;
+
+	/* The records between the acknowledgement and the read position */
+	guint64 read_count;
+	guint64 read_size;
+
+	struct oio_events_spool_stats_s stats;
+};
+
+static guint32
+_checksum(const guint8 *b, gsize len)
+{
+	guint32 h = 2166136261U;
+	for (gsize i = 0; i < len; ++i) {
+		h ^= b[i];
+		h *= 16777619U;
+	}
+	return h ^ (guint32) len;
+}
+
+static gchar *
+_segment_path(struct oio_events_spool_s *sp, guint64 seq)
+{
+	gchar name[32];
+	g_snprintf(name, sizeof(name),
+			"%016" G_GINT64_MODIFIER "x" SEGMENT_SUFFIX, seq);
+	return g_build_filename(sp->path, name, NULL);
+}
+
+static void
+_segment_unmap(struct spool_segment_s *seg)
+{
+	if (!seg)
+		return;
+	if (seg->base)
+		munmap(seg->base, seg->size);
+	g_free(seg);
+}
+
+/* Map the segment <seq>, after its creation with <size> bytes if <create>
+ * is set. */
+static GError *
+_segment_map(struct oio_events_spool_s *sp, guint64 seq, gsize size,
+		gboolean create, struct spool_segment_s **out)
+{
+	GError *err = NULL;
+	gchar *path = _segment_path(sp, seq);
+
+	int fd = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT|O_TRUNC : 0),
+			0644);
+	if (fd < 0) {
+		err = SYSERR("open(%s): (%d) %s", path, errno, strerror(errno));
+		goto exit;
+	}
+
+	if (create) {
+		/* The blocks are allocated now, so that a full device cannot raise
+		 * a SIGBUS later, during a write in the mapping. */
+		int rc = posix_fallocate(fd, 0, size);
+		if (rc != 0) {
+			err = SYSERR("fallocate(%s): (%d) %s", path, rc, strerror(rc));
+			goto exit;
+		}
+	} else {
+		struct stat st = {};
+		if (fstat(fd, &st) < 0) {
+			err = SYSERR("stat(%s): (%d) %s", path, errno, strerror(errno));
+			goto exit;
+		}
+		size = st.st_size;
+		if (size < RECORD_HEADER) {
+			err = SYSERR("Truncated segment %s", path);
+			goto exit;
+		}
+	}
+
+	void *base = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		err = SYSERR("mmap(%s): (%d) %s", path, errno, strerror(errno));
+		goto exit;
+	}
+
+	*out = g_malloc0(sizeof(struct spool_segment_s));
+	(*out)->seq = seq;
+	(*out)->base = base;
+	(*out)->size = size;
+
+exit:
+	if (err && create)
+		unlink(path);
+	if (fd >= 0)
+		close(fd);
+	g_free(path);
+	return err;
+}
+
+/* Returns the record at <offset> in <seg>, or NULL past the last one */
+static struct spool_record_s *
+_record_at(struct spool_segment_s *seg, gsize offset)
+{
+	if (offset + RECORD_HEADER > seg->size)
+		return NULL;
+	struct spool_record_s *rec = (struct spool_record_s*) (seg->base + offset);
+	if (!rec->size || offset + RECORD_SIZE(rec->size) > seg->size)
+		return NULL;
+	return rec;
+}
+
+static GError *
+_ack_write(struct oio_events_spool_s *sp)
+{
+	struct spool_ack_s ack = {
+		.seq = SEG(sp,0)->seq,
+		.offset = sp->ack_offset,
+	};
+	ssize_t w = pwrite(sp->fd_ack, &ack, sizeof(ack), 0);
+	if (w != (ssize_t) sizeof(ack))
+		return SYSERR("write(ack): (%d) %s", errno, strerror(errno));
+	sp->stats.bytes_written += sizeof(ack);
+	return NULL;
+}
+
+static gint
+_cmp_seq(gconstpointer a, gconstpointer b)
+{
+	const guint64 s0 = *(const guint64*)a, s1 = *(const guint64*)b;
+	return CMP(s0, s1);
+}
+
+/* A spool has a single reader, that keeps its own acknowledgement: two
+ * spools open on the same directory, in one process or two, would replay
+ * and remove each other's records. */
+static GError *
+_spool_lock(struct oio_events_spool_s *sp)
+{
+	GError *err = NULL;
+	gchar *lock_path = g_build_filename(sp->path, LOCK_NAME, NULL);
+	sp->fd_lock = open(lock_path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+	if (sp->fd_lock < 0)
+		err = SYSERR("open(%s): (%d) %s", lock_path, errno, strerror(errno));
+	else if (flock(sp->fd_lock, LOCK_EX|LOCK_NB) < 0)
+		err = (errno == EWOULDBLOCK)
+			? BUSY("Already in use")
+			: SYSERR("flock(%s): (%d) %s", lock_path, errno, strerror(errno));
+	g_free(lock_path);
+	return err;
+}
+
+static GError *
+_spool_load(struct oio_events_spool_s *sp)
+{
+	GError *err = NULL;
+
+	/* Where the last acknowledgement stopped */
+	gchar *ack_path = g_build_filename(sp->path, ACK_NAME, NULL);
+	sp->fd_ack = open(ack_path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+	if (sp->fd_ack < 0)
+		err = SYSERR("open(%s): (%d) %s", ack_path, errno, strerror(errno));
+	g_free(ack_path);
+	if (err)
+		return err;
+	struct spool_ack_s ack = {};
+	const gboolean has_ack =
+		pread(sp->fd_ack, &ack, sizeof(ack), 0) == (ssize_t) sizeof(ack);
+
+	/* The segments, in the order they have been written */
+	GDir *dir = g_dir_open(sp->path, 0, &err);
+	if (!dir)
+		return err;
+	GArray *seqv = g_array_new(FALSE, FALSE, sizeof(guint64));
+	for (const gchar *name; (name = g_dir_read_name(dir));) {
+		gchar *end = NULL;
+		guint64 seq = g_ascii_strtoull(name, &end, 16);
+		if (end == name + 16 && !strcmp(end, SEGMENT_SUFFIX))
+			g_array_append_val(seqv, seq);
+	}
+	g_dir_close(dir);
+	g_array_sort(seqv, _cmp_seq);
+
+	for (guint i = 0; !err && i < seqv->len; ++i) {
+		const guint64 seq = g_array_index(seqv, guint64, i);
+		if (has_ack && seq < ack.seq) {
+			/* Acknowledged but not removed yet */
+			gchar *path = _segment_path(sp, seq);
+			unlink(path);
+			g_free(path);
+			continue;
+		}
+		struct spool_segment_s *seg = NULL;
+		err = _segment_map(sp, seq, 0, FALSE, &seg);
+		if (!err)
+			g_ptr_array_add(sp->segments, seg);
+	}
+	g_array_free(seqv, TRUE);
+	if (err)
+		return err;
+
+	if (!sp->segments->len) {
+		struct spool_segment_s *seg = NULL;
+		err = _segment_map(sp, has_ack ? ack.seq : 0,
+				oio_events_spool_segment_size, TRUE, &seg);
+		if (err)
+			return err;
+		g_ptr_array_add(sp->segments, seg);
+	} else if (has_ack && SEG(sp,0)->seq == ack.seq) {
+		sp->ack_offset = MIN(ack.offset, SEG(sp,0)->size);
+	}
+
+	/* Count the records to be replayed, and find the end of the last one */
+	for (guint i = 0; i < sp->segments->len; ++i) {
+		struct spool_segment_s *seg = SEG(sp,i);
+		gsize off = i ? 0 : sp->ack_offset;
+		for (struct spool_record_s *rec; (rec = _record_at(seg, off));) {
+			if (rec->sum != _checksum((guint8*)(rec + 1), rec->size)) {
+				GRID_WARN("Spool %s: corrupted record in segment %"
+						G_GUINT64_FORMAT " at %" G_GSIZE_FORMAT,
+						sp->path, seg->seq, off);
+				break;
+			}
+			sp->stats.backlog ++;
+			sp->stats.backlog_size += RECORD_SIZE(rec->size);
+			off += RECORD_SIZE(rec->size);
+		}
+		/* Cut the garbage left by a torn write */
+		if (off + RECORD_HEADER <= seg->size)
+			memset(seg->base + off, 0, RECORD_HEADER);
+		sp->write_offset = off;
+	}
+
+	sp->read_offset = sp->ack_offset;
+	if (sp->stats.backlog > 0) {
+		GRID_NOTICE("Spool %s: %" G_GUINT64_FORMAT " events to be replayed",
+				sp->path, sp->stats.backlog);
+	}
+	return NULL;
+}
+
+GError *
+oio_events_spool_open(const char *path, struct oio_events_spool_s **out)
+{
+	EXTRA_ASSERT(path != NULL);
+	EXTRA_ASSERT(out != NULL);
+	*out = NULL;
+
+	if (g_mkdir_with_parents(path, 0755) < 0)
+		return SYSERR("mkdir(%s): (%d) %s", path, errno, strerror(errno));
+
+	struct oio_events_spool_s *sp = g_malloc0(sizeof(*sp));
+	g_mutex_init(&sp->lock);
+	sp->path = g_strdup(path);
+	sp->fd_ack = -1;
+	sp->fd_lock = -1;
+	sp->segments = g_ptr_array_new_with_free_func(
+			(GDestroyNotify) _segment_unmap);
+
+	GError *err = _spool_lock(sp);
+	if (!err)
+		err = _spool_load(sp);
+	if (err) {
+		g_prefix_error(&err, "Spool %s: ", path);
+		oio_events_spool_close(sp);
+		return err;
+	}
+
+	*out = sp;
+	return NULL;
+}
+
+void
+oio_events_spool_close(struct oio_events_spool_s *sp)
+{
+	if (!sp)
+		return;
+	g_ptr_array_free(sp->segments, TRUE);
+	if (sp->fd_ack >= 0)
+		close(sp->fd_ack);
+	if (sp->fd_lock >= 0)
+		close(sp->fd_lock);
+	g_free(sp->path);
+	g_mutex_clear(&sp->lock);
+	g_free(sp);
+}
+
+GError *
+oio_events_spool_append(struct oio_events_spool_s *sp,
+		const char *msg, gsize len)
+{
+	EXTRA_ASSERT(sp != NULL);
+	if (!len)
+		return NULL;
+	if (len > G_MAXUINT32 - RECORD_HEADER)
+		return BADREQ("Event too large");
+
+	const gsize need = RECORD_SIZE(len);
+	GError *err = NULL;
+
+	g_mutex_lock(&sp->lock);
+	struct spool_segment_s *seg = SEG(sp, sp->segments->len - 1);
+	if (sp->write_offset + need > seg->size) {
+		struct spool_segment_s *next = NULL;
+		const gsize size = MAX((gsize) oio_events_spool_segment_size, need);
+		err = _segment_map(sp, seg->seq + 1, size, TRUE, &next);
+		if (!err) {
+			g_ptr_array_add(sp->segments, next);
+			seg = next;
+			sp->write_offset = 0;
+		}
+	}
+	if (!err) {
+		struct spool_record_s *rec =
+			(struct spool_record_s*) (seg->base + sp->write_offset);
+		memcpy(rec + 1, msg, len);
+		/* Mark the end of the records, for the next load of the segment */
+		if (sp->write_offset + need + RECORD_HEADER <= seg->size)
+			memset(seg->base + sp->write_offset + need, 0, RECORD_HEADER);
+		rec->sum = _checksum((const guint8*) msg, len);
+		rec->size = len;
+		sp->write_offset += need;
+
+		sp->stats.bytes_in += len;
+		sp->stats.bytes_written += need;
+		sp->stats.backlog ++;
+		sp->stats.backlog_size += need;
+	}
+	g_mutex_unlock(&sp->lock);
+
+	return err;
+}
+
+guint
+oio_events_spool_read(struct oio_events_spool_s *sp, GPtrArray *out, guint max)
+{
+	EXTRA_ASSERT(sp != NULL);
+	EXTRA_ASSERT(out != NULL);
+
+	guint count = 0;
+	g_mutex_lock(&sp->lock);
+	while (count < max) {
+		struct spool_segment_s *seg = SEG(sp, sp->read_index);
+		const gboolean last = sp->read_index + 1 >= sp->segments->len;
+		struct spool_record_s *rec = NULL;
+		if (!last || sp->read_offset < sp->write_offset)
+			rec = _record_at(seg, sp->read_offset);
+		if (!rec) {
+			if (last)
+				break;
+			sp->read_index ++;
+			sp->read_offset = 0;
+			continue;
+		}
+		g_ptr_array_add(out, g_strndup((gchar*)(rec + 1), rec->size));
+		sp->read_offset += RECORD_SIZE(rec->size);
+		sp->read_count ++;
+		sp->read_size += RECORD_SIZE(rec->size);
+		++ count;
+	}
+	g_mutex_unlock(&sp->lock);
+
+	return count;
+}
+
+GError *
+oio_events_spool_ack(struct oio_events_spool_s *sp)
+{
+	EXTRA_ASSERT(sp != NULL);
+
+	GError *err = NULL;
+	g_mutex_lock(&sp->lock);
+	if (sp->read_index > 0 || sp->read_offset != sp->ack_offset) {
+		gchar **paths = g_malloc0((sp->read_index + 1) * sizeof(gchar*));
+		for (guint i = 0; i < sp->read_index; ++i)
+			paths[i] = _segment_path(sp, SEG(sp,i)->seq);
+		g_ptr_array_remove_range(sp->segments, 0, sp->read_index);
+		sp->read_index = 0;
+		sp->ack_offset = sp->read_offset;
+
+		sp->stats.drained += sp->read_count;
+		sp->stats.backlog -= sp->read_count;
+		sp->stats.backlog_size -= sp->read_size;
+		sp->read_count = sp->read_size = 0;
+
+		/* The segments are removed once the acknowledgement is saved, they
+		 * would be removed at the next load anyway. */
+		err = _ack_write(sp);
+		for (gchar **p = paths; *p; ++p) {
+			if (unlink(*p) < 0 && errno != ENOENT)
+				GRID_WARN("unlink(%s): (%d) %s", *p, errno, strerror(errno));
+		}
+		g_strfreev(paths);
+	}
+	g_mutex_unlock(&sp->lock);
+
+	return err;
+}
+
+void
+oio_events_spool_get_stats(struct oio_events_spool_s *sp,
+		struct oio_events_spool_stats_s *out)
+{
+	EXTRA_ASSERT(sp != NULL);
+	EXTRA_ASSERT(out != NULL);
+	g_mutex_lock(&sp->lock);
+	*out = sp->stats;
+	g_mutex_unlock(&sp->lock);
+}
@@ -0,0 +1,62 @@
+/*
+OpenIO SDS event queue
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#ifndef OIO_SDS__events__oio_events_spool_h
+# define OIO_SDS__events__oio_events_spool_h 1
+
+#include <glib.h>
+
+/* An append-only spool of events, stored in a directory as a sequence of
+ * memory-mapped segments. The records are read in the order of their
+ * append, and acknowledged by bulks: an acknowledgement covers all the
+ * records read so far. The segments fully acknowledged are removed.
+ * When the spool is open again, the reading restarts after the last
+ * acknowledgement, so that the records read but not acknowledged are
+ * replayed. */
+struct oio_events_spool_s;
+
+struct oio_events_spool_stats_s
+{
+	guint64 bytes_in;       /* size of the events appended */
+	guint64 bytes_written;  /* bytes written in the segments and the ack */
+	guint64 drained;        /* records acknowledged */
+	guint64 backlog;        /* records not acknowledged yet */
+	guint64 backlog_size;   /* size of the records not acknowledged yet */
+};
+
+GError * oio_events_spool_open(const char *path,
+		struct oio_events_spool_s **out);
+
+void oio_events_spool_close(struct oio_events_spool_s *sp);
+
+/* The event is copied, <msg> remains owned by the caller */
+GError * oio_events_spool_append(struct oio_events_spool_s *sp,
+		const char *msg, gsize len);
+
+/* Append to <out> a copy of at most <max> records not read yet.
+ * Returns the number of records appended. */
+guint oio_events_spool_read(struct oio_events_spool_s *sp,
+		GPtrArray *out, guint max);
+
+/* Acknowledge all the records read so far. */
+GError * oio_events_spool_ack(struct oio_events_spool_s *sp);
+
+void oio_events_spool_get_stats(struct oio_events_spool_s *sp,
+		struct oio_events_spool_stats_s *out);
+
+#endif /*OIO_SDS__events__oio_events_spool_h*/
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta1v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -46,9 +46,12 @@ const char * meta1_backend_basename(struct meta1_backend_s *m1,
 static GError *
 _init_notifiers(struct meta1_backend_s *m1, const char *ns)
 {
-#define INIT(Out,Tube) if (!err) { \
+#define INIT(Out,Name,Tube) if (!err) { \
 	err = oio_events_queue_factory__create(url, (Tube), &(Out)); \
 	g_assert((err != NULL) ^ ((Out) != NULL)); \
+	if (!err && spool) { \
+		err = oio_events_queue__set_spool_named((Out), spool, (Name)); \
+	} \
 	if (!err) { \
 		err = oio_events_queue__start((Out)); \
 	} \
@@ -58,9 +61,17 @@ _init_notifiers(struct meta1_backend_s *m1, const char *ns)
 		return NULL;
 	STRING_STACKIFY(url);
 
+	gchar *spool = NULL;
+	if (oio_events_spool_enabled) {
+		spool = g_build_filename(
+				sqlx_repository_get_basedir(m1->repo), "spool", NULL);
+		STRING_STACKIFY(spool);
+	}
+
 	GError *err = NULL;
-	INIT(m1->notifier_srv, oio_meta1_tube_services);
-	INIT(m1->notifier_ref, oio_meta1_tube_references);
+	/* Both tubes default to the same one */
+	INIT(m1->notifier_srv, "services", oio_meta1_tube_services);
+	INIT(m1->notifier_ref, "references", oio_meta1_tube_references);
 	return err;
 }
 
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta1v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -133,7 +133,7 @@ __create_user(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url)
 	EXTRA_ASSERT(sq3->db != NULL);
 
 	/* Prepare the statement */
-	sqlite3_prepare_debug(rc, sq3->db, sql, -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, sql, -1, &stmt);
 	if (rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -152,7 +152,7 @@ __create_user(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url)
 			}
 		}
 
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 	}
 
 	if (err)
@@ -177,7 +177,7 @@ __info_user(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url, gboolean ac,
 
 retry:
 	/* Prepare the statement */
-	sqlite3_prepare_debug(rc, sq3->db, "SELECT account,user FROM users WHERE cid = ?", -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, "SELECT account,user FROM users WHERE cid = ?", -1, &stmt);
 	if (rc != SQLITE_OK)
 		return M1_SQLITE_GERROR(sq3->db, rc);
 	(void) sqlite3_bind_blob(stmt, 1, oio_url_get_id (url), oio_url_get_id_size (url), NULL);
@@ -201,7 +201,7 @@ retry:
 		g_prefix_error(&err, "DB error: ");
 	}
 
-	sqlite3_finalize_debug(rc,stmt);
+	sqlx_stmt_release_debug(rc,stmt);
 	stmt = NULL;
 
 	if (err) {
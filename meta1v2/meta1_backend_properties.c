@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta1v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -39,8 +39,8 @@ __delete_property(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	EXTRA_ASSERT(name != NULL && *name != '\0');
 	GRID_TRACE("%s(n=%s)", __FUNCTION__, name);
 
-	sqlite3_prepare_debug(rc, sq3->db,
-			"DELETE FROM properties WHERE cid = ? AND name = ?", -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db,
+			"DELETE FROM properties WHERE cid = ? AND name = ?", -1, &stmt);
 	if (rc != SQLITE_OK && rc != SQLITE_DONE)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -49,7 +49,7 @@ __delete_property(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 		sqlite3_step_debug_until_end (rc, stmt);
 		if (rc != SQLITE_DONE && rc != SQLITE_OK)
 			err = M1_SQLITE_GERROR(sq3->db, rc);
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 	}
 
 	return err;
@@ -87,8 +87,8 @@ __replace_property(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	EXTRA_ASSERT(value != NULL && *value != '\0');
 	GRID_TRACE("%s(n=%s,v=%s)", __FUNCTION__, name, value);
 
-	sqlite3_prepare_debug(rc, sq3->db,
-			"REPLACE INTO properties (name,value,cid) VALUES (?,?,?)", -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db,
+			"REPLACE INTO properties (name,value,cid) VALUES (?,?,?)", -1, &stmt);
 	if (rc != SQLITE_OK && rc != SQLITE_DONE)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -98,7 +98,7 @@ __replace_property(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 		sqlite3_step_debug_until_end (rc, stmt);
 		if (rc != SQLITE_DONE && rc != SQLITE_OK)
 			err = M1_SQLITE_GERROR(sq3->db, rc);
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 	}
 
 	return err;
@@ -134,7 +134,7 @@ __get_all_container_properties(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url
 	int rc;
 
 	/* prepare the statement */
-	sqlite3_prepare_debug(rc, sq3->db, "SELECT name,value FROM properties WHERE cid = ?", -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, "SELECT name,value FROM properties WHERE cid = ?", -1, &stmt);
 	if (rc != SQLITE_OK && rc != SQLITE_DONE)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -145,7 +145,7 @@ __get_all_container_properties(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url
 		}
 		if (rc != SQLITE_DONE && rc != SQLITE_OK)
 			err = M1_SQLITE_GERROR(sq3->db, rc);
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 	}
 
 	return err;
@@ -160,9 +160,9 @@ __get_one_property(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url, const gcha
 
 	GRID_TRACE("%s(n=%s)", __FUNCTION__, name);
 
-	sqlite3_prepare_debug(rc, sq3->db,
+	sqlx_stmt_prepare_debug(rc, sq3->db,
 			"SELECT name,value FROM properties WHERE cid = ? AND name = ?",
-			-1, &stmt, NULL);
+			-1, &stmt);
 	if (rc != SQLITE_OK && rc != SQLITE_DONE)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -174,7 +174,7 @@ __get_one_property(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url, const gcha
 		}
 		if (rc != SQLITE_OK && rc != SQLITE_DONE)
 			err = M1_SQLITE_GERROR(sq3->db, rc);
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 	}
 
 	return err;
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta1v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -45,7 +45,7 @@ __count_FK (struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	gchar sql[sizeof(FMT_COUNT)+32];
 	g_snprintf (sql, sizeof(sql), FMT_COUNT, table);
 
-	sqlite3_prepare_debug(rc, sq3->db, sql, -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, sql, -1, &stmt);
 	if (rc != SQLITE_OK)
 		return M1_SQLITE_GERROR(sq3->db, rc);
 
@@ -58,7 +58,7 @@ __count_FK (struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	GError *err = NULL;
 	if (rc != SQLITE_OK && rc != SQLITE_DONE)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
-	sqlite3_finalize_debug(rc, stmt);
+	sqlx_stmt_release_debug(rc, stmt);
 
 	if (err)
 		return err;
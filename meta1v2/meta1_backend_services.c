@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta1v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -177,9 +177,9 @@ __del_container_srvtype_properties(struct sqlx_sqlite3_s *sq3,
 	gint rc;
 	sqlite3_stmt *stmt = NULL;
 
-	sqlite3_prepare_debug(rc, sq3->db,
+	sqlx_stmt_prepare_debug(rc, sq3->db,
 			"DELETE FROM properties WHERE cid = ? AND name LIKE ?",
-			-1, &stmt, NULL);
+			-1, &stmt);
 	if (rc != SQLITE_OK && rc != SQLITE_DONE) {
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	} else {
@@ -193,7 +193,7 @@ __del_container_srvtype_properties(struct sqlx_sqlite3_s *sq3,
 			sqlite3_step_debug_until_end (rc, stmt);
 			if (rc != SQLITE_OK && rc != SQLITE_DONE)
 				err = M1_SQLITE_GERROR(sq3->db, rc);
-			sqlite3_finalize_debug(rc, stmt);
+			sqlx_stmt_release_debug(rc, stmt);
 			g_free (tmp_name);
 		}
 	}
@@ -209,9 +209,9 @@ __del_container_all_services(struct sqlx_sqlite3_s *sq3,
 	GError *err = NULL;
 	int rc;
 
-	sqlite3_prepare_debug(rc, sq3->db,
+	sqlx_stmt_prepare_debug(rc, sq3->db,
 			"DELETE FROM services WHERE cid = ? AND srvtype = ?",
-			-1, &stmt, NULL);
+			-1, &stmt);
 	if (rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -221,7 +221,7 @@ __del_container_all_services(struct sqlx_sqlite3_s *sq3,
 		sqlite3_step_debug_until_end (rc, stmt);
 		if (rc != SQLITE_OK && rc != SQLITE_DONE)
 			err = M1_SQLITE_GERROR(sq3->db, rc);
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 	}
 
 	return err;
@@ -236,7 +236,7 @@ __del_container_one_service(struct sqlx_sqlite3_s *sq3,
 	GError *err = NULL;
 	int rc;
 
-	sqlite3_prepare_debug(rc, sq3->db, sql, -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, sql, -1, &stmt);
 	if (rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -246,7 +246,7 @@ __del_container_one_service(struct sqlx_sqlite3_s *sq3,
 		sqlite3_step_debug_until_end (rc, stmt);
 		if (rc != SQLITE_OK && rc != SQLITE_DONE)
 			err = M1_SQLITE_GERROR(sq3->db, rc);
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 	}
 
 	return err;
@@ -305,7 +305,7 @@ __configure_service(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	GError *err = NULL;
 	sqlite3_stmt *stmt = NULL;
 
-	sqlite3_prepare_debug(rc, sq3->db, sql, -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, sql, -1, &stmt);
 	if (rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 	else {
@@ -316,7 +316,7 @@ __configure_service(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 		sqlite3_step_debug_until_end (rc, stmt);
 		if (rc != SQLITE_OK && rc != SQLITE_DONE)
 			err = M1_SQLITE_GERROR(sq3->db, rc);
-		sqlite3_finalize_debug(rc, stmt);
+		sqlx_stmt_release_debug(rc, stmt);
 		if (!err && !sqlite3_changes(sq3->db))
 			err = NEWERROR(CODE_SRV_NOLINK, "Service not found");
 	}
@@ -334,9 +334,9 @@ __get_all_services(struct sqlx_sqlite3_s *sq3,
 	int rc;
 
 	// Prepare the statement
-	sqlite3_prepare_debug(rc, sq3->db,
+	sqlx_stmt_prepare_debug(rc, sq3->db,
 			"SELECT DISTINCT srvtype,url FROM services order by srvtype,url",
-			-1, &stmt, NULL);
+			-1, &stmt);
 	if (rc != SQLITE_OK)
 		return M1_SQLITE_GERROR(sq3->db, rc);
 
@@ -358,7 +358,7 @@ __get_all_services(struct sqlx_sqlite3_s *sq3,
 	if (rc != SQLITE_DONE && rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
 
-	sqlite3_finalize_debug(rc, stmt);
+	sqlx_stmt_release_debug(rc, stmt);
 
 	if (err) {
 		gpa_str_free(gpa);
@@ -381,16 +381,16 @@ __get_container_all_services(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 
 	/* Prepare the statement */
 	if (srvtype && *srvtype) {
-		sqlite3_prepare_debug(rc, sq3->db,
-				"SELECT seq,srvtype,url,args FROM services WHERE cid = ? AND srvtype = ?", -1, &stmt, NULL);
+		sqlx_stmt_prepare_debug(rc, sq3->db,
+				"SELECT seq,srvtype,url,args FROM services WHERE cid = ? AND srvtype = ?", -1, &stmt);
 		if (rc != SQLITE_OK)
 			return M1_SQLITE_GERROR(sq3->db, rc);
 		(void) sqlite3_bind_blob(stmt, 1, oio_url_get_id(url), oio_url_get_id_size(url), NULL);
 		(void) sqlite3_bind_text(stmt, 2, srvtype, -1, NULL);
 	}
 	else {
-		sqlite3_prepare_debug(rc, sq3->db,
-				"SELECT seq,srvtype,url,args FROM services WHERE cid = ?", -1, &stmt, NULL);
+		sqlx_stmt_prepare_debug(rc, sq3->db,
+				"SELECT seq,srvtype,url,args FROM services WHERE cid = ?", -1, &stmt);
 		if (rc != SQLITE_OK)
 			return M1_SQLITE_GERROR(sq3->db, rc);
 		(void) sqlite3_bind_blob(stmt, 1, oio_url_get_id(url), oio_url_get_id_size(url), NULL);
@@ -411,7 +411,7 @@ __get_container_all_services(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 
 	if (rc != SQLITE_DONE && rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
-	sqlite3_finalize_debug(rc, stmt);
+	sqlx_stmt_release_debug(rc, stmt);
 
 	if (err) {
 		gpa_str_free(gpa);
@@ -431,10 +431,10 @@ __save_service(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	GError *err = NULL;
 	sqlite3_stmt *stmt = NULL;
 
-	sqlite3_prepare_debug(rc, sq3->db, force
+	sqlx_stmt_prepare_debug(rc, sq3->db, force
 			? "INSERT OR REPLACE INTO services (cid,srvtype,seq,url,args) VALUES (?,?,?,?,?)"
 			: "INSERT            INTO services (cid,srvtype,seq,url,args) VALUES (?,?,?,?,?)",
-			-1, &stmt, NULL);
+			-1, &stmt);
 	if (rc != SQLITE_OK)
 		return M1_SQLITE_GERROR(sq3->db, rc);
 
@@ -446,7 +446,7 @@ __save_service(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	sqlite3_step_debug_until_end(rc, stmt);
 	if (rc != SQLITE_DONE && rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
-	sqlite3_finalize_debug(rc, stmt);
+	sqlx_stmt_release_debug(rc, stmt);
 
 	return err;
 }
@@ -459,9 +459,9 @@ __delete_service(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	GError *err = NULL;
 	sqlite3_stmt *stmt = NULL;
 
-	sqlite3_prepare_debug(rc, sq3->db,
+	sqlx_stmt_prepare_debug(rc, sq3->db,
 			"DELETE FROM services WHERE cid = ? AND srvtype = ?",
-			-1, &stmt, NULL);
+			-1, &stmt);
 	if (rc != SQLITE_OK)
 		return M1_SQLITE_GERROR(sq3->db, rc);
 
@@ -470,7 +470,7 @@ __delete_service(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url,
 	sqlite3_step_debug_until_end (rc, stmt);
 	if (rc != SQLITE_DONE && rc != SQLITE_OK)
 		err = M1_SQLITE_GERROR(sq3->db, rc);
-	sqlite3_finalize_debug(rc, stmt);
+	sqlx_stmt_release_debug(rc, stmt);
 
 	return err;
 }
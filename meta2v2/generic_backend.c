@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta2v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -458,7 +458,7 @@ _db_prepare_statement(sqlite3 *db, const gchar *sql, int len, sqlite3_stmt **res
 	gint rc;
 	sqlite3_stmt *stmt = NULL;
 
-	sqlite3_prepare_debug(rc, db, sql, len, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, db, sql, len, &stmt);
 
 	if (rc != SQLITE_OK && rc != SQLITE_ROW)
 		return M2_SQLITE_GERROR(db,rc);
@@ -492,7 +492,7 @@ _db_execute(sqlite3 *db, const gchar *query, int len, GVariant **params)
 		}
 	}
 
-	sqlite3_finalize(stmt);
+	sqlx_stmt_release(stmt);
 	return err;
 }
 
@@ -584,7 +584,7 @@ _db_get_bean(const struct bean_descriptor_s *descr,
 		}
 	}
 
-	sqlite3_finalize(stmt);
+	sqlx_stmt_release(stmt);
 	stmt = NULL;
 	return err;
 }
@@ -629,7 +629,7 @@ _db_count_bean(const struct bean_descriptor_s *descr,
 		}
 	}
 
-	sqlite3_finalize(stmt);
+	sqlx_stmt_release(stmt);
 	stmt = NULL;
 	return err;
 }
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta2v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -50,6 +50,8 @@ enum m2v2_open_type_e
 	M2V2_OPEN_MASTERSLAVE = 0x003,
 
 	M2V2_OPEN_AUTOCREATE  = 0x010,
+	// The base won't be modified, it may be shared with other readers
+	M2V2_OPEN_SHARED      = 0x020,
 
 	// Set an OR'ed combination of the following flags to require
 	// a check on the container's status during the open phase.
@@ -145,9 +147,12 @@ meta2_backend_get_local_addr(struct meta2_backend_s *m2)
 static GError *
 _init_notifiers(struct meta2_backend_s *m2, const char *ns)
 {
-#define INIT(Out,Tube) if (!err) { \
+/* Several notifiers may share the same tube, each one needs its own spool */
+#define INIT(Out,Name,Tube) if (!err) { \
 	err = oio_events_queue_factory__create(url, (Tube), &(Out)); \
 	g_assert((err != NULL) ^ ((Out) != NULL)); \
+	if (!err && spool) \
+		err = oio_events_queue__set_spool_named((Out), spool, (Name)); \
 	if (!err) \
 		err = oio_events_queue__start((Out)); \
 }
@@ -156,20 +161,27 @@ _init_notifiers(struct meta2_backend_s *m2, const char *ns)
 		return NULL;
 	STRING_STACKIFY(url);
 
+	gchar *spool = NULL;
+	if (oio_events_spool_enabled) {
+		spool = g_build_filename(
+				sqlx_repository_get_basedir(m2->repo), "spool", NULL);
+		STRING_STACKIFY(spool);
+	}
+
 	GError *err = NULL;
-	INIT(m2->notifier_container_created, oio_meta2_tube_container_new);
-	INIT(m2->notifier_container_deleted, oio_meta2_tube_container_deleted);
-	INIT(m2->notifier_container_state, oio_meta2_tube_container_state);
-	INIT(m2->notifier_container_updated, oio_meta2_tube_container_updated);
+	INIT(m2->notifier_container_created, "container_created", oio_meta2_tube_container_new);
+	INIT(m2->notifier_container_deleted, "container_deleted", oio_meta2_tube_container_deleted);
+	INIT(m2->notifier_container_state, "container_state", oio_meta2_tube_container_state);
+	INIT(m2->notifier_container_updated, "container_updated", oio_meta2_tube_container_updated);
 
-	INIT(m2->notifier_content_created, oio_meta2_tube_content_created);
-	INIT(m2->notifier_content_appended, oio_meta2_tube_content_appended);
-	INIT(m2->notifier_content_deleted, oio_meta2_tube_content_deleted);
-	INIT(m2->notifier_content_updated, oio_meta2_tube_content_updated);
-	INIT(m2->notifier_content_broken, oio_meta2_tube_content_broken);
-	INIT(m2->notifier_content_drained, oio_meta2_tube_content_drained);
+	INIT(m2->notifier_content_created, "content_created", oio_meta2_tube_content_created);
+	INIT(m2->notifier_content_appended, "content_appended", oio_meta2_tube_content_appended);
+	INIT(m2->notifier_content_deleted, "content_deleted", oio_meta2_tube_content_deleted);
+	INIT(m2->notifier_content_updated, "content_updated", oio_meta2_tube_content_updated);
+	INIT(m2->notifier_content_broken, "content_broken", oio_meta2_tube_content_broken);
+	INIT(m2->notifier_content_drained, "content_drained", oio_meta2_tube_content_drained);
 
-	INIT(m2->notifier_meta2_deleted, oio_meta2_tube_meta2_deleted);
+	INIT(m2->notifier_meta2_deleted, "meta2_deleted", oio_meta2_tube_meta2_deleted);
 
 	return err;
 }
@@ -314,6 +326,8 @@ m2_to_sqlx(enum m2v2_open_type_e t)
 
 	if (t & M2V2_OPEN_AUTOCREATE)
 		result |= SQLX_OPEN_CREATE;
+	if (t & M2V2_OPEN_SHARED)
+		result |= SQLX_OPEN_SHARED;
 
 	if (t & M2V2_OPEN_ENABLED)
 		result |= SQLX_OPEN_ENABLED;
@@ -546,9 +560,9 @@ _check_if_container_empty (struct sqlx_sqlite3_s *sq3)
 	sqlite3_stmt *stmt = NULL;
 	gint64 count = 0;
 
-	int rc = sqlite3_prepare(sq3->db,
+	int rc = sqlx_stmt_prepare(sq3->db,
 			"SELECT exists(SELECT 1 FROM chunks LIMIT 1)",
-			-1, &stmt, NULL);
+			-1, &stmt);
 	while (SQLITE_ROW == (rc = sqlite3_step(stmt)))
 		count = sqlite3_column_int64 (stmt, 0);
 	if (rc != SQLITE_OK && rc != SQLITE_DONE) {
@@ -560,7 +574,7 @@ _check_if_container_empty (struct sqlx_sqlite3_s *sq3)
 					rc, sqlite3_errmsg(sq3->db));
 		}
 	}
-	(void) sqlite3_finalize (stmt);
+	(void) sqlx_stmt_release (stmt);
 
 	if (!err && count > 0)
 		err = NEWERROR(CODE_CONTAINER_NOTEMPTY, "Container not empty");
@@ -1011,7 +1025,7 @@ meta2_backend_list_aliases(struct meta2_backend_s *m2b, struct oio_url_s *url,
 	EXTRA_ASSERT(lp != NULL);
 
 	guint32 open_mode = lp->flag_local ? M2V2_FLAG_LOCAL: 0;
-	err = m2b_open(m2b, url, _mode_readonly(open_mode), &sq3);
+	err = m2b_open(m2b, url, M2V2_OPEN_SHARED|_mode_readonly(open_mode), &sq3);
 	if (!err) {
 		err = m2db_list_aliases(sq3, lp, headers, cb, u0);
 		if (!err && out_properties)
@@ -1033,7 +1047,7 @@ meta2_backend_get_alias(struct meta2_backend_s *m2b,
 	EXTRA_ASSERT(m2b != NULL);
 	EXTRA_ASSERT(url != NULL);
 
-	err = m2b_open(m2b, url, _mode_readonly(flags), &sq3);
+	err = m2b_open(m2b, url, M2V2_OPEN_SHARED|_mode_readonly(flags), &sq3);
 	if (!err) {
 		err = m2db_get_alias(sq3, url, flags, cb, u0);
 		m2b_close(sq3);
@@ -1772,9 +1786,9 @@ meta2_backend_open_callback(struct sqlx_sqlite3_s *sq3,
 	 * - creation : no check
 	 * - local access : no check
 	 * - replicated access : init done */
+	/* On error, the base is closed by the caller */
 	if (!oio_ext_is_admin() && !_create && !_local
 			&& !_is_container_initiated(sq3)) {
-		m2b_close(sq3);
 		return NEWERROR(CODE_CONTAINER_NOTFOUND,
 				"container created but not initiated");
 	}
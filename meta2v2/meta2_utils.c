@@ -648,6 +648,38 @@ check_alias_doesnt_exist2(struct sqlx_sqlite3_s *sq3, struct oio_url_s *url)
 
 /* LIST --------------------------------------------------------------------- */
 
+/* How many aliases share the queries loading their headers and properties.
+ * Each alias takes 2 variables of the properties query, and sqlite allows
+ * at least 999 of them. */
+#define LIST_BATCH 256
+
+/* Returns the smallest string greater than all the strings starting with
+ * <prefix>, or NULL if there is none. The last character is incremented
+ * rather than the last byte, for the bound to remain a valid UTF-8 string:
+ * the UTF-8 encoding preserves the order of the code points. */
+static gchar *
+_prefix_upper_bound(const gchar *prefix)
+{
+	gchar *bound = g_strdup(prefix);
+	for (gchar *end = bound + strlen(bound); end > bound;) {
+		gchar *last = g_utf8_find_prev_char(bound, end);
+		gunichar c = g_utf8_get_char(last);
+		*last = '\0';
+		if (c < 0x10FFFF) {
+			gchar next[8] = {0};
+			g_unichar_to_utf8(c == 0xD7FF ? 0xE000 : c + 1, next);
+			gchar *result = g_strconcat(bound, next, NULL);
+			g_free(bound);
+			return result;
+		}
+		end = last;
+	}
+	/* Only U+10FFFF characters: the strings not lesser than the prefix all
+	 * start with it. */
+	g_free(bound);
+	return NULL;
+}
+
 static GVariant **
 _list_params_to_sql_clause(struct list_params_s *lp, GString *clause,
 		GSList *headers)
@@ -661,10 +693,22 @@ _list_params_to_sql_clause(struct list_params_s *lp, GString *clause,
 		lazy_and();
 		g_string_append_static (clause, " alias > ?");
 		g_ptr_array_add (params, g_variant_new_string (lp->marker_start));
-	} else if (lp->prefix) {
-		lazy_and();
-		g_string_append_static (clause, " alias >= ?");
-		g_ptr_array_add (params, g_variant_new_string (lp->prefix));
+	}
+
+	/* The prefix is a range of the index, no alias out of it is loaded */
+	if (lp->prefix && *lp->prefix) {
+		if (!lp->marker_start || strcmp(lp->marker_start, lp->prefix) < 0) {
+			lazy_and();
+			g_string_append_static (clause, " alias >= ?");
+			g_ptr_array_add (params, g_variant_new_string (lp->prefix));
+		}
+		gchar *bound = _prefix_upper_bound(lp->prefix);
+		if (bound) {
+			lazy_and();
+			g_string_append_static (clause, " alias < ?");
+			g_ptr_array_add (params, g_variant_new_string (bound));
+			g_free (bound);
+		}
 	}
 
 	if (lp->marker_end) {
@@ -704,26 +748,142 @@ _list_params_to_sql_clause(struct list_params_s *lp, GString *clause,
 	return (GVariant**) g_ptr_array_free (params, FALSE);
 }
 
+static gint
+_header_cmp(gconstpointer p0, gconstpointer p1)
+{
+	return metautils_gba_cmp(
+			CONTENTS_HEADERS_get_id(*(struct bean_CONTENTS_HEADERS_s**)p0),
+			CONTENTS_HEADERS_get_id(*(struct bean_CONTENTS_HEADERS_s**)p1));
+}
+
+static struct bean_CONTENTS_HEADERS_s *
+_header_find(GPtrArray *sorted, GByteArray *id)
+{
+	guint lo = 0, hi = sorted->len;
+	while (lo < hi) {
+		const guint mid = lo + (hi - lo) / 2;
+		int rc = metautils_gba_cmp(id,
+				CONTENTS_HEADERS_get_id(sorted->pdata[mid]));
+		if (!rc)
+			return sorted->pdata[mid];
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+/* Loads the headers of all the <aliases> with a single query, sorted by ID */
+static GError *
+_load_headers_batch(sqlite3 *db, GPtrArray *aliases, GPtrArray *out)
+{
+	GString *clause = g_string_sized_new(16 + 2 * aliases->len);
+	GPtrArray *params = g_ptr_array_sized_new(aliases->len + 1);
+	g_string_append_static(clause, "id IN (");
+	for (guint i = 0; i < aliases->len; i++) {
+		if (i)
+			g_string_append_c(clause, ',');
+		g_string_append_c(clause, '?');
+		g_ptr_array_add(params,
+				_gba_to_gvariant(ALIASES_get_content(aliases->pdata[i])));
+	}
+	g_string_append_c(clause, ')');
+	g_ptr_array_add(params, NULL);
+
+	GError *err = CONTENTS_HEADERS_load(db, clause->str,
+			(GVariant**)params->pdata, _bean_buffer_cb, out);
+	metautils_gvariant_unrefv((GVariant**)params->pdata);
+	g_ptr_array_free(params, TRUE);
+	g_string_free(clause, TRUE);
+
+	g_ptr_array_sort(out, _header_cmp);
+	return err;
+}
+
+/* Loads the properties of all the <aliases> with a single query, in the
+ * order of the aliases (by name then by decreasing version) */
+static GError *
+_load_properties_batch(sqlite3 *db, GPtrArray *aliases, GPtrArray *out)
+{
+	GString *clause = g_string_sized_new(64 + 32 * aliases->len);
+	GPtrArray *params = g_ptr_array_sized_new(2 * aliases->len + 1);
+	for (guint i = 0; i < aliases->len; i++) {
+		struct bean_ALIASES_s *alias = aliases->pdata[i];
+		if (i)
+			g_string_append_static(clause, " OR ");
+		g_string_append_static(clause, "(alias = ? AND version = ?)");
+		g_ptr_array_add(params,
+				g_variant_new_string(ALIASES_get_alias(alias)->str));
+		g_ptr_array_add(params,
+				g_variant_new_int64(ALIASES_get_version(alias)));
+	}
+	g_string_append_static(clause, " ORDER BY alias ASC, version DESC");
+	g_ptr_array_add(params, NULL);
+
+	GError *err = PROPERTIES_load(db, clause->str,
+			(GVariant**)params->pdata, _bean_buffer_cb, out);
+	metautils_gvariant_unrefv((GVariant**)params->pdata);
+	g_ptr_array_free(params, TRUE);
+	g_string_free(clause, TRUE);
+	return err;
+}
+
+/* Sends the <aliases> (sorted by name then by decreasing version), each
+ * preceded by its header and its properties if requested. The aliases are
+ * sent whatever, as if they had no header and no property, if these cannot
+ * be loaded. */
 static void
-_load_fk_by_name(struct sqlx_sqlite3_s *sq3, struct bean_ALIASES_s *alias,
-		const gchar *fk_name, m2_onbean_cb cb, gpointer udata)
+_send_aliases_batch(struct sqlx_sqlite3_s *sq3, struct list_params_s *lp,
+		GPtrArray *aliases, m2_onbean_cb cb, gpointer u)
 {
-	EXTRA_ASSERT(sq3 != NULL);
-	EXTRA_ASSERT(alias != NULL);
-	EXTRA_ASSERT(fk_name != NULL);
-	EXTRA_ASSERT(cb != NULL);
+	GPtrArray *headers = g_ptr_array_new_with_free_func(_bean_clean);
+	GPtrArray *props = g_ptr_array_new_with_free_func(_bean_clean);
+	GError *err = NULL;
 
-	GPtrArray *t0 = g_ptr_array_new();
-	GError *err = _db_get_FK_by_name_buffered(alias, fk_name, sq3->db, t0);
-	if (err) {
-		GRID_WARN("Failed to load FK '%s' for alias [%s]: (%d) %s", fk_name,
-				ALIASES_get_alias(alias)->str, err->code, err->message);
-		g_clear_error(&err);
-	} else {
-		for (guint i = 0; i < t0->len; i++)
-			cb(udata, t0->pdata[i]);
+	if (lp->flag_headers && aliases->len > 0) {
+		if ((err = _load_headers_batch(sq3->db, aliases, headers))) {
+			GRID_WARN("Failed to load the headers of %u aliases: (%d) %s",
+					aliases->len, err->code, err->message);
+			g_clear_error(&err);
+			g_ptr_array_set_size(headers, 0);
+		}
+	}
+	if (lp->flag_properties && aliases->len > 0) {
+		if ((err = _load_properties_batch(sq3->db, aliases, props))) {
+			GRID_WARN("Failed to load the properties of %u aliases: (%d) %s",
+					aliases->len, err->code, err->message);
+			g_clear_error(&err);
+			g_ptr_array_set_size(props, 0);
+		}
+	}
+
+	guint iprop = 0;
+	for (guint i = 0; i < aliases->len; i++) {
+		struct bean_ALIASES_s *alias = aliases->pdata[i];
+		if (headers->len > 0) {
+			struct bean_CONTENTS_HEADERS_s *header =
+				_header_find(headers, ALIASES_get_content(alias));
+			/* Several versions may share a header */
+			if (header)
+				cb(u, _bean_dup(header));
+		}
+		/* The properties come in the order of the aliases */
+		for (; iprop < props->len; iprop++) {
+			struct bean_PROPERTIES_s *prop = props->pdata[iprop];
+			if (PROPERTIES_get_version(prop) != ALIASES_get_version(alias)
+					|| strcmp(PROPERTIES_get_alias(prop)->str,
+						ALIASES_get_alias(alias)->str))
+				break;
+			cb(u, prop);
+			props->pdata[iprop] = NULL;
+		}
+		cb(u, alias);
 	}
-	g_ptr_array_free(t0, TRUE);
+
+	g_ptr_array_set_size(aliases, 0);
+	g_ptr_array_free(headers, TRUE);
+	g_ptr_array_free(props, TRUE);
 }
 
 GError*
@@ -737,13 +897,13 @@ m2db_list_aliases(struct sqlx_sqlite3_s *sq3, struct list_params_s *lp0,
 	struct list_params_s lp = *lp0;
 	gboolean done = FALSE;
 	GPtrArray *cur_aliases = NULL;
+	// The aliases to be sent, with their headers and properties
+	GPtrArray *batch = g_ptr_array_sized_new(LIST_BATCH);
 
 	void _load_header_and_send(struct bean_ALIASES_s *alias) {
-		if (lp.flag_headers)
-			_load_fk_by_name(sq3, alias, "image", cb, u);
-		if (lp.flag_properties)
-			_load_fk_by_name(sq3, alias, "properties", cb, u);
-		cb(u, alias);
+		g_ptr_array_add(batch, alias);
+		if (batch->len >= LIST_BATCH)
+			_send_aliases_batch(sq3, &lp, batch, cb, u);
 	}
 	void cleanup (void) {
 		if (cur_aliases) {
@@ -785,9 +945,6 @@ m2db_list_aliases(struct sqlx_sqlite3_s *sq3, struct list_params_s *lp0,
 			struct bean_ALIASES_s *alias = cur_aliases->pdata[i-1];
 			const gchar *name = ALIASES_get_alias(alias)->str;
 
-			if (lp.prefix && !g_str_has_prefix(name, lp.prefix))
-				goto label_end;
-
 			g_ptr_array_remove_index_fast(cur_aliases, i-1);
 
 			if (lp.flag_allversion) {
@@ -820,6 +977,12 @@ m2db_list_aliases(struct sqlx_sqlite3_s *sq3, struct list_params_s *lp0,
 
 label_end:
 	cleanup();
+	if (err) {
+		g_ptr_array_set_free_func(batch, _bean_clean);
+	} else {
+		_send_aliases_batch(sq3, &lp, batch, cb, u);
+	}
+	g_ptr_array_free(batch, TRUE);
 	g_free(last_alias_name);
 	return err;
 }
@@ -2787,9 +2950,7 @@ _purge_exceeding_aliases(struct sqlx_sqlite3_s *sq3, gint64 max_versions,
 	if (!VERSIONS_ENABLED(max_versions))
 		max_versions = 1;
 
-	sqlite3_prepare_debug(rc, sq3->db, sql_lookup, -1, &stmt, NULL);
-	sqlite3_clear_bindings(stmt);
-	sqlite3_reset(stmt);
+	sqlx_stmt_prepare_debug(rc, sq3->db, sql_lookup, -1, &stmt);
 	if (alias) {
 		sqlite3_bind_text(stmt, 1, alias, -1, NULL);
 		sqlite3_bind_int64(stmt, 2, max_versions);
@@ -2802,7 +2963,7 @@ _purge_exceeding_aliases(struct sqlx_sqlite3_s *sq3, gint64 max_versions,
 		elt->count = sqlite3_column_int64(stmt, 1);
 		to_be_deleted = g_slist_prepend(to_be_deleted, elt);
 	}
-	(void) sqlite3_finalize(stmt);
+	(void) sqlx_stmt_release(stmt);
 
 	GRID_DEBUG("Nb alias to drop: %d", g_slist_length(to_be_deleted));
 
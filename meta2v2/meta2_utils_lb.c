@@ -1,7 +1,7 @@
 /*
 OpenIO SDS meta2v2
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -336,8 +336,33 @@ _m2_generate_chunks(struct gen_ctx_s *ctx,
 
 	_m2_generate_alias_header(ctx);
 
-	guint pos = 0;
+	const char *pool = storage_policy_get_service_pool(ctx->pol);
 	gint64 esize = MAX(ctx->size, 1);
+
+	if (!ctx->pin || !ctx->mode) {
+		/* All the metachunks at once, on the same view of the services */
+		const guint count = (esize + mcs - 1) / mcs;
+		guint last = 0;
+		int i = 0;
+		void _on_set_id(guint set, struct oio_lb_selected_item_s *sel)
+		{
+			if (set != last) {
+				last = set;
+				i = 0;
+			}
+			_gen_chunk(ctx, sel, ctx->chunk_size, set, subpos? i : -1);
+			i++;
+		}
+		err = oio_lb__poll_pool_many(ctx->lb, pool, count, NULL,
+				_on_set_id, NULL);
+		if (err != NULL) {
+			g_prefix_error(&err, "did not find enough services "
+					"matching the criteria for pool [%s]: ", pool);
+		}
+		return err;
+	}
+
+	guint pos = 0;
 	for (gint64 s = 0; s < esize && !err; s += mcs, ++pos) {
 		int i = 0;
 		void _on_id(struct oio_lb_selected_item_s *sel, gpointer u UNUSED)
@@ -345,7 +370,6 @@ _m2_generate_chunks(struct gen_ctx_s *ctx,
 			_gen_chunk(ctx, sel, ctx->chunk_size, pos, subpos? i : -1);
 			i++;
 		}
-		const char *pool = storage_policy_get_service_pool(ctx->pol);
 		// FIXME(FVE): set last argument
 
 		err = oio_lb__poll_pool_around(ctx->lb, pool,
@@ -0,0 +1,231 @@
+/*
+OpenIO SDS metautils
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <glib.h>
+
+#include <metautils/lib/metautils.h>
+
+struct idle_cnx_s
+{
+	struct gridd_client_s *client;
+	gint64 last_use;
+};
+
+static GMutex lock_idle_cnx;
+static GHashTable *idle_cnx = NULL;  /* <gchar*> -> <GQueue*> of <struct idle_cnx_s*> */
+
+static void
+_idle_cnx_free(struct idle_cnx_s *ic)
+{
+	if (!ic)
+		return;
+	gridd_client_free(ic->client);
+	g_free(ic);
+}
+
+static void
+_idle_cnx_queue_free(GQueue *q)
+{
+	g_queue_free_full(q, (GDestroyNotify)_idle_cnx_free);
+}
+
+struct gridd_client_s *
+cnx_pool_take(const gchar *url, const gint64 oldest)
+{
+	GSList *expired = NULL;
+	struct gridd_client_s *client = NULL;
+
+	g_mutex_lock(&lock_idle_cnx);
+	GQueue *q = idle_cnx ? g_hash_table_lookup(idle_cnx, url) : NULL;
+	while (q && !client && !g_queue_is_empty(q)) {
+		struct idle_cnx_s *ic = g_queue_pop_head(q);
+		if (ic->last_use < oldest) {
+			expired = g_slist_prepend(expired, ic);
+		} else {
+			client = ic->client;
+			g_free(ic);
+		}
+	}
+	g_mutex_unlock(&lock_idle_cnx);
+
+	/* Close the old connections out of the critical section */
+	g_slist_free_full(expired, (GDestroyNotify)_idle_cnx_free);
+	return client;
+}
+
+void
+cnx_pool_give(struct gridd_client_s *client, const gint64 now, const guint max)
+{
+	if (max > 0 && gridd_client_reusable(client)) {
+		const gchar *url = gridd_client_url(client);
+		g_mutex_lock(&lock_idle_cnx);
+		if (!idle_cnx)
+			idle_cnx = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, (GDestroyNotify)_idle_cnx_queue_free);
+		GQueue *q = g_hash_table_lookup(idle_cnx, url);
+		if (!q) {
+			q = g_queue_new();
+			g_hash_table_insert(idle_cnx, g_strdup(url), q);
+		}
+		if (q->length < max) {
+			struct idle_cnx_s *ic = g_malloc0(sizeof(*ic));
+			ic->client = client;
+			ic->last_use = now;
+			g_queue_push_head(q, ic);
+			client = NULL;
+		}
+		g_mutex_unlock(&lock_idle_cnx);
+	}
+
+	if (client)
+		gridd_client_free(client);
+}
+
+void
+cnx_pool_forget(const gchar *url)
+{
+	GQueue *q = NULL;
+	g_mutex_lock(&lock_idle_cnx);
+	if (idle_cnx && g_hash_table_lookup_extended(
+				idle_cnx, url, NULL, (gpointer*)&q))
+		g_hash_table_steal(idle_cnx, url);
+	g_mutex_unlock(&lock_idle_cnx);
+	if (q)
+		_idle_cnx_queue_free(q);
+}
+
+guint
+cnx_pool_expire(const gint64 oldest)
+{
+	GSList *expired = NULL;
+	guint count = 0;
+
+	g_mutex_lock(&lock_idle_cnx);
+	if (idle_cnx) {
+		GHashTableIter iter;
+		gpointer k, v;
+		g_hash_table_iter_init(&iter, idle_cnx);
+		while (g_hash_table_iter_next(&iter, &k, &v)) {
+			GQueue *q = v;
+			/* The most recently used connections are at the head */
+			struct idle_cnx_s *ic;
+			while ((ic = g_queue_peek_tail(q)) && ic->last_use < oldest) {
+				expired = g_slist_prepend(expired, g_queue_pop_tail(q));
+				++ count;
+			}
+			if (g_queue_is_empty(q))
+				g_hash_table_iter_remove(&iter);
+		}
+	}
+	g_mutex_unlock(&lock_idle_cnx);
+
+	g_slist_free_full(expired, (GDestroyNotify)_idle_cnx_free);
+	return count;
+}
+
+void
+cnx_pool_count(guint *peers, guint *idle)
+{
+	guint p = 0, i = 0;
+	g_mutex_lock(&lock_idle_cnx);
+	if (idle_cnx) {
+		GHashTableIter iter;
+		gpointer k, v;
+		g_hash_table_iter_init(&iter, idle_cnx);
+		while (g_hash_table_iter_next(&iter, &k, &v)) {
+			++ p;
+			i += ((GQueue*)v)->length;
+		}
+	}
+	g_mutex_unlock(&lock_idle_cnx);
+	*peers = p;
+	*idle = i;
+}
+
+/* Returns a client with a new connection to `url`, to be established */
+static struct gridd_client_s *
+_cnx_create(const gchar *url, GError **err)
+{
+	struct gridd_client_s *client = gridd_client_create_empty();
+	if (!client) {
+		*err = SYSERR("Memory allocation error");
+		return NULL;
+	}
+	if ((*err = gridd_client_connect_url(client, url))) {
+		GRID_WARN("Invalid peer [%s]", url);
+		(*err)->code = ERRCODE_CONN_NOROUTE;
+		gridd_client_free(client);
+		return NULL;
+	}
+	gridd_client_set_keepalive(client, TRUE);
+	return client;
+}
+
+static GError *
+_cnx_run(struct gridd_client_s *client, GByteArray *req,
+		gpointer ctx, client_on_reply cb, gboolean no_redirect,
+		gdouble timeout, gint64 deadline)
+{
+	GError *err = gridd_client_request(client, req, ctx, cb);
+	if (err)
+		return err;
+	if (no_redirect)
+		gridd_client_no_redirect(client);
+	gridd_client_start(client);
+	gridd_client_set_timeout(client, oio_clamp_timeout(timeout, deadline));
+	if (!(err = gridd_client_loop(client)))
+		err = gridd_client_error(client);
+	return err;
+}
+
+GError *
+cnx_pool_request(const gchar *url, GByteArray *req,
+		gpointer ctx, client_on_reply cb, gboolean no_redirect,
+		gdouble timeout, gint64 deadline, gint64 oldest,
+		struct gridd_client_s **pclient, struct cnx_pool_stats_s *stats)
+{
+	GError *err = NULL;
+	*pclient = NULL;
+
+	struct gridd_client_s *client = cnx_pool_take(url, oldest);
+	if (client) {
+		++ stats->reused;
+		err = _cnx_run(client, req, ctx, cb, no_redirect, timeout, deadline);
+		/* The service closed the idle connection before it read the
+		 * request, that tells nothing about its health. Nothing has been
+		 * replied, so nothing has been handled by `cb`. */
+		if (!err || !gridd_client_stale(client)) {
+			*pclient = client;
+			return err;
+		}
+		GRID_DEBUG("Stale connection to [%s]: (%d) %s",
+				url, err->code, err->message);
+		++ stats->stale;
+		g_clear_error(&err);
+		gridd_client_free(client);
+	}
+
+	/* A fresh connection, never another idle one that could be as stale */
+	if (!(client = _cnx_create(url, &err)))
+		return err;
+	err = _cnx_run(client, req, ctx, cb, no_redirect, timeout, deadline);
+	if (gridd_client_connected(client))
+		++ stats->created;
+	*pclient = client;
+	return err;
+}
@@ -0,0 +1,65 @@
+/*
+OpenIO SDS metautils
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#ifndef OIO_SDS__metautils__lib__cnx_pool_h
+# define OIO_SDS__metautils__lib__cnx_pool_h 1
+
+# include "metautils.h"
+# include "gridd_client.h"
+
+/* Idle keep-alive connections to the services, per "IP:PORT". The most
+ * recently used connections are reused first. */
+
+struct cnx_pool_stats_s
+{
+	guint reused;  /* requests sent on an idle connection */
+	guint created;  /* connections established */
+	guint stale;  /* idle connections found closed by the service */
+};
+
+/* Returns a client with an open connection to `url`, used for the last time
+ * after `oldest`, or NULL. The older connections met are closed. */
+struct gridd_client_s * cnx_pool_take (const gchar *url, gint64 oldest);
+
+/* Parks `client` for the next request to the same service, if its connection
+ * is still usable and less than `max` connections to the service are idle.
+ * Otherwise closes it. */
+void cnx_pool_give (struct gridd_client_s *client, gint64 now, guint max);
+
+/* Closes all the idle connections to `url` */
+void cnx_pool_forget (const gchar *url);
+
+/* Closes the connections used for the last time before `oldest` */
+guint cnx_pool_expire (gint64 oldest);
+
+/* Counts the services with idle connections, and those connections */
+void cnx_pool_count (guint *peers, guint *idle);
+
+/* Sends `req` to `url` and waits for the final reply, on an idle connection
+ * used after `oldest` if any, on a new one otherwise. The service may have
+ * closed the idle connection just before: if it did it before it replied
+ * anything, the request is sent once again on a new connection. Neither a
+ * timeout nor a partial reply lead to a retry.
+ * `*pclient` is set to the client used (possibly with an error), that the
+ * caller gives back with cnx_pool_give(). */
+GError * cnx_pool_request (const gchar *url, GByteArray *req,
+		gpointer ctx, client_on_reply cb, gboolean no_redirect,
+		gdouble timeout, gint64 deadline, gint64 oldest,
+		struct gridd_client_s **pclient, struct cnx_pool_stats_s *stats);
+
+#endif /*OIO_SDS__metautils__lib__cnx_pool_h*/
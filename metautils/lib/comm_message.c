@@ -25,9 +25,44 @@ License along with this library.
 
 #include "metautils.h"
 #include "codec.h"
+#include "common_variables.h"
 
 enum message_param_e { MP_ID, MP_NAME, MP_VERSION, MP_BODY };
 
+/* The compact binary framing. After the 4-byte size common to both framings:
+ *   [1] WIRE_MAGIC, where a BER Message starts with 0x30 (a SEQUENCE)
+ *   [1] the presence of the id, the name, the version and the body (bits 0-3)
+ *   [2] the number of fields
+ *   for each of the id, name, version, body present: [4] size, bytes
+ *   for each field: [2] name size, [4] value size, name, value
+ * The integers are big-endian. A decoded message points into the frame,
+ * see struct wire_arena_s. */
+#define WIRE_MAGIC 0xB1
+#define WIRE_HEADER 4
+
+/* Marks the messages decoded from the binary framing, in the phase of their
+ * decoding context, that asn1c only uses while decoding BER. */
+#define WIRE_BORROWED 0x7B1
+
+/* One allocation holding the structures of a decoded message. Their buffers
+ * point into the frame, that follows them when it had to be copied. */
+struct wire_arena_s
+{
+	OCTET_STRING_t strings[4];
+	Parameter_t params[];
+};
+
+/* Tells if `p` is a structure of the arena of `m`, whose buffer belongs to
+ * the frame and must not be freed. */
+static gboolean
+_wire_borrowed(MESSAGE m, const void *p)
+{
+	if (m->_asn_ctx.phase != WIRE_BORROWED)
+		return FALSE;
+	const guint8 *a = m->_asn_ctx.ptr;
+	return (const guint8*)p >= a && (const guint8*)p < a + m->_asn_ctx.left;
+}
+
 static void
 _free_Parameter(Parameter_t * p)
 {
@@ -93,17 +128,26 @@ metautils_message_destroy(MESSAGE m)
 	if (!m)
 		return ;
 
-	if (m->id != NULL)
+	if (m->id != NULL && !_wire_borrowed(m, m->id))
 		ASN_STRUCT_FREE(asn_DEF_OCTET_STRING, m->id);
-	if (m->body != NULL)
+	if (m->body != NULL && !_wire_borrowed(m, m->body))
 		ASN_STRUCT_FREE(asn_DEF_OCTET_STRING, m->body);
-	if (m->version != NULL)
+	if (m->version != NULL && !_wire_borrowed(m, m->version))
 		ASN_STRUCT_FREE(asn_DEF_OCTET_STRING, m->version);
-	if (m->name != NULL)
+	if (m->name != NULL && !_wire_borrowed(m, m->name))
 		ASN_STRUCT_FREE(asn_DEF_OCTET_STRING, m->name);
 
-	m->content.list.free = _free_Parameter;
+	for (int i = 0; i < m->content.list.count; i++) {
+		Parameter_t *p = m->content.list.array[i];
+		if (!_wire_borrowed(m, p))
+			_free_Parameter(p);
+	}
+	m->content.list.count = 0;
+	m->content.list.free = NULL;
 	asn_set_empty(&(m->content.list));
+
+	if (m->_asn_ctx.phase == WIRE_BORROWED)
+		g_free(m->_asn_ctx.ptr);
 	ASN1C_FREE(m);
 }
 
@@ -115,17 +159,19 @@ metautils_asn1c_write_gba (const void *b, gsize bSize, void *key)
 	return 0;
 }
 
-GByteArray*
-message_marshall_gba(MESSAGE m, GError **err)
+static gboolean
+_is_reply(MESSAGE m)
 {
-	asn_enc_rval_t encRet;
-
-	/*sanity check */
-	if (!m) {
-		GSETERROR(err, "Invalid parameter");
-		return NULL;
-	}
+	gsize len = 0;
+	void *name = metautils_message_get_NAME(m, &len);
+	return name && len == sizeof(NAME_MSGNAME_METAREPLY) - 1
+		&& !memcmp(name, NAME_MSGNAME_METAREPLY, len);
+}
 
+/* Add the fields carrying the context of the current thread */
+static void
+_prepare_for_send(MESSAGE m)
+{
 	/*set an ID if it is not present */
 	if (!metautils_message_has_ID(m)) {
 		const char *reqid = oio_ext_get_reqid ();
@@ -151,6 +197,24 @@ message_marshall_gba(MESSAGE m, GError **err)
 	if (user_agent != NULL)
 		metautils_message_add_field_str(
 			m, NAME_MSGKEY_USER_AGENT, user_agent);
+}
+
+GByteArray*
+message_marshall_gba(MESSAGE m, GError **err)
+{
+	asn_enc_rval_t encRet;
+
+	/*sanity check */
+	if (!m) {
+		GSETERROR(err, "Invalid parameter");
+		return NULL;
+	}
+
+	_prepare_for_send(m);
+
+	/* Tell the service it may reply in the binary framing */
+	if (oio_wire_binary && !_is_reply(m))
+		metautils_message_add_field_strint(m, NAME_MSGKEY_WIRE, 1);
 
 	/*try to encode */
 	guint32 u32 = 0;
@@ -169,6 +233,106 @@ message_marshall_gba(MESSAGE m, GError **err)
 	return result;
 }
 
+static inline guint8 *
+_put_be16(guint8 *p, guint16 v)
+{
+	*(p++) = v >> 8;
+	*(p++) = v;
+	return p;
+}
+
+static inline guint8 *
+_put_be32(guint8 *p, guint32 v)
+{
+	v = g_htonl(v);
+	memcpy(p, &v, 4);
+	return p + 4;
+}
+
+static inline guint32
+_get_be32(const guint8 *p)
+{
+	guint32 v;
+	memcpy(&v, p, 4);
+	return g_ntohl(v);
+}
+
+GByteArray*
+message_marshall_binary(MESSAGE m, GError **err)
+{
+	if (!m) {
+		GSETERROR(err, "Invalid parameter");
+		return NULL;
+	}
+
+	_prepare_for_send(m);
+
+	const int count = m->content.list.count;
+	if (count > G_MAXUINT16) {
+		GSETERROR(err, "Encoding error (too many fields)");
+		return NULL;
+	}
+
+	/* Compute the size first, for a single allocation */
+	OCTET_STRING_t *strings[4] = {m->id, m->name, m->version, m->body};
+	guint8 present = 0;
+	gsize total = 4 + WIRE_HEADER;
+	for (int i = 0; i < 4; i++) {
+		if (strings[i] && strings[i]->buf) {
+			present |= 1 << i;
+			total += 4 + strings[i]->size;
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		Parameter_t *p = m->content.list.array[i];
+		if (p->name.size > G_MAXUINT16) {
+			GSETERROR(err, "Encoding error (field name too long)");
+			return NULL;
+		}
+		total += 6 + p->name.size + p->value.size;
+	}
+	if (total - 4 > G_MAXUINT32) {
+		GSETERROR(err, "Encoding error (message too large)");
+		return NULL;
+	}
+
+	GByteArray *result = g_byte_array_sized_new(total);
+	g_byte_array_set_size(result, total);
+	guint8 *w = _put_be32(result->data, total - 4);
+	*(w++) = WIRE_MAGIC;
+	*(w++) = present;
+	w = _put_be16(w, count);
+	for (int i = 0; i < 4; i++) {
+		if (!(present & (1 << i)))
+			continue;
+		w = _put_be32(w, strings[i]->size);
+		memcpy(w, strings[i]->buf, strings[i]->size);
+		w += strings[i]->size;
+	}
+	for (int i = 0; i < count; i++) {
+		Parameter_t *p = m->content.list.array[i];
+		w = _put_be16(w, p->name.size);
+		w = _put_be32(w, p->value.size);
+		memcpy(w, p->name.buf, p->name.size);
+		w += p->name.size;
+		memcpy(w, p->value.buf, p->value.size);
+		w += p->value.size;
+	}
+	EXTRA_ASSERT(w == result->data + total);
+	return result;
+}
+
+GByteArray*
+message_marshall_binary_and_clean(MESSAGE m)
+{
+	EXTRA_ASSERT(m != NULL);
+	GByteArray *result = message_marshall_binary(m, NULL);
+	if (!result)
+		result = message_marshall_gba(m, NULL);
+	metautils_message_destroy(m);
+	return result;
+}
+
 GByteArray*
 message_marshall_gba_and_clean(MESSAGE m)
 {
@@ -180,8 +344,99 @@ message_marshall_gba_and_clean(MESSAGE m)
 	return result;
 }
 
-MESSAGE
-message_unmarshall(const guint8 *buf, gsize len, GError ** error)
+gboolean
+message_is_binary(const guint8 *buf, gsize len)
+{
+	return buf && len > 4 && buf[4] == WIRE_MAGIC;
+}
+
+/* Decodes the `len` bytes of the binary frame at `buf`, after its size.
+ * When `copy` is set, the frame is copied after the arena, otherwise the
+ * message points into `buf`. */
+static MESSAGE
+_wire_decode(const guint8 *buf, gsize len, gboolean copy, GError **error)
+{
+	if (len < WIRE_HEADER || buf[0] != WIRE_MAGIC) {
+		GSETERROR(error, "invalid binary header");
+		return NULL;
+	}
+	const guint8 present = buf[1];
+	const guint count = (buf[2] << 8) | buf[3];
+
+	/* Each field takes at least 6 bytes */
+	if (count > (len - WIRE_HEADER) / 6) {
+		GSETERROR(error, "invalid binary header (%u fields)", count);
+		return NULL;
+	}
+
+	const gsize arena_size = sizeof(struct wire_arena_s)
+		+ count * sizeof(Parameter_t);
+	struct wire_arena_s *arena = g_malloc0(arena_size + (copy ? len : 0));
+	if (copy) {
+		memcpy(((guint8*)arena) + arena_size, buf, len);
+		buf = ((guint8*)arena) + arena_size;
+	}
+
+	MESSAGE m = ASN1C_CALLOC(1, sizeof(Message_t));
+	m->_asn_ctx.phase = WIRE_BORROWED;
+	m->_asn_ctx.ptr = arena;
+	m->_asn_ctx.left = arena_size;
+	if (count > 0) {
+		m->content.list.array = ASN1C_CALLOC(count, sizeof(void*));
+		m->content.list.size = count;
+	}
+
+	const guint8 *r = buf + WIRE_HEADER, *end = buf + len;
+	OCTET_STRING_t **slots[4] = {&m->id, &m->name, &m->version, &m->body};
+	for (int i = 0; i < 4; i++) {
+		if (!(present & (1 << i)))
+			continue;
+		if (end - r < 4)
+			goto label_truncated;
+		const guint32 size = _get_be32(r);
+		r += 4;
+		if ((gsize)(end - r) < size)
+			goto label_truncated;
+		arena->strings[i].buf = (uint8_t*) r;
+		arena->strings[i].size = size;
+		*(slots[i]) = arena->strings + i;
+		r += size;
+	}
+
+	for (guint i = 0; i < count; i++) {
+		if (end - r < 6)
+			goto label_truncated;
+		const guint16 nsize = (r[0] << 8) | r[1];
+		const guint32 vsize = _get_be32(r + 2);
+		r += 6;
+		if ((gsize)(end - r) < nsize || (gsize)(end - r - nsize) < vsize)
+			goto label_truncated;
+		Parameter_t *p = arena->params + i;
+		p->name.buf = (uint8_t*) r;
+		p->name.size = nsize;
+		p->value.buf = (uint8_t*) (r + nsize);
+		p->value.size = vsize;
+		m->content.list.array[m->content.list.count++] = p;
+		r += nsize + vsize;
+	}
+
+	if (r != end) {
+		GSETERROR(error, "invalid content (%"G_GSIZE_FORMAT" trailing bytes)",
+				(gsize)(end - r));
+		metautils_message_destroy(m);
+		return NULL;
+	}
+	return m;
+
+label_truncated:
+	GSETERROR(error, "%s (%"G_GSIZE_FORMAT" bytes consumed)",
+			"uncomplete content", (gsize)(r - buf));
+	metautils_message_destroy(m);
+	return NULL;
+}
+
+static MESSAGE
+_unmarshall(const guint8 *buf, gsize len, gboolean copy, GError ** error)
 {
 	if (!buf || len < 4) {
 		GSETERROR(error, "Invalid parameter");
@@ -196,6 +451,9 @@ message_unmarshall(const guint8 *buf, gsize len, GError ** error)
 		return NULL;
 	}
 
+	if (message_is_binary(buf, len))
+		return _wire_decode(buf + 4, l0, copy, error);
+
 	MESSAGE m = NULL;
 	asn_codec_ctx_t codec_ctx;
 	codec_ctx.max_stack_size = ASN1C_MAX_STACK;
@@ -214,6 +472,18 @@ message_unmarshall(const guint8 *buf, gsize len, GError ** error)
 	return NULL;
 }
 
+MESSAGE
+message_unmarshall(const guint8 *buf, gsize len, GError ** error)
+{
+	return _unmarshall(buf, len, TRUE, error);
+}
+
+MESSAGE
+message_unmarshall_inplace(const guint8 *buf, gsize len, GError ** error)
+{
+	return _unmarshall(buf, len, FALSE, error);
+}
+
 static void*
 message_get_param(MESSAGE m, enum message_param_e mp, gsize *sSize)
 {
@@ -230,9 +500,9 @@ message_get_param(MESSAGE m, enum message_param_e mp, gsize *sSize)
 }
 
 static void
-_os_set (OCTET_STRING_t **pos, const void *s, gsize sSize)
+_os_set (MESSAGE m, OCTET_STRING_t **pos, const void *s, gsize sSize)
 {
-	if (*pos)
+	if (*pos && !_wire_borrowed(m, *pos))
 		OCTET_STRING_fromBuf(*pos, s, sSize);
 	else
 		*pos = OCTET_STRING_new_fromBuf(&asn_DEF_OCTET_STRING, s, sSize);
@@ -246,16 +516,16 @@ message_set_param(MESSAGE m, enum message_param_e mp, const void *s, gsize sSize
 
 	switch (mp) {
 		case MP_ID:
-			_os_set(&m->id, s, sSize);
+			_os_set(m, &m->id, s, sSize);
 			return;
 		case MP_NAME:
-			_os_set(&m->name, s, sSize);
+			_os_set(m, &m->name, s, sSize);
 			return;
 		case MP_VERSION:
-			_os_set(&m->version, s, sSize);
+			_os_set(m, &m->version, s, sSize);
 			return;
 		case MP_BODY:
-			_os_set(&m->body, s, sSize);
+			_os_set(m, &m->body, s, sSize);
 			return;
 		default:
 			g_assert_not_reached();
@@ -0,0 +1,210 @@
+/*
+OpenIO SDS metautils
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+/* Compare the cost of the BER and the binary framings of the messages, on
+ * a meta2 PUT request and on a reply to a meta2 listing. The bodies are
+ * opaque for the framing, only their size matters. */
+
+#include "metautils.h"
+
+static guint iterations = 10000;
+static guint list_size = 1000;
+
+static void
+_add_url(MESSAGE m)
+{
+	metautils_message_add_field_str(m, "NS", "OPENIO");
+	metautils_message_add_field_str(m, "ACCT", "ACCT-benchmark");
+	metautils_message_add_field_str(m, "REF", "JFS-benchmark");
+	metautils_message_add_field_str(m, "CID",
+			"0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF");
+	metautils_message_add_field_str(m, "TYPE", "meta2");
+}
+
+static GByteArray *
+_make_body(gsize size)
+{
+	GByteArray *gba = g_byte_array_sized_new(size);
+	g_byte_array_set_size(gba, size);
+	for (gsize i = 0; i < size; i++)
+		gba->data[i] = i * 31;
+	return gba;
+}
+
+/* A content of 3 chunks: 1 alias, 1 header, 3 chunks, with properties */
+static MESSAGE
+_make_put(void)
+{
+	MESSAGE m = metautils_message_create_named("M2_PUT", 0);
+	metautils_message_set_ID(m, "BENCHMARK-REQID", 15);
+	_add_url(m);
+	metautils_message_add_field_str(m, "PATH", "path/to/the/object-0001.jpg");
+	metautils_message_add_field_str(m, "CONTENT",
+			"0123456789ABCDEF0123456789ABCDEF");
+	metautils_message_add_field_strint64(m, NAME_MSGKEY_TIMEOUT, 30000000);
+	metautils_message_add_body_unref(m, _make_body(1400));
+	return m;
+}
+
+/* The reply to a listing: one bean of ~200 bytes per alias */
+static MESSAGE
+_make_list_reply(void)
+{
+	MESSAGE m = metautils_message_create_named(NAME_MSGNAME_METAREPLY, 0);
+	metautils_message_set_ID(m, "BENCHMARK-REQID", 15);
+	metautils_message_add_field_strint(m, NAME_MSGKEY_STATUS, CODE_FINAL_OK);
+	metautils_message_add_field_str(m, NAME_MSGKEY_MESSAGE, "OK");
+	metautils_message_add_field_str(m, NAME_MSGKEY_TRUNCATED, "true");
+	metautils_message_add_field_str(m, NAME_MSGKEY_NEXTMARKER, "obj-0999");
+	for (guint i = 0; i < 8; i++) {
+		gchar k[32];
+		g_snprintf(k, sizeof(k), "%s%u", NAME_MSGKEY_PREFIX_PROPERTY, i);
+		metautils_message_add_field_str(m, k, "a-property-value");
+	}
+	metautils_message_add_body_unref(m, _make_body(200 * list_size));
+	return m;
+}
+
+static gboolean
+_same(MESSAGE m0, MESSAGE m1)
+{
+	gsize l0 = 0, l1 = 0;
+	void *b0 = metautils_message_get_BODY(m0, &l0);
+	void *b1 = metautils_message_get_BODY(m1, &l1);
+	if (l0 != l1 || (l0 && memcmp(b0, b1, l0)))
+		return FALSE;
+	gchar **names = metautils_message_get_field_names(m0);
+	gboolean rc = TRUE;
+	for (gchar **pn = names; rc && *pn; pn++) {
+		b0 = metautils_message_get_field(m0, *pn, &l0);
+		b1 = metautils_message_get_field(m1, *pn, &l1);
+		rc = l0 == l1 && (!l0 || !memcmp(b0, b1, l0));
+	}
+	g_strfreev(names);
+	return rc;
+}
+
+static gboolean
+_run(const char *what, MESSAGE (*make)(void))
+{
+	/* Both framings must carry the same message */
+	GByteArray *ber = message_marshall_gba_and_clean(make());
+	GByteArray *bin = message_marshall_binary_and_clean(make());
+	MESSAGE m0 = message_unmarshall(ber->data, ber->len, NULL);
+	MESSAGE m1 = message_unmarshall_inplace(bin->data, bin->len, NULL);
+	const gboolean ok = m0 && m1 && _same(m0, m1) && _same(m1, m0);
+	metautils_message_destroy(m0);
+	metautils_message_destroy(m1);
+
+	gint64 t0 = oio_ext_monotonic_time();
+	for (guint i = 0; i < iterations; i++)
+		g_byte_array_unref(message_marshall_gba_and_clean(make()));
+	gint64 t1 = oio_ext_monotonic_time();
+	for (guint i = 0; i < iterations; i++)
+		g_byte_array_unref(message_marshall_binary_and_clean(make()));
+	gint64 t2 = oio_ext_monotonic_time();
+	for (guint i = 0; i < iterations; i++)
+		metautils_message_destroy(message_unmarshall(ber->data, ber->len, NULL));
+	gint64 t3 = oio_ext_monotonic_time();
+	for (guint i = 0; i < iterations; i++) {
+		MESSAGE m = message_unmarshall_inplace(bin->data, bin->len, NULL);
+		metautils_message_destroy(m);
+	}
+	gint64 t4 = oio_ext_monotonic_time();
+
+	GRID_NOTICE("%s: %u bytes (BER) / %u bytes (binary)%s",
+			what, ber->len, bin->len, ok ? "" : ", MISMATCH");
+	GRID_NOTICE("%s: encode %.1fus (BER) / %.1fus (binary)", what,
+			(t1 - t0) / (gdouble) iterations, (t2 - t1) / (gdouble) iterations);
+	GRID_NOTICE("%s: decode %.1fus (BER) / %.1fus (binary)", what,
+			(t3 - t2) / (gdouble) iterations, (t4 - t3) / (gdouble) iterations);
+
+	g_byte_array_unref(ber);
+	g_byte_array_unref(bin);
+	return ok;
+}
+
+static void
+cli_action(void)
+{
+	oio_ext_set_reqid("BENCHMARK-REQID");
+	gboolean ok = _run("PUT", _make_put);
+	ok &= _run("LIST", _make_list_reply);
+	if (!ok)
+		grid_main_set_status(1);
+}
+
+static struct grid_main_option_s *
+cli_get_options(void)
+{
+	static struct grid_main_option_s cli_options[] = {
+		{"iterations", OT_UINT, {.u=&iterations},
+			"Number of times each message is encoded and decoded."},
+		{"list", OT_UINT, {.u=&list_size},
+			"Number of items in the reply to the listing."},
+		{NULL, 0, {.i=0}, NULL}
+	};
+	return cli_options;
+}
+
+static void
+cli_set_defaults(void)
+{
+	oio_log_init_level(GRID_LOGLVL_NOTICE);
+}
+
+static void
+cli_specific_fini(void)
+{
+	/* no op */
+}
+
+static void
+cli_specific_stop(void)
+{
+	/* no op */
+}
+
+static const gchar *
+cli_usage(void)
+{
+	return "";
+}
+
+static gboolean
+cli_configure(int argc UNUSED, char **argv UNUSED)
+{
+	return TRUE;
+}
+
+struct grid_main_callbacks cli_callbacks =
+{
+	.options = cli_get_options,
+	.action = cli_action,
+	.set_defaults = cli_set_defaults,
+	.specific_fini = cli_specific_fini,
+	.configure = cli_configure,
+	.usage = cli_usage,
+	.specific_stop = cli_specific_stop,
+};
+
+int
+main(int argc, char **args)
+{
+	return grid_main_cli(argc, args, &cli_callbacks);
+}
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS metautils
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -79,6 +79,10 @@ struct gridd_client_s
 	guint8 keepalive : 1;
 	guint8 forbid_redirect : 1;
 	guint8 avoidance_onoff : 1;
+	guint8 final_read : 1; /* the final reply has been fully read */
+	guint8 reused : 1; /* kept-alive connection, no reply byte read yet */
+	guint8 stale : 1; /* the kept-alive connection was closed by the peer */
+	guint8 connected : 1; /* bytes went through the connection */
 
 	gchar orig_url[URL_MAXLEN];
 	gchar url[URL_MAXLEN];
@@ -195,6 +199,9 @@ _client_connect(struct gridd_client_s *client)
 	EXTRA_ASSERT(err == NULL);
 	client->tv_connect = oio_ext_monotonic_time ();
 	client->sent_bytes = sent;
+	client->reused = 0;
+	if (sent > 0)
+		client->connected = 1;
 	if (client->sent_bytes >= client->request->len) {
 		_client_reset_reply(client);
 		client->step = REP_READING_SIZE;
@@ -223,6 +230,17 @@ _client_reset_cnx(struct gridd_client_s *client)
 	if (client->fd >= 0)
 		metautils_pclose(&(client->fd));
 	client->step = NONE;
+	client->final_read = 0;
+}
+
+/* The peer closed a kept-alive connection before it replied anything: it
+ * most likely did it while the connection was idle, without even reading
+ * the request. */
+static void
+_client_check_stale(struct gridd_client_s *client, int errsv)
+{
+	if (client->reused && (errsv == 0 || errsv == EPIPE || errsv == ECONNRESET))
+		client->stale = 1;
 }
 
 static void
@@ -289,12 +307,18 @@ _client_manage_reply(struct gridd_client_s *client, MESSAGE reply)
 		if (client->step == STATUS_OK) {
 			if (!client->keepalive)
 				metautils_pclose(&(client->fd));
+			client->final_read = 1;
 		} else {
 			_client_reset_reply(client);
 		}
 		if (client->on_reply) {
-			if (!client->on_reply(client->ctx, reply))
+			if (!client->on_reply(client->ctx, reply)) {
+				/* Replies may remain unread on the socket, it cannot carry
+				 * any other request. */
+				if (!client->final_read)
+					metautils_pclose(&(client->fd));
 				return SYSERR("Handler error");
+			}
 		}
 		return NULL;
 	}
@@ -339,7 +363,8 @@ static GError *
 _client_manage_reply_data(struct gridd_client_s *c)
 {
 	GError *err = NULL;
-	MESSAGE r = message_unmarshall(c->reply->data, c->reply->len, &err);
+	/* The reply is destroyed before the buffer is reused */
+	MESSAGE r = message_unmarshall_inplace(c->reply->data, c->reply->len, &err);
 	if (!r)
 		g_prefix_error(&err, "Decoding: ");
 	else
@@ -376,13 +401,19 @@ _client_manage_event_in_buffer(struct gridd_client_s *client, guint8 *d, gsize d
 						client->request->len - client->sent_bytes,
 						MSG_NOSIGNAL);
 
-				if (rc < 0)
-					return (errno == EINTR || errno == EAGAIN) ? NULL :
-						NEWERROR(CODE_NETWORK_ERROR,
-								"ERROR while requesting %s: (%d) %s",
-								gridd_client_url(client), errno, strerror(errno));
-				if (rc > 0)
+				if (rc < 0) {
+					const int errsv = errno;
+					if (errsv == EINTR || errsv == EAGAIN)
+						return NULL;
+					_client_check_stale(client, errsv);
+					return NEWERROR(CODE_NETWORK_ERROR,
+							"ERROR while requesting %s: (%d) %s",
+							gridd_client_url(client), errsv, strerror(errsv));
+				}
+				if (rc > 0) {
 					client->sent_bytes += rc;
+					client->connected = 1;
+				}
 
 				if (client->sent_bytes < client->request->len)
 					return NULL;
@@ -402,19 +433,27 @@ _client_manage_event_in_buffer(struct gridd_client_s *client, guint8 *d, gsize d
 				/* Continue reading the size */
 				ssize_t rc = metautils_syscall_read(
 						client->fd, d, (4 - client->reply->len));
-				if (rc == 0)
+				if (rc == 0) {
+					_client_check_stale(client, 0);
 					return NEWERROR(CODE_NETWORK_ERROR,
 							"EOF while reading response size from %s",
 							gridd_client_url(client));
-				if (rc < 0)
-					return (errno == EINTR || errno == EAGAIN) ? NULL :
-						NEWERROR(CODE_NETWORK_ERROR,
-								"ERROR while reading response size from %s:"
-								" (%d) %s", gridd_client_url(client),
-								errno, strerror(errno));
+				}
+				if (rc < 0) {
+					const int errsv = errno;
+					if (errsv == EINTR || errsv == EAGAIN)
+						return NULL;
+					_client_check_stale(client, errsv);
+					return NEWERROR(CODE_NETWORK_ERROR,
+							"ERROR while reading response size from %s:"
+							" (%d) %s", gridd_client_url(client),
+							errsv, strerror(errsv));
+				}
 
 				EXTRA_ASSERT(rc > 0);
 				g_byte_array_append(client->reply, d, rc);
+				client->reused = 0;
+				client->connected = 1;
 
 				if (client->reply->len < 4)  /* size still incomplete */
 					return NULL;
@@ -646,6 +685,10 @@ gridd_client_request(struct gridd_client_s *client, GByteArray *req,
 	_client_reset_reply(client);
 	_client_reset_request(client);
 	_client_replace_error(client, NULL);
+	client->final_read = 0;
+	client->reused = BOOL(client->fd >= 0);
+	client->stale = 0;
+	client->connected = 0;
 
 	/* Now set the new request components */
 	client->ctx = ctx;
@@ -753,6 +796,11 @@ gridd_client_start(struct gridd_client_s *client)
 	client->deadline_single = now + client->delay_single;
 	client->deadline_overall = now + client->delay_overall;
 
+	/* A keep-alive client that already holds a connection has been armed by
+	 * gridd_client_request(): just start sending on the open socket. */
+	if (client->step == REQ_SENDING && client->keepalive && client->fd >= 0)
+		return TRUE;
+
 	if (client->step != NONE) {
 		_client_replace_error(client, SYSERR("bug: invalid client state"));
 		return FALSE;
@@ -943,3 +991,35 @@ gridd_client_set_avoidance (struct gridd_client_s *c, gboolean onoff)
 	c->avoidance_onoff = BOOL(onoff);
 }
 
+void
+gridd_client_set_keepalive (struct gridd_client_s *c, gboolean onoff)
+{
+	if (unlikely(!c)) return;
+	c->keepalive = BOOL(onoff);
+}
+
+gboolean
+gridd_client_reusable (struct gridd_client_s *c)
+{
+	EXTRA_ASSERT(c != NULL);
+	if (!c->keepalive || c->fd < 0)
+		return FALSE;
+	/* Only a final reply fully consumed leaves nothing unread on the
+	 * socket. Any failure may have left a partial or pending reply. */
+	return c->step == STATUS_OK && c->final_read && !c->error;
+}
+
+gboolean
+gridd_client_stale (struct gridd_client_s *c)
+{
+	EXTRA_ASSERT(c != NULL);
+	return BOOL(c->stale);
+}
+
+gboolean
+gridd_client_connected (struct gridd_client_s *c)
+{
+	EXTRA_ASSERT(c != NULL);
+	return BOOL(c->connected);
+}
+
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS metautils
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -94,6 +94,25 @@ void gridd_client_no_redirect (struct gridd_client_s *c);
 /* Only works with clients of the default type */
 void gridd_client_set_avoidance (struct gridd_client_s *c, gboolean on);
 
+/* Only works with clients of the default type. When set, the connection is
+ * kept open after a complete reply, so that the next gridd_client_request()
+ * then gridd_client_start() reuse it. */
+void gridd_client_set_keepalive (struct gridd_client_s *c, gboolean on);
+
+/* Tells if `c` is idle on an open connection that may carry a new request,
+ * i.e. its last request succeeded and its final reply has been fully read. */
+gboolean gridd_client_reusable (struct gridd_client_s *c);
+
+/* Tells if the last request failed because the peer had closed the
+ * kept-alive connection (EOF or reset) before it replied anything, i.e. most
+ * likely while the connection was idle. Then the request may be sent again on
+ * a new connection. A timeout never makes a connection stale. */
+gboolean gridd_client_stale (struct gridd_client_s *c);
+
+/* Tells if bytes went through the connection for the last request, i.e. if
+ * the connection was established. */
+gboolean gridd_client_connected (struct gridd_client_s *c);
+
 /* ------------------------------------------------------------------------- */
 
 typedef GTree* down_hosts_t;
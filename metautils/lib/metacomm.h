@@ -1,7 +1,7 @@
 /*
 OpenIO SDS metautils
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -53,12 +53,28 @@ void metautils_message_destroy(MESSAGE m);
 /** Perform the serialization of the message. */
 GByteArray* message_marshall_gba(MESSAGE m, GError **err);
 
-/** Allocates a new message and Unserializes the given buffer. */
+/** Perform the serialization of the message in the compact binary framing.
+ * Only for the peers that advertised it with NAME_MSGKEY_WIRE. */
+GByteArray* message_marshall_binary(MESSAGE m, GError **err);
+
+/** Allocates a new message and Unserializes the given buffer, whatever its
+ * framing (BER or binary). */
 MESSAGE message_unmarshall(const guint8 *buf, gsize len, GError ** error);
 
+/** As message_unmarshall(), but a message in the binary framing is decoded
+ * without copy: its fields point into 'buf', that must outlive it. */
+MESSAGE message_unmarshall_inplace(const guint8 *buf, gsize len, GError ** error);
+
+/** Tells if the encoded message (with its size) uses the binary framing */
+gboolean message_is_binary(const guint8 *buf, gsize len);
+
 /** Calls message_marshall_gba() then metautils_message_destroy() on 'm'. */
 GByteArray* message_marshall_gba_and_clean(MESSAGE m);
 
+/** Calls message_marshall_binary() then metautils_message_destroy() on 'm'.
+ * Falls back to BER if the message does not fit in the binary framing. */
+GByteArray* message_marshall_binary_and_clean(MESSAGE m);
+
 typedef gint (*body_decoder_f)(GSList **r, const void *b, gsize l, GError **e);
 
 /** Adds a new custom field in the list of the message. Now check is made to
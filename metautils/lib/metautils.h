@@ -61,6 +61,7 @@ License along with this library.
 # include <metautils/lib/metacomm.h>
 # include <metautils/lib/gridd_client.h>
 # include <metautils/lib/gridd_client_ext.h>
+# include <metautils/lib/cnx_pool.h>
 
 # include <metautils/lib/stats.h>
 
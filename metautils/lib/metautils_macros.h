@@ -48,14 +48,17 @@ License along with this library.
 #define NAME_MSGKEY_BASETYPE           "BTYPE"
 #define NAME_MSGKEY_CHANGE_POLICY      "CHANGE_POLICY"
 #define NAME_MSGKEY_CHUNKED            "CHUNKED"
+#define NAME_MSGKEY_COMPRESS           "COMPRESS"
 #define NAME_MSGKEY_CONTAINERID        "CID"
 #define NAME_MSGKEY_CONTENTLENGTH      "CL"
 #define NAME_MSGKEY_CONTENTPATH        "CP"
 #define NAME_MSGKEY_CONTENTID          "CI"
 #define NAME_MSGKEY_DAMAGED_OBJECTS    "DAMAGED_OBJECTS"
 #define NAME_MSGKEY_DELETE_MARKER      "DELETE_MARKER"
+#define NAME_MSGKEY_DELTA              "DELTA"
 #define NAME_MSGKEY_DRYRUN             "DRYRUN"
 #define NAME_MSGKEY_DST                "DST"
+#define NAME_MSGKEY_EPOCH              "EPOCH"
 #define NAME_MSGKEY_EVENT              "E"
 #define NAME_MSGKEY_EXTEND             "EXT"
 #define NAME_MSGKEY_FLAGS              "FLAGS"
@@ -64,6 +67,7 @@ License along with this library.
 #define NAME_MSGKEY_FORCE_VERSIONING   "FORCE_VERSIONING"
 #define NAME_MSGKEY_FROZEN             "FROZEN"
 #define NAME_MSGKEY_FULL               "FULL"
+#define NAME_MSGKEY_GENERATION         "GEN"
 #define NAME_MSGKEY_KEY                "K"
 #define NAME_MSGKEY_LOCAL              "LOCAL"
 #define NAME_MSGKEY_MASTER             "MASTER"
@@ -85,6 +89,7 @@ License along with this library.
 #define NAME_MSGKEY_PREFIX             "PREFIX"
 #define NAME_MSGKEY_QUERY              "Q"
 #define NAME_MSGKEY_RECOMPUTE          "RECOMPUTE"
+#define NAME_MSGKEY_REMOVED            "RMV"
 #define NAME_MSGKEY_REPLICAS           "REPLICAS"
 #define NAME_MSGKEY_SEQNUM             "SEQ_NUM"
 #define NAME_MSGKEY_SIM_VER            "SIM_VER"
@@ -100,6 +105,7 @@ License along with this library.
 #define NAME_MSGKEY_USER               "USR"
 #define NAME_MSGKEY_VERPOLICY          "VP"
 #define NAME_MSGKEY_VERSION            "VER"
+#define NAME_MSGKEY_WIRE               "WIRE"
 
 #define NS_STATE_VALUE_MASTER     "master"
 #define NS_STATE_VALUE_SLAVE      "slave"
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS metautils
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -80,6 +80,8 @@ gboolean sock_set_tcpquickack(int fd, gboolean enabled);
 
 gboolean sock_set_reuseaddr(int fd, gboolean enabled);
 
+gboolean sock_set_reuseport(int fd, gboolean enabled);
+
 gboolean sock_set_nodelay(int fd, gboolean enabled);
 
 gboolean sock_set_cork(int fd, gboolean enabled);
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS metautils
-Copyright (C) 2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2019-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -16,12 +16,65 @@ You should have received a copy of the GNU Lesser General Public
 License along with this library.
 */
 
+#include <string.h>
+
 #include <metautils/lib/metautils.h>
 #include <metautils/lib/common_variables.h>
 
+/* The increments are spread among shards, each thread sticking to one of
+ * them, so that the threads do not contend on a single lock. The shards are
+ * merged when the stats are read. */
+#define STATS_SHARDS 16
+
+/* Log-linear histograms: the values below HISTO_SUB are exact, then each
+ * power of 2 is split in HISTO_SUB buckets (i.e. at most 12.5% of error).
+ * The values above 2^HISTO_MAX_BITS are accounted in the last bucket. */
+#define HISTO_SUB_BITS 3
+#define HISTO_SUB (1 << HISTO_SUB_BITS)
+#define HISTO_MAX_BITS 40
+#define HISTO_BUCKETS ((HISTO_MAX_BITS - HISTO_SUB_BITS + 1) * HISTO_SUB)
+
+struct histo_s
+{
+	guint64 count;
+	guint64 max;
+	guint64 buckets[HISTO_BUCKETS];
+};
+
+/* The percentiles exported, in per-thousand */
+static const struct {
+	const char *suffix;
+	guint64 permil;
+} percentiles[] = {
+	{"p50", 500}, {"p90", 900}, {"p99", 990}, {"p999", 999},
+};
+
+#define PCT_COUNT G_N_ELEMENTS(percentiles)
+
+struct histo_names_s
+{
+	GQuark q[PCT_COUNT];
+};
+
+struct stats_shard_s
+{
+	GMutex lock;
+	GArray *values;  /* <struct stat_record_s> indexed by GQuark */
+	GPtrArray *histos;  /* <struct histo_s*> indexed by GQuark */
+} __attribute__ ((aligned (64)));
+
+/* The values set, to which the shards are added */
 static GArray *stats = NULL;  /* <struct server_stat_s> */
 static GMutex lock_stats = {};
 
+/* Never held while taking another lock */
+static GPtrArray *histo_names = NULL;  /* <struct histo_names_s*> */
+static GMutex lock_names = {};
+
+static struct stats_shard_s shards[STATS_SHARDS];
+static volatile gint shard_next = 0;
+static __thread gint shard_id = -1;
+
 void __attribute__ ((constructor)) _stats_init(void);
 void __attribute__ ((destructor)) _stats_fini (void);
 
@@ -33,47 +86,91 @@ _stats_init(void)
 {
 	stats = ARRAY();
 	g_assert(stats != NULL);
+	histo_names = g_ptr_array_new_with_free_func(g_free);
 	g_mutex_init(&lock_stats);
+	g_mutex_init(&lock_names);
+	for (guint i = 0; i < STATS_SHARDS; i++) {
+		g_mutex_init(&shards[i].lock);
+		shards[i].values = ARRAY();
+		shards[i].histos = g_ptr_array_new_with_free_func(g_free);
+	}
 }
 
 void
 _stats_fini(void)
 {
+	for (guint i = 0; i < STATS_SHARDS; i++) {
+		g_mutex_clear(&shards[i].lock);
+		if (shards[i].values)
+			g_array_free(shards[i].values, TRUE);
+		if (shards[i].histos)
+			g_ptr_array_free(shards[i].histos, TRUE);
+	}
 	g_mutex_clear(&lock_stats);
+	g_mutex_clear(&lock_names);
 	if (stats)
 		g_array_free (stats, TRUE);
+	if (histo_names)
+		g_ptr_array_free(histo_names, TRUE);
+}
+
+static struct stats_shard_s *
+_shard(void)
+{
+	if (shard_id < 0)
+		shard_id = ((guint) g_atomic_int_add(&shard_next, 1)) % STATS_SHARDS;
+	return shards + shard_id;
 }
 
 static void
-_stretch(const GQuark k)
+_stretch(GArray *values, const GQuark k)
 {
-	while (stats->len <= k) {  /* lazy stretch */
+	while (values->len <= k) {  /* lazy stretch */
 		struct stat_record_s st = {.value=0, .which=0};
-		g_array_append_vals(stats, &st, 1);
+		g_array_append_vals(values, &st, 1);
 	}
 }
 
 static void
-_on_stat(gboolean increment, const GQuark k, const gint64 v)
+_on_stat(GArray *values, gboolean increment, const GQuark k, const gint64 v)
 {
 	if (k <= 0)
 		return;
-	_stretch(k);
-	struct stat_record_s *ss = &g_array_index(stats, struct stat_record_s, k);
+	_stretch(values, k);
+	struct stat_record_s *ss = &g_array_index(values, struct stat_record_s, k);
 	ss->which = k;
 	ss->value = (increment ? ss->value : 0) + v;
 }
 
+/* Reset the increments of the shards, the value set becomes the reference */
+static void
+_on_stat_reset(const GQuark k)
+{
+	if (k <= 0)
+		return;
+	for (guint i = 0; i < STATS_SHARDS; i++) {
+		struct stats_shard_s *shard = shards + i;
+		g_mutex_lock(&shard->lock);
+		if (k < shard->values->len)
+			g_array_index(shard->values, struct stat_record_s, k).value = 0;
+		g_mutex_unlock(&shard->lock);
+	}
+}
+
 void
 oio_stats_set(
 		GQuark k1, guint64 v1, GQuark k2, guint64 v2,
 		GQuark k3, guint64 v3, GQuark k4, guint64 v4)
 {
 	g_mutex_lock (&lock_stats);
-	_on_stat(FALSE, k1, v1);
-	_on_stat(FALSE, k2, v2);
-	_on_stat(FALSE, k3, v3);
-	_on_stat(FALSE, k4, v4);
+	_on_stat(stats, FALSE, k1, v1);
+	_on_stat(stats, FALSE, k2, v2);
+	_on_stat(stats, FALSE, k3, v3);
+	_on_stat(stats, FALSE, k4, v4);
+	_on_stat_reset(k1);
+	_on_stat_reset(k2);
+	_on_stat_reset(k3);
+	_on_stat_reset(k4);
 	g_mutex_unlock (&lock_stats);
 }
 
@@ -82,12 +179,152 @@ oio_stats_add(
 		GQuark k1, guint64 v1, GQuark k2, guint64 v2,
 		GQuark k3, guint64 v3, GQuark k4, guint64 v4)
 {
-	g_mutex_lock (&lock_stats);
-	_on_stat(TRUE, k1, v1);
-	_on_stat(TRUE, k2, v2);
-	_on_stat(TRUE, k3, v3);
-	_on_stat(TRUE, k4, v4);
-	g_mutex_unlock (&lock_stats);
+	struct stats_shard_s *shard = _shard();
+	g_mutex_lock (&shard->lock);
+	_on_stat(shard->values, TRUE, k1, v1);
+	_on_stat(shard->values, TRUE, k2, v2);
+	_on_stat(shard->values, TRUE, k3, v3);
+	_on_stat(shard->values, TRUE, k4, v4);
+	g_mutex_unlock (&shard->lock);
+}
+
+/* Histograms --------------------------------------------------------------- */
+
+static guint
+_histo_index(guint64 v)
+{
+	if (v < HISTO_SUB)
+		return v;
+	guint msb = 63 - __builtin_clzll(v);
+	if (msb >= HISTO_MAX_BITS) {
+		msb = HISTO_MAX_BITS - 1;
+		v = (1ULL << HISTO_MAX_BITS) - 1;
+	}
+	const guint shift = msb - HISTO_SUB_BITS;
+	return (shift + 1) * HISTO_SUB + ((v >> shift) & (HISTO_SUB - 1));
+}
+
+/* The highest value accounted in the bucket */
+static guint64
+_histo_value(guint i)
+{
+	if (i < HISTO_SUB)
+		return i;
+	const guint shift = i / HISTO_SUB - 1;
+	const guint64 low = ((guint64)(HISTO_SUB + i % HISTO_SUB)) << shift;
+	return low + (1ULL << shift) - 1;
+}
+
+/* Name the percentiles of <k>, e.g. "latency req.time.PING.p99" for
+ * "counter req.time.PING". */
+static void
+_histo_names_ensure(const GQuark k)
+{
+	g_mutex_lock(&lock_names);
+	while (histo_names->len <= k)
+		g_ptr_array_add(histo_names, NULL);
+	if (histo_names->pdata[k]) {
+		g_mutex_unlock(&lock_names);
+		return;
+	}
+
+	struct histo_names_s *names = g_malloc0(sizeof(*names));
+	const char *s = g_quark_to_string(k);
+	if (g_str_has_prefix(s, "counter "))
+		s += sizeof("counter ") - 1;
+	for (guint i = 0; i < PCT_COUNT; i++) {
+		gchar tmp[256];
+		g_snprintf(tmp, sizeof(tmp), "latency %s.%s", s, percentiles[i].suffix);
+		names->q[i] = g_quark_from_string(tmp);
+	}
+	histo_names->pdata[k] = names;
+	g_mutex_unlock(&lock_names);
+}
+
+static void
+_on_histo(struct stats_shard_s *shard, const GQuark k, const guint64 v)
+{
+	if (k <= 0)
+		return;
+	while (shard->histos->len <= k)
+		g_ptr_array_add(shard->histos, NULL);
+	struct histo_s *h = shard->histos->pdata[k];
+	if (!h) {
+		_histo_names_ensure(k);
+		h = shard->histos->pdata[k] = g_malloc0(sizeof(struct histo_s));
+	}
+	h->count ++;
+	h->buckets[_histo_index(v)] ++;
+	if (v > h->max)
+		h->max = v;
+}
+
+void
+oio_stats_histo_add(GQuark k1, guint64 v1, GQuark k2, guint64 v2)
+{
+	struct stats_shard_s *shard = _shard();
+	g_mutex_lock (&shard->lock);
+	_on_histo(shard, k1, v1);
+	_on_histo(shard, k2, v2);
+	g_mutex_unlock (&shard->lock);
+}
+
+static guint64
+_histo_percentile(struct histo_s *h, guint64 permil)
+{
+	/* The rank of the value, rounded up */
+	const guint64 rank = MAX(1, (h->count * permil + 999) / 1000);
+	guint64 total = 0;
+	for (guint i = 0; i < HISTO_BUCKETS; i++) {
+		total += h->buckets[i];
+		if (total >= rank)
+			return MIN(h->max, _histo_value(i));
+	}
+	return h->max;
+}
+
+/* Merge the histograms of all the shards, then append their percentiles */
+static void
+_histo_getall(GArray *out)
+{
+	/* The names are never freed, a copy of the array is enough */
+	g_mutex_lock(&lock_names);
+	const guint len = histo_names->len;
+	struct histo_names_s **all = g_memdup(histo_names->pdata,
+			len * sizeof(gpointer));
+	g_mutex_unlock(&lock_names);
+
+	struct histo_s *merged = g_malloc(sizeof(struct histo_s));
+	for (guint k = 1; k < len; k++) {
+		struct histo_names_s *names = all[k];
+		if (!names)
+			continue;
+		memset(merged, 0, sizeof(*merged));
+		for (guint i = 0; i < STATS_SHARDS; i++) {
+			struct stats_shard_s *shard = shards + i;
+			g_mutex_lock(&shard->lock);
+			struct histo_s *h = k < shard->histos->len
+				? shard->histos->pdata[k] : NULL;
+			if (h) {
+				merged->count += h->count;
+				merged->max = MAX(merged->max, h->max);
+				for (guint b = 0; b < HISTO_BUCKETS; b++)
+					merged->buckets[b] += h->buckets[b];
+			}
+			g_mutex_unlock(&shard->lock);
+		}
+		if (!merged->count)
+			continue;
+		for (guint i = 0; i < PCT_COUNT; i++) {
+			struct stat_record_s st = {
+				.value = _histo_percentile(merged, percentiles[i].permil),
+				.which = names->q[i],
+			};
+			g_array_append_vals(out, &st, 1);
+		}
+	}
+	g_free(merged);
+	g_free(all);
 }
 
 GArray*
@@ -95,11 +332,35 @@ network_server_stat_getall (void)
 {
 	GArray *out = ARRAY();
 	g_mutex_lock (&lock_stats);
-	for (guint i=0; i<stats->len ;++i) {
-		struct stat_record_s *ss = &g_array_index(stats, struct stat_record_s, i);
+
+	GArray *all = ARRAY();
+	g_array_append_vals(all, stats->data, stats->len);
+	for (guint i = 0; i < STATS_SHARDS; i++) {
+		struct stats_shard_s *shard = shards + i;
+		g_mutex_lock(&shard->lock);
+		if (shard->values->len > 0)
+			_stretch(all, shard->values->len - 1);
+		for (guint k = 0; k < shard->values->len; k++) {
+			struct stat_record_s *src =
+				&g_array_index(shard->values, struct stat_record_s, k);
+			struct stat_record_s *dst =
+				&g_array_index(all, struct stat_record_s, k);
+			if (src->which != 0) {
+				dst->which = src->which;
+				dst->value += src->value;
+			}
+		}
+		g_mutex_unlock(&shard->lock);
+	}
+
+	for (guint i=0; i<all->len ;++i) {
+		struct stat_record_s *ss = &g_array_index(all, struct stat_record_s, i);
 		if (ss->which != 0)
 			g_array_append_vals (out, ss, 1);
 	}
+	g_array_free(all, TRUE);
+
+	_histo_getall(out);
 	g_mutex_unlock (&lock_stats);
 	return out;
 }
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS server
-Copyright (C) 2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2019-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -51,7 +51,16 @@ void oio_stats_add(
 		GQuark k3, guint64 v3, GQuark k4, guint64 v4);
 
 /**
- * Dump all the stats at once.
+ * Account 2 values (e.g. durations in microseconds) in the latency
+ * histograms of their keys. Any key to 0 is ignored.
+ * The histograms are exported as percentiles, e.g. "counter req.time.PING"
+ * gives "latency req.time.PING.p50", ".p90", ".p99" and ".p999".
+ */
+void oio_stats_histo_add(GQuark k1, guint64 v1, GQuark k2, guint64 v2);
+
+/**
+ * Dump all the stats at once, with the percentiles of the histograms
+ * computed at that time.
  * @return a GArray of <struct stat_record_s>
  */
 GArray* network_server_stat_getall (void);
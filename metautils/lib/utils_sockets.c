@@ -1,7 +1,7 @@
 /*
 OpenIO SDS metautils
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -248,6 +248,22 @@ sock_set_reuseaddr(int fd, gboolean enabled)
 	return FALSE;
 }
 
+gboolean
+sock_set_reuseport(int fd, gboolean enabled)
+{
+#ifdef SO_REUSEPORT
+	int opt = BOOL(enabled);
+	if (!metautils_syscall_setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void*)&opt, sizeof(opt)))
+		return TRUE;
+	GRID_DEBUG("fd=%i set(SO_REUSEPORT,%d): (%d) %s",
+			fd, opt, errno, strerror(errno));
+#else
+	(void) fd, (void) enabled;
+	errno = ENOPROTOOPT;
+#endif
+	return FALSE;
+}
+
 gboolean
 sock_set_nodelay(int fd, gboolean enabled)
 {
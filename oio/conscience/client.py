@@ -1,4 +1,4 @@
-# Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+# Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 #
 # This library is free software; you can redistribute it and/or
 # modify it under the terms of the GNU Lesser General Public
@@ -29,16 +29,21 @@ class LbClient(ProxyClient):
         super(LbClient, self).__init__(
             conf, request_prefix="/lb", **kwargs)
 
-    def next_instances(self, pool, size=None, **kwargs):
+    def next_instances(self, pool, size=None, sets=None, **kwargs):
         """
         Get the next service instances from the specified pool.
 
         :keyword size: number of services to get
         :type size: `int`
+        :keyword sets: number of independent sets of services to get,
+            the result is then a list of lists of services
+        :type sets: `int`
         """
         params = {'type': pool}
         if size is not None:
             params['size'] = size
+        if sets is not None:
+            params['sets'] = sets
         resp, body = self._request('GET', '/choose', params=params, **kwargs)
         if resp.status == 200:
             return body
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS proxy
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -61,9 +61,39 @@ service_is_ok (gconstpointer k)
 	return v == NULL;
 }
 
+/* Idle keep-alive connections to the services ---------------------------- */
+
+static GQuark gq_cnx_reuse = 0;
+static GQuark gq_cnx_create = 0;
+static GQuark gq_cnx_stale = 0;
+
+static void __attribute__ ((constructor))
+_constructor (void)
+{
+	gq_cnx_reuse = g_quark_from_static_string("counter proxy.cnx.reuse");
+	gq_cnx_create = g_quark_from_static_string("counter proxy.cnx.create");
+	gq_cnx_stale = g_quark_from_static_string("counter proxy.cnx.stale");
+}
+
+guint
+service_cnx_expire(void)
+{
+	return cnx_pool_expire(
+			OLDEST(oio_ext_monotonic_time(), proxy_outgoing_cnx_idle));
+}
+
+void
+service_cnx_count(guint *peers, guint *idle)
+{
+	cnx_pool_count(peers, idle);
+}
+
+/* -------------------------------------------------------------------------- */
+
 void
 service_invalidate (gconstpointer k)
 {
+	cnx_pool_forget(k);
 	gchar *k0 = g_strdup((const char *)k);
 	SRV_WRITE(lru_tree_insert (srv_down, k0, GINT_TO_POINTER(1)));
 	if (GRID_DEBUG_ENABLED())
@@ -366,60 +396,40 @@ label_retry:
 	const gchar *headers[4] = {SQLX_ADMIN_PEERS, peers, NULL, NULL};
 	GByteArray *packed = pack(&n, headers);
 
+	struct cnx_pool_stats_s cnx_stats = {0};
 	gboolean stop = FALSE;
 	for (gchar **pu = m1uv; *pu && !stop; ++pu) {
 		const char *url = pu[0];
 		const char *next_url = pu[1];
 		GByteArray *body = NULL;
+		struct gridd_client_s *client = NULL;
 
-		struct gridd_client_s *client = gridd_client_create_empty();
-		if (!client) {
-			err = SYSERR("Memory allocation error");
-		} else {
-			err = gridd_client_connect_url(client, url);
-			if (err) {
-				GRID_WARN("Invalid peer [%s]", url);
-				err->code = ERRCODE_CONN_NOROUTE;
-			}
-		}
-
-		if (!err) {
-			/* TODO ensure the service match the expected TYPE and SEQ */
-			if (!ctx->decoder) {
-				err = gridd_client_request(client, packed, &body, _on_reply);
-			} else {
-				err = gridd_client_request(client, packed, ctx->decoder_data, ctx->decoder);
-			}
-		}
-
-		if (!err) {
 #ifdef HAVE_ENBUG
-			gint32 threshold = 0;
-			if (url == m1uv[0] && !next_url)
-				threshold = oio_proxy_request_failure_threshold_alone;
-			else if (url == m1uv[0])
-				threshold = oio_proxy_request_failure_threshold_first;
-			else if (next_url == NULL)
-				threshold = oio_proxy_request_failure_threshold_last;
-			else
-				threshold = oio_proxy_request_failure_threshold_middle;
-			if (threshold >= oio_ext_rand_int_range(1, 100)) {
-				err = NEWERROR(CODE_AVOIDED, "FAKE ERROR");
-			} else {
+		gint32 threshold = 0;
+		if (url == m1uv[0] && !next_url)
+			threshold = oio_proxy_request_failure_threshold_alone;
+		else if (url == m1uv[0])
+			threshold = oio_proxy_request_failure_threshold_first;
+		else if (next_url == NULL)
+			threshold = oio_proxy_request_failure_threshold_last;
+		else
+			threshold = oio_proxy_request_failure_threshold_middle;
+		if (threshold >= oio_ext_rand_int_range(1, 100)) {
+			err = NEWERROR(CODE_AVOIDED, "FAKE ERROR");
+		} else {
 #endif /* HAVE_ENBUG */
-				/* Send a unitary request */
-				if (ctx->which == CLIENT_RUN_ALL
-						|| ctx->which == CLIENT_SPECIFIED)
-					gridd_client_no_redirect (client);
-				gridd_client_start (client);
-				gridd_client_set_timeout (client,
-					oio_clamp_timeout(proxy_timeout_common, deadline));
-				if (!(err = gridd_client_loop (client)))
-					err = gridd_client_error (client);
+			/* Send a unitary request */
+			/* TODO ensure the service match the expected TYPE and SEQ */
+			err = cnx_pool_request(url, packed,
+					ctx->decoder ? ctx->decoder_data : &body,
+					ctx->decoder ? ctx->decoder : _on_reply,
+					ctx->which == CLIENT_RUN_ALL || ctx->which == CLIENT_SPECIFIED,
+					proxy_timeout_common, deadline,
+					OLDEST(oio_ext_monotonic_time(), proxy_outgoing_cnx_idle),
+					&client, &cnx_stats);
 #ifdef HAVE_ENBUG
-			}
-#endif
 		}
+#endif
 
 		/* ensure an output for that request: each array (url, body, error)
 		 * must contain the corresponding item. */
@@ -494,11 +504,17 @@ label_retry:
 		}
 
 		if (client) {
-			gridd_client_free (client);
+			cnx_pool_give(client, oio_ext_monotonic_time(),
+					proxy_outgoing_cnx_max);
 			client = NULL;
 		}
 	}
 	ctx->request_duration = oio_ext_monotonic_time() - resolve_end;
+	oio_stats_add(
+			gq_cnx_reuse, cnx_stats.reused,
+			gq_cnx_create, cnx_stats.created,
+			gq_cnx_stale, cnx_stats.stale,
+			0, 0);
 
 	EXTRA_ASSERT(urlv->len == bodyv->len);
 	EXTRA_ASSERT(urlv->len == errorv->len);
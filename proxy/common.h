@@ -1,7 +1,7 @@
 /*
 OpenIO SDS proxy
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -54,6 +54,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "meta2v2_remote.h"
 #include "path_parser.h"
+#include "srvtype_mirror.h"
 #include "transport_http.h"
 
 #define TOK(N)    _req_get_token(args,(N))
@@ -176,8 +177,16 @@ extern struct lru_tree_s *srv_down; /* "IP:PORT" that had a problem */
 extern struct lru_tree_s *srv_known; /* services seen since 'ever' */
 
 gboolean service_is_ok (gconstpointer p);
+
+/* Marks the service down and closes the idle connections to it */
 void service_invalidate (gconstpointer n);
 
+/* Closes the connections idle for longer than proxy.outgoing.cnx.idle */
+guint service_cnx_expire (void);
+
+/* Counts the services with idle connections, and those connections */
+void service_cnx_count (guint *peers, guint *idle);
+
 void service_learn (const char *key);
 gboolean service_is_known (const char *key);
 
@@ -324,6 +333,13 @@ GError * conscience_remote_get_services(gchar **cs,
 		const char *type, gboolean full, GSList **out,
 		gint64 deadline);
 
+/* Fetch the services of <type> changed since <changes->generation>, then
+ * update <changes> with the reply. Pass a zeroed <changes> to fetch the
+ * full list. */
+GError * conscience_remote_get_changes(gchar **cs,
+		const char *type, gboolean full, struct conscience_changes_s *changes,
+		gint64 deadline);
+
 GError * conscience_remote_get_types(gchar **cs,
 		gchar ***out,
 		gint64 deadline);
@@ -81,6 +81,90 @@ conscience_remote_get_services(gchar **allcs, const char *type, gboolean full,
 	return _loop_on_allcs_while_neterror(allcs, action);
 }
 
+GError *
+conscience_remote_get_changes(gchar **allcs, const char *type, gboolean full,
+		struct conscience_changes_s *changes, gint64 deadline)
+{
+	EXTRA_ASSERT(type != NULL);
+	EXTRA_ASSERT(changes != NULL);
+	EXTRA_ASSERT(changes->services == NULL);
+	EXTRA_ASSERT(changes->removed == NULL);
+
+	GError * action (const char *cs) {
+		GError *err = NULL;
+		gint64 epoch = 0, generation = 0;
+		gboolean delta = FALSE;
+		GSList *services = NULL, *removed = NULL;
+
+		gboolean _on_reply(gpointer ctx UNUSED, MESSAGE reply) {
+			/* An old conscience does not number its generations */
+			GError *e = metautils_message_extract_strint64(
+					reply, NAME_MSGKEY_EPOCH, &epoch);
+			if (!e)
+				e = metautils_message_extract_strint64(
+						reply, NAME_MSGKEY_GENERATION, &generation);
+			if (e) {
+				epoch = generation = 0;
+				g_clear_error(&e);
+			}
+			delta = epoch && metautils_message_extract_flag(
+					reply, NAME_MSGKEY_DELTA, FALSE);
+			if (delta)
+				err = metautils_message_extract_header_encoded(reply,
+						NAME_MSGKEY_REMOVED, FALSE, &removed,
+						service_info_unmarshall);
+			GSList *l = NULL;
+			if (!err)
+				err = metautils_message_extract_body_encoded(reply, FALSE,
+						&l, service_info_unmarshall);
+			services = metautils_gslist_precat(services, l);
+			return err == NULL;
+		}
+
+		MESSAGE req = metautils_message_create_named("CS_SRV",
+				oio_clamp_deadline(proxy_timeout_conscience, deadline));
+		metautils_message_add_field_str(req, NAME_MSGKEY_TYPENAME, type);
+		if (full)
+			metautils_message_add_field_str(req, NAME_MSGKEY_FULL, "1");
+		if (changes->epoch && changes->generation) {
+			metautils_message_add_field_strint64(req,
+					NAME_MSGKEY_EPOCH, changes->epoch);
+			metautils_message_add_field_strint64(req,
+					NAME_MSGKEY_GENERATION, changes->generation);
+		}
+
+		GByteArray *encoded = message_marshall_gba_and_clean(req);
+		struct gridd_client_s *client = gridd_client_create(cs,
+				encoded, NULL, _on_reply);
+		g_byte_array_unref(encoded);
+		if (!client)
+			return SYSERR("client creation");
+		gridd_client_set_timeout(client,
+				oio_clamp_timeout(proxy_timeout_conscience, deadline));
+		GError *e = gridd_client_run(client);
+		gridd_client_free(client);
+		if (!e && err)
+			g_prefix_error(&err, "Decoding error: ");
+		if (!e)
+			e = err;
+		else
+			g_clear_error(&err);
+
+		if (e) {
+			g_slist_free_full(services, (GDestroyNotify)service_info_clean);
+			g_slist_free_full(removed, (GDestroyNotify)service_info_clean);
+		} else {
+			changes->epoch = epoch;
+			changes->generation = generation;
+			changes->delta = delta;
+			changes->services = services;
+			changes->removed = removed;
+		}
+		return e;
+	}
+	return _loop_on_allcs_while_neterror(allcs, action);
+}
+
 GError *
 conscience_remote_get_types(gchar **allcs, gchar ***out, gint64 deadline)
 {
@@ -0,0 +1,202 @@
+/*
+OpenIO SDS proxy
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <metautils/lib/metautils.h>
+
+#include "http_parser.h"
+
+/* The line feeds are searched with memchr(), whose glibc implementation is
+ * vectorized (SSE2/AVX2, selected at runtime). Only the LF candidates are
+ * then checked byte per byte. Returns the size of the head, including the
+ * empty line ending it, or -1 when the head is not complete. */
+static gssize
+_find_head_end(const guint8 *base, gsize from, gsize len)
+{
+	const guint8 *p = base + from, *end = base + len;
+	while (p < end) {
+		const guint8 *lf = memchr(p, '\n', end - p);
+		if (!lf)
+			return -1;
+		if (lf - base >= 3 && lf[-1] == '\r' && lf[-2] == '\n' && lf[-3] == '\r')
+			return lf - base + 1;
+		p = lf + 1;
+	}
+	return -1;
+}
+
+static gboolean
+_parse_command(struct http_parser_s *parser, gchar *line)
+{
+	if (!*line)
+		return FALSE;
+	gchar *selector = strchr(line, ' ');
+	if (!selector)
+		return FALSE;
+	*(selector++) = '\0';
+	gchar *version = strrchr(selector, ' ');
+	if (!version)
+		return FALSE;
+	*(version++) = '\0';
+
+	if (parser->command_provider)
+		parser->command_provider(line, selector, version);
+	return TRUE;
+}
+
+static gboolean
+_parse_header(struct http_parser_s *parser, gchar *line, gchar *eol)
+{
+	gchar *value = strchr(line, ':');
+	if (!value || value == line)
+		return FALSE;
+	*(value++) = '\0';
+	while (*value == ' ' || *value == '\t')
+		value++;
+	while (eol > value && (eol[-1] == ' ' || eol[-1] == '\t'))
+		*(--eol) = '\0';
+
+	oio_str_lower(line);
+	if (*line == 'c' && !strcmp(line, "content-length"))
+		parser->content_length = g_ascii_strtoll(value, NULL, 10);
+
+	if (parser->header_provider)
+		parser->header_provider(line, value);
+	return TRUE;
+}
+
+/* <head> holds <len> bytes, the last 4 being the CRLF ending the last
+ * header and the empty line. The separators are replaced in place by NUL
+ * characters, so that each span is a valid string. */
+static gboolean
+_parse_head(struct http_parser_s *parser, gchar *head, gsize len)
+{
+	EXTRA_ASSERT(len >= 4);
+	gchar *line = head, *end = head + len - 2;
+
+	for (gboolean first = TRUE; line < end; first = FALSE) {
+		gchar *eol = memchr(line, '\n', end - line);
+		EXTRA_ASSERT(eol != NULL);
+		if (eol == line || eol[-1] != '\r')
+			return FALSE;
+		*(--eol) = '\0';
+		if (first) {
+			if (!_parse_command(parser, line))
+				return FALSE;
+		} else {
+			if (!_parse_header(parser, line, eol))
+				return FALSE;
+		}
+		line = eol + 2;
+	}
+	return TRUE;
+}
+
+struct http_parsing_result_s
+http_parse(struct http_parser_s *parser, guint8 *data, gsize available)
+{
+	struct http_parsing_result_s rc = {.status = HPRC_MORE, .consumed = 0};
+
+	struct http_parsing_result_s _error(const gchar *msg) {
+		parser->error = NEWERROR(0, "%s", msg);
+		rc.status = HPRC_ERROR;
+		return rc;
+	}
+
+	if (parser->step == STEP_HEAD) {
+		if (!parser->buf->len) {
+			/* Fast path: the whole head is in the input, it is parsed
+			 * without any copy. */
+			gssize end = _find_head_end(data, 0, available);
+			if (end < 0) {
+				g_string_append_len(parser->buf, (gchar*)data, available);
+				parser->scanned = available;
+				rc.consumed = available;
+				return rc;
+			}
+			if (!_parse_head(parser, (gchar*)data, end))
+				return _error("HEAD parsing error");
+			rc.consumed = end;
+		} else {
+			/* The head spans several inputs, it is accumulated until its
+			 * end is found. Only the new bytes are searched. */
+			const gsize before = parser->buf->len;
+			g_string_append_len(parser->buf, (gchar*)data, available);
+			gssize end = _find_head_end((guint8*)parser->buf->str,
+					parser->scanned, parser->buf->len);
+			if (end < 0) {
+				parser->scanned = parser->buf->len;
+				rc.consumed = available;
+				return rc;
+			}
+			if (!_parse_head(parser, parser->buf->str, end))
+				return _error("HEAD parsing error");
+			rc.consumed = end - before;
+			g_string_set_size(parser->buf, 0);
+			parser->scanned = 0;
+		}
+		parser->step = STEP_BODY;
+	}
+
+	gint64 max = available - rc.consumed;
+	if (max > parser->content_length - parser->content_read)
+		max = MAX(0, parser->content_length - parser->content_read);
+	if (max > 0) {
+		if (parser->body_provider)
+			parser->body_provider(data + rc.consumed, max);
+		rc.consumed += max;
+		parser->content_read += max;
+	}
+
+	if (parser->content_read >= parser->content_length)
+		rc.status = HPRC_SUCCESS;
+	return rc;
+}
+
+void
+http_parser_reset(struct http_parser_s *parser)
+{
+	parser->step = STEP_HEAD;
+	g_string_set_size(parser->buf, 0);
+	parser->scanned = 0;
+	parser->content_read = 0;
+	parser->content_length = -1;
+	if (parser->error)
+		g_clear_error(&parser->error);
+}
+
+struct http_parser_s*
+http_parser_create(void)
+{
+	struct http_parser_s *parser = g_malloc0(sizeof(struct http_parser_s));
+	parser->buf = g_string_sized_new(1024);
+	http_parser_reset(parser);
+	return parser;
+}
+
+void
+http_parser_destroy(struct http_parser_s *parser)
+{
+	if (!parser)
+		return;
+	if (parser->error)
+		g_clear_error(&parser->error);
+	g_string_free(parser->buf, TRUE);
+	g_free(parser);
+}
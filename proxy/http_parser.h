@@ -0,0 +1,70 @@
+/*
+OpenIO SDS proxy
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OIO_SDS__proxy__http_parser_h
+# define OIO_SDS__proxy__http_parser_h 1
+
+# include <glib.h>
+
+enum http_parser_step_e
+{
+	STEP_HEAD,
+	STEP_BODY,
+};
+
+/* Parses the HTTP/1.x requests. The head of a request (its request line and
+ * its headers) is parsed at once, in place, as soon as its end is known. It
+ * is only buffered when it spans several inputs. */
+struct http_parser_s
+{
+	enum http_parser_step_e step;
+	GError *error;
+
+	/* The beginning of the head, when it is not complete in the input */
+	GString *buf;
+	/* How many bytes of <buf> have been searched for the end of the head */
+	gsize scanned;
+
+	gint64 content_read;
+	gint64 content_length;
+	void (*command_provider)(const gchar *req, const gchar *sel, const gchar *ver);
+	void (*header_provider)(const gchar *name, const gchar *value);
+	void (*body_provider)(const guint8 *data, gsize data_len);
+};
+
+struct http_parsing_result_s
+{
+	enum { HPRC_SUCCESS = 0, HPRC_MORE, HPRC_ERROR } status;
+	/* How many bytes of the input belong to the current request. The rest
+	 * of the input is the beginning of the next (pipelined) request. */
+	gsize consumed;
+};
+
+struct http_parser_s * http_parser_create(void);
+
+void http_parser_reset(struct http_parser_s *parser);
+
+void http_parser_destroy(struct http_parser_s *parser);
+
+/* Feed the parser with the next input. <data> is modified: the names and
+ * the values passed to the providers point into it, with NUL terminators
+ * set in place of the separators. */
+struct http_parsing_result_s http_parse(struct http_parser_s *parser,
+		guint8 *data, gsize available);
+
+#endif /*OIO_SDS__proxy__http_parser_h*/
@@ -0,0 +1,412 @@
+/*
+OpenIO SDS proxy
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Compare the throughput of the HTTP parser with the byte-per-byte state
+ * machine it replaced, on a stream of pipelined requests similar to the
+ * ones the proxy receives, cut in inputs of a configurable size. */
+
+#include <string.h>
+
+#include <metautils/lib/metautils.h>
+#include "http_parser.h"
+
+static guint iterations = 20;
+static guint requests = 10000;
+static guint input_size = 16384;
+
+/* The legacy parser --------------------------------------------------------*/
+
+enum legacy_step_e
+{
+	STEP_FIRST_R0, STEP_FIRST_N0,
+	STEP_SEP_R0, STEP_SEP_N0,
+	STEP_HEADERS_R0, STEP_HEADERS_N0,
+	STEP_BODY_ASIS
+};
+
+struct legacy_parser_s
+{
+	enum legacy_step_e step;
+	GString *buf;
+	gint64 content_read;
+	gint64 content_length;
+	void (*command_provider)(const gchar *req, const gchar *sel, const gchar *ver);
+	void (*header_provider)(const gchar *name, const gchar *value);
+	void (*body_provider)(const guint8 *data, gsize data_len);
+};
+
+static void
+legacy_reset(struct legacy_parser_s *parser)
+{
+	parser->step = STEP_FIRST_R0;
+	g_string_set_size(parser->buf, 0);
+	parser->content_read = 0;
+	parser->content_length = -1;
+}
+
+static gboolean
+legacy_command(struct legacy_parser_s *parser, GString *buf)
+{
+	if (!buf->len)
+		return FALSE;
+	gchar *cmd = buf->str, *selector = strchr(cmd, ' ');
+	if (!selector)
+		return FALSE;
+	*(selector++) = '\0';
+	gchar *version = strrchr(selector, ' ');
+	if (!version)
+		return FALSE;
+	*(version++) = '\0';
+	parser->command_provider(cmd, selector, version);
+	g_string_set_size(buf, 0);
+	return TRUE;
+}
+
+static gboolean
+legacy_header(struct legacy_parser_s *parser, GString *buf)
+{
+	if (!buf->len)
+		return TRUE;
+	gchar *header = buf->str, *sep = strchr(header, ':');
+	if (!sep)
+		return FALSE;
+	*(sep++) = '\0';
+	if (*(sep++) != ' ')
+		return FALSE;
+	oio_str_lower(header);
+	if (*header == 'c' && !strcmp(header, "content-length"))
+		parser->content_length = g_ascii_strtoll(sep, NULL, 10);
+	parser->header_provider(header, sep);
+	g_string_set_size(buf, 0);
+	return TRUE;
+}
+
+/* Returns the number of bytes consumed (the legacy parser did not report
+ * it), or -1 upon an error. <*done> tells if a request is complete. */
+static gssize
+legacy_parse(struct legacy_parser_s *parser, const guint8 *data,
+		gsize available, gboolean *done)
+{
+	gsize consumed = 0;
+	*done = FALSE;
+	while (consumed < available) {
+		guint8 d = data[consumed];
+		gint64 max;
+		switch (parser->step) {
+			case STEP_FIRST_R0:
+				if (d == '\r')
+					parser->step = STEP_FIRST_N0;
+				else
+					g_string_append_c(parser->buf, d);
+				++ consumed;
+				continue;
+			case STEP_FIRST_N0:
+				if (d != '\n' || !legacy_command(parser, parser->buf))
+					return -1;
+				parser->step = STEP_SEP_R0;
+				++ consumed;
+				continue;
+			case STEP_SEP_R0:
+				if (d == '\r')
+					parser->step = STEP_SEP_N0;
+				else {
+					if (!legacy_header(parser, parser->buf))
+						return -1;
+					g_string_append_c(parser->buf, d);
+					parser->step = STEP_HEADERS_R0;
+				}
+				++ consumed;
+				continue;
+			case STEP_SEP_N0:
+				if (d != '\n')
+					return -1;
+				++ consumed;
+				if (!legacy_header(parser, parser->buf))
+					return -1;
+				parser->step = STEP_BODY_ASIS;
+				if (parser->content_read >= parser->content_length) {
+					*done = TRUE;
+					return consumed;
+				}
+				continue;
+			case STEP_HEADERS_R0:
+				if (d == '\r')
+					parser->step = STEP_HEADERS_N0;
+				else
+					g_string_append_c(parser->buf, d);
+				++ consumed;
+				continue;
+			case STEP_HEADERS_N0:
+				if (d != '\n')
+					return -1;
+				parser->step = STEP_SEP_R0;
+				++ consumed;
+				continue;
+			case STEP_BODY_ASIS:
+				max = available - consumed;
+				if (max > (parser->content_length - parser->content_read))
+					max = parser->content_length - parser->content_read;
+				parser->body_provider(data+consumed, max);
+				consumed += max;
+				parser->content_read += max;
+				if (parser->content_read >= parser->content_length) {
+					*done = TRUE;
+					return consumed;
+				}
+				continue;
+		}
+	}
+	return consumed;
+}
+
+/* The workload -------------------------------------------------------------*/
+
+static GByteArray *
+_make_stream(void)
+{
+	static const char body[] = "{\"action\":\"Touch\",\"args\":null}";
+	GString *gs = g_string_sized_new(requests * 400);
+	for (guint i = 0; i < requests; i++) {
+		const gboolean post = (i % 4) == 0;
+		g_string_append_printf(gs,
+				"%s /v3.0/OPENIO/content/%s?acct=ACCT-%u&ref=JFS-%u&path=obj-%u"
+				" HTTP/1.1\r\n", post ? "POST" : "GET",
+				post ? "action" : "show", i % 7, i % 101, i);
+		g_string_append_static(gs, "Host: 127.0.0.1:6000\r\n");
+		g_string_append_static(gs, "User-Agent: python-requests/2.22.0\r\n");
+		g_string_append_static(gs, "Accept-Encoding: gzip, deflate\r\n");
+		g_string_append_static(gs, "Accept: */*\r\n");
+		g_string_append_static(gs, "Connection: keep-alive\r\n");
+		g_string_append_printf(gs, "X-oio-req-id: %032X\r\n", i);
+		if (post) {
+			g_string_append_printf(gs, "Content-Length: %u\r\n",
+					(guint) sizeof(body) - 1);
+			g_string_append_static(gs, "Content-Type: application/json\r\n");
+		}
+		g_string_append_static(gs, "\r\n");
+		if (post)
+			g_string_append_len(gs, body, sizeof(body) - 1);
+	}
+	return g_bytes_unref_to_array(g_string_free_to_bytes(gs));
+}
+
+/* Both parsers report what they parsed into the same checksum */
+static guint64 checksum = 0;
+static guint parsed = 0;
+
+static void
+_sum(const void *b, gsize len)
+{
+	for (gsize i = 0; i < len; i++)
+		checksum = (checksum ^ ((const guint8*)b)[i]) * 1099511628211ULL;
+}
+
+static void
+_command(const gchar *c, const gchar *s, const gchar *v)
+{
+	_sum(c, strlen(c)); _sum(s, strlen(s)); _sum(v, strlen(v));
+}
+
+static void
+_header(const gchar *k, const gchar *v)
+{
+	_sum(k, strlen(k)); _sum(v, strlen(v));
+}
+
+static void
+_body(const guint8 *data, gsize data_len)
+{
+	_sum(data, data_len);
+}
+
+/* Each input is copied first, as both parsers may alter it */
+static gboolean
+_run_legacy(GByteArray *stream, guint8 *input)
+{
+	struct legacy_parser_s parser = {0};
+	parser.buf = g_string_sized_new(1024);
+	parser.command_provider = _command;
+	parser.header_provider = _header;
+	parser.body_provider = _body;
+	legacy_reset(&parser);
+
+	gboolean ok = TRUE;
+	for (guint off = 0; ok && off < stream->len; off += input_size) {
+		gsize len = MIN(input_size, stream->len - off);
+		memcpy(input, stream->data + off, len);
+		for (guint8 *p = input; ok && len > 0;) {
+			gboolean done = FALSE;
+			gssize rc = legacy_parse(&parser, p, len, &done);
+			if (rc < 0) {
+				ok = FALSE;
+			} else {
+				p += rc;
+				len -= rc;
+				if (done) {
+					parsed ++;
+					legacy_reset(&parser);
+				}
+			}
+		}
+	}
+	g_string_free(parser.buf, TRUE);
+	return ok;
+}
+
+static gboolean
+_run_vectorized(GByteArray *stream, guint8 *input)
+{
+	struct http_parser_s *parser = http_parser_create();
+	parser->command_provider = _command;
+	parser->header_provider = _header;
+	parser->body_provider = _body;
+
+	gboolean ok = TRUE;
+	for (guint off = 0; ok && off < stream->len; off += input_size) {
+		gsize len = MIN(input_size, stream->len - off);
+		memcpy(input, stream->data + off, len);
+		for (guint8 *p = input; ok && len > 0;) {
+			struct http_parsing_result_s rc = http_parse(parser, p, len);
+			if (rc.status == HPRC_ERROR) {
+				ok = FALSE;
+			} else {
+				p += rc.consumed;
+				len -= rc.consumed;
+				if (rc.status == HPRC_SUCCESS) {
+					parsed ++;
+					http_parser_reset(parser);
+				}
+			}
+		}
+	}
+	http_parser_destroy(parser);
+	return ok;
+}
+
+static void
+cli_action(void)
+{
+	if (!input_size) {
+		GRID_ERROR("Invalid input size");
+		grid_main_set_status(1);
+		return;
+	}
+
+	GByteArray *stream = _make_stream();
+	guint8 *input = g_malloc(input_size);
+
+	/* Check both parsers see the same requests */
+	checksum = 0, parsed = 0;
+	gboolean ok0 = _run_legacy(stream, input);
+	const guint64 sum0 = checksum;
+	const guint parsed0 = parsed;
+	checksum = 0, parsed = 0;
+	gboolean ok1 = _run_vectorized(stream, input);
+	const gboolean mismatch = !ok0 || !ok1
+		|| sum0 != checksum || parsed0 != parsed || parsed != requests;
+
+	gint64 start = oio_ext_monotonic_time();
+	for (guint it = 0; it < iterations; it++)
+		_run_legacy(stream, input);
+	const gint64 legacy = oio_ext_monotonic_time() - start;
+
+	start = oio_ext_monotonic_time();
+	for (guint it = 0; it < iterations; it++)
+		_run_vectorized(stream, input);
+	const gint64 vectorized = oio_ext_monotonic_time() - start;
+
+	const gdouble total = (gdouble) iterations * requests;
+	const gdouble mib = (gdouble) iterations * stream->len / (1024 * 1024);
+	GRID_NOTICE("%u requests (%u bytes) in inputs of %u bytes, x %u iterations%s",
+			requests, stream->len, input_size, iterations,
+			mismatch ? ", MISMATCH" : "");
+	GRID_NOTICE("legacy: %.3fs, %.1fns per request, %.1f MiB/s",
+			legacy / (gdouble) G_TIME_SPAN_SECOND, legacy * 1000.0 / total,
+			mib * G_TIME_SPAN_SECOND / MAX(1, legacy));
+	GRID_NOTICE("vectorized: %.3fs, %.1fns per request, %.1f MiB/s",
+			vectorized / (gdouble) G_TIME_SPAN_SECOND,
+			vectorized * 1000.0 / total,
+			mib * G_TIME_SPAN_SECOND / MAX(1, vectorized));
+	if (mismatch)
+		grid_main_set_status(1);
+
+	g_free(input);
+	g_byte_array_free(stream, TRUE);
+}
+
+static struct grid_main_option_s *
+cli_get_options(void)
+{
+	static struct grid_main_option_s cli_options[] = {
+		{"iterations", OT_UINT, {.u=&iterations},
+			"Number of times the stream of requests is parsed."},
+		{"requests", OT_UINT, {.u=&requests},
+			"Number of requests in the stream."},
+		{"input", OT_UINT, {.u=&input_size},
+			"Size of the inputs the stream is cut into."},
+		{NULL, 0, {.i=0}, NULL}
+	};
+	return cli_options;
+}
+
+static void
+cli_set_defaults(void)
+{
+	oio_log_init_level(GRID_LOGLVL_NOTICE);
+}
+
+static void
+cli_specific_fini(void)
+{
+	/* no op */
+}
+
+static void
+cli_specific_stop(void)
+{
+	/* no op */
+}
+
+static const gchar *
+cli_usage(void)
+{
+	return "";
+}
+
+static gboolean
+cli_configure(int argc UNUSED, char **argv UNUSED)
+{
+	return TRUE;
+}
+
+struct grid_main_callbacks cli_callbacks =
+{
+	.options = cli_get_options,
+	.action = cli_action,
+	.set_defaults = cli_set_defaults,
+	.specific_fini = cli_specific_fini,
+	.configure = cli_configure,
+	.usage = cli_usage,
+	.specific_stop = cli_specific_stop,
+};
+
+int
+main(int argc, char **args)
+{
+	return grid_main_cli(argc, args, &cli_callbacks);
+}
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS proxy
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -52,6 +52,52 @@ _lb_pack_srvid_tab(const char **ids)
 	return gstr;
 }
 
+/* Poll several independent sets of services at once, and reply with an
+ * array of arrays as produced by _lb_pack_srvid_tab() */
+static enum http_rc_e
+_lb_sets(struct req_args_s *args, struct oio_lb_pool_s *pool, guint sets)
+{
+	GPtrArray *tabs = g_ptr_array_new();
+	for (guint i = 0; i < sets; i++)
+		g_ptr_array_add(tabs, g_ptr_array_new_with_free_func(g_free));
+
+	guint polled = 0;
+	void _on_id(guint set, struct oio_lb_selected_item_s *sel) {
+		g_ptr_array_add(tabs->pdata[set], g_strdup(sel->item->id));
+		polled = set + 1;
+	}
+	enum http_rc_e code;
+	gboolean flawed = FALSE;
+	GError *err = oio_lb_pool__poll_sets(pool, sets, NULL, _on_id, &flawed);
+	if (err) {
+		g_prefix_error(&err,
+				"found only %u sets of services matching the criteria: ",
+				polled);
+		code = _reply_common_error(args, err);
+	} else {
+		GString *gstr = g_string_sized_new(512 * sets);
+		g_string_append_c(gstr, '[');
+		for (guint i = 0; i < sets; i++) {
+			GPtrArray *ids = tabs->pdata[i];
+			g_ptr_array_add(ids, NULL);
+			GString *tab = _lb_pack_srvid_tab((const char**)ids->pdata);
+			if (i)
+				g_string_append_c(gstr, ',');
+			g_string_append_len(gstr, tab->str, tab->len);
+			g_string_free(tab, TRUE);
+		}
+		g_string_append_c(gstr, ']');
+		if (flawed)
+			args->rp->add_header(
+					PROXYD_HEADER_PREFIX "lb-flawed", g_strdup("1"));
+		code = _reply_success_json(args, gstr);
+	}
+
+	g_ptr_array_foreach(tabs, (GFunc)g_ptr_array_unref, NULL);
+	g_ptr_array_free(tabs, TRUE);
+	return code;
+}
+
 static enum http_rc_e
 _lb(struct req_args_s *args, const char *srvtype)
 {
@@ -59,10 +105,15 @@ _lb(struct req_args_s *args, const char *srvtype)
 
 	const char *slot = OPT("slot");
 	const char *sz = OPT("size");
+	const char *str_sets = OPT("sets");
 
 	gint64 howmany = 1;
 	if (sz && !oio_str_is_number(sz, &howmany))
 		return _reply_format_error(args, BADREQ("Invalid size"));
+	gint64 sets = 1;
+	if (str_sets && (!oio_str_is_number(str_sets, &sets)
+				|| sets < 1 || sets > G_MAXUINT16))
+		return _reply_format_error(args, BADREQ("Invalid sets"));
 
 	struct oio_lb_pool_s *pool = oio_lb_world__create_pool(lb_world, srvtype);
 	GString *targets = g_string_sized_new(64);
@@ -83,6 +134,12 @@ _lb(struct req_args_s *args, const char *srvtype)
 	oio_lb_world__add_pool_targets(pool, targets->str);
 	g_string_free(targets, TRUE);
 
+	if (str_sets) {
+		code = _lb_sets(args, pool, sets);
+		oio_lb_pool__destroy(pool);
+		return code;
+	}
+
 	GPtrArray *ids = g_ptr_array_new_with_free_func(g_free);
 	void _on_id(struct oio_lb_selected_item_s *sel, gpointer u UNUSED) {
 		g_ptr_array_add(ids, g_strdup(sel->item->id));
@@ -72,6 +72,9 @@ GRWLock wanted_rwlock = {0};
 gchar **wanted_srvtypes = NULL;
 GBytes **wanted_prepared = NULL;
 
+static GMutex mirrors_lock = {0};
+static GHashTable *mirrors = NULL;
+
 // Misc. handlers --------------------------------------------------------------
 
 static enum http_rc_e
@@ -115,6 +118,11 @@ action_status(struct req_args_s *args)
 	g_string_append_printf(gstr, "gauge down.srv %"G_GINT64_FORMAT"\n", cd);
 	g_string_append_printf(gstr, "gauge known.srv %"G_GINT64_FORMAT"\n", ck);
 
+	guint cnx_peers = 0, cnx_idle = 0;
+	service_cnx_count(&cnx_peers, &cnx_idle);
+	g_string_append_printf(gstr, "gauge cnx.idle.srv %u\n", cnx_peers);
+	g_string_append_printf(gstr, "gauge cnx.idle %u\n", cnx_idle);
+
 	args->rp->set_body_gstr(gstr);
 	args->rp->set_status(HTTP_CODE_OK, "OK");
 	args->rp->set_content_type("text/x-java-properties");
@@ -313,6 +321,7 @@ handler_action (struct http_request_s *rq, struct http_reply_ctx_s *rp)
 	oio_stats_add(
 			gq_count, 1, gq_count_all, 1,
 			gq_time, (guint64) spent, gq_time_all, (guint64) spent);
+	oio_stats_histo_add(gq_time, (guint64) spent, gq_time_all, (guint64) spent);
 
 	path_matching_cleanv (matchings);
 	oio_requri_clear (&ruri);
@@ -375,6 +384,14 @@ _task_expire_local (gpointer p UNUSED)
 		GRID_INFO("Expired %u local services", count);
 }
 
+static void
+_task_expire_cnx (gpointer p UNUSED)
+{
+	guint count = service_cnx_expire ();
+	if (count)
+		GRID_DEBUG("Closed %u idle connections", count);
+}
+
 static void
 _task_expire_resolver (gpointer p UNUSED)
 {
@@ -431,9 +448,48 @@ _encode_wanted_services (const char *type, GSList *list)
 	return g_string_free_to_bytes(encoded);
 }
 
+/* Fetch the services of <type> changed since the last refresh. A full list
+ * is asked when the incremental refreshes are disabled, or when enough of
+ * them happened in a row. Call it with <mirrors_lock> held. */
+static GError *
+_srvtype_mirror_refresh(gchar **cs, const char *type,
+		struct srvtype_update_s **out)
+{
+	struct srvtype_mirror_s *mirror = g_hash_table_lookup(mirrors, type);
+	if (!mirror) {
+		mirror = srvtype_mirror_create();
+		g_hash_table_insert(mirrors, g_strdup(type), mirror);
+	}
+
+	struct conscience_changes_s changes = {};
+	if (proxy_cs_delta_max > 0 && mirror->deltas < proxy_cs_delta_max) {
+		changes.epoch = mirror->epoch;
+		changes.generation = mirror->generation;
+	}
+
+	GError *err = conscience_remote_get_changes(cs, type, TRUE,
+			&changes, oio_ext_get_deadline());
+	if (err)
+		return err;
+
+	*out = srvtype_mirror_apply(mirror, &changes);
+	GRID_DEBUG("Services [%s] %s: %u changed, %u refreshed, %u removed,"
+			" %u known", type, (*out)->delta ? "delta" : "full",
+			g_slist_length((*out)->changed),
+			g_slist_length((*out)->refreshed),
+			g_slist_length((*out)->stale),
+			g_hash_table_size(mirror->services));
+	return NULL;
+}
+
 static void
-_reload_srvtype(const char *type, GSList *list)
+_reload_srvtype(const char *type, struct srvtype_update_s *update,
+		gboolean full)
 {
+	GSList *list = update->all;
+	const gboolean unchanged = update->delta
+		&& !update->changed && !update->refreshed && !update->stale;
+
 	/* reloads the known services */
 	time_t now = oio_ext_monotonic_seconds ();
 	SRV_WRITE(for (GSList *l=list; l ;l=l->next) {
@@ -448,18 +504,19 @@ _reload_srvtype(const char *type, GSList *list)
 	}
 
 	/* prepares a cache of services wanted by the clients */
-	if (flag_cache_enabled && NULL != list) {
+	if (flag_cache_enabled && NULL != list && !unchanged) {
 		GBytes *encoded = _encode_wanted_services (type, list);
 		WANTED_WRITE (encoded = _NOLOCK_precache_list_of_services (type, encoded));
 		g_bytes_unref (encoded);
 	}
 
-	/* reload the LB worlds, all of them #facepalm */
-	if (list) {
-		oio_lb_world__feed_service_info_list(lb_world, list);
+	void _feed(GSList *services) {
+		if (!services)
+			return;
+		oio_lb_world__feed_service_info_list(lb_world, services);
 
 		GSList *rlist = NULL;
-		for (GSList *l = list; l; l=l->next) {
+		for (GSList *l = services; l; l=l->next) {
 			struct service_info_s *si = l->data;
 			if (!si || strcmp(si->type, NAME_SRVTYPE_RAWX)) continue;
 			rlist = g_slist_prepend(rlist, si);
@@ -467,12 +524,23 @@ _reload_srvtype(const char *type, GSList *list)
 		oio_lb_world__feed_service_info_list(lb_world_rawx, rlist);
 		g_slist_free(rlist);
 	}
+
+	/* reload the LB worlds, all of them #facepalm. When no type needed
+	 * a full refresh, the changes are applied in place: the stale
+	 * versions leave their slots, then the new versions are fed. */
+	if (full) {
+		_feed(list);
+	} else {
+		_feed(update->stale);
+		_feed(update->changed);
+	}
 }
 
 static void
 _reload_lb_service_types(
 		struct oio_lb_world_s *lbw, struct oio_lb_s *lb_,
-		gchar **tabtypes, GPtrArray *tabsrv, GPtrArray *taberr)
+		gchar **tabtypes, GPtrArray *tabsrv, GPtrArray *taberr,
+		gboolean full)
 {
 	struct service_update_policies_s *pols = service_update_policies_create();
 	gchar *pols_cfg = oio_var_get_string(oio_ns_service_update_policy);
@@ -488,20 +556,12 @@ _reload_lb_service_types(
 		}
 
 		if (!taberr->pdata[i])
-			_reload_srvtype(srvtype, tabsrv->pdata[i]);
+			_reload_srvtype(srvtype, tabsrv->pdata[i], full);
 	}
 
 	service_update_policies_destroy(pols);
 }
 
-static void
-_free_list_of_services(gpointer p)
-{
-	if (!p)
-		return;
-	g_slist_free_full((GSList*)p, (GDestroyNotify)service_info_clean);
-}
-
 static void
 _free_error(gpointer p)
 {
@@ -510,29 +570,6 @@ _free_error(gpointer p)
 	g_error_free((GError*)p);
 }
 
-static GSList *
-_filter_good_services(GSList *src, GSList **out_garbage)
-{
-	GSList *good = NULL, *bad = NULL;
-
-	while (src) {
-		GSList *next = src->next;
-		struct service_info_s *si = src->data;
-
-		if (metautils_addr_valid_for_connect(&si->addr)) {
-			src->next = good;
-			good = src;
-		} else {
-			src->next = bad;
-			bad = src;
-		}
-		src = next;
-	}
-
-	*out_garbage = bad;
-	return good;
-}
-
 /* If you ever plan to factorize this code with the similar part in
  * sqlx/sqlx_service.c be carefull that a lot of context is expected on both
  * sides, and that even the function used to fetch the services cannot be the
@@ -543,7 +580,7 @@ lb_cache_reload (void)
 	struct namespace_info_s *nsi = NULL;
 	gchar **tabtypes = NULL;
 	GPtrArray *tabsrv = NULL, *taberr = NULL;
-	gboolean any_loading_error = FALSE;
+	gboolean any_loading_error = FALSE, any_full = FALSE;
 	down_hosts_t down = NULL;
 	guint nb_down = 0;
 
@@ -559,35 +596,39 @@ lb_cache_reload (void)
 		goto out;
 	}
 
+	/* The lists of services are borrowed from the mirrors */
+	g_mutex_lock(&mirrors_lock);
+
 	/* preload all the services */
-	tabsrv = g_ptr_array_new_full(8, _free_list_of_services);
+	tabsrv = g_ptr_array_new_full(8,
+			(GDestroyNotify)srvtype_update_destroy);
 	taberr = g_ptr_array_new_full(8, _free_error);
 	for (char **pt=tabtypes; *pt ;++pt) {
-		GSList *srv = NULL;
+		struct srvtype_update_s *update = NULL;
 		/* TODO(mbo): only retrieve static tags to still use cache on conscience side */
-		GError *e = conscience_remote_get_services(cs, *pt, TRUE, &srv, oio_ext_get_deadline());
+		GError *e = _srvtype_mirror_refresh(cs, *pt, &update);
 		if (e) {
 			GRID_WARN("Failed to load the list of [%s] in NS=%s", *pt, ns_name);
 			any_loading_error = TRUE;
+		} else {
+			any_full |= !update->delta;
+			nb_down += gridd_client_update_down_hosts(&down, update->all);
 		}
 
-		GSList *bad = NULL;
-		srv = _filter_good_services(srv, &bad);
-		g_slist_free_full(bad, (GDestroyNotify)service_info_clean);
-
-		g_ptr_array_add(tabsrv, srv);
+		g_ptr_array_add(tabsrv, update);
 		g_ptr_array_add(taberr, e);
-		nb_down += gridd_client_update_down_hosts(&down, srv);
 	}
 	gridd_client_replace_global_down_hosts(&down, nb_down);
 
+	/* A full refresh of any type requires all the types to be fed, the
+	 * items not fed are purged. Otherwise, the LB worlds are patched. */
 #define reload_lb(W,L) do { \
-	if (!any_loading_error) \
+	if (!any_loading_error && any_full) \
 		oio_lb_world__increment_generation(W); \
 	oio_lb_world__reload_pools(W, L, nsi); \
-	_reload_lb_service_types(W, L, tabtypes, tabsrv, taberr); \
+	_reload_lb_service_types(W, L, tabtypes, tabsrv, taberr, any_full); \
 	oio_lb_world__reload_storage_policies(W, L, nsi); \
-	if (!any_loading_error) \
+	if (!any_loading_error && any_full) \
 		oio_lb_world__purge_old_generations(W); \
 	else \
 		oio_lb_world__rehash_all_slots(W); \
@@ -597,6 +638,8 @@ lb_cache_reload (void)
 	reload_lb(lb_world, lb);
 	reload_lb(lb_world_rawx, lb_rawx);
 
+	g_mutex_unlock(&mirrors_lock);
+
 out:
 	if (tabtypes) g_free0 (tabtypes);
 	if (nsi) namespace_info_free(nsi);
@@ -907,6 +950,10 @@ grid_main_specific_fini (void)
 		lru_tree_destroy (srv_known);
 		srv_known = NULL;
 	}
+	if (mirrors) {
+		g_hash_table_destroy (mirrors);
+		mirrors = NULL;
+	}
 	if (srv_master) {
 		lru_tree_destroy (srv_master);
 		srv_master = NULL;
@@ -1219,6 +1266,8 @@ grid_main_configure (int argc, char **argv)
 
 	srv_down = lru_tree_create((GCompareFunc)g_strcmp0, g_free, NULL, LTO_NOATIME);
 	srv_known = lru_tree_create((GCompareFunc)g_strcmp0, g_free, NULL, LTO_NOATIME);
+	mirrors = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify)srvtype_mirror_destroy);
 	srv_master = lru_tree_create((GCompareFunc)g_strcmp0, g_free, g_free, LTO_NOATIME);
 
 	oio_resolver_cache_enabled = BOOL(flag_cache_enabled);
@@ -1260,6 +1309,9 @@ grid_main_configure (int argc, char **argv)
 	grid_task_queue_register (admin_gtq, 1,
 		(GDestroyNotify) _task_expire_resolver, NULL, NULL);
 
+	grid_task_queue_register (admin_gtq, 1,
+		(GDestroyNotify) _task_expire_cnx, NULL, NULL);
+
 	grid_task_queue_register (admin_gtq, 1,
 		(GDestroyNotify) _task_reload_csurl, NULL, NULL);
 
@@ -0,0 +1,174 @@
+/*
+OpenIO SDS proxy
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "srvtype_mirror.h"
+
+void
+conscience_changes_clean(struct conscience_changes_s *changes)
+{
+	if (!changes)
+		return;
+	g_slist_free_full(changes->services, (GDestroyNotify)service_info_clean);
+	g_slist_free_full(changes->removed, (GDestroyNotify)service_info_clean);
+	changes->services = changes->removed = NULL;
+}
+
+struct srvtype_mirror_s *
+srvtype_mirror_create(void)
+{
+	struct srvtype_mirror_s *mirror = g_malloc0(sizeof(*mirror));
+	mirror->services = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify)service_info_clean);
+	return mirror;
+}
+
+void
+srvtype_mirror_destroy(struct srvtype_mirror_s *mirror)
+{
+	if (!mirror)
+		return;
+	g_hash_table_destroy(mirror->services);
+	g_free(mirror);
+}
+
+void
+srvtype_update_destroy(struct srvtype_update_s *update)
+{
+	if (!update)
+		return;
+	g_slist_free(update->all);
+	g_slist_free(update->changed);
+	g_slist_free(update->refreshed);
+	g_slist_free_full(update->stale, (GDestroyNotify)service_info_clean);
+	g_free(update);
+}
+
+/* Count the "tag." tags of <si> whose value is the same in <other> */
+static guint
+_count_same_tags(const struct service_info_s *si,
+		const struct service_info_s *other, guint *total)
+{
+	guint same = 0;
+	*total = 0;
+	for (guint i = 0; si->tags && i < si->tags->len; i++) {
+		const struct service_tag_s *tag = si->tags->pdata[i];
+		if (!g_str_has_prefix(tag->name, "tag."))
+			continue;
+		++ *total;
+		gchar v0[256] = "", v1[256] = "";
+		service_tag_to_string(tag, v0, sizeof(v0));
+		const struct service_tag_s *t1 =
+			service_info_get_tag(other->tags, tag->name);
+		if (!t1)
+			continue;
+		service_tag_to_string(t1, v1, sizeof(v1));
+		same += !strcmp(v0, v1);
+	}
+	return same;
+}
+
+/* Tells if the load-balancers see no difference between <a> and <b>: same
+ * score, same "tag." tags. The "stat." tags do not matter to them. */
+static gboolean
+_same_for_lb(const struct service_info_s *a, const struct service_info_s *b)
+{
+	if (a->score.value != b->score.value)
+		return FALSE;
+	guint total_a = 0, total_b = 0;
+	const guint same = _count_same_tags(a, b, &total_a);
+	_count_same_tags(b, a, &total_b);
+	return same == total_a && total_a == total_b;
+}
+
+/* Move the service known at <key> out of the mirror, to the list of the
+ * stale services. Its score is zeroed so that feeding it removes it from
+ * the LB slots. */
+static void
+_srvtype_mirror_forget(struct srvtype_mirror_s *mirror, const char *key,
+		struct srvtype_update_s *update)
+{
+	gpointer k = NULL, v = NULL;
+	if (!g_hash_table_lookup_extended(mirror->services, key, &k, &v))
+		return;
+	g_hash_table_steal(mirror->services, key);
+	g_free(k);
+	struct service_info_s *si = v;
+	si->score.value = SCORE_DOWN;
+	update->stale = g_slist_prepend(update->stale, si);
+}
+
+struct srvtype_update_s *
+srvtype_mirror_apply(struct srvtype_mirror_s *mirror,
+		struct conscience_changes_s *changes)
+{
+	struct srvtype_update_s *update = g_malloc0(sizeof(*update));
+	update->delta = changes->delta;
+
+	if (!changes->delta) {
+		g_hash_table_remove_all(mirror->services);
+		mirror->deltas = 0;
+	} else {
+		mirror->deltas ++;
+	}
+	mirror->epoch = changes->epoch;
+	mirror->generation = changes->generation;
+
+	gchar key[STRLEN_ADDRINFO];
+	for (GSList *l = changes->removed; l; l = l->next) {
+		struct service_info_s *si = l->data;
+		grid_addrinfo_to_string(&si->addr, key, sizeof(key));
+		_srvtype_mirror_forget(mirror, key, update);
+	}
+
+	for (GSList *l = changes->services; l; l = l->next) {
+		struct service_info_s *si = l->data;
+		l->data = NULL;
+		if (!metautils_addr_valid_for_connect(&si->addr)) {
+			service_info_clean(si);
+			continue;
+		}
+		grid_addrinfo_to_string(&si->addr, key, sizeof(key));
+
+		struct service_info_s *old =
+			g_hash_table_lookup(mirror->services, key);
+		const gboolean only_stats = old && _same_for_lb(old, si);
+
+		/* The service may have left some slots */
+		if (old && g_strcmp0(
+					service_info_get_tag_value(old, NAME_TAGNAME_SLOTS, NULL),
+					service_info_get_tag_value(si, NAME_TAGNAME_SLOTS, NULL)))
+			_srvtype_mirror_forget(mirror, key, update);
+
+		g_hash_table_replace(mirror->services, g_strdup(key), si);
+		if (only_stats)
+			update->refreshed = g_slist_prepend(update->refreshed, si);
+		else
+			update->changed = g_slist_prepend(update->changed, si);
+	}
+
+	GHashTableIter iter;
+	gpointer v = NULL;
+	g_hash_table_iter_init(&iter, mirror->services);
+	while (g_hash_table_iter_next(&iter, NULL, &v))
+		update->all = g_slist_prepend(update->all, v);
+
+	conscience_changes_clean(changes);
+	return update;
+}
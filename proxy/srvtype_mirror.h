@@ -0,0 +1,76 @@
+/*
+OpenIO SDS proxy
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OIO_SDS__proxy__srvtype_mirror_h
+# define OIO_SDS__proxy__srvtype_mirror_h 1
+
+# include <glib.h>
+# include <metautils/lib/metautils.h>
+
+/* The services of a type changed since a generation known by the caller.
+ * The generations are only meaningful in the run of the conscience that
+ * numbered them, the one identified by <epoch>. */
+struct conscience_changes_s
+{
+	gint64 epoch;
+	gint64 generation;
+	/* FALSE when <services> is the full list of services */
+	gboolean delta;
+	GSList *services;  /* <struct service_info_s*> added or changed */
+	GSList *removed;  /* <struct service_info_s*> */
+};
+
+void conscience_changes_clean(struct conscience_changes_s *changes);
+
+/* The services known from the conscience, for one type. It is refreshed
+ * with the changes since the last generation received. */
+struct srvtype_mirror_s
+{
+	gint64 epoch;
+	gint64 generation;
+	guint deltas;  /* Consecutive incremental refreshes */
+	GHashTable *services;  /* <gchar*,struct service_info_s*> by address */
+};
+
+/* What a refresh of the services of a type brings */
+struct srvtype_update_s
+{
+	gboolean delta;
+	GSList *all;  /* <struct service_info_s*> borrowed from the mirror */
+	/* <struct service_info_s*> borrowed from the mirror, whose score or
+	 * "tag." tags changed, i.e. to be fed to the load-balancers */
+	GSList *changed;
+	/* <struct service_info_s*> borrowed from the mirror, whose "stat." tags
+	 * only changed */
+	GSList *refreshed;
+	GSList *stale;  /* <struct service_info_s*> old versions, zero scored */
+};
+
+struct srvtype_mirror_s * srvtype_mirror_create(void);
+
+void srvtype_mirror_destroy(struct srvtype_mirror_s *mirror);
+
+/* Apply the changes received from the conscience to the mirror. The
+ * services of <changes> then belong to the mirror, and <changes> is
+ * cleaned. */
+struct srvtype_update_s * srvtype_mirror_apply(
+		struct srvtype_mirror_s *mirror, struct conscience_changes_s *changes);
+
+void srvtype_update_destroy(struct srvtype_update_s *update);
+
+#endif /*OIO_SDS__proxy__srvtype_mirror_h*/
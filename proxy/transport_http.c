@@ -1,7 +1,7 @@
 /*
 OpenIO SDS proxy
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <server/network_server.h>
 
 #include "transport_http.h"
+#include "http_parser.h"
 
 struct transport_client_context_s
 {
@@ -49,219 +50,6 @@ static int http_notify_input(struct network_client_s *clt);
 
 //------------------------------------------------------------------------------
 
-enum http_parser_step_e
-{
-	STEP_FIRST_R0, STEP_FIRST_N0,
-	STEP_SEP_R0, STEP_SEP_N0,
-	STEP_HEADERS_R0, STEP_HEADERS_N0,
-	STEP_BODY_ASIS
-};
-
-struct http_parser_s
-{
-	enum http_parser_step_e step;
-	GError *error;
-	GString *buf;
-
-	gint64 content_read;
-	gint64 content_length;
-	void (*command_provider)(const gchar *req, const gchar *sel, const gchar *ver);
-	void (*header_provider)(const gchar *name, const gchar *value);
-	void (*body_provider)(const guint8 *data, gsize data_len);
-};
-
-struct http_parsing_result_s
-{
-	enum { HPRC_SUCCESS = 0, HPRC_MORE, HPRC_ERROR } status;
-};
-
-static void
-gstr_chomp(GString *gstr)
-{
-	if (!gstr)
-		return;
-	gchar *start, *end;
-	start = gstr->str;
-	end = start + gstr->len;
-	while (end > start && (*(end-1) == '\n' || *(end-1) == '\r'))
-		*(--end) = '\0';
-}
-
-static gboolean
-_manage_and_renew_command(struct http_parser_s *parser, GString *buf)
-{
-	gchar *cmd, *selector, *version;
-
-	if (!buf->len)
-		return FALSE;
-
-	gstr_chomp(buf);
-	cmd = buf->str;
-	selector = strchr(cmd, ' ');
-	if (!selector)
-		return FALSE;
-	*(selector++) = '\0';
-	version = strrchr(selector, ' ');
-	if (!version)
-		return FALSE;
-	*(version++) = '\0';
-
-	if (parser->command_provider)
-		parser->command_provider(cmd, selector, version);
-
-	g_string_set_size(buf, 0);
-	return TRUE;
-}
-
-static gboolean
-_manage_and_renew_header(struct http_parser_s *parser, GString *buf)
-{
-	if (!buf->len)
-		return TRUE;
-
-	gstr_chomp(buf);
-	gchar *header = buf->str;
-	gchar *sep = strchr(header, ':');
-	if (!sep)
-		return FALSE;
-	*(sep++) = '\0';
-	if (*(sep++) != ' ')
-		return FALSE;
-
-	oio_str_lower (header);
-	if (*header == 'c' && !strcmp(header, "content-length"))
-		parser->content_length = g_ascii_strtoll(sep, NULL, 10);
-
-	if (parser->header_provider)
-		parser->header_provider(header, sep);
-
-	g_string_set_size(buf, 0);
-	return TRUE;
-}
-
-static struct http_parsing_result_s
-http_parse(struct http_parser_s *parser, const guint8 *data, gsize available)
-{
-	gsize consumed = 0;
-
-	struct http_parsing_result_s _build_rc(int status, const gchar *msg) {
-		struct http_parsing_result_s rc;
-		if (msg)
-			parser->error = NEWERROR(0, "%s", msg);
-		rc.status = status;
-		return rc;
-	}
-
-	while (consumed < available) {
-		guint8 d = data[consumed];
-		gint64 max;
-		switch (parser->step) {
-
-			case STEP_FIRST_R0:
-				if (d == '\r')
-					parser->step = STEP_FIRST_N0;
-				else
-					g_string_append_c(parser->buf, d);
-				++ consumed;
-				continue;
-
-			case STEP_FIRST_N0:
-				if (d == '\n') {
-					if (!_manage_and_renew_command(parser, parser->buf))
-						return _build_rc(HPRC_ERROR, "CMD parsing error");
-					parser->step = STEP_SEP_R0;
-					++ consumed;
-					continue;
-				}
-				return _build_rc(HPRC_ERROR, "CMD parsing error");
-
-			case STEP_SEP_R0:
-				if (d == '\r')
-					parser->step = STEP_SEP_N0;
-				else {
-					if (!_manage_and_renew_header(parser, parser->buf))
-						return _build_rc(HPRC_ERROR, "HDR parsing error");
-					g_string_append_c(parser->buf, d);
-					parser->step = STEP_HEADERS_R0;
-				}
-				++ consumed;
-				continue;
-
-			case STEP_SEP_N0:
-				if (d == '\n') {
-					++ consumed;
-					if (!_manage_and_renew_header(parser, parser->buf))
-						return _build_rc(HPRC_ERROR, "HDR parsing error");
-					parser->step = STEP_BODY_ASIS;
-					if (parser->content_read >= parser->content_length)
-						return _build_rc(HPRC_SUCCESS, NULL);
-					continue;
-				}
-				return _build_rc(HPRC_ERROR, "SEP parsing error");
-
-			case STEP_HEADERS_R0:
-				if (d == '\r')
-					parser->step = STEP_HEADERS_N0;
-				else
-					g_string_append_c(parser->buf, d);
-				++ consumed;
-				continue;
-
-			case STEP_HEADERS_N0:
-				if (d == '\n') {
-					parser->step = STEP_SEP_R0;
-					++ consumed;
-					continue;
-				}
-				return _build_rc(HPRC_ERROR, "HDR parsing error");
-
-			case STEP_BODY_ASIS:
-				max = available - consumed;
-				if (max > (parser->content_length - parser->content_read))
-					max = parser->content_length - parser->content_read;
-				if (parser->body_provider)
-					parser->body_provider(data+consumed, max);
-				consumed += max;
-				parser->content_read += max;
-
-				if (parser->content_read >= parser->content_length)
-					return _build_rc(HPRC_SUCCESS, NULL);
-				continue;
-		}
-	}
-
-	return _build_rc(HPRC_MORE, NULL);
-}
-
-static void
-http_parser_reset(struct http_parser_s *parser)
-{
-	parser->step = STEP_FIRST_R0;
-	g_string_set_size(parser->buf, 0);
-	parser->content_read = 0;
-	parser->content_length = -1;
-	if (parser->error)
-		g_clear_error(&parser->error);
-}
-
-static struct http_parser_s*
-http_parser_create(void)
-{
-	struct http_parser_s *parser = g_malloc0(sizeof(struct http_parser_s));
-	parser->buf = g_string_sized_new(1024);
-	http_parser_reset(parser);
-	return parser;
-}
-
-static void
-http_parser_destroy(struct http_parser_s *parser)
-{
-	if (!parser)
-		return;
-	g_string_free(parser->buf, TRUE);
-	g_free(parser);
-}
-
 static struct http_request_s *
 http_request_create(struct network_client_s *client)
 {
@@ -467,15 +255,12 @@ http_manage_request(struct req_ctx_s *r)
 
 		// Finalize and send the headers
 		g_string_append_static(buf, "\r\n");
-		if (body) {
-			sock_set_cork(r->client->fd, TRUE);
-		}
-		network_client_send_slab(r->client, data_slab_make_gstr(buf));
-
-		// Now send the body
-		if (body) {
+		if (!body) {
+			network_client_send_slab(r->client, data_slab_make_gstr(buf));
+		} else {
+			// The headers and the body leave in a single writev()
+			network_client_queue_slab(r->client, data_slab_make_gstr(buf));
 			network_client_send_slab(r->client, data_slab_make_gbytes(body));
-			sock_set_cork(r->client->fd, FALSE);
 		}
 		body = NULL;
 
@@ -601,42 +386,50 @@ http_notify_input(struct network_client_s *clt)
 			continue;
 		}
 
-		struct http_parsing_result_s rc = http_parse(parser, data, data_size);
-
-		if (rc.status == HPRC_SUCCESS) {
-
-			// Important times are now known.
-			// First, the last chunk of data received;
-			// Second, the moment the real treatment start ... i.e. now!
-			r.tv_start = clt->time.evt_in;
-			r.tv_parsed = oio_ext_monotonic_time();
-
-			GError *err = http_manage_request(&r);
-
-			http_parser_reset(parser);
-			http_request_clean(r.request);
-			r.request = r.context->request = http_request_create(r.client);
-
-			if (err) {
-				GRID_INFO("Request management error: %d %s",
-						err->code, err->message);
-				g_clear_error(&err);
-				network_client_allow_input(clt, FALSE);
-				network_client_close_output(clt, 0);
-				done = TRUE;
+		/* A single input may carry several pipelined requests */
+		while (!done && data_size > 0) {
+			struct http_parsing_result_s rc = http_parse(parser, data, data_size);
+			EXTRA_ASSERT(rc.status == HPRC_ERROR || rc.consumed <= data_size);
+			data += rc.consumed;
+			data_size -= rc.consumed;
+
+			if (rc.status == HPRC_SUCCESS) {
+
+				// Important times are now known.
+				// First, the last chunk of data received;
+				// Second, the moment the real treatment start ... i.e. now!
+				r.tv_start = clt->time.evt_in;
+				r.tv_parsed = oio_ext_monotonic_time();
+
+				GError *err = http_manage_request(&r);
+
+				http_parser_reset(parser);
+				http_request_clean(r.request);
+				r.request = r.context->request = http_request_create(r.client);
+
+				if (err) {
+					GRID_INFO("Request management error: %d %s",
+							err->code, err->message);
+					g_clear_error(&err);
+					network_client_allow_input(clt, FALSE);
+					network_client_close_output(clt, 0);
+					done = TRUE;
+				}
+				else if (r.close_after_request) {
+					GRID_TRACE("No connection keep-alive, closing.");
+					network_client_allow_input(clt, FALSE);
+					network_client_close_output(clt, 0);
+					done = TRUE;
+				}
 			}
-			else if (r.close_after_request) {
-				GRID_TRACE("No connection keep-alive, closing.");
+			else if (rc.status == HPRC_ERROR) {
+				GRID_DEBUG("Request parsing error");
 				network_client_allow_input(clt, FALSE);
 				network_client_close_output(clt, 0);
 				done = TRUE;
 			}
-		}
-		else if (rc.status == HPRC_ERROR) {
-			GRID_DEBUG("Request parsing error");
-			network_client_allow_input(clt, FALSE);
-			network_client_close_output(clt, 0);
-			done = TRUE;
+			else
+				break;
 		}
 
 		data_slab_sequence_unshift(&clt->input, slab);
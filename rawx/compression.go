@@ -0,0 +1,225 @@
+// OpenIO SDS Go rawx
+// Copyright (C) 2020 OpenIO SAS
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+package main
+
+/*
+Block-framed compressed chunks. The clear data is cut in blocks of
+compressionBlockSize bytes, each block is compressed independently and the
+file ends with an index of the blocks and a fixed-size footer:
+
+	[block 0] ... [block N-1] [index: N x uint32] [footer]
+
+Each index entry is the size of the block on disk, its highest bit set when
+the block is stored without compression. The footer holds the size of the
+clear blocks, the number of blocks and a magic string.
+
+A range read only loads the index and then decodes the blocks covering the
+range, instead of decoding the chunk from its beginning.
+*/
+
+import (
+	"encoding/binary"
+	"errors"
+	"io"
+	"os"
+)
+
+const (
+	compressionBlockSize   = 64 * 1024
+	compressionBlockRaw    = 1 << 31
+	compressionFooterSize  = 16
+	compressionFooterMagic = "OIOBLK01"
+)
+
+var errCompressionCorrupted = errors.New("Corrupted compressed chunk")
+
+type blockWriter struct {
+	out   io.Writer
+	buf   []byte
+	comp  []byte
+	index []byte
+	count uint32
+	table lz4Table
+}
+
+func newBlockWriter(out io.Writer) *blockWriter {
+	return &blockWriter{
+		out:  out,
+		buf:  make([]byte, 0, compressionBlockSize),
+		comp: make([]byte, 0, lz4CompressBound(compressionBlockSize)),
+	}
+}
+
+func (bw *blockWriter) flushBlock() error {
+	if len(bw.buf) <= 0 {
+		return nil
+	}
+
+	bw.comp = lz4Compress(bw.comp, bw.buf, &bw.table)
+	block, entry := bw.comp, uint32(len(bw.comp))
+	if len(bw.comp) >= len(bw.buf) {
+		block, entry = bw.buf, uint32(len(bw.buf))|compressionBlockRaw
+	}
+	bw.buf = bw.buf[:0]
+
+	if _, err := dumpBuffer(bw.out, block); err != nil {
+		return err
+	}
+	var tmp [4]byte
+	binary.LittleEndian.PutUint32(tmp[:], entry)
+	bw.index = append(bw.index, tmp[:]...)
+	bw.count++
+	return nil
+}
+
+func (bw *blockWriter) Write(p []byte) (int, error) {
+	written := 0
+	for len(p) > 0 {
+		n := len(p)
+		if room := compressionBlockSize - len(bw.buf); n > room {
+			n = room
+		}
+		bw.buf = append(bw.buf, p[:n]...)
+		p = p[n:]
+		written += n
+		if len(bw.buf) >= compressionBlockSize {
+			if err := bw.flushBlock(); err != nil {
+				return written, err
+			}
+		}
+	}
+	return written, nil
+}
+
+// Flush the last block, then write the index and the footer
+func (bw *blockWriter) Close() error {
+	if err := bw.flushBlock(); err != nil {
+		return err
+	}
+	var footer [compressionFooterSize]byte
+	binary.LittleEndian.PutUint32(footer[0:], compressionBlockSize)
+	binary.LittleEndian.PutUint32(footer[4:], bw.count)
+	copy(footer[8:], compressionFooterMagic)
+	bw.index = append(bw.index, footer[:]...)
+	_, err := dumpBuffer(bw.out, bw.index)
+	return err
+}
+
+type blockReader struct {
+	f         *os.File
+	blockSize int64
+	offsets   []int64 // the offset of each block, then the end of the last
+	raw       []bool
+	next      int // the next block to load
+	skip      int // the bytes to skip in the next block loaded
+	comp      []byte
+	buf       []byte
+	pos       int
+}
+
+// Load the index of the compressed chunk, and prepare a reader of the clear
+// data starting at the given offset.
+func newBlockReader(in fileReader, offset int64) (*blockReader, error) {
+	f := in.File()
+	size := in.size()
+	if size < compressionFooterSize {
+		return nil, errCompressionCorrupted
+	}
+
+	var footer [compressionFooterSize]byte
+	if _, err := f.ReadAt(footer[:], size-compressionFooterSize); err != nil {
+		return nil, err
+	}
+	if string(footer[8:]) != compressionFooterMagic {
+		return nil, errCompressionCorrupted
+	}
+	blockSize := int64(binary.LittleEndian.Uint32(footer[0:]))
+	count := int64(binary.LittleEndian.Uint32(footer[4:]))
+	indexOffset := size - compressionFooterSize - 4*count
+	if blockSize <= 0 || indexOffset < 0 {
+		return nil, errCompressionCorrupted
+	}
+
+	index := make([]byte, 4*count)
+	if _, err := f.ReadAt(index, indexOffset); err != nil {
+		return nil, err
+	}
+	br := &blockReader{
+		f:         f,
+		blockSize: blockSize,
+		offsets:   make([]int64, count+1),
+		raw:       make([]bool, count),
+	}
+	for i := int64(0); i < count; i++ {
+		entry := binary.LittleEndian.Uint32(index[4*i:])
+		br.raw[i] = (entry & compressionBlockRaw) != 0
+		br.offsets[i+1] = br.offsets[i] + int64(entry&^compressionBlockRaw)
+	}
+	if br.offsets[count] != indexOffset {
+		return nil, errCompressionCorrupted
+	}
+
+	br.next = int(offset / blockSize)
+	br.skip = int(offset % blockSize)
+	return br, nil
+}
+
+func (br *blockReader) loadBlock() error {
+	if br.next >= len(br.raw) {
+		return io.EOF
+	}
+
+	start, end := br.offsets[br.next], br.offsets[br.next+1]
+	if int64(cap(br.comp)) < end-start {
+		br.comp = make([]byte, end-start)
+	}
+	br.comp = br.comp[:end-start]
+	if _, err := br.f.ReadAt(br.comp, start); err != nil {
+		return err
+	}
+
+	if br.raw[br.next] {
+		br.buf, br.comp = br.comp, br.buf
+	} else {
+		var err error
+		if br.buf, err = lz4Decompress(br.buf, br.comp, int(br.blockSize)); err != nil {
+			return err
+		}
+	}
+	br.next++
+	if br.skip > len(br.buf) {
+		return errCompressionCorrupted
+	}
+	br.pos, br.skip = br.skip, 0
+	return nil
+}
+
+func (br *blockReader) Read(p []byte) (int, error) {
+	for br.pos >= len(br.buf) {
+		if err := br.loadBlock(); err != nil {
+			return 0, err
+		}
+	}
+	n := copy(p, br.buf[br.pos:])
+	br.pos += n
+	return n, nil
+}
+
+// The underlying file belongs to the caller
+func (br *blockReader) Close() error {
+	return nil
+}
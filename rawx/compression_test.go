@@ -0,0 +1,238 @@
+// OpenIO SDS Go rawx
+// Copyright (C) 2020 OpenIO SAS
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+package main
+
+/*
+Run the comparison of the codecs with:
+	go test -run Compress -bench Compress -benchtime 10x
+*/
+
+import (
+	"bytes"
+	"compress/flate"
+	"compress/lzw"
+	"compress/zlib"
+	"io"
+	"io/ioutil"
+	"math/rand"
+	"os"
+	"syscall"
+	"testing"
+	"time"
+)
+
+type testFileReader struct {
+	f *os.File
+}
+
+func (tf *testFileReader) Read(p []byte) (int, error) { return tf.f.Read(p) }
+func (tf *testFileReader) Close() error               { return tf.f.Close() }
+func (tf *testFileReader) File() *os.File             { return tf.f }
+func (tf *testFileReader) seek(o int64) error {
+	_, err := tf.f.Seek(o, os.SEEK_SET)
+	return err
+}
+func (tf *testFileReader) getAttr(string, []byte) (int, error) { return 0, nil }
+func (tf *testFileReader) size() int64 {
+	fi, err := tf.f.Stat()
+	if err != nil {
+		return -1
+	}
+	return fi.Size()
+}
+
+// Generate some text-like data, compressible but not trivially
+func compressionSample(size int) []byte {
+	words := []string{"openio", "sds", "chunk", "rawx", "meta2", "content",
+		"container", "account", "0123456789ABCDEF", " ", "\n", "{\"key\": ", "}"}
+	rng := rand.New(rand.NewSource(42))
+	var buf bytes.Buffer
+	for buf.Len() < size {
+		if rng.Intn(8) == 0 {
+			buf.WriteByte(byte(rng.Intn(256)))
+		} else {
+			buf.WriteString(words[rng.Intn(len(words))])
+		}
+	}
+	return buf.Bytes()[:size]
+}
+
+func TestCompressLz4RoundTrip(t *testing.T) {
+	var table lz4Table
+	for _, size := range []int{0, 1, 12, 13, 64, 1000, compressionBlockSize} {
+		for _, src := range [][]byte{compressionSample(size), make([]byte, size)} {
+			comp := lz4Compress(nil, src, &table)
+			clear, err := lz4Decompress(nil, comp, size)
+			if err != nil {
+				t.Fatalf("size %d: %v", size, err)
+			}
+			if !bytes.Equal(src, clear) {
+				t.Fatalf("size %d: round trip mismatch", size)
+			}
+		}
+	}
+
+	// Corrupted blocks must be detected, not crash
+	comp := lz4Compress(nil, compressionSample(4096), &table)
+	for i := 0; i < len(comp); i++ {
+		_, _ = lz4Decompress(nil, comp[:i], 4096)
+	}
+}
+
+func TestCompressBlockRange(t *testing.T) {
+	tmp, err := ioutil.TempFile("", "rawx-compression-")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.Remove(tmp.Name())
+	defer tmp.Close()
+
+	// Mix compressible and incompressible blocks
+	src := compressionSample(5*compressionBlockSize + 1234)
+	rand.New(rand.NewSource(1)).Read(src[compressionBlockSize : 2*compressionBlockSize])
+
+	bw := newBlockWriter(tmp)
+	if _, err = bw.Write(src); err != nil {
+		t.Fatal(err)
+	}
+	if err = bw.Close(); err != nil {
+		t.Fatal(err)
+	}
+
+	in := &testFileReader{f: tmp}
+	for _, r := range [][2]int64{{0, int64(len(src))}, {1, 10},
+		{compressionBlockSize - 1, 2}, {3*compressionBlockSize + 7, 70000},
+		{int64(len(src)) - 1, 1}} {
+		br, err := newBlockReader(in, r[0])
+		if err != nil {
+			t.Fatal(err)
+		}
+		got, err := ioutil.ReadAll(&io.LimitedReader{R: br, N: r[1]})
+		if err != nil {
+			t.Fatal(err)
+		}
+		if !bytes.Equal(got, src[r[0]:r[0]+r[1]]) {
+			t.Fatalf("range %d+%d mismatch", r[0], r[1])
+		}
+	}
+}
+
+type compressionCodec struct {
+	name   string
+	writer func(io.Writer) io.WriteCloser
+	reader func(io.Reader) io.ReadCloser
+}
+
+var compressionCodecs = []compressionCodec{
+	{compressionZlib,
+		func(w io.Writer) io.WriteCloser { return zlib.NewWriter(w) },
+		func(r io.Reader) io.ReadCloser { z, _ := zlib.NewReader(r); return z }},
+	{compressionDeflate,
+		func(w io.Writer) io.WriteCloser { z, _ := flate.NewWriter(w, 1); return z },
+		func(r io.Reader) io.ReadCloser { return flate.NewReader(r) }},
+	{compressionLzw,
+		func(w io.Writer) io.WriteCloser { return lzw.NewWriter(w, lzw.MSB, 8) },
+		func(r io.Reader) io.ReadCloser { return lzw.NewReader(r, lzw.MSB, 8) }},
+	{compressionLz4,
+		func(w io.Writer) io.WriteCloser { return newBlockWriter(w) },
+		nil},
+}
+
+// The CPU time (user and system) consumed so far by the whole process
+func compressionCPUTime(b *testing.B) time.Duration {
+	var ru syscall.Rusage
+	if err := syscall.Getrusage(syscall.RUSAGE_SELF, &ru); err != nil {
+		b.Fatal(err)
+	}
+	return time.Duration(ru.Utime.Nano() + ru.Stime.Nano())
+}
+
+// Report the CPU time spent per GiB of clear data. It is measured for the
+// whole process, so the work of the garbage collector is accounted too.
+func compressionReport(b *testing.B, start time.Duration, clear int64) {
+	cpu := compressionCPUTime(b) - start
+	gib := float64(clear) * float64(b.N) / float64(1<<30)
+	b.ReportMetric(cpu.Seconds()/gib, "cpu-s/GiB")
+}
+
+func BenchmarkCompressUpload(b *testing.B) {
+	src := compressionSample(16 * 1024 * 1024)
+	for _, codec := range compressionCodecs {
+		b.Run(codec.name, func(b *testing.B) {
+			var out bytes.Buffer
+			b.SetBytes(int64(len(src)))
+			b.ResetTimer()
+			start := compressionCPUTime(b)
+			for i := 0; i < b.N; i++ {
+				out.Reset()
+				z := codec.writer(&out)
+				z.Write(src)
+				z.Close()
+			}
+			compressionReport(b, start, int64(len(src)))
+			b.ReportMetric(float64(out.Len())/float64(len(src)), "ratio")
+		})
+	}
+}
+
+func BenchmarkCompressRangeRead(b *testing.B) {
+	src := compressionSample(16 * 1024 * 1024)
+	// A 64KiB range, at the end of the chunk
+	offset, size := int64(len(src)-2*compressionBlockSize), int64(compressionBlockSize)
+
+	for _, codec := range compressionCodecs {
+		var out bytes.Buffer
+		z := codec.writer(&out)
+		z.Write(src)
+		z.Close()
+
+		b.Run(codec.name, func(b *testing.B) {
+			var in fileReader
+			if codec.reader == nil {
+				tmp, err := ioutil.TempFile("", "rawx-compression-")
+				if err != nil {
+					b.Fatal(err)
+				}
+				defer os.Remove(tmp.Name())
+				defer tmp.Close()
+				tmp.Write(out.Bytes())
+				in = &testFileReader{f: tmp}
+			}
+			b.SetBytes(size)
+			b.ResetTimer()
+			start := compressionCPUTime(b)
+			for i := 0; i < b.N; i++ {
+				var r io.Reader
+				if codec.reader != nil {
+					filter := codec.reader(bytes.NewReader(out.Bytes()))
+					io.CopyN(ioutil.Discard, filter, offset)
+					r = filter
+				} else {
+					br, err := newBlockReader(in, offset)
+					if err != nil {
+						b.Fatal(err)
+					}
+					r = br
+				}
+				if n, _ := io.CopyN(ioutil.Discard, r, size); n != size {
+					b.Fatalf("short read: %d/%d", n, size)
+				}
+			}
+			compressionReport(b, start, size)
+		})
+	}
+}
@@ -46,6 +46,7 @@ const (
 	compressionLzw     = "lzw"
 	compressionZlib    = "zlib"
 	compressionDeflate = "deflate"
+	compressionLz4     = "lz4"
 )
 
 const (
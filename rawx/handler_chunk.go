@@ -190,6 +190,8 @@ func (rr *rawxRequest) uploadChunk() {
 		z, err = flate.NewWriter(out, 1)
 	case compressionLzw:
 		z = lzw.NewWriter(out, lzw.MSB, 8)
+	case compressionLz4:
+		z = newBlockWriter(out)
 	case "", compressionOff:
 		z = nil
 	default:
@@ -430,6 +432,17 @@ func (rr *rawxRequest) getChunkReader(inChunk fileReader, cs int64, ri rangeInfo
 		filter = lzw.NewReader(inChunk.File(), lzw.MSB, 8)
 	case compressionDeflate:
 		filter = flate.NewReader(inChunk.File())
+	case compressionLz4:
+		// The block-framed format allows to start at the block of the range
+		var br *blockReader
+		if br, err = newBlockReader(inChunk, ri.offset); err == nil {
+			filter = br
+			in = &io.LimitedReader{R: br, N: cs}
+			if !ri.isVoid() {
+				in.N = ri.size
+			}
+		}
+		return in, filter, err
 	case "", compressionOff:
 		filter = nil
 	default:
@@ -0,0 +1,206 @@
+// OpenIO SDS Go rawx
+// Copyright (C) 2020 OpenIO SAS
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation; either
+// version 3.0 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+package main
+
+/*
+A codec for the LZ4 block format, as documented in
+https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+
+Only the raw blocks are managed, the framing is up to the caller. The
+compressor is a greedy single-pass one, it favors the speed over the ratio.
+*/
+
+import (
+	"encoding/binary"
+	"errors"
+)
+
+const (
+	lz4MinMatch     = 4
+	lz4LastLiterals = 5
+	// The last match must start at least 12 bytes before the end of the block
+	lz4MatchFindLimit = 12
+	lz4MaxOffset      = 65535
+	lz4HashLog        = 14
+)
+
+var errLz4Corrupted = errors.New("Corrupted LZ4 block")
+
+// Scratch space of the compressor, reused among the blocks. No reset is
+// necessary between two blocks because each candidate is verified.
+type lz4Table [1 << lz4HashLog]int32
+
+func lz4CompressBound(n int) int {
+	return n + n/255 + 16
+}
+
+func lz4Hash(seq uint32) uint32 {
+	return (seq * 2654435761) >> (32 - lz4HashLog)
+}
+
+func lz4AppendLength(dst []byte, l int) []byte {
+	for ; l >= 255; l -= 255 {
+		dst = append(dst, 255)
+	}
+	return append(dst, byte(l))
+}
+
+func lz4AppendSequence(dst, literals []byte, offset, matchLen int) []byte {
+	ll := len(literals)
+	ml := matchLen - lz4MinMatch
+	token := byte(0)
+	if ll >= 15 {
+		token = 15 << 4
+	} else {
+		token = byte(ll) << 4
+	}
+	if matchLen > 0 {
+		if ml >= 15 {
+			token |= 15
+		} else {
+			token |= byte(ml)
+		}
+	}
+
+	dst = append(dst, token)
+	if ll >= 15 {
+		dst = lz4AppendLength(dst, ll-15)
+	}
+	dst = append(dst, literals...)
+	if matchLen > 0 {
+		dst = append(dst, byte(offset), byte(offset>>8))
+		if ml >= 15 {
+			dst = lz4AppendLength(dst, ml-15)
+		}
+	}
+	return dst
+}
+
+// Compress src and append the block to dst[:0]
+func lz4Compress(dst, src []byte, table *lz4Table) []byte {
+	dst = dst[:0]
+	n := len(src)
+	anchor := 0
+
+	if n > lz4MatchFindLimit {
+		limit := n - lz4MatchFindLimit
+		matchLimit := n - lz4LastLiterals
+		for i := 0; i < limit; {
+			seq := binary.LittleEndian.Uint32(src[i:])
+			h := lz4Hash(seq)
+			ref := int(table[h])
+			table[h] = int32(i)
+			if ref >= i || i-ref > lz4MaxOffset || ref < 0 ||
+				binary.LittleEndian.Uint32(src[ref:]) != seq {
+				// Accelerate in the areas that do not compress well
+				i += 1 + (i-anchor)>>6
+				continue
+			}
+
+			// Extend the match backwards, then forwards
+			for i > anchor && ref > 0 && src[i-1] == src[ref-1] {
+				i--
+				ref--
+			}
+			end := i + lz4MinMatch
+			for end < matchLimit && src[end] == src[ref+end-i] {
+				end++
+			}
+
+			dst = lz4AppendSequence(dst, src[anchor:i], i-ref, end-i)
+			anchor = end
+			i = end
+		}
+	}
+
+	return lz4AppendSequence(dst, src[anchor:], 0, 0)
+}
+
+func lz4ReadLength(src []byte, i, l int) (int, int, error) {
+	for {
+		if i >= len(src) {
+			return 0, 0, errLz4Corrupted
+		}
+		b := src[i]
+		i++
+		l += int(b)
+		if b != 255 {
+			return i, l, nil
+		}
+	}
+}
+
+// Decode the block in src and append the result to dst[:0]. The decoded
+// block must not exceed max bytes.
+func lz4Decompress(dst, src []byte, max int) ([]byte, error) {
+	var err error
+	dst = dst[:0]
+
+	for i := 0; i < len(src); {
+		token := src[i]
+		i++
+
+		ll := int(token >> 4)
+		if ll == 15 {
+			if i, ll, err = lz4ReadLength(src, i, ll); err != nil {
+				return dst, err
+			}
+		}
+		if ll > len(src)-i || ll > max-len(dst) {
+			return dst, errLz4Corrupted
+		}
+		dst = append(dst, src[i:i+ll]...)
+		i += ll
+
+		// The last sequence has no match
+		if i == len(src) {
+			break
+		}
+
+		if i+2 > len(src) {
+			return dst, errLz4Corrupted
+		}
+		offset := int(src[i]) | int(src[i+1])<<8
+		i += 2
+		if offset == 0 || offset > len(dst) {
+			return dst, errLz4Corrupted
+		}
+
+		ml := int(token & 15)
+		if ml == 15 {
+			if i, ml, err = lz4ReadLength(src, i, ml); err != nil {
+				return dst, err
+			}
+		}
+		ml += lz4MinMatch
+		if ml > max-len(dst) {
+			return dst, errLz4Corrupted
+		}
+
+		pos := len(dst) - offset
+		if offset >= ml {
+			dst = append(dst, dst[pos:pos+ml]...)
+		} else {
+			// Overlapping copy, byte per byte
+			for k := 0; k < ml; k++ {
+				dst = append(dst, dst[pos+k])
+			}
+		}
+	}
+
+	return dst, nil
+}
@@ -61,9 +61,13 @@ static GTree *tree_bases = NULL;
 #define CHUNK_PREFIX "chunk|"
 #define ADMIN_PREFIX "admin|"
 #define CONTAINER_PREFIX "container|"
+#define COUNTER_PREFIX "counter|"
 
 #define KEY_LOCK	 ADMIN_PREFIX "lock"
 #define KEY_INCIDENT ADMIN_PREFIX "incident_date"
+#define KEY_COUNTERS ADMIN_PREFIX "counters"
+/* Where the bases of the previous release kept the state of their counters */
+#define KEY_COUNTERS_LEGACY "counters"
 
 #define STRDUPA(Out, Src, Len) do { \
 	if (Src) { \
@@ -274,6 +278,31 @@ struct rdir_base_s
 {
 	leveldb_t *base;
 	GThread *owner;
+
+	/* Serializes the updates of the chunk records, that require to read
+	 * the previous record to maintain the counters of its container. */
+	GMutex lock;
+	/* Cache of KEY_INCIDENT and KEY_COUNTERS, under the lock */
+	gboolean admin_loaded;
+	gint64 incident;
+	/* The incident date the counters have been built for, or -1 when they
+	 * must be rebuilt */
+	gint64 counters_incident;
+
+	/* While the counters are rebuilt from a snapshot, out of the lock, the
+	 * changes of the chunk records since the snapshot, per container.
+	 * NULL when no rebuild is running. */
+	GTree *rebuild_deltas;
+	gint64 rebuild_incident;
+	GCond rebuild_done;
+};
+
+/* The chunks of a container, the "to_rebuild" part being only meaningful
+ * for the incident date of the counters. */
+struct rdir_counters_s
+{
+	gint64 total;
+	gint64 to_rebuild;
 };
 
 struct rdir_record_s
@@ -296,6 +325,8 @@ _base_destroy(struct rdir_base_s *base)
 
 	base->owner = NULL;
 
+	g_mutex_clear(&base->lock);
+	g_cond_clear(&base->rebuild_done);
 	g_free(base);
 }
 
@@ -425,6 +456,8 @@ retry:
 		}
 	} else {
 		b = g_malloc0(sizeof(*b));
+		g_mutex_init(&b->lock);
+		g_cond_init(&b->rebuild_done);
 		g_tree_replace(db_tree, g_strdup(volid), b);
 open:
 		b->owner = g_thread_self();
@@ -497,6 +530,232 @@ _db_admin_get_incident(const char *volid, gint64 *pincident)
 	return err;
 }
 
+static GError *
+_db_get_value(struct rdir_base_s *base, const char *key, size_t keylen,
+		char **pvalue, size_t *plen)
+{
+	char *errmsg = NULL;
+	leveldb_readoptions_t *options = leveldb_readoptions_create();
+	leveldb_readoptions_set_fill_cache(options, 1);
+	leveldb_readoptions_set_verify_checksums(options, 0);
+	*pvalue = leveldb_get(base->base, options, key, keylen, plen, &errmsg);
+	int errsav = errno;
+	leveldb_readoptions_destroy(options);
+	if (!errmsg)
+		return NULL;
+	return _map_errno_to_gerror(errsav, errmsg);
+}
+
+static GError *
+_db_write_batch(struct rdir_base_s *base, leveldb_writebatch_t *batch,
+		gboolean sync)
+{
+	char *errmsg = NULL;
+	leveldb_writeoptions_t *options = leveldb_writeoptions_create();
+	leveldb_writeoptions_set_sync(options, BOOL(sync));
+	leveldb_write(base->base, options, batch, &errmsg);
+	int errsav = errno;
+	leveldb_writeoptions_destroy(options);
+	if (!errmsg)
+		return NULL;
+	return _map_errno_to_gerror(errsav, errmsg);
+}
+
+/* Loads the date of the incident and the state of the counters, if not yet
+ * cached. Must be called under the lock of the base. */
+static GError *
+_db_load_admin(struct rdir_base_s *base)
+{
+	if (base->admin_loaded)
+		return NULL;
+
+	gint64 parse(char *value, size_t length, gint64 absent) {
+		gint64 v = absent;
+		if (value) {
+			gchar *s;
+			STRDUPA(s, value, MIN(length, 32));
+			if (!oio_str_is_number(s, &v))
+				v = absent;
+			free(value);
+		}
+		return v;
+	}
+
+	char *value = NULL;
+	size_t length = 0;
+	GError *err = _db_get_value(base,
+			KEY_INCIDENT, sizeof(KEY_INCIDENT)-1, &value, &length);
+	if (err)
+		return err;
+	base->incident = parse(value, length, 0);
+
+	err = _db_get_value(base,
+			KEY_COUNTERS, sizeof(KEY_COUNTERS)-1, &value, &length);
+	if (!err && !value)
+		err = _db_get_value(base, KEY_COUNTERS_LEGACY,
+				sizeof(KEY_COUNTERS_LEGACY)-1, &value, &length);
+	if (err)
+		return err;
+	base->counters_incident = parse(value, length, -1);
+
+	base->admin_loaded = TRUE;
+	return NULL;
+}
+
+/* The counters are stored as "<total> <to_rebuild>" */
+static void
+_counters_parse(const char *value, size_t length, struct rdir_counters_s *c)
+{
+	gchar *s, *end = NULL;
+	STRDUPA(s, value, MIN(length, 64));
+	c->total = g_ascii_strtoll(s, &end, 10);
+	if (end && *end == ' ')
+		c->to_rebuild = g_ascii_strtoll(end + 1, NULL, 10);
+}
+
+static GError *
+_db_counters_get(struct rdir_base_s *base, const char *cid,
+		struct rdir_counters_s *out)
+{
+	gchar *key = g_strconcat(COUNTER_PREFIX, cid, NULL);
+	char *value = NULL;
+	size_t length = 0;
+	GError *err = _db_get_value(base, key, strlen(key), &value, &length);
+	g_free(key);
+
+	out->total = out->to_rebuild = 0;
+	if (!err && value) {
+		_counters_parse(value, length, out);
+		free(value);
+	}
+	return err;
+}
+
+static void
+_db_counters_put(leveldb_writebatch_t *batch, const char *cid,
+		struct rdir_counters_s *c)
+{
+	gchar *key = g_strconcat(COUNTER_PREFIX, cid, NULL);
+	if (c->total <= 0) {
+		leveldb_writebatch_delete(batch, key, strlen(key));
+	} else {
+		gchar buf[64];
+		gsize len = g_snprintf(buf, sizeof(buf),
+				"%"G_GINT64_FORMAT" %"G_GINT64_FORMAT,
+				c->total, MAX(0, c->to_rebuild));
+		leveldb_writebatch_put(batch, key, strlen(key), buf, len);
+	}
+	g_free(key);
+}
+
+/* Tells the counters are consistent, and the incident date they have been
+ * computed for. A negative date tells they must be rebuilt. */
+static void
+_db_counters_state(leveldb_writebatch_t *batch, gint64 incident)
+{
+	leveldb_writebatch_delete(batch,
+			KEY_COUNTERS_LEGACY, sizeof(KEY_COUNTERS_LEGACY)-1);
+	if (incident < 0) {
+		leveldb_writebatch_delete(batch, KEY_COUNTERS, sizeof(KEY_COUNTERS)-1);
+	} else {
+		gchar buf[64];
+		gsize len = g_snprintf(buf, sizeof(buf), "%"G_GINT64_FORMAT, incident);
+		leveldb_writebatch_put(batch, KEY_COUNTERS, sizeof(KEY_COUNTERS)-1,
+				buf, len);
+	}
+}
+
+/* Adds to the <batch> the deletion of all the counters */
+static void
+_db_counters_reset(struct rdir_base_s *base, leveldb_writebatch_t *batch)
+{
+	leveldb_readoptions_t *options = leveldb_readoptions_create();
+	leveldb_readoptions_set_fill_cache(options, 0);
+	leveldb_iterator_t *it = leveldb_create_iterator(base->base, options);
+	leveldb_readoptions_destroy(options);
+	leveldb_iter_seek(it, COUNTER_PREFIX, sizeof(COUNTER_PREFIX)-1);
+	for (; leveldb_iter_valid(it); leveldb_iter_next(it)) {
+		size_t keylen = 0;
+		const char *key = leveldb_iter_key(it, &keylen);
+		if (keylen < sizeof(COUNTER_PREFIX)-1
+				|| memcmp(key, COUNTER_PREFIX, sizeof(COUNTER_PREFIX)-1))
+			break;
+		leveldb_writebatch_delete(batch, key, keylen);
+	}
+	leveldb_iter_destroy(it);
+}
+
+/* Extracts the container ID from the key of a chunk record */
+static gboolean
+_key_to_container(const char *key, size_t keylen, gchar *cid, gsize cidlen)
+{
+	if (keylen < sizeof(CHUNK_PREFIX)-1)
+		return FALSE;
+	g_snprintf(cid, cidlen, "%.*s",
+			(int)(keylen - (sizeof(CHUNK_PREFIX) - 1)),
+			key + (sizeof(CHUNK_PREFIX) - 1));
+	char *colon = strchr(cid, '|');
+	if (!colon)
+		return FALSE;
+	*colon = 0;
+	return TRUE;
+}
+
+/* Tells how the counters of its container change when the chunk record is
+ * added (sign > 0) or removed (sign < 0). Must be called under the lock of
+ * the base. */
+static void
+_db_counters_apply(struct rdir_base_s *base, struct rdir_counters_s *c,
+		struct rdir_record_s *rec, int sign)
+{
+	c->total += sign;
+	if (base->incident > 0 && base->counters_incident == base->incident
+			&& rec->mtime <= base->incident)
+		c->to_rebuild += sign;
+}
+
+/* Journals the change of a chunk record made while the counters are rebuilt,
+ * to be added to the counters computed from the snapshot. Must be called
+ * under the lock of the base, once the change has been written. */
+static void
+_db_counters_journal(struct rdir_base_s *base, const char *cid,
+		struct rdir_record_s *rec, int sign)
+{
+	if (!base->rebuild_deltas)
+		return;
+	struct rdir_counters_s *c = g_tree_lookup(base->rebuild_deltas, cid);
+	if (!c) {
+		c = g_malloc0(sizeof(*c));
+		g_tree_replace(base->rebuild_deltas, g_strdup(cid), c);
+	}
+	c->total += sign;
+	if (base->rebuild_incident > 0 && rec->mtime <= base->rebuild_incident)
+		c->to_rebuild += sign;
+}
+
+/* Loads the current version of the record at <key>. <present> is set to
+ * FALSE when it is absent or malformed, i.e. when it is not counted. */
+static GError *
+_db_record_get(struct rdir_base_s *base, const char *key, size_t keylen,
+		struct rdir_record_s *rec, gboolean *present)
+{
+	char *value = NULL;
+	size_t length = 0;
+	*present = FALSE;
+	GError *err = _db_get_value(base, key, keylen, &value, &length);
+	if (!err && value) {
+		GError *e = _record_parse(rec, value, length);
+		if (e) {
+			GRID_WARN("Malformed record at [%.*s]", (int)keylen, key);
+			g_clear_error(&e);
+		} else {
+			*present = TRUE;
+		}
+		free(value);
+	}
+	return err;
+}
+
 static GError *
 _db_admin_set_incident(const char *volid, gint64 when)
 {
@@ -510,7 +769,10 @@ _db_admin_set_incident(const char *volid, gint64 when)
 	gchar buf[64];
 	gsize len = g_snprintf(buf, sizeof(buf), "%"G_GINT64_FORMAT, when);
 
-	/* forward to the ... nope, this is too short to be insulated */
+	/* The "to_rebuild" counters are recomputed by the admin task, if the
+	 * incident has been re-dated. Meanwhile the status only tells the
+	 * totals, that do not depend on the incident. */
+	g_mutex_lock(&base->lock);
 	leveldb_writeoptions_t *woptions = leveldb_writeoptions_create();
 	leveldb_writeoptions_set_sync(woptions, 1);
 	leveldb_put(base->base, woptions,
@@ -518,6 +780,9 @@ _db_admin_set_incident(const char *volid, gint64 when)
 			buf, len, &errmsg);
 	int errsav = errno;
 	leveldb_writeoptions_destroy(woptions);
+	if (!errmsg)
+		base->incident = when;
+	g_mutex_unlock(&base->lock);
 
 	if (!errmsg)
 		return NULL;
@@ -542,16 +807,62 @@ _db_insert_generic(struct rdir_base_s *base, GString *key, GString *value)
 	return _map_errno_to_gerror(errno, errmsg);
 }
 
+/* Must be called under the lock of the base */
 static GError *
-_db_vol_push(const char *volid, gboolean autocreate, GString *key,
-			 GString *value)
+_db_vol_push_locked(struct rdir_base_s *base, struct rdir_record_s *rec,
+		GString *key, GString *value)
+{
+	GError *err = _db_load_admin(base);
+	if (err)
+		return err;
+
+	/* Without consistent counters, there is nothing to maintain */
+	const gboolean maintain = base->counters_incident >= 0;
+	if (!maintain && !base->rebuild_deltas)
+		return _db_insert_generic(base, key, value);
+
+	struct rdir_record_s old = {0};
+	gboolean present = FALSE;
+	if ((err = _db_record_get(base, key->str, key->len, &old, &present)))
+		return err;
+
+	leveldb_writebatch_t *batch = leveldb_writebatch_create();
+	leveldb_writebatch_put(batch, key->str, key->len, value->str, value->len);
+	if (maintain) {
+		struct rdir_counters_s c = {0};
+		if ((err = _db_counters_get(base, rec->container, &c))) {
+			leveldb_writebatch_destroy(batch);
+			return err;
+		}
+		if (present)
+			_db_counters_apply(base, &c, &old, -1);
+		_db_counters_apply(base, &c, rec, 1);
+		_db_counters_put(batch, rec->container, &c);
+	}
+	err = _db_write_batch(base, batch, FALSE);
+	leveldb_writebatch_destroy(batch);
+
+	if (!err) {
+		if (present)
+			_db_counters_journal(base, rec->container, &old, -1);
+		_db_counters_journal(base, rec->container, rec, 1);
+	}
+	return err;
+}
+
+static GError *
+_db_vol_push(const char *volid, gboolean autocreate,
+		struct rdir_record_s *rec, GString *key, GString *value)
 {
 	struct rdir_base_s *base = NULL;
 	GError *err = _db_get(volid, autocreate, &base);
 	if (err)
 		return err;
 
-	return _db_insert_generic(base, key, value);
+	g_mutex_lock(&base->lock);
+	err = _db_vol_push_locked(base, rec, key, value);
+	g_mutex_unlock(&base->lock);
+	return err;
 }
 
 struct _listing_req_s {
@@ -780,13 +1091,56 @@ _db_vol_delete_generic(struct rdir_base_s *base, GString *key)
 	return _map_errno_to_gerror(errno, errmsg);
 }
 
+/* Must be called under the lock of the base */
+static GError *
+_db_vol_delete_locked(struct rdir_base_s *base, GString *key)
+{
+	GError *err = _db_load_admin(base);
+	if (err)
+		return err;
+
+	struct rdir_record_s old = {0};
+	gboolean present = FALSE;
+	gchar cid[128];
+	const gboolean maintain = base->counters_incident >= 0;
+	if ((!maintain && !base->rebuild_deltas)
+			|| !_key_to_container(key->str, key->len, cid, sizeof(cid)))
+		return _db_vol_delete_generic(base, key);
+	if ((err = _db_record_get(base, key->str, key->len, &old, &present)))
+		return err;
+	if (!present)
+		return _db_vol_delete_generic(base, key);
+
+	leveldb_writebatch_t *batch = leveldb_writebatch_create();
+	leveldb_writebatch_delete(batch, key->str, key->len);
+	if (maintain) {
+		struct rdir_counters_s c = {0};
+		if ((err = _db_counters_get(base, cid, &c))) {
+			leveldb_writebatch_destroy(batch);
+			return err;
+		}
+		_db_counters_apply(base, &c, &old, -1);
+		_db_counters_put(batch, cid, &c);
+	}
+	err = _db_write_batch(base, batch, FALSE);
+	leveldb_writebatch_destroy(batch);
+
+	if (!err)
+		_db_counters_journal(base, cid, &old, -1);
+	return err;
+}
+
 static GError *
 _db_vol_delete(const char *volid, GString *key){
 	struct rdir_base_s *base = NULL;
 	GError *err = _db_get(volid, FALSE, &base);
 	if (err)
 		return err;
-	return _db_vol_delete_generic(base, key);
+
+	g_mutex_lock(&base->lock);
+	err = _db_vol_delete_locked(base, key);
+	g_mutex_unlock(&base->lock);
+	return err;
 }
 
 static void
@@ -814,8 +1168,49 @@ _dump_vol_status(GString *value, GTree *tree_containers, GTree *tree_to_rebuild)
 	g_tree_foreach(tree_containers, _on_container, NULL);
 }
 
+/* A negative <nb_to_rebuild> tells the chunks to rebuild are being counted
+ * for the current incident date. */
+static void
+_pack_vol_status(GString *value, gint64 incident_date,
+		gint64 nb_chunks, gint64 nb_to_rebuild, GString *containers)
+{
+	g_string_append_c(value, '{');
+	oio_str_gstring_append_json_quote(value, "chunk");
+	g_string_append_c(value, ':');
+	g_string_append_c(value, '{');
+	oio_str_gstring_append_json_pair_int(value, "total", nb_chunks);
+	if (incident_date > 0 && nb_to_rebuild >= 0) {
+		g_string_append_c(value, ',');
+		oio_str_gstring_append_json_pair_int(value, "to_rebuild",
+				nb_to_rebuild);
+	}
+	g_string_append_c(value, '}');
+	g_string_append_c(value, ',');
+	oio_str_gstring_append_json_quote(value, "container");
+	g_string_append_c(value, ':');
+	g_string_append_c(value, '{');
+	g_string_append_len(value, containers->str, containers->len);
+	g_string_append_c(value, '}');
+	if (incident_date > 0) {
+		g_string_append_c(value, ',');
+		oio_str_gstring_append_json_quote(value, "rebuild");
+		g_string_append_c(value, ':');
+		g_string_append_c(value, '{');
+		oio_str_gstring_append_json_pair_int(value,
+				"incident_date", incident_date);
+		if (nb_to_rebuild < 0) {
+			g_string_append_c(value, ',');
+			oio_str_gstring_append_json_pair_boolean(value, "counting", TRUE);
+		}
+		g_string_append_c(value, '}');
+	}
+	g_string_append_c(value, '}');
+}
+
+/* Counts the chunks with a scan of their records, for the prefixes finer
+ * than a container, that the counters cannot serve. */
 static GError *
-_db_vol_status(const char *volid, struct _listing_req_s *listing_req,
+_db_vol_status_scan(const char *volid, struct _listing_req_s *listing_req,
 		struct _listing_resp_s *listing_resp, GString *value)
 {
 	gint64 nb_chunks = 0, nb_to_rebuild = 0;
@@ -840,15 +1235,10 @@ _db_vol_status(const char *volid, struct _listing_req_s *listing_req,
 			size_t keylen, const gchar *key, struct rdir_record_s *rec) {
 		/* Insulate the name of its container */
 		gchar cid[128];
-		g_snprintf(cid, sizeof(cid), "%.*s",
-				(int)(keylen - (sizeof(CHUNK_PREFIX) - 1)),
-				key + (sizeof(CHUNK_PREFIX) - 1));
-		char *colon = strchr(cid, '|');
-		if (!colon) {
+		if (!_key_to_container(key, keylen, cid, sizeof(cid))) {
 			GRID_WARN("Malformed key at [%.*s]", (int)keylen, key);
 			return;
 		}
-		*colon = 0;
 
 		/* count that chunk */
 		nb_chunks++;
@@ -867,44 +1257,242 @@ _db_vol_status(const char *volid, struct _listing_req_s *listing_req,
 	}
 
 	err = _db_vol_listing(volid, listing_req, listing_resp, listing_func);
-	if (err)
-		goto label_end;
-
-	/* pack the answer */
-	g_string_append_c(value, '{');
-	oio_str_gstring_append_json_quote(value, "chunk");
-	g_string_append_c(value, ':');
-	g_string_append_c(value, '{');
-	oio_str_gstring_append_json_pair_int(value, "total", nb_chunks);
-	if (listing_resp->incident_date > 0) {
-		g_string_append_c(value, ',');
-		oio_str_gstring_append_json_pair_int(value, "to_rebuild",
-				nb_to_rebuild);
-	}
-	g_string_append_c(value, '}');
-	g_string_append_c(value, ',');
-	oio_str_gstring_append_json_quote(value, "container");
-	g_string_append_c(value, ':');
-	g_string_append_c(value, '{');
-	_dump_vol_status(value, tree_containers, tree_to_rebuild);
-	g_string_append_c(value, '}');
-	if (listing_resp->incident_date > 0) {
-		g_string_append_c(value, ',');
-		oio_str_gstring_append_json_quote(value, "rebuild");
-		g_string_append_c(value, ':');
-		g_string_append_c(value, '{');
-		oio_str_gstring_append_json_pair_int(value,
-				"incident_date", listing_resp->incident_date);
-		g_string_append_c(value, '}');
+	if (!err) {
+		GString *containers = g_string_sized_new(1024);
+		_dump_vol_status(containers, tree_containers, tree_to_rebuild);
+		_pack_vol_status(value, listing_resp->incident_date,
+				nb_chunks, nb_to_rebuild, containers);
+		g_string_free(containers, TRUE);
 	}
-	g_string_append_c(value, '}');
 
-label_end:
 	g_tree_destroy(tree_containers);
 	g_tree_destroy(tree_to_rebuild);
 	return err;
 }
 
+/* Recounts the chunks of each container with a full scan of the volume.
+ * Only necessary on the bases created before the counters, after an admin
+ * clear, and when the incident has been re-dated.
+ * Must be called under the lock of the base, that is released during the
+ * scan: the scan reads a snapshot, the pushes and deletions made meanwhile
+ * are journaled then added to its result. */
+static GError *
+_db_counters_rebuild(struct rdir_base_s *base)
+{
+	const gint64 incident = MAX(0, base->incident);
+	const gint64 start = oio_ext_monotonic_time();
+	GTree *counters = g_tree_new_full(metautils_strcmp3, NULL, g_free, g_free);
+
+	EXTRA_ASSERT(base->rebuild_deltas == NULL);
+	base->rebuild_deltas =
+		g_tree_new_full(metautils_strcmp3, NULL, g_free, g_free);
+	base->rebuild_incident = incident;
+	const leveldb_snapshot_t *snapshot = leveldb_create_snapshot(base->base);
+	g_mutex_unlock(&base->lock);
+
+	leveldb_readoptions_t *options = leveldb_readoptions_create();
+	leveldb_readoptions_set_fill_cache(options, 0);
+	leveldb_readoptions_set_verify_checksums(options, 0);
+	leveldb_readoptions_set_snapshot(options, snapshot);
+	leveldb_iterator_t *it = leveldb_create_iterator(base->base, options);
+	leveldb_readoptions_destroy(options);
+
+	struct rdir_counters_s *_get(const char *cid) {
+		struct rdir_counters_s *c = g_tree_lookup(counters, cid);
+		if (!c) {
+			c = g_malloc0(sizeof(*c));
+			g_tree_replace(counters, g_strdup(cid), c);
+		}
+		return c;
+	}
+
+	leveldb_iter_seek(it, CHUNK_PREFIX, sizeof(CHUNK_PREFIX)-1);
+	for (; leveldb_iter_valid(it); leveldb_iter_next(it)) {
+		size_t keylen = 0, vallen = 0;
+		const char *key = leveldb_iter_key(it, &keylen);
+		if (keylen < sizeof(CHUNK_PREFIX)-1
+				|| memcmp(key, CHUNK_PREFIX, sizeof(CHUNK_PREFIX)-1))
+			break;
+
+		gchar cid[128];
+		struct rdir_record_s rec = {0};
+		const char *val = leveldb_iter_value(it, &vallen);
+		GError *e = _record_parse(&rec, val, vallen);
+		if (e || !_key_to_container(key, keylen, cid, sizeof(cid))) {
+			GRID_WARN("Malformed record at [%.*s]", (int)keylen, key);
+			g_clear_error(&e);
+			continue;
+		}
+
+		struct rdir_counters_s *c = _get(cid);
+		c->total ++;
+		if (incident > 0 && rec.mtime <= incident)
+			c->to_rebuild ++;
+	}
+	leveldb_iter_destroy(it);
+
+	g_mutex_lock(&base->lock);
+	leveldb_release_snapshot(base->base, snapshot);
+	GTree *deltas = base->rebuild_deltas;
+	base->rebuild_deltas = NULL;
+
+	GError *err = NULL;
+	if (MAX(0, base->incident) != incident) {
+		/* Re-dated during the scan, the caller has to start again */
+		GRID_INFO("Incident re-dated during the count of the chunks");
+	} else {
+		gboolean _add(gpointer k, gpointer v, gpointer i UNUSED) {
+			struct rdir_counters_s *delta = v, *c = _get(k);
+			c->total += delta->total;
+			c->to_rebuild += delta->to_rebuild;
+			return FALSE;
+		}
+		g_tree_foreach(deltas, _add, NULL);
+
+		leveldb_writebatch_t *batch = leveldb_writebatch_create();
+		_db_counters_reset(base, batch);
+		gboolean _put(gpointer k, gpointer v, gpointer i UNUSED) {
+			_db_counters_put(batch, k, v);
+			return FALSE;
+		}
+		g_tree_foreach(counters, _put, NULL);
+		_db_counters_state(batch, incident);
+		err = _db_write_batch(base, batch, FALSE);
+		leveldb_writebatch_destroy(batch);
+
+		if (!err)
+			base->counters_incident = incident;
+	}
+	g_cond_broadcast(&base->rebuild_done);
+
+	GRID_NOTICE("Counted the chunks of %d containers in %"G_GINT64_FORMAT"ms"
+			" (%d changed meanwhile)",
+			g_tree_nnodes(counters),
+			(oio_ext_monotonic_time() - start) / G_TIME_SPAN_MILLISECOND,
+			g_tree_nnodes(deltas));
+	g_tree_destroy(deltas);
+	g_tree_destroy(counters);
+	return err;
+}
+
+/* Tells the "to_rebuild" counters do not match the incident date anymore.
+ * Must be called under the lock of the base, with the admin keys loaded. */
+static gboolean
+_db_counters_redated(struct rdir_base_s *base)
+{
+	return base->counters_incident >= 0 && base->incident > 0
+		&& base->counters_incident != base->incident;
+}
+
+/* Answers in O(containers) with the counters maintained along with the
+ * chunk records. <max> then applies to the containers. Only the loss of the
+ * counters requires to wait for them to be rebuilt: after a re-dating of the
+ * incident, the totals are still right and the chunks to rebuild are
+ * recounted in the background. */
+static GError *
+_db_vol_status(const char *volid, struct _listing_req_s *listing_req,
+		struct _listing_resp_s *listing_resp, GString *value)
+{
+	if (listing_req->prefix && strchr(listing_req->prefix, '|'))
+		return _db_vol_status_scan(volid, listing_req, listing_resp, value);
+
+	struct rdir_base_s *base = NULL;
+	GError *err = _db_get(volid, FALSE, &base);
+	if (err)
+		return err;
+
+	/* The iterator is created under the lock, so that it reads a snapshot
+	 * of the counters consistent with the incident date */
+	leveldb_iterator_t *it = NULL;
+	gint64 incident = 0;
+	gboolean counting = FALSE;
+	g_mutex_lock(&base->lock);
+	err = _db_load_admin(base);
+	while (!err && base->counters_incident < 0) {
+		if (base->rebuild_deltas)
+			g_cond_wait(&base->rebuild_done, &base->lock);
+		else
+			err = _db_counters_rebuild(base);
+	}
+	if (!err) {
+		incident = MAX(0, base->incident);
+		counting = _db_counters_redated(base);
+		leveldb_readoptions_t *options = leveldb_readoptions_create();
+		leveldb_readoptions_set_fill_cache(options, 0);
+		leveldb_readoptions_set_verify_checksums(options, 0);
+		it = leveldb_create_iterator(base->base, options);
+		leveldb_readoptions_destroy(options);
+	}
+	g_mutex_unlock(&base->lock);
+	if (err)
+		return err;
+
+	listing_resp->incident_date = incident;
+
+	gchar *prefix = g_strconcat(COUNTER_PREFIX, listing_req->prefix ?: "", NULL);
+	gchar *after = g_strconcat(COUNTER_PREFIX, listing_req->marker ?: "", NULL);
+	const size_t prefix_len = strlen(prefix), after_len = strlen(after);
+	const char *key_seek = strcmp(prefix, after) > 0 ? prefix : after;
+	leveldb_iter_seek(it, key_seek, strlen(key_seek));
+	if (leveldb_iter_valid(it) && listing_req->marker) {
+		size_t keylen = 0;
+		const char *key = leveldb_iter_key(it, &keylen);
+		if (after_len == keylen && !memcmp(key, after, after_len))
+			leveldb_iter_next(it);
+	}
+
+	gint64 nb_containers = 0, nb_chunks = 0, nb_to_rebuild = 0;
+	GString *containers = g_string_sized_new(1024);
+	for (; leveldb_iter_valid(it); leveldb_iter_next(it)) {
+		size_t keylen = 0, vallen = 0;
+		const char *key = leveldb_iter_key(it, &keylen);
+		if (keylen < prefix_len || memcmp(key, prefix, prefix_len))
+			break;
+
+		if (listing_req->max > 0 && nb_containers >= listing_req->max) {
+			listing_resp->truncated = TRUE;
+			leveldb_iter_prev(it);
+			key = leveldb_iter_key(it, &keylen);
+			listing_resp->marker = g_strndup(
+					key + (sizeof(COUNTER_PREFIX) - 1),
+					keylen - (sizeof(COUNTER_PREFIX) - 1));
+			break;
+		}
+
+		struct rdir_counters_s c = {0};
+		const char *val = leveldb_iter_value(it, &vallen);
+		_counters_parse(val, vallen, &c);
+
+		if (containers->len > 0)
+			g_string_append_c(containers, ',');
+		g_string_append_c(containers, '"');
+		oio_str_gstring_append_json_blob(containers,
+				key + (sizeof(COUNTER_PREFIX) - 1),
+				keylen - (sizeof(COUNTER_PREFIX) - 1));
+		g_string_append_static(containers, "\":{");
+		oio_str_gstring_append_json_pair_int(containers, "total", c.total);
+		if (incident > 0 && !counting && c.to_rebuild > 0) {
+			g_string_append_c(containers, ',');
+			oio_str_gstring_append_json_pair_int(containers,
+					"to_rebuild", c.to_rebuild);
+		}
+		g_string_append_c(containers, '}');
+
+		nb_containers ++;
+		nb_chunks += c.total;
+		if (incident > 0)
+			nb_to_rebuild += c.to_rebuild;
+	}
+	leveldb_iter_destroy(it);
+
+	_pack_vol_status(value, incident, nb_chunks,
+			counting ? -1 : nb_to_rebuild, containers);
+	g_string_free(containers, TRUE);
+	g_free(prefix);
+	g_free(after);
+	return NULL;
+}
+
 static GError *
 _db_admin_show(const char *volid, GString *value)
 {
@@ -1042,6 +1630,15 @@ _db_admin_clear(const char *volid, gboolean all, gboolean before_incident,
 	if ((err = _db_get(volid, FALSE, &base)))
 		return err;
 
+	g_mutex_lock(&base->lock);
+	/* The changes below are not journaled for a rebuild of the counters */
+	while (base->rebuild_deltas)
+		g_cond_wait(&base->rebuild_done, &base->lock);
+	if ((err = _db_load_admin(base))) {
+		g_mutex_unlock(&base->lock);
+		return err;
+	}
+
 	leveldb_writebatch_t *batch = leveldb_writebatch_create();
 
 	if (all || (before_incident && incident > 0) || repair) {
@@ -1053,7 +1650,8 @@ _db_admin_clear(const char *volid, gboolean all, gboolean before_incident,
 		for (; leveldb_iter_valid(it) ; leveldb_iter_next(it)) {
 			size_t keylen = 0;
 			const char *key = leveldb_iter_key(it, &keylen);
-			if (*key != CHUNK_PREFIX[0])
+			if (keylen < sizeof(CHUNK_PREFIX)-1
+					|| memcmp(key, CHUNK_PREFIX, sizeof(CHUNK_PREFIX)-1))
 				break;
 
 			if (all) {
@@ -1086,7 +1684,7 @@ _db_admin_clear(const char *volid, gboolean all, gboolean before_incident,
 				GString *repaired_key = _record_to_key(&rec);
 				GString *repaired_val = g_string_sized_new(1024);
 				_record_encode(&rec, repaired_val);
-				err = _db_vol_push(volid, FALSE, repaired_key, repaired_val);
+				err = _db_insert_generic(base, repaired_key, repaired_val);
 				g_string_free(repaired_key, TRUE);
 				g_string_free(repaired_val, TRUE);
 				if (err) {
@@ -1104,12 +1702,33 @@ _db_admin_clear(const char *volid, gboolean all, gboolean before_incident,
 
 	leveldb_writebatch_delete(batch, KEY_INCIDENT, sizeof(KEY_INCIDENT)-1);
 
+	/* Without incident, only the totals of the counters matter, and they
+	 * remain valid unless some records have been removed or repaired. */
+	gint64 counters_incident = base->counters_incident;
+	if (all) {
+		_db_counters_reset(base, batch);
+		counters_incident = 0;
+	} else if (nb_removed > 0 || nb_repaired > 0) {
+		counters_incident = -1;
+	} else if (counters_incident > 0) {
+		counters_incident = 0;
+	}
+	_db_counters_state(batch, counters_incident);
+
 	leveldb_writeoptions_t *woptions = leveldb_writeoptions_create();
 	leveldb_write(base->base, woptions, batch, &errmsg);
 	errsav = errno;
 	leveldb_writeoptions_destroy(woptions);
 	leveldb_writebatch_destroy(batch);
 
+	if (errmsg) {
+		base->admin_loaded = FALSE;
+	} else {
+		base->incident = 0;
+		base->counters_incident = counters_incident;
+	}
+	g_mutex_unlock(&base->lock);
+
 	*p_nb_removed = nb_removed;
 	*p_nb_repaired = nb_repaired;
 	*p_errors = errors;
@@ -1247,7 +1866,7 @@ _route_vol_push(struct req_args_s *args, struct json_object *jbody,
 	_record_encode(&rec, value);
 
 	/* Eventually push the record in the database */
-	err = _db_vol_push(volid, autocreate, key, value);
+	err = _db_vol_push(volid, autocreate, &rec, key, value);
 	g_string_free(key, TRUE);
 	g_string_free(value, TRUE);
 
@@ -1350,7 +1969,10 @@ _route_vol_create(struct req_args_s *args, const char *volid)
 // RDIR{{
 // POST /v1/rdir/status?vol=<volume ip>%3A<volume port>
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Show the target volume status
+// Show the target volume status: the number of chunks of each container,
+// and of chunks to rebuild when an incident date is set. The counters are
+// maintained along with the chunk records, the optional "max" and "marker"
+// parameters page through the containers.
 //
 // .. code-block:: http
 //
@@ -2679,6 +3301,39 @@ _task_malloc_trim(gpointer p UNUSED)
 	malloc_trim (sqlx_periodic_malloctrim_size);
 }
 
+/* Recounts the chunks to rebuild of the bases whose incident has been
+ * re-dated, so that no status request has to wait for it. The bases are
+ * never freed before the admin queue is stopped. */
+static void
+_task_recount_redated(gpointer p UNUSED)
+{
+	GSList *bases = NULL;
+	gboolean _collect(gpointer k UNUSED, gpointer v, gpointer i UNUSED) {
+		struct rdir_base_s *base = v;
+		if (base->base)
+			bases = g_slist_prepend(bases, base);
+		return FALSE;
+	}
+	g_mutex_lock(&lock_bases);
+	g_tree_foreach(tree_bases, _collect, NULL);
+	g_mutex_unlock(&lock_bases);
+
+	for (GSList *l = bases; l && grid_main_is_running(); l = l->next) {
+		struct rdir_base_s *base = l->data;
+		g_mutex_lock(&base->lock);
+		GError *err = _db_load_admin(base);
+		if (!err && !base->rebuild_deltas && _db_counters_redated(base))
+			err = _db_counters_rebuild(base);
+		g_mutex_unlock(&base->lock);
+		if (err) {
+			GRID_WARN("Failed to count the chunks to rebuild: (%d) %s",
+					err->code, err->message);
+			g_clear_error(&err);
+		}
+	}
+	g_slist_free(bases);
+}
+
 #define CFG(K) g_key_file_get_string(gkf, CFG_GROUP, (K), &err)
 
 #define DUAL_ERROR(FMT,...) do { \
@@ -2817,6 +3472,7 @@ grid_main_configure(int argc, char **argv)
 	/* Ask for a periodic release of the memory slices kept by the process */
 	gtq_admin = grid_task_queue_create("admin");
 	grid_task_queue_register(gtq_admin, 1, _task_malloc_trim, NULL, NULL);
+	grid_task_queue_register(gtq_admin, 1, _task_recount_redated, NULL, NULL);
 	return TRUE;
 }
 
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS server
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -31,6 +31,11 @@ License along with this library.
 #define OIO_SERVER_UDP_QUEUE_MAXAGE (2 * G_TIME_SPAN_SECOND)
 #endif
 
+/* How many slabs are sent at once by data_slab_sequence_send() */
+#ifndef OIO_SERVER_SLAB_IOV_MAX
+#define OIO_SERVER_SLAB_IOV_MAX 64
+#endif
+
 enum {
 	EXCESS_NONE = 0,
 	EXCESS_HARD
@@ -51,19 +56,47 @@ struct endpoint_s
 	gchar url[1];
 };
 
-struct network_server_s
+/* An event loop, with its own epoll set and its own pool of workers. The
+ * connections accepted by a loop remain pinned to it until they are closed. */
+struct network_loop_s
 {
+	struct network_server_s *server;
+
+	/* NULL for the first loop, that uses the endpoints of the server. The
+	 * other loops own a clone of each INET endpoint, each clone with its own
+	 * socket bound (thanks to SO_REUSEPORT) to the same address. */
 	struct endpoint_s **endpointv;
 
 	struct network_client_s *first;
 
+	GThread *thread;
+	GThreadPool *pool;
+	GAsyncQueue *queue_monitor; /* from the workers to the loop's thread */
+
+	guint64 cnx_accept;
+	guint64 cnx_close;
+	volatile guint cnx_clients;
+
+	GQuark gq_gauge_threads;
+	GQuark gq_gauge_cnx_current;
+	GQuark gq_counter_cnx_accept;
+	GQuark gq_counter_cnx_close;
+
+	guint index;
+	int eventfd;
+	int epollfd;
+};
+
+struct network_server_s
+{
+	struct endpoint_s **endpointv;
+
+	struct network_loop_s **loopv;
+	guint loops;
+
 	GThread *thread_udp;
-	GThread *thread_tcp;
-	GThreadPool *pool_tcp;
 	GThreadPool *pool_udp;
 
-	GAsyncQueue *queue_monitor; /* from the workers to the events_thread */
-
 	GMutex lock_threads;
 
 	guint64 cnx_accept;
@@ -76,8 +109,6 @@ struct network_server_s
 	GQuark gq_counter_cnx_accept;
 	GQuark gq_counter_cnx_close;
 
-	int eventfd;
-	int epollfd;
 	volatile gboolean flag_continue;
 	gboolean abort_allowed;
 	gboolean udp_allowed;
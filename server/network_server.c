@@ -1,7 +1,7 @@
 /*
 OpenIO SDS server
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -59,11 +59,12 @@ static gboolean _endpoint_is_INET6 (struct endpoint_s *u);
 static gboolean _endpoint_is_INET4 (struct endpoint_s *u);
 static gboolean _endpoint_is_INET (struct endpoint_s *u);
 
-static GError * _endpoint_open (struct endpoint_s *u, gboolean udp_allowed);
+static GError * _endpoint_open (struct endpoint_s *u, gboolean udp_allowed,
+		gboolean reuseport);
 static void _endpoint_close (struct endpoint_s *u);
 
 static struct network_client_s* _endpoint_accept_one(
-		struct network_server_s *srv, const struct endpoint_s *e);
+		struct network_loop_s *loop, const struct endpoint_s *e);
 
 static void _client_clean(struct network_server_s *srv,
 		struct network_client_s *client);
@@ -74,14 +75,14 @@ static gboolean _client_has_pending_output(struct network_client_s *client);
 
 static gboolean _client_ready_for_output(struct network_client_s *client);
 
-static void _client_remove_from_monitored(struct network_server_s *srv,
+static void _client_remove_from_monitored(struct network_loop_s *loop,
 		struct network_client_s *clt);
 
-static void _client_add_to_monitored(struct network_server_s *srv,
+static void _client_add_to_monitored(struct network_loop_s *loop,
 		struct network_client_s *clt);
 
 static void _cb_tcp_worker(struct network_client_s *clt,
-		struct network_server_s *srv);
+		struct network_loop_s *loop);
 
 static void _manage_udp_task(struct network_client_s *clt,
 		struct network_server_s *srv);
@@ -110,12 +111,15 @@ _client_send_pending_output(struct network_client_s *client)
 }
 
 static int
-_cnx_notify_accept(struct network_server_s *srv)
+_cnx_notify_accept(struct network_loop_s *loop)
 {
+	struct network_server_s *srv = loop->server;
 	int inxs = EXCESS_NONE;
 	g_mutex_lock(&srv->lock_threads);
 	++ srv->cnx_accept;
 	++ srv->cnx_clients;
+	++ loop->cnx_accept;
+	++ loop->cnx_clients;
 	if (srv->cnx_clients > srv->cnx_max)
 		inxs = EXCESS_HARD;
 	g_mutex_unlock(&srv->lock_threads);
@@ -123,12 +127,16 @@ _cnx_notify_accept(struct network_server_s *srv)
 }
 
 static void
-_cnx_notify_close(struct network_server_s *srv)
+_cnx_notify_close(struct network_loop_s *loop)
 {
+	struct network_server_s *srv = loop->server;
 	g_mutex_lock(&srv->lock_threads);
 	EXTRA_ASSERT(srv->cnx_clients > 0);
+	EXTRA_ASSERT(loop->cnx_clients > 0);
 	-- srv->cnx_clients;
 	++ srv->cnx_close;
+	-- loop->cnx_clients;
+	++ loop->cnx_close;
 	g_mutex_unlock(&srv->lock_threads);
 }
 
@@ -178,48 +186,114 @@ network_server_reconfigure(struct network_server_s *srv)
 		return (i<=0 || i>G_MAXINT) ? -1 : (gint)i;
 	}
 
-	g_thread_pool_set_max_threads(
-			srv->pool_tcp, _map(server_threadpool_max_tcp), NULL);
+	/* The TCP workers are shared among the loops */
+	guint max_tcp = server_threadpool_max_tcp;
+	if (max_tcp > 0 && max_tcp <= G_MAXINT)
+		max_tcp = MAX(1, (max_tcp + srv->loops - 1) / srv->loops);
+	for (guint i=0; i<srv->loops ;++i)
+		g_thread_pool_set_max_threads(srv->loopv[i]->pool, _map(max_tcp), NULL);
 
 	g_thread_pool_set_max_threads(
 			srv->pool_udp, _map(server_threadpool_max_udp), NULL);
 }
 
-struct network_server_s *
-network_server_init(void)
+static GQuark
+_loop_quark(const char *type, guint index, const char *name)
+{
+	gchar tmp[64];
+	g_snprintf(tmp, sizeof(tmp), "%s loop.%u.%s", type, index, name);
+	return g_quark_from_string(tmp);
+}
+
+static void
+_loop_free(struct network_loop_s *loop)
 {
-	int efd;
-	if ((efd = eventfd(0, EFD_NONBLOCK)) < 0) {
+	if (!loop)
+		return;
+
+	if (loop->pool)
+		g_thread_pool_free(loop->pool, FALSE, TRUE);
+	if (loop->endpointv) {
+		for (struct endpoint_s **u=loop->endpointv; *u ;u++) {
+			_endpoint_close(*u);
+			g_free(*u);
+		}
+		g_free(loop->endpointv);
+	}
+	metautils_pclose(&(loop->eventfd));
+	metautils_pclose(&(loop->epollfd));
+	if (loop->queue_monitor)
+		g_async_queue_unref(loop->queue_monitor);
+	g_free(loop);
+}
+
+static struct network_loop_s *
+_loop_create(struct network_server_s *srv, guint index)
+{
+	struct network_loop_s *loop = g_malloc0(sizeof(struct network_loop_s));
+	loop->server = srv;
+	loop->index = index;
+	loop->eventfd = loop->epollfd = -1;
+
+	if ((loop->eventfd = eventfd(0, EFD_NONBLOCK)) < 0) {
 		GRID_ERROR("eventfd creation failure: (%d) %s",
 				errno, strerror(errno));
+		_loop_free(loop);
 		return NULL;
 	}
+	if ((loop->epollfd = epoll_create(1024)) < 0) {
+		GRID_ERROR("epoll creation failure: (%d) %s",
+				errno, strerror(errno));
+		_loop_free(loop);
+		return NULL;
+	}
+
+	loop->queue_monitor = g_async_queue_new();
+	loop->gq_gauge_threads =      _loop_quark("gauge", index, "thread.active");
+	loop->gq_gauge_cnx_current =  _loop_quark("gauge", index, "cnx.client");
+	loop->gq_counter_cnx_accept = _loop_quark("counter", index, "cnx.accept");
+	loop->gq_counter_cnx_close =  _loop_quark("counter", index, "cnx.close");
 
+	/* no limit at the creation, the server will reconfigure it */
+	loop->pool = g_thread_pool_new(
+			(GFunc)_cb_tcp_worker, loop, 0, FALSE, NULL);
+
+	GRID_DEBUG("LOOP %u ready with epollfd[%d] eventfd[%d]",
+			index, loop->epollfd, loop->eventfd);
+	return loop;
+}
+
+struct network_server_s *
+network_server_init(void)
+{
 	struct network_server_s *result = g_malloc0(sizeof(struct network_server_s));
 	result->flag_continue = ~0;
 	result->cnx_max = metautils_syscall_count_maxfd();
-	result->queue_monitor = g_async_queue_new();
 	result->endpointv = g_malloc0(sizeof(struct endpoint_s*));
 	g_mutex_init(&result->lock_threads);
-	result->eventfd = efd;
-	result->epollfd = epoll_create(1024);
 	result->gq_gauge_threads =      g_quark_from_static_string ("gauge thread.active");
 	result->gq_gauge_cnx_current =  g_quark_from_static_string ("gauge cnx.client");
 	result->gq_counter_cnx_accept = g_quark_from_static_string ("counter cnx.accept");
 	result->gq_counter_cnx_close =  g_quark_from_static_string ("counter cnx.close");
 
+	/* The number of loops is set once for all */
+	result->loops = CLAMP(server_loops, 1, 64);
+	result->loopv = g_malloc0(result->loops * sizeof(struct network_loop_s*));
+	for (guint i=0; i<result->loops ;++i) {
+		if (!(result->loopv[i] = _loop_create(result, i))) {
+			network_server_clean(result);
+			return NULL;
+		}
+	}
+
 	/* no limit at the creation ... */
-	result->pool_tcp = g_thread_pool_new(
-			(GFunc)_cb_tcp_worker, result, 0, FALSE, NULL);
 	result->pool_udp = g_thread_pool_new(
 			(GFunc)_manage_udp_task, result, 0, FALSE, NULL);
 
 	/* ... and then supersedes the limits now */
 	network_server_reconfigure(result);
 
-	GRID_DEBUG("SERVER ready with epollfd[%d] eventfd[%d]",
-			result->epollfd, result->eventfd);
-
+	GRID_DEBUG("SERVER ready with %u event loops", result->loops);
 	return result;
 }
 
@@ -245,9 +319,12 @@ _stop_pools (struct network_server_s *srv)
 		g_thread_pool_free (srv->pool_udp, FALSE, TRUE);
 		srv->pool_udp = NULL;
 	}
-	if (srv->pool_tcp) {
-		g_thread_pool_free (srv->pool_tcp, FALSE, TRUE);
-		srv->pool_tcp = NULL;
+	for (guint i=0; i<srv->loops ;++i) {
+		struct network_loop_s *loop = srv->loopv[i];
+		if (loop && loop->pool) {
+			g_thread_pool_free (loop->pool, FALSE, TRUE);
+			loop->pool = NULL;
+		}
 	}
 }
 
@@ -258,8 +335,10 @@ network_server_clean(struct network_server_s *srv)
 		return;
 
 	_stop_pools (srv);
-	if (srv->thread_tcp != NULL)
-		g_error("Event thread not joined: %s", "tcp");
+	for (guint i=0; i<srv->loops ;++i) {
+		if (srv->loopv[i] && srv->loopv[i]->thread != NULL)
+			g_error("Event thread not joined: %s %u", "tcp", i);
+	}
 	if (srv->thread_udp != NULL)
 		g_error("Event thread not joined: %s", "udp");
 
@@ -271,13 +350,13 @@ network_server_clean(struct network_server_s *srv)
 		g_free(srv->endpointv);
 	}
 
-	metautils_pclose(&(srv->eventfd));
-
-	if (srv->queue_monitor) {
-		g_async_queue_unref(srv->queue_monitor);
-		srv->queue_monitor = NULL;
+	if (srv->loopv) {
+		for (guint i=0; i<srv->loops ;++i)
+			_loop_free(srv->loopv[i]);
+		g_free(srv->loopv);
 	}
 
+	g_mutex_clear(&srv->lock_threads);
 	g_free(srv);
 }
 
@@ -344,12 +423,63 @@ network_server_endpoints (struct network_server_s *srv)
 	return (gchar**) g_ptr_array_free(tmp, FALSE);
 }
 
+static struct endpoint_s **
+_loop_endpoints(struct network_loop_s *loop)
+{
+	return loop->index ? loop->endpointv : loop->server->endpointv;
+}
+
 void
 network_server_close_servers(struct network_server_s *srv)
 {
 	EXTRA_ASSERT(srv != NULL);
 	for (struct endpoint_s **pu=srv->endpointv; *pu ;pu++)
 		_endpoint_close (*pu);
+	for (guint i=1; i<srv->loops ;++i) {
+		struct endpoint_s **pu = srv->loopv[i]->endpointv;
+		for (; pu && *pu ;pu++)
+			_endpoint_close (*pu);
+	}
+}
+
+/* Clones the INET endpoints of the server in each additional loop, with
+ * the port actually bound by the first loop. */
+static GError *
+_loop_open_servers(struct network_loop_s *loop)
+{
+	struct network_server_s *srv = loop->server;
+
+	if (loop->endpointv) {
+		for (struct endpoint_s **u=loop->endpointv; *u ;u++) {
+			_endpoint_close(*u);
+			g_free(*u);
+		}
+		g_free(loop->endpointv);
+	}
+
+	GPtrArray *tmp = g_ptr_array_new();
+	for (struct endpoint_s **u = srv->endpointv; *u; u++) {
+		if (!_endpoint_is_INET(*u))
+			continue;
+		const gsize len = strlen((*u)->url);
+		struct endpoint_s *e = g_malloc0(sizeof(*e) + 1 + len);
+		memcpy(e, *u, sizeof(*e) + len);
+		e->fd = e->fd_udp = -1;
+		e->port_cfg = (*u)->port_real;
+		e->port_real = 0;
+		g_ptr_array_add(tmp, e);
+	}
+	g_ptr_array_add(tmp, NULL);
+	loop->endpointv = (struct endpoint_s **) g_ptr_array_free(tmp, FALSE);
+
+	for (struct endpoint_s **u = loop->endpointv; *u; u++) {
+		GError *err = _endpoint_open(*u, FALSE, TRUE);
+		if (err) {
+			g_prefix_error(&err, "loop %u: ", loop->index);
+			return err;
+		}
+	}
+	return NULL;
 }
 
 GError *
@@ -357,18 +487,31 @@ network_server_open_servers(struct network_server_s *srv)
 {
 	g_assert(srv != NULL);
 
+	const gboolean reuseport = srv->loops > 1;
 	for (struct endpoint_s **u = srv->endpointv; srv->endpointv && *u; u++) {
 		GError *err;
-		if (NULL != (err = _endpoint_open(*u, srv->udp_allowed))) {
+		if (NULL != (err = _endpoint_open(*u, srv->udp_allowed, reuseport))) {
 			g_prefix_error(&err, "url open error : ");
 			network_server_close_servers(srv);
 			return err;
 		}
 	}
 
-	for (struct endpoint_s **u = srv->endpointv; srv->endpointv && *u; u++) {
-		GRID_DEBUG("fd=%d port=%d endpoint=%s ready", (*u)->fd,
-				(*u)->port_real, (*u)->url);
+	for (guint i=1; i<srv->loops ;++i) {
+		GError *err;
+		if (NULL != (err = _loop_open_servers(srv->loopv[i]))) {
+			g_prefix_error(&err, "url open error : ");
+			network_server_close_servers(srv);
+			return err;
+		}
+	}
+
+	for (guint i=0; i<srv->loops ;++i) {
+		struct endpoint_s **pu = _loop_endpoints(srv->loopv[i]);
+		for (; pu && *pu; pu++) {
+			GRID_DEBUG("loop=%u fd=%d port=%d endpoint=%s ready", i,
+					(*pu)->fd, (*pu)->port_real, (*pu)->url);
+		}
 	}
 
 	return NULL;
@@ -403,57 +546,59 @@ epoll2str(int how)
 }
 
 static void
-ARM_WAKER(struct network_server_s *srv, int how)
+ARM_WAKER(struct network_loop_s *loop, int how)
 {
 	struct epoll_event ev;
-	ev.data.ptr = &(srv->eventfd);
+	ev.data.ptr = &(loop->eventfd);
 	ev.events = EPOLLIN|EPOLLET|EPOLLONESHOT;
 
-	if (0 == epoll_ctl(srv->epollfd, how, srv->eventfd, &ev))
+	if (0 == epoll_ctl(loop->epollfd, how, loop->eventfd, &ev))
 		return;
-	GRID_DEBUG("WUP epoll_ctl(%d,%d,%s) = (%d) %s", srv->epollfd,
-			srv->eventfd, epoll2str(how), errno, strerror(errno));
+	GRID_DEBUG("WUP epoll_ctl(%d,%d,%s) = (%d) %s", loop->epollfd,
+			loop->eventfd, epoll2str(how), errno, strerror(errno));
 }
 
 static void
-ARM_CLIENT(struct network_server_s *srv, struct network_client_s *clt, int how)
+ARM_CLIENT(struct network_loop_s *loop, struct network_client_s *clt, int how)
 {
+	EXTRA_ASSERT(clt->loop == loop);
+
 	struct epoll_event ev;
 	ev.data.ptr = clt;
 	ev.events = EPOLLIN|EPOLLET|EPOLLONESHOT;
 	if (clt->events & CLT_WRITE)
 		ev.events |= EPOLLOUT;
 
-	if (0 == epoll_ctl(srv->epollfd, how, clt->fd, &ev)) {
+	if (0 == epoll_ctl(loop->epollfd, how, clt->fd, &ev)) {
 		if (how != EPOLL_CTL_DEL)
-			_client_add_to_monitored(srv, clt);
+			_client_add_to_monitored(loop, clt);
 		return;
 	}
 
-	GRID_WARN("CLT epoll_ctl(%d,%d,%s) = (%d) %s", srv->epollfd,
+	GRID_WARN("CLT epoll_ctl(%d,%d,%s) = (%d) %s", loop->epollfd,
 			clt->fd, epoll2str(how), errno, strerror(errno));
-	_client_clean(srv, clt);
+	_client_clean(loop->server, clt);
 }
 
 static void
-ARM_ENDPOINT(struct network_server_s *srv, struct endpoint_s *e, int how)
+ARM_ENDPOINT(struct network_loop_s *loop, struct endpoint_s *e, int how)
 {
 	struct epoll_event ev;
 	ev.events = EPOLLIN|EPOLLET|EPOLLONESHOT;
 	ev.data.ptr = e;
-	if (0 == epoll_ctl(srv->epollfd, how, e->fd, &ev))
+	if (0 == epoll_ctl(loop->epollfd, how, e->fd, &ev))
 		return;
-	GRID_DEBUG("SRV epoll_ctl(%d,%d,%s) = (%d) %s", srv->epollfd,
+	GRID_DEBUG("SRV epoll_ctl(%d,%d,%s) = (%d) %s", loop->epollfd,
 			e->fd, epoll2str(how), errno, strerror(errno));
 }
 
 static void
-_manage_client_event(struct network_server_s *srv,
+_manage_client_event(struct network_loop_s *loop,
 		struct network_client_s *clt, register int ev0)
 {
-	_client_remove_from_monitored(srv, clt);
+	_client_remove_from_monitored(loop, clt);
 
-	if (!srv->flag_continue)
+	if (!loop->server->flag_continue)
 		clt->transport.waiting_for_close = TRUE;
 
 	ev0 = MACRO_COND(ev0 & EPOLLIN, CLT_READ, 0)
@@ -465,55 +610,55 @@ _manage_client_event(struct network_server_s *srv,
 		clt->time.evt_in = oio_ext_monotonic_time();
 
 	if (clt->events & CLT_ERROR)
-		ARM_CLIENT(srv, clt, EPOLL_CTL_DEL);
-	metautils_gthreadpool_push("TCP", srv->pool_tcp, clt);
+		ARM_CLIENT(loop, clt, EPOLL_CTL_DEL);
+	metautils_gthreadpool_push("TCP", loop->pool, clt);
 }
 
 static void
-_manage_endpoint_event (struct network_server_s *srv, struct endpoint_s *e)
+_manage_endpoint_event (struct network_loop_s *loop, struct endpoint_s *e)
 {
 	for (guint i=0; i<server_accept_batch_size ;++i) {
-		struct network_client_s *clt = _endpoint_accept_one(srv, e);
+		struct network_client_s *clt = _endpoint_accept_one(loop, e);
 		if (!clt) break;
 		if (clt->current_error)
-			_client_clean(srv, clt);
+			_client_clean(loop->server, clt);
 		else {
-			ARM_CLIENT(srv, clt, EPOLL_CTL_ADD);
+			ARM_CLIENT(loop, clt, EPOLL_CTL_ADD);
 		}
 	}
-	ARM_ENDPOINT(srv, e, EPOLL_CTL_MOD);
+	ARM_ENDPOINT(loop, e, EPOLL_CTL_MOD);
 }
 
 static void
-_manage_events(struct network_server_s *srv)
+_manage_events(struct network_loop_s *loop)
 {
 	int erc;
 	struct epoll_event *pev, allev[server_event_batch_size];
 
-	erc = epoll_wait(srv->epollfd, allev, server_event_batch_size, 500);
+	erc = epoll_wait(loop->epollfd, allev, server_event_batch_size, 500);
 	if (erc > 0) {
 		while (erc-- > 0) {
 			pev = allev+erc;
-			if (pev->data.ptr == &(srv->eventfd))
+			if (pev->data.ptr == &(loop->eventfd))
 				continue;
 			if (MAGIC_ENDPOINT == *((unsigned int*)(pev->data.ptr)))
-				_manage_endpoint_event (srv, pev->data.ptr);
+				_manage_endpoint_event (loop, pev->data.ptr);
 			else
-				_manage_client_event(srv, pev->data.ptr, pev->events);
+				_manage_client_event(loop, pev->data.ptr, pev->events);
 		}
 	}
 
-	_drain_eventfd(srv->eventfd);
-	ARM_WAKER(srv, EPOLL_CTL_MOD);
+	_drain_eventfd(loop->eventfd);
+	ARM_WAKER(loop, EPOLL_CTL_MOD);
 	struct network_client_s *clt;
-	while (NULL != (clt = g_async_queue_try_pop(srv->queue_monitor))) {
+	while (NULL != (clt = g_async_queue_try_pop(loop->queue_monitor))) {
 		EXTRA_ASSERT(clt->events != 0 && !(clt->events & CLT_ERROR));
-		ARM_CLIENT(srv, clt, EPOLL_CTL_MOD);
+		ARM_CLIENT(loop, clt, EPOLL_CTL_MOD);
 	}
 }
 
 static void
-_server_shutdown_inactive_connections(struct network_server_s *srv)
+_server_shutdown_inactive_connections(struct network_loop_s *loop)
 {
 	guint count = 0;
 	gint64 now = oio_ext_monotonic_time ();
@@ -522,22 +667,22 @@ _server_shutdown_inactive_connections(struct network_server_s *srv)
 	const gint64 tp = now - server_cnx_ttl_persist;
 
 	struct network_client_s *clt, *n;
-	for (clt=srv->first ; clt ; clt=n) {
+	for (clt=loop->first ; clt ; clt=n) {
 		n = clt->next;
 		EXTRA_ASSERT(clt->fd >= 0);
 		if (clt->time.evt_in) {
 			if (clt->time.evt_in < ti) {
 				GRID_DEBUG("cnx %d closed: %s", clt->fd, "idle for too long");
-				_manage_client_event(srv, clt, 0);
+				_manage_client_event(loop, clt, 0);
 				++ count;
 			} else if (clt->time.cnx < tp) {
 				GRID_DEBUG("cnx %d closed: %s", clt->fd, "open since too long");
-				_manage_client_event(srv, clt, 0);
+				_manage_client_event(loop, clt, 0);
 				++ count;
 			}
 		} else if (clt->time.cnx < tc) { /* never input */
 			GRID_DEBUG("cnx %d closed: %s", clt->fd, "inactive since too long");
-			_manage_client_event(srv, clt, 0);
+			_manage_client_event(loop, clt, 0);
 			++ count;
 		}
 	}
@@ -550,12 +695,13 @@ _thread_cb_events(gpointer d)
 {
 	metautils_ignore_signals();
 
-	struct network_server_s *srv = d;
+	struct network_loop_s *loop = d;
+	struct network_server_s *srv = loop->server;
 	for (gint64 next = 0; srv->flag_continue ;) {
-		_manage_events(srv);
+		_manage_events(loop);
 		gint64 now = oio_ext_monotonic_time ();
 		if (now > next) {
-			_server_shutdown_inactive_connections(srv);
+			_server_shutdown_inactive_connections(loop);
 			next = now + 30 * G_TIME_SPAN_SECOND;
 		}
 	}
@@ -564,16 +710,17 @@ _thread_cb_events(gpointer d)
 	 * received the exit signal. They will be removed automatically from
 	 * the epoll pool.*/
 
-	GRID_DEBUG("Server %p waiting for its connections", srv);
+	GRID_DEBUG("Server %p loop %u waiting for its connections",
+			srv, loop->index);
 	server_cnx_ttl_never = 5 * G_TIME_SPAN_SECOND;
 	server_cnx_ttl_persist = 5 * G_TIME_SPAN_SECOND;
 	server_cnx_ttl_idle = 1 * G_TIME_SPAN_SECOND;
 
-	for (gint64 next = 0; 0 < srv->cnx_clients ;) {
-		_manage_events(srv);
+	for (gint64 next = 0; 0 < loop->cnx_clients ;) {
+		_manage_events(loop);
 		gint64 now = oio_ext_monotonic_time ();
 		if (now > next) {
-			_server_shutdown_inactive_connections(srv);
+			_server_shutdown_inactive_connections(loop);
 			next = now + 1 * G_TIME_SPAN_SECOND;
 		}
 	}
@@ -738,22 +885,42 @@ network_server_run(struct network_server_s *srv, void (*on_reload)(void))
 		return NULL;
 	}
 
-	for (pu=srv->endpointv; srv->flag_continue && (u = *pu) ;pu++)
-		ARM_ENDPOINT(srv, u, EPOLL_CTL_ADD);
-	ARM_WAKER(srv, EPOLL_CTL_ADD);
+	for (guint i=0; i<srv->loops ;++i) {
+		struct network_loop_s *loop = srv->loopv[i];
+		pu = _loop_endpoints(loop);
+		for (; pu && srv->flag_continue && (u = *pu) ;pu++)
+			ARM_ENDPOINT(loop, u, EPOLL_CTL_ADD);
+		ARM_WAKER(loop, EPOLL_CTL_ADD);
+	}
 
 	if (srv->udp_allowed)
 		srv->thread_udp = g_thread_new("udp", _thread_cb_ping, srv);
-	srv->thread_tcp = g_thread_new("tcp", _thread_cb_events, srv);
+	for (guint i=0; i<srv->loops ;++i) {
+		gchar name[16] = "tcp";
+		if (srv->loops > 1)
+			g_snprintf(name, sizeof(name), "tcp-%u", i);
+		srv->loopv[i]->thread = g_thread_new(name, _thread_cb_events,
+				srv->loopv[i]);
+	}
 
 	while (srv->flag_continue) {
 		g_usleep(1 * G_TIME_SPAN_SECOND);
 		oio_stats_set(
 				srv->gq_gauge_threads,
-				(guint64) g_thread_pool_get_num_threads(srv->pool_tcp),
+				(guint64) network_server_count_threads(srv),
 				srv->gq_gauge_cnx_current, srv->cnx_clients,
 				srv->gq_counter_cnx_accept, srv->cnx_accept,
 				srv->gq_counter_cnx_close, srv->cnx_close);
+		/* Only a multi-loop server details its loops */
+		for (guint i=0; srv->loops > 1 && i<srv->loops ;++i) {
+			struct network_loop_s *loop = srv->loopv[i];
+			oio_stats_set(
+					loop->gq_gauge_threads,
+					(guint64) g_thread_pool_get_num_threads(loop->pool),
+					loop->gq_gauge_cnx_current, loop->cnx_clients,
+					loop->gq_counter_cnx_accept, loop->cnx_accept,
+					loop->gq_counter_cnx_close, loop->cnx_close);
+		}
 		if (main_signal_SIGHUP) {
 			main_signal_SIGHUP = FALSE;
 			if (on_reload)
@@ -765,9 +932,12 @@ network_server_run(struct network_server_s *srv, void (*on_reload)(void))
 	GRID_DEBUG("Server %p waiting for its threads", srv);
 
 	/* wait for the event threads */
-	if (srv->thread_tcp) {
-		g_thread_join(srv->thread_tcp);
-		srv->thread_tcp = NULL;
+	for (guint i=0; i<srv->loops ;++i) {
+		struct network_loop_s *loop = srv->loopv[i];
+		if (loop->thread) {
+			g_thread_join(loop->thread);
+			loop->thread = NULL;
+		}
 	}
 	if (srv->thread_udp) {
 		g_thread_join(srv->thread_udp);
@@ -776,7 +946,8 @@ network_server_run(struct network_server_s *srv, void (*on_reload)(void))
 
 	/* XXX(jfs): seems legit but requires exit critical path to be reviewed.
 	_stop_pools (srv); */
-	ARM_WAKER(srv, EPOLL_CTL_DEL);
+	for (guint i=0; i<srv->loops ;++i)
+		ARM_WAKER(srv->loopv[i], EPOLL_CTL_DEL);
 
 	GRID_DEBUG("Server %p exiting its main loop", srv);
 	return err;
@@ -790,6 +961,17 @@ network_server_stop(struct network_server_s *srv)
 	srv->flag_continue = FALSE;
 }
 
+guint
+network_server_count_threads(struct network_server_s *srv)
+{
+	guint count = 0;
+	for (guint i=0; srv && i<srv->loops ;++i) {
+		if (srv->loopv[i]->pool)
+			count += g_thread_pool_get_num_threads(srv->loopv[i]->pool);
+	}
+	return count;
+}
+
 /* Endpoint features ------------------------------------------------------- */
 
 static gboolean _endpoint_is_UNIX (struct endpoint_s *u)
@@ -835,7 +1017,7 @@ _checked_inet_pton(int af, const char *src, void *dst)
 }
 
 static GError *
-_endpoint_open(struct endpoint_s *u, gboolean udp_allowed)
+_endpoint_open(struct endpoint_s *u, gboolean udp_allowed, gboolean reuseport)
 {
 	EXTRA_ASSERT(u != NULL);
 
@@ -871,6 +1053,11 @@ _endpoint_open(struct endpoint_s *u, gboolean udp_allowed)
 		sock_set_reuseaddr (u->fd, TRUE);
 		if (u->fd_udp >= 0)
 			sock_set_reuseaddr (u->fd_udp, TRUE);
+		/* Each event loop listens on its own socket, bound to the same
+		 * address, and the kernel balances the connections among them. */
+		if (reuseport && !sock_set_reuseport (u->fd, TRUE))
+			return NEWERROR(errno, "setsockopt(SO_REUSEPORT) = '%s'",
+					strerror(errno));
 	}
 
 	GError *err = NULL;
@@ -929,8 +1116,9 @@ _endpoint_open(struct endpoint_s *u, gboolean udp_allowed)
 }
 
 static struct network_client_s *
-_endpoint_accept_one(struct network_server_s *srv, const struct endpoint_s *e)
+_endpoint_accept_one(struct network_loop_s *loop, const struct endpoint_s *e)
 {
+	struct network_server_s *srv = loop->server;
 	int fd;
 	struct sockaddr_storage ss;
 	socklen_t ss_len;
@@ -955,23 +1143,24 @@ retry:
 	struct network_client_s *clt = g_slice_new0(struct network_client_s);
 	if (NULL == clt) {
 		metautils_pclose(&fd);
-		_cnx_notify_close(srv);
+		_cnx_notify_close(loop);
 		return NULL;
 	}
 
-	switch (_cnx_notify_accept(srv)) {
+	switch (_cnx_notify_accept(loop)) {
 		case EXCESS_NONE:
 			break;
 		case EXCESS_HARD:
 			g_slice_free(struct network_client_s, clt);
 			metautils_pclose(&fd);
-			_cnx_notify_close(srv);
+			_cnx_notify_close(loop);
 			GRID_WARN("Too many inbound connections! (max=%u)",
 					srv->cnx_max);
 			return NULL;
 	}
 
 	clt->server = srv;
+	clt->loop = loop;
 	clt->fd = fd;
 	grid_sockaddr_to_string((struct sockaddr*)&ss,
 			clt->peer_name, sizeof(clt->peer_name));
@@ -990,10 +1179,11 @@ retry:
 /* Server features ---------------------------------------------------------- */
 
 static void
-_cb_tcp_worker(struct network_client_s *clt, struct network_server_s *srv)
+_cb_tcp_worker(struct network_client_s *clt, struct network_loop_s *loop)
 {
 	EXTRA_ASSERT(clt != NULL);
-	EXTRA_ASSERT(clt->server == srv);
+	EXTRA_ASSERT(clt->loop == loop);
+	struct network_server_s *srv = loop->server;
 
 	if ((clt->events & CLT_ERROR) || !clt->events) {
 		_client_clean(srv, clt);
@@ -1044,9 +1234,9 @@ _cb_tcp_worker(struct network_client_s *clt, struct network_server_s *srv)
 		_client_clean(srv, clt);
 	}
 	else {
-		g_async_queue_push(srv->queue_monitor, clt);
+		g_async_queue_push(loop->queue_monitor, clt);
 		guint64 evt_count = 1u;
-		ssize_t w = write(srv->eventfd, &evt_count, 8);
+		ssize_t w = write(loop->eventfd, &evt_count, 8);
 		if (w != 8) {
 			GRID_WARN("event thread notification failed: (%d) %s",
 					errno, strerror(errno));
@@ -1057,15 +1247,15 @@ _cb_tcp_worker(struct network_client_s *clt, struct network_server_s *srv)
 /* Client functions --------------------------------------------------------- */
 
 static void
-_client_remove_from_monitored(struct network_server_s *srv,
+_client_remove_from_monitored(struct network_loop_s *loop,
 		struct network_client_s *clt)
 {
-	EXTRA_ASSERT(clt->server == srv);
+	EXTRA_ASSERT(clt->loop == loop);
 
-	if (srv->first == clt) {
+	if (loop->first == clt) {
 		EXTRA_ASSERT(clt->prev == NULL);
-		if (NULL != (srv->first = clt->next))
-			srv->first->prev = NULL;
+		if (NULL != (loop->first = clt->next))
+			loop->first->prev = NULL;
 	}
 	else {
 		EXTRA_ASSERT(clt->prev != NULL);
@@ -1077,17 +1267,17 @@ _client_remove_from_monitored(struct network_server_s *srv,
 }
 
 static void
-_client_add_to_monitored(struct network_server_s *srv,
+_client_add_to_monitored(struct network_loop_s *loop,
 		struct network_client_s *clt)
 {
-	EXTRA_ASSERT(clt->server == srv);
+	EXTRA_ASSERT(clt->loop == loop);
 	EXTRA_ASSERT(clt->prev == NULL);
 	EXTRA_ASSERT(clt->next == NULL);
 	EXTRA_ASSERT(clt->fd >= 0);
 
-	if (NULL != (clt->next = srv->first))
+	if (NULL != (clt->next = loop->first))
 		clt->next->prev = clt;
-	srv->first = clt;
+	loop->first = clt;
 }
 
 static gboolean
@@ -1117,9 +1307,12 @@ _client_clean(struct network_server_s *srv, struct network_client_s *clt)
 	EXTRA_ASSERT(clt->prev == NULL);
 	EXTRA_ASSERT(clt->next == NULL);
 
+	(void) srv;
 	if (clt->fd >= 0) {
+		EXTRA_ASSERT(clt->loop != NULL);
+		EXTRA_ASSERT(clt->loop->server == srv);
 		metautils_pclose(&(clt->fd));
-		_cnx_notify_close(srv);
+		_cnx_notify_close(clt->loop);
 	}
 
 	clt->flags = clt->events = 0;
@@ -1306,21 +1499,70 @@ network_client_send_slab(struct network_client_s *client, struct data_slab_s *ds
 		return MACRO_COND(type == STYPE_EOF, 0, -1);
 	}
 
-	/* Try to send the slab now, if allowed */
-	if (!_client_has_pending_output(client)) {
-		if (!data_slab_send(ds, client->fd)) {
+	/* An EOF marker with nothing before it is managed immediately */
+	if (ds->type == STYPE_EOF && !_client_has_pending_output(client)) {
+		data_slab_send(ds, client->fd);
+		data_slab_free(ds);
+		return 0;
+	}
+
+	/* Queue the slab behind the pending ones, then try to flush the whole
+	 * output in a single syscall. What remains will be sent by the worker,
+	 * when the socket becomes writable again. */
+	data_slab_sequence_append(&(client->output), ds);
+	if (_client_has_pending_output(client)) {
+		if (!_client_send_pending_output(client)) {
 			if (errno != EAGAIN) {
-				data_slab_free(ds);
+				data_slab_sequence_clean_data(&(client->output));
 				return -1;
 			}
 		}
 	}
+	return 0;
+}
 
-	/* manage what remains */
-	if (!data_slab_has_data(ds))
+gboolean
+network_client_drain_output(struct network_client_s *clt, gsize max,
+		gint64 deadline)
+{
+	EXTRA_ASSERT(clt != NULL);
+
+	while (_client_ready_for_output(clt)) {
+		if (data_slab_sequence_size(&(clt->output)) <= max)
+			return TRUE;
+		if (!_client_send_pending_output(clt) && errno != EAGAIN) {
+			data_slab_sequence_clean_data(&(clt->output));
+			return FALSE;
+		}
+		if (data_slab_sequence_size(&(clt->output)) <= max)
+			return TRUE;
+
+		const gint64 now = oio_ext_monotonic_time();
+		if (now >= deadline) {
+			GRID_WARN("fd=%d/%s output not drained before the deadline",
+					clt->fd, clt->peer_name);
+			return FALSE;
+		}
+		struct pollfd pfd = {.fd = clt->fd, .events = POLLOUT, .revents = 0};
+		const int ms = MIN(1000, 1 + (deadline - now) / G_TIME_SPAN_MILLISECOND);
+		if (poll(&pfd, 1, ms) < 0 && errno != EINTR)
+			return FALSE;
+	}
+	return FALSE;
+}
+
+int
+network_client_queue_slab(struct network_client_s *client, struct data_slab_s *ds)
+{
+	EXTRA_ASSERT(client != NULL);
+	EXTRA_ASSERT(ds != NULL);
+
+	if (!_client_ready_for_output(client)) {
 		data_slab_free(ds);
-	else
-		data_slab_sequence_append(&(client->output), ds);
+		return -1;
+	}
+
+	data_slab_sequence_append(&(client->output), ds);
 	return 0;
 }
 
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS server
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -23,6 +23,7 @@ License along with this library.
 # include <server/slab.h>
 
 struct network_server_s;
+struct network_loop_s;
 struct network_client_s;
 struct network_transport_s;
 
@@ -79,6 +80,7 @@ struct network_client_s
 	struct network_transport_s transport;
 	GError *current_error;
 
+	struct network_loop_s *loop; /*!< DO NOT USE */
 	struct network_client_s *prev; /*!< DO NOT USE */
 	struct network_client_s *next; /*!< DO NOT USE */
 
@@ -129,6 +131,10 @@ GError * network_server_run(struct network_server_s *srv,
 
 void network_server_stop(struct network_server_s *srv);
 
+/* Returns the number of worker threads currently running, summed on all the
+ * event loops of the server. */
+guint network_server_count_threads(struct network_server_s *srv);
+
 void network_server_clean(struct network_server_s *srv);
 
 /* -------------------------------------------------------------------------- */
@@ -137,7 +143,22 @@ void network_client_allow_input(struct network_client_s *clt, gboolean v);
 
 void network_client_close_output(struct network_client_s *clt, int now);
 
+/* Appends the slab to the output of the client, then sends as much of the
+ * pending output as possible. */
 int network_client_send_slab(struct network_client_s *client,
 		struct data_slab_s *slab);
 
+/* Only appends the slab to the output of the client. It will be sent with
+ * the slabs of the next call to network_client_send_slab(), or when the
+ * current worker releases the client. */
+int network_client_queue_slab(struct network_client_s *client,
+		struct data_slab_s *slab);
+
+/* Sends the pending output of the client, waiting for its socket to become
+ * writable, until at most <max> bytes remain queued. Meant for the workers
+ * that stream a large reply, to keep a bounded output.
+ * Returns FALSE if the output is closed, or if <deadline> is reached. */
+gboolean network_client_drain_output(struct network_client_s *clt,
+		gsize max, gint64 deadline);
+
 #endif /*OIO_SDS__server__network_server_h*/
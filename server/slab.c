@@ -1,7 +1,7 @@
 /*
 OpenIO SDS server
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -21,6 +21,7 @@ License along with this library.
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "slab.h"
 #include "internals.h"
@@ -37,7 +38,8 @@ data_slab_size(struct data_slab_s *ds)
 				return 0;
 			return (ds->data.buffer.end - ds->data.buffer.start);
 		case STYPE_GBYTES:
-			return g_bytes_get_size (ds->data.gbytes);
+			return g_bytes_get_size (ds->data.gbytes.bytes)
+				- ds->data.gbytes.offset;
 		case STYPE_EOF:
 			return 0;
 	}
@@ -54,7 +56,8 @@ data_slab_has_data(struct data_slab_s *ds)
 			return ds->data.buffer.buff != NULL
 				&& (ds->data.buffer.start < ds->data.buffer.end);
 		case STYPE_GBYTES:
-			return 0 < g_bytes_get_size (ds->data.gbytes);
+			return ds->data.gbytes.offset
+				< g_bytes_get_size (ds->data.gbytes.bytes);
 		case STYPE_EOF:
 			return FALSE;
 	}
@@ -78,7 +81,7 @@ data_slab_free(struct data_slab_s *ds)
 			ds->data.buffer.start = ds->data.buffer.end = 0;
 			break;
 		case STYPE_GBYTES:
-			g_bytes_unref (ds->data.gbytes);
+			g_bytes_unref (ds->data.gbytes.bytes);
 			break;
 		case STYPE_EOF:
 			break;
@@ -130,49 +133,69 @@ data_slab_sequence_has_data(struct data_slab_sequence_s *dss)
 	return FALSE;
 }
 
-gboolean
-data_slab_send(struct data_slab_s *ds, int fd)
+/* Points <iov> to the data remaining in <ds>, without any copy */
+static gsize
+_slab_to_iovec(struct data_slab_s *ds, struct iovec *iov)
 {
-	ssize_t w;
-
 	switch (ds->type) {
 		case STYPE_BUFFER:
 		case STYPE_BUFFER_STATIC:
-			/* send */
-			errno = 0;
-			w = write(fd,
-					ds->data.buffer.buff + ds->data.buffer.start,
-					ds->data.buffer.end - ds->data.buffer.start);
-			if (w < 0)
-				return FALSE;
-			/* consume */
-			ds->data.buffer.start += (guint) w;
-			return TRUE;
-
+			iov->iov_base = ds->data.buffer.buff + ds->data.buffer.start;
+			iov->iov_len = data_slab_size(ds);
+			return iov->iov_len;
 		case STYPE_GBYTES:
 			do {
 				gsize l = 0;
-				gconstpointer b = g_bytes_get_data (ds->data.gbytes, &l);
-				/* send */
-				errno = 0;
-				w = write(fd, b, l);
-				if (w < 0)
-					return FALSE;
-				/* consume */
-				GBytes *old = ds->data.gbytes;
-				ds->data.gbytes = g_bytes_new_from_bytes (old, w, l-w);
-				g_bytes_unref (old);
-				return TRUE;
+				const guint8 *b = g_bytes_get_data (ds->data.gbytes.bytes, &l);
+				iov->iov_base = (guint8*) b + ds->data.gbytes.offset;
+				iov->iov_len = l - ds->data.gbytes.offset;
 			} while (0);
-			return TRUE;
-
+			return iov->iov_len;
 		case STYPE_EOF:
-			shutdown(fd, SHUT_RDWR);
-			return TRUE;
+			iov->iov_base = NULL;
+			iov->iov_len = 0;
+			return 0;
 	}
+	g_assert_not_reached ();
+	return 0;
+}
 
+/* Marks at most <max> bytes of <ds> as sent, and returns how many were */
+static gsize
+_slab_skip(struct data_slab_s *ds, gsize max)
+{
+	const gsize len = MIN(max, data_slab_size(ds));
+	switch (ds->type) {
+		case STYPE_BUFFER:
+		case STYPE_BUFFER_STATIC:
+			ds->data.buffer.start += (guint) len;
+			return len;
+		case STYPE_GBYTES:
+			ds->data.gbytes.offset += len;
+			return len;
+		case STYPE_EOF:
+			return 0;
+	}
 	g_assert_not_reached ();
-	return FALSE;
+	return 0;
+}
+
+gboolean
+data_slab_send(struct data_slab_s *ds, int fd)
+{
+	if (ds->type == STYPE_EOF) {
+		shutdown(fd, SHUT_RDWR);
+		return TRUE;
+	}
+
+	struct iovec iov;
+	_slab_to_iovec(ds, &iov);
+	errno = 0;
+	ssize_t w = write(fd, iov.iov_base, iov.iov_len);
+	if (w < 0)
+		return FALSE;
+	_slab_skip(ds, w);
+	return TRUE;
 }
 
 gboolean
@@ -220,6 +243,15 @@ data_slab_consume(struct data_slab_s *ds, guint8 **p_data, gsize *p_size)
 	return FALSE;
 }
 
+gsize
+data_slab_sequence_size(struct data_slab_sequence_s *dss)
+{
+	gsize total = 0;
+	for (struct data_slab_s *ds = dss->first; ds; ds = ds->next)
+		total += data_slab_size(ds);
+	return total;
+}
+
 gboolean
 data_slab_sequence_send(struct data_slab_sequence_s *dss, int fd)
 {
@@ -228,7 +260,32 @@ data_slab_sequence_send(struct data_slab_sequence_s *dss, int fd)
 		return TRUE;
 	}
 
-	return data_slab_send(dss->first, fd);
+	/* Everything before the EOF marker has been sent */
+	if (dss->first->type == STYPE_EOF)
+		return data_slab_send(dss->first, fd);
+
+	struct iovec iov[OIO_SERVER_SLAB_IOV_MAX];
+	int iovcnt = 0;
+	for (struct data_slab_s *ds = dss->first;
+			ds && ds->type != STYPE_EOF && iovcnt < OIO_SERVER_SLAB_IOV_MAX;
+			ds = ds->next) {
+		if (_slab_to_iovec(ds, iov + iovcnt) > 0)
+			++ iovcnt;
+	}
+	if (!iovcnt)
+		return TRUE;
+
+	errno = 0;
+	ssize_t w = writev(fd, iov, iovcnt);
+	if (w < 0)
+		return FALSE;
+
+	/* The slabs fully sent will be freed by the next call to
+	 * data_slab_sequence_has_data() */
+	gsize remaining = w;
+	for (struct data_slab_s *ds = dss->first; ds && remaining > 0; ds = ds->next)
+		remaining -= _slab_skip(ds, remaining);
+	return TRUE;
 }
 
 void
@@ -326,7 +383,8 @@ data_slab_make_gbytes(GBytes *gb)
 {
 	struct data_slab_s *ds = _slab();
 	ds->type = STYPE_GBYTES;
-	ds->data.gbytes = gb;
+	ds->data.gbytes.bytes = gb;
+	ds->data.gbytes.offset = 0;
 	ds->next = NULL;
 	return ds;
 }
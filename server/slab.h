@@ -1,7 +1,7 @@
 /*
 OpenIO SDS server
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -35,7 +35,10 @@ struct data_slab_s
 {
 	enum data_slab_type_e type;
 	union {
-		GBytes *gbytes;
+		struct {
+			GBytes *bytes;
+			gsize offset; /* what has already been consumed */
+		} gbytes;
 		struct {
 			guint start;
 			guint end;
@@ -78,6 +81,12 @@ gboolean data_slab_sequence_ready_for_data(struct data_slab_sequence_s *dss);
 
 gboolean data_slab_sequence_has_data(struct data_slab_sequence_s *dss);
 
+/* Returns the number of bytes still to be sent */
+gsize data_slab_sequence_size(struct data_slab_sequence_s *dss);
+
+/* Sends as many pending slabs as possible, in a single writev() call. The
+ * slabs are not copied, and the call stops at the first EOF marker, that is
+ * only managed once all the slabs before it have been sent. */
 gboolean data_slab_sequence_send(struct data_slab_sequence_s *dss, int fd);
 
 void data_slab_sequence_append(struct data_slab_sequence_s *dss,
@@ -37,6 +37,8 @@ struct transport_client_context_s
 {
 	struct gridd_request_dispatcher_s *dispatcher;
 	GByteArray *gba_l4v;
+	/* Set once the client advertised the binary framing */
+	gboolean wire_binary;
 };
 
 struct gridd_request_handler_s
@@ -408,13 +410,17 @@ _notify_request(struct req_ctx_s *ctx, GQuark gq_count, GQuark gq_time)
 	oio_stats_add(
 			gq_count, 1, gq_count_all, 1,
 			gq_time, diff, gq_time_all, diff);
+	oio_stats_histo_add(gq_time, diff, gq_time_all, diff);
 }
 
 static gsize
 _reply_message(struct network_client_s *clt, MESSAGE reply)
 {
 	gint64 start = oio_ext_monotonic_time();
-	GByteArray *encoded = message_marshall_gba_and_clean(reply);
+	struct transport_client_context_s *ctx = clt->transport.client_context;
+	GByteArray *encoded = ctx->wire_binary
+		? message_marshall_binary_and_clean(reply)
+		: message_marshall_gba_and_clean(reply);
 	gint64 encode = oio_ext_monotonic_time();
 	gsize encoded_size = encoded->len;
 	network_client_send_slab(clt, data_slab_make_gba(encoded));
@@ -639,7 +645,8 @@ _client_manage_l4v(struct network_client_s *client, GByteArray *gba)
 	req_ctx.clt_ctx = req_ctx.transport->client_context;
 	req_ctx.disp = req_ctx.clt_ctx->dispatcher;
 
-	MESSAGE request = message_unmarshall(gba->data, gba->len, &err);
+	/* The request is destroyed before the buffer is reused */
+	MESSAGE request = message_unmarshall_inplace(gba->data, gba->len, &err);
 
 	// take the encoding into account
 	req_ctx.tv_start = client->time.evt_in;
@@ -657,6 +664,12 @@ _client_manage_l4v(struct network_client_s *client, GByteArray *gba)
 		goto label_exit;
 	}
 
+	if (oio_wire_binary && !req_ctx.clt_ctx->wire_binary) {
+		gsize len = 0;
+		req_ctx.clt_ctx->wire_binary = message_is_binary(gba->data, gba->len)
+			|| metautils_message_get_field(request, NAME_MSGKEY_WIRE, &len);
+	}
+
 	req_ctx.request = request;
 	req_ctx.reqname = _request_get_name(request);
 	req_ctx.reqid = _req_get_ID(request, reqid, sizeof(reqid));
@@ -44,6 +44,13 @@ License along with this library.
 
 #define BEACON_RESET(B) do { (B)->first = (B)->last = -1; } while (0)
 
+/* Each shard manages at least that number of bases. This avoids small
+ * caches to be split in partitions too small to be useful. */
+#define SHARD_MIN_BASES 64
+
+#define SHARD_BY_NAME(C,N) ((C)->shards + ((N)->hl.h % (C)->shards_count))
+#define SHARD_BY_BASE(C,B) ((C)->shards + (B)->shard)
+
 struct beacon_s
 {
 	gint first;
@@ -58,7 +65,9 @@ enum sqlx_base_status_e
 	SQLX_BASE_USED,	  /*!< with users. count_open then
 						 * tells how many threads have marked the base
 						 * to be kept open, and owner tells if the lock
-						 * os currently owned by a thread. */
+						 * os currently owned by a thread. When owner is
+						 * NULL, the base is shared by count_readers
+						 * threads. */
 	SQLX_BASE_CLOSING, // base being closed, wait for notification and retry on it
 	SQLX_BASE_CLOSING_FOR_DELETION, // base about to be deleted
 };
@@ -68,13 +77,13 @@ struct sqlx_base_s
 	hashstr_t *name; /*!< This is registered in the DB */
 
 	GThread *owner; /*!< The current owner of the database. Changed under the
-					  global lock */
+					  lock of the shard */
 	GCond cond;
 	GCond cond_prio;
 
 	gpointer handle;
 
-	gint64 last_update; /*!< Changed under the global lock */
+	gint64 last_update; /*!< Changed under the lock of the shard */
 
 	struct {
 		gint prev;
@@ -89,9 +98,21 @@ struct sqlx_base_s
 	guint32 count_waiting; /*!< Counts the number of threads waiting for the
 							base to become avaible. */
 
+	guint32 count_waiting_writers; /*!< Among the waiting threads, those who
+									 require an exclusive access. New readers
+									 wait behind them. */
+
+	guint32 count_readers; /*!< Counts the threads sharing the base in
+							 read-only mode. Exclusive with <owner>. */
+
+	GSList *readers; /*!< Idle read-only handles, kept for the next readers */
+
 	gint index; /*!< self reference */
 
-	enum sqlx_base_status_e status; /*!< Changed under the global lock */
+	guint shard; /*!< The shard managing the base. Only changed while the
+				   base is FREE, under the lock of its former shard. */
+
+	enum sqlx_base_status_e status; /*!< Changed under the lock of the shard */
 
 	struct grid_single_rrd_s *open_attempts;
 	struct grid_single_rrd_s *open_wait_time;
@@ -99,20 +120,33 @@ struct sqlx_base_s
 
 typedef struct sqlx_base_s sqlx_base_t;
 
-struct sqlx_cache_s
+/* A partition of the cache, with its own lock. A base name is always managed
+ * by the shard selected by its hash. The bases are initially spread among
+ * the shards, then a FREE base may move to a shard that lacks some. */
+struct sqlx_cache_shard_s
 {
 	GMutex lock;
 	GTree *bases_by_name;
-	sqlx_base_t *bases;
-	guint bases_max_soft;
-	guint bases_max_hard;
-	guint bases_used;
 
 	/* Doubly linked lists of tables, one by status */
 	struct beacon_s beacon_free;
 	struct beacon_s beacon_idle;
 	struct beacon_s beacon_idle_hot;
 	struct beacon_s beacon_used;
+};
+
+typedef struct sqlx_cache_shard_s sqlx_cache_shard_t;
+
+struct sqlx_cache_s
+{
+	sqlx_base_t *bases;
+	guint bases_max_soft;
+	guint bases_max_hard;
+	gint bases_used; /*!< Shared by all the shards, atomically changed */
+
+	sqlx_cache_shard_t *shards;
+	guint shards_count;
+	gint shards_next; /*!< Where the next expiration round starts */
 
 	sqlx_cache_close_hook close_hook;
 };
@@ -280,34 +314,35 @@ SQLX_UNSHIFT(sqlx_cache_t *cache, sqlx_base_t *base,
 }
 
 static void
-sqlx_save_id(sqlx_cache_t *cache, sqlx_base_t *base)
+sqlx_save_id(sqlx_cache_shard_t *shard, sqlx_base_t *base)
 {
 	gpointer pointer_index = GINT_TO_POINTER(base->index + 1);
-	g_tree_replace(cache->bases_by_name, base->name, pointer_index);
+	g_tree_replace(shard->bases_by_name, base->name, pointer_index);
 }
 
 static gint
-sqlx_lookup_id(sqlx_cache_t *cache, const hashstr_t *hs)
+sqlx_lookup_id(sqlx_cache_shard_t *shard, const hashstr_t *hs)
 {
-	gpointer lookup_result = g_tree_lookup(cache->bases_by_name, hs);
+	gpointer lookup_result = g_tree_lookup(shard->bases_by_name, hs);
 	return !lookup_result ? -1 : (GPOINTER_TO_INT(lookup_result) - 1);
 }
 
 static void
 sqlx_base_remove_from_list(sqlx_cache_t *cache, sqlx_base_t *base)
 {
+	sqlx_cache_shard_t *shard = SHARD_BY_BASE(cache, base);
 	switch (base->status) {
 		case SQLX_BASE_FREE:
-			SQLX_REMOVE(cache, base, &(cache->beacon_free));
+			SQLX_REMOVE(cache, base, &(shard->beacon_free));
 			return;
 		case SQLX_BASE_IDLE:
-			SQLX_REMOVE(cache, base, &(cache->beacon_idle));
+			SQLX_REMOVE(cache, base, &(shard->beacon_idle));
 			return;
 		case SQLX_BASE_IDLE_HOT:
-			SQLX_REMOVE(cache, base, &(cache->beacon_idle_hot));
+			SQLX_REMOVE(cache, base, &(shard->beacon_idle_hot));
 			return;
 		case SQLX_BASE_USED:
-			SQLX_REMOVE(cache, base, &(cache->beacon_used));
+			SQLX_REMOVE(cache, base, &(shard->beacon_used));
 			return;
 		case SQLX_BASE_CLOSING:
 		case SQLX_BASE_CLOSING_FOR_DELETION:
@@ -321,23 +356,25 @@ static void
 sqlx_base_add_to_list(sqlx_cache_t *cache, sqlx_base_t *base,
 		enum sqlx_base_status_e status)
 {
+	sqlx_cache_shard_t *shard = SHARD_BY_BASE(cache, base);
+
 	EXTRA_ASSERT(base->link.prev < 0);
 	EXTRA_ASSERT(base->link.next < 0);
 
 	switch (status) {
 		case SQLX_BASE_FREE:
-			EXTRA_ASSERT(cache->bases_used > 0);
-			cache->bases_used --;
-			SQLX_UNSHIFT(cache, base, &(cache->beacon_free), SQLX_BASE_FREE);
+			EXTRA_ASSERT(g_atomic_int_get(&cache->bases_used) > 0);
+			g_atomic_int_add(&cache->bases_used, -1);
+			SQLX_UNSHIFT(cache, base, &(shard->beacon_free), SQLX_BASE_FREE);
 			return;
 		case SQLX_BASE_IDLE:
-			SQLX_UNSHIFT(cache, base, &(cache->beacon_idle), SQLX_BASE_IDLE);
+			SQLX_UNSHIFT(cache, base, &(shard->beacon_idle), SQLX_BASE_IDLE);
 			return;
 		case SQLX_BASE_IDLE_HOT:
-			SQLX_UNSHIFT(cache, base, &(cache->beacon_idle_hot), SQLX_BASE_IDLE_HOT);
+			SQLX_UNSHIFT(cache, base, &(shard->beacon_idle_hot), SQLX_BASE_IDLE_HOT);
 			return;
 		case SQLX_BASE_USED:
-			SQLX_UNSHIFT(cache, base, &(cache->beacon_used), SQLX_BASE_USED);
+			SQLX_UNSHIFT(cache, base, &(shard->beacon_used), SQLX_BASE_USED);
 			return;
 		case SQLX_BASE_CLOSING:
 		case SQLX_BASE_CLOSING_FOR_DELETION:
@@ -365,30 +402,48 @@ sqlx_base_move_to_list(sqlx_cache_t *cache, sqlx_base_t *base,
 }
 
 static gboolean
-_has_idle_unlocked(sqlx_cache_t *cache)
+_has_idle_unlocked(sqlx_cache_shard_t *shard)
+{
+	return shard->beacon_idle.first != -1 ||
+			shard->beacon_idle_hot.first != -1;
+}
+
+/* Atomically account one more base in use, unless the soft limit (that is
+ * global to all the shards) has been reached. */
+static gboolean
+_cache_take_slot(sqlx_cache_t *cache)
 {
-	return cache->beacon_idle.first != -1 ||
-			cache->beacon_idle_hot.first != -1;
+	for (;;) {
+		const gint used = g_atomic_int_get(&cache->bases_used);
+		if ((guint)used >= cache->bases_max_soft)
+			return FALSE;
+		if (g_atomic_int_compare_and_exchange(&cache->bases_used, used, used+1))
+			return TRUE;
+	}
+}
+
+/* Tells if the soft limit (global to all the shards) allows one more base */
+static gboolean
+_cache_has_room(sqlx_cache_t *cache)
+{
+	return (guint)g_atomic_int_get(&cache->bases_used) < cache->bases_max_soft;
 }
 
 static GError *
-sqlx_base_reserve(sqlx_cache_t *cache, const hashstr_t *hs,
-		sqlx_base_t **result)
+sqlx_base_reserve(sqlx_cache_t *cache, sqlx_cache_shard_t *shard,
+		const hashstr_t *hs, sqlx_base_t **result)
 {
 	*result = NULL;
-	if (cache->bases_used >= cache->bases_max_soft) {
-		if (_has_idle_unlocked(cache)) {
+
+	sqlx_base_t *base = sqlx_get_by_id(cache, shard->beacon_free.first);
+	if (!base || !_cache_take_slot(cache)) {
+		if (_has_idle_unlocked(shard)) {
 			return NULL;  // No free base but we can recycle an idle one
 		} else {
 			return BUSY("Max bases reached");
 		}
 	}
 
-	sqlx_base_t *base = sqlx_get_by_id(cache, cache->beacon_free.first);
-	if (!base)
-		return NULL;
-
-	cache->bases_used ++;
 	EXTRA_ASSERT(base->count_open == 0);
 
 	/* base reserved and in PENDING state */
@@ -398,7 +453,7 @@ sqlx_base_reserve(sqlx_cache_t *cache, const hashstr_t *hs,
 	base->handle = NULL;
 	base->owner = g_thread_self();
 	sqlx_base_move_to_list(cache, base, SQLX_BASE_USED);
-	sqlx_save_id(cache, base);
+	sqlx_save_id(shard, base);
 
 	sqlx_base_debug(__FUNCTION__, base);
 	*result = base;
@@ -417,23 +472,28 @@ _signal_base(sqlx_base_t *base)
  * PRE:
  * - The base must be owned by the current thread
  * - it must be opened only once and locked only once
- * - the cache-wide lock must be owned by the current thread
+ * - the lock of the shard of the base must be owned by the current thread
  *
  * POST:
  * - The base is returned to the FREE list
  * - the base is not owned by any thread
- * - The cache-wide lock is still owned
+ * - The lock of the shard is still owned
  */
 static void
 _expire_base(sqlx_cache_t *cache, sqlx_base_t *b, gboolean deleted)
 {
+	sqlx_cache_shard_t *shard = SHARD_BY_BASE(cache, b);
 	gpointer handle = b->handle;
+	GSList *readers = b->readers;
 
 	sqlx_base_debug("FREEING", b);
 	EXTRA_ASSERT(b->owner != NULL);
 	EXTRA_ASSERT(b->count_open == 0);
+	EXTRA_ASSERT(b->count_readers == 0);
 	EXTRA_ASSERT(b->status == SQLX_BASE_USED);
 
+	b->readers = NULL;
+
 	sqlx_base_move_to_list(cache, b,
 			deleted? SQLX_BASE_CLOSING_FOR_DELETION : SQLX_BASE_CLOSING);
 
@@ -441,10 +501,14 @@ _expire_base(sqlx_cache_t *cache, sqlx_base_t *b, gboolean deleted)
 	 * But this can take a lot of time. So we can release the pool,
 	 * free the handle and unlock the cache */
 	_signal_base(b),
-	g_mutex_unlock(&cache->lock);
-	if (cache->close_hook)
+	g_mutex_unlock(&shard->lock);
+	if (cache->close_hook) {
+		for (GSList *l = readers; l ;l = l->next)
+			cache->close_hook(l->data);
 		cache->close_hook(handle);
-	g_mutex_lock(&cache->lock);
+	}
+	g_slist_free(readers);
+	g_mutex_lock(&shard->lock);
 
 	hashstr_t *n = b->name;
 
@@ -455,7 +519,7 @@ _expire_base(sqlx_cache_t *cache, sqlx_base_t *b, gboolean deleted)
 	b->last_update = 0;
 	sqlx_base_move_to_list(cache, b, SQLX_BASE_FREE);
 
-	g_tree_remove(cache->bases_by_name, n);
+	g_tree_remove(shard->bases_by_name, n);
 	g_free(n);
 }
 
@@ -469,7 +533,7 @@ _expire_specific_base(sqlx_cache_t *cache, sqlx_base_t *b,
 			return 0;
 	}
 
-	/* At this point, I have the global lock, and the base is IDLE.
+	/* At this point, I have the lock of the shard, and the base is IDLE.
 	 * We know no one have the lock on it. So we make the base USED
 	 * and we get the lock on it. because we have the lock, it is
 	 * protected from other uses */
@@ -494,15 +558,16 @@ _expire_specific_base(sqlx_cache_t *cache, sqlx_base_t *b,
 }
 
 static gint
-sqlx_expire_first_idle_base(sqlx_cache_t *cache, gint64 now)
+sqlx_expire_first_idle_base(sqlx_cache_t *cache, sqlx_cache_shard_t *shard,
+		gint64 now)
 {
 	gint rc = 0, bd_idle;
 
 	/* Poll the next idle base, and respect the increasing order of the 'heat' */
-	if (0 <= (bd_idle = cache->beacon_idle.last))
+	if (0 <= (bd_idle = shard->beacon_idle.last))
 		rc = _expire_specific_base(cache, GET(cache, bd_idle), now,
 				_cache_grace_delay_cool);
-	if (!rc && 0 <= (bd_idle = cache->beacon_idle_hot.last))
+	if (!rc && 0 <= (bd_idle = shard->beacon_idle_hot.last))
 		rc = _expire_specific_base(cache, GET(cache, bd_idle), now,
 				_cache_grace_delay_hot);
 
@@ -513,6 +578,56 @@ sqlx_expire_first_idle_base(sqlx_cache_t *cache, gint64 now)
 	return rc;
 }
 
+/* Expire one idle base in any shard but the given one. Called when a shard
+ * has reached the global soft limit while the idle bases are elsewhere.
+ * PRE: no shard lock is held by the current thread. */
+static gint
+sqlx_expire_idle_base_elsewhere(sqlx_cache_t *cache, sqlx_cache_shard_t *excl)
+{
+	gint rc = 0;
+	for (guint i=0; !rc && i < cache->shards_count ;i++) {
+		sqlx_cache_shard_t *shard = cache->shards + i;
+		if (shard == excl)
+			continue;
+		g_mutex_lock(&shard->lock);
+		rc = sqlx_expire_first_idle_base(cache, shard, 0);
+		g_mutex_unlock(&shard->lock);
+	}
+	return rc;
+}
+
+/* Move a FREE base from any other shard to <dst>, so that a shard whose
+ * free bases ran out does not refuse to open a base while the others still
+ * have some.
+ * PRE: no shard lock is held by the current thread. */
+static gboolean
+sqlx_steal_free_base(sqlx_cache_t *cache, sqlx_cache_shard_t *dst)
+{
+	sqlx_base_t *base = NULL;
+	for (guint i=0; !base && i < cache->shards_count ;i++) {
+		sqlx_cache_shard_t *src = cache->shards + i;
+		if (src == dst)
+			continue;
+		g_mutex_lock(&src->lock);
+		if (src->beacon_free.first >= 0) {
+			base = GET(cache, src->beacon_free.first);
+			EXTRA_ASSERT(base->status == SQLX_BASE_FREE);
+			SQLX_REMOVE(cache, base, &(src->beacon_free));
+			/* Out of any list, no other thread may reach it now */
+			base->status = SQLX_BASE_FREE;
+			base->shard = dst - cache->shards;
+		}
+		g_mutex_unlock(&src->lock);
+	}
+	if (!base)
+		return FALSE;
+
+	g_mutex_lock(&dst->lock);
+	SQLX_UNSHIFT(cache, base, &(dst->beacon_free), SQLX_BASE_FREE);
+	g_mutex_unlock(&dst->lock);
+	return TRUE;
+}
+
 /* ------------------------------------------------------------------------- */
 
 void
@@ -539,23 +654,31 @@ sqlx_cache_t *
 sqlx_cache_init(void)
 {
 	sqlx_cache_t *cache = g_malloc0(sizeof(*cache));
-	g_mutex_init(&cache->lock);
-	cache->bases_by_name = g_tree_new_full(hashstr_quick_cmpdata,
-			NULL, NULL, NULL);
-	BEACON_RESET(&(cache->beacon_free));
-	BEACON_RESET(&(cache->beacon_idle));
-	BEACON_RESET(&(cache->beacon_idle_hot));
-	BEACON_RESET(&(cache->beacon_used));
 
 	cache->bases_used = 0;
 	cache->bases_max_hard = sqliterepo_repo_max_bases_hard? : 1024;
 	cache->bases_max_soft = CLAMP(sqliterepo_repo_max_bases_soft, 1, cache->bases_max_hard);
 	cache->bases = g_malloc0(cache->bases_max_hard * sizeof(sqlx_base_t));
 
+	cache->shards_count = CLAMP(_cache_shards, 1,
+			MAX(1, cache->bases_max_hard / SHARD_MIN_BASES));
+	cache->shards = g_malloc0(cache->shards_count * sizeof(sqlx_cache_shard_t));
+	for (guint i=0; i<cache->shards_count ;i++) {
+		sqlx_cache_shard_t *shard = cache->shards + i;
+		g_mutex_init(&shard->lock);
+		shard->bases_by_name = g_tree_new_full(hashstr_quick_cmpdata,
+				NULL, NULL, NULL);
+		BEACON_RESET(&(shard->beacon_free));
+		BEACON_RESET(&(shard->beacon_idle));
+		BEACON_RESET(&(shard->beacon_idle_hot));
+		BEACON_RESET(&(shard->beacon_used));
+	}
+
 	time_t now = oio_ext_monotonic_seconds();
 	for (guint i=0; i<cache->bases_max_hard ;i++) {
 		sqlx_base_t *base = cache->bases + i;
 		base->index = i;
+		base->shard = i % cache->shards_count;
 		base->link.prev = base->link.next = -1;
 		g_cond_init(&base->cond);
 		g_cond_init(&base->cond_prio);
@@ -563,11 +686,12 @@ sqlx_cache_init(void)
 		base->open_wait_time = grid_single_rrd_create(now, 60);
 	}
 
-	/* stack all the bases in the FREE list, so that the first bases are
-	 * prefered. */
+	/* stack all the bases in the FREE list of their shard, so that the
+	 * first bases are prefered. */
 	for (guint i=cache->bases_max_hard; i>0 ;i--) {
 		sqlx_base_t *base = cache->bases + i - 1;
-		SQLX_UNSHIFT(cache, base, &(cache->beacon_free), SQLX_BASE_FREE);
+		SQLX_UNSHIFT(cache, base, &(SHARD_BY_BASE(cache, base)->beacon_free),
+				SQLX_BASE_FREE);
 	}
 
 	return cache;
@@ -599,6 +723,13 @@ sqlx_cache_clean(sqlx_cache_t *cache)
 					break;
 			}
 
+			if (base->readers) {
+				if (cache->close_hook)
+					g_slist_free_full(base->readers, cache->close_hook);
+				else
+					g_slist_free(base->readers);
+				base->readers = NULL;
+			}
 			g_cond_clear(&base->cond);
 			g_cond_clear(&base->cond_prio);
 			grid_single_rrd_destroy(base->open_attempts);
@@ -609,9 +740,15 @@ sqlx_cache_clean(sqlx_cache_t *cache)
 		g_free(cache->bases);
 	}
 
-	g_mutex_clear(&cache->lock);
-	if (cache->bases_by_name)
-		g_tree_destroy(cache->bases_by_name);
+	if (cache->shards) {
+		for (guint i=0; i < cache->shards_count ;i++) {
+			sqlx_cache_shard_t *shard = cache->shards + i;
+			g_mutex_clear(&shard->lock);
+			if (shard->bases_by_name)
+				g_tree_destroy(shard->bases_by_name);
+		}
+		g_free(cache->shards);
+	}
 
 	g_free(cache);
 }
@@ -619,15 +756,33 @@ sqlx_cache_clean(sqlx_cache_t *cache)
 GError *
 sqlx_cache_open_and_lock_base(sqlx_cache_t *cache, const hashstr_t *hname,
 		gboolean urgent, gint *result, gint64 deadline)
+{
+	return sqlx_cache_open_and_lock_base2(cache, hname, urgent, NULL,
+			result, deadline);
+}
+
+GError *
+sqlx_cache_open_and_lock_base2(sqlx_cache_t *cache, const hashstr_t *hname,
+		gboolean urgent, gboolean *shared, gint *result, gint64 deadline)
 {
 	gint bd;
 	GError *err = NULL;
 	sqlx_base_t *base = NULL;
+	gboolean expired_elsewhere = FALSE, stolen = FALSE;
 
 	EXTRA_ASSERT(cache != NULL);
 	EXTRA_ASSERT(hname != NULL);
 	EXTRA_ASSERT(result != NULL);
 
+	/* Shared accesses require the base to be already open, and the
+	 * current thread to not already own it. Until proven, assume an
+	 * exclusive access. */
+	const gboolean want_shared = shared && *shared && _cache_readers_max > 0;
+	if (shared)
+		*shared = FALSE;
+
+	sqlx_cache_shard_t *shard = SHARD_BY_NAME(cache, hname);
+
 	const gint64 start = oio_ext_monotonic_time();
 	const gint64 local_deadline = start + _cache_timeout_open;
 	deadline = (deadline <= 0) ? local_deadline : MIN(deadline, local_deadline);
@@ -636,21 +791,50 @@ sqlx_cache_open_and_lock_base(sqlx_cache_t *cache, const hashstr_t *hname,
 			(void*)cache, hname ? hashstr_str(hname) : "NULL",
 			(void*)result, (deadline - start) / G_TIME_SPAN_MILLISECOND);
 
-	g_mutex_lock(&cache->lock);
+	g_mutex_lock(&shard->lock);
 retry:
 
-	bd = sqlx_lookup_id(cache, hname);
+	bd = sqlx_lookup_id(shard, hname);
+	if (bd < 0 && !stolen && cache->shards_count > 1
+			&& shard->beacon_free.first < 0 && _cache_has_room(cache)) {
+		/* Prefer a free base of another shard to the recycling of a
+		 * local idle base, or to a failure. Without owning two shard locks
+		 * at once. */
+		stolen = TRUE;
+		g_mutex_unlock(&shard->lock);
+		sqlx_steal_free_base(cache, shard);
+		g_mutex_lock(&shard->lock);
+		goto retry;
+	}
 	if (bd < 0) {
-		if (!(err = sqlx_base_reserve(cache, hname, &base))) {
+		if (!(err = sqlx_base_reserve(cache, shard, hname, &base))) {
 			if (base) {
 				bd = base->index;
 				*result = base->index;
 				sqlx_base_debug("OPEN", base);
 			} else {
-				if (sqlx_expire_first_idle_base(cache, 0) >= 0)
+				if (sqlx_expire_first_idle_base(cache, shard, 0) >= 0)
 					goto retry;
 				err = NEWERROR(CODE_UNAVAILABLE, "No idle base in cache");
 			}
+		} else if (!expired_elsewhere && cache->shards_count > 1) {
+			/* The global limit has been reached while the idle bases are
+			 * in other shards. Let's try to recycle one of them, then to
+			 * get its slot if the current shard has no free base left,
+			 * without owning two shard locks at once. */
+			expired_elsewhere = TRUE;
+			const gboolean need_free = shard->beacon_free.first < 0;
+			g_mutex_unlock(&shard->lock);
+			gint rc = 1;
+			if (!_cache_has_room(cache))
+				rc = sqlx_expire_idle_base_elsewhere(cache, shard);
+			if (rc && need_free)
+				rc = sqlx_steal_free_base(cache, shard);
+			g_mutex_lock(&shard->lock);
+			if (rc) {
+				g_clear_error(&err);
+				goto retry;
+			}
 		}
 		EXTRA_ASSERT((base != NULL) ^ (err != NULL));
 	}
@@ -679,19 +863,40 @@ retry:
 			case SQLX_BASE_IDLE_HOT:
 				/* Base unused right now, the current thread get it! */
 				EXTRA_ASSERT(base->count_open == 0);
+				EXTRA_ASSERT(base->count_readers == 0);
 				EXTRA_ASSERT(base->owner == NULL);
 				sqlx_base_move_to_list(cache, base, SQLX_BASE_USED);
-				base->count_open ++;
-				base->owner = g_thread_self();
+				if (want_shared && base->handle != NULL
+						&& base->count_waiting_writers == 0) {
+					base->count_readers ++;
+					*shared = TRUE;
+				} else {
+					base->count_open ++;
+					base->owner = g_thread_self();
+				}
 				*result = base->index;
 				break;
 
 			case SQLX_BASE_USED:
-				EXTRA_ASSERT(base->count_open > 0);
-				EXTRA_ASSERT(base->owner != NULL);
+				EXTRA_ASSERT((base->count_open > 0) ^ (base->count_readers > 0));
+				EXTRA_ASSERT((base->owner != NULL) ^ (base->count_readers > 0));
+				if (want_shared && base->owner == NULL
+						&& base->count_waiting_writers == 0
+						&& base->count_readers < _cache_readers_max) {
+					/* Already shared, and no writer is waiting */
+					base->count_readers ++;
+					*shared = TRUE;
+					*result = base->index;
+					break;
+				}
 				if (base->owner != g_thread_self()) {
-					GRID_DEBUG("Base [%s] in use by another thread (%X), waiting...",
-							hashstr_str(hname), oio_log_thread_id(base->owner));
+					if (base->owner) {
+						GRID_DEBUG("Base [%s] in use by another thread (%X), waiting...",
+								hashstr_str(hname), oio_log_thread_id(base->owner));
+					} else {
+						GRID_DEBUG("Base [%s] shared by %u readers, waiting...",
+								hashstr_str(hname), base->count_readers);
+					}
 
 					if (!urgent && _cache_max_waiting > 0 &&
 							base->count_waiting >= _cache_max_waiting) {
@@ -717,13 +922,17 @@ retry:
 					}
 
 					base->count_waiting ++;
+					if (!want_shared)
+						base->count_waiting_writers ++;
 
 					/* The lock is held by another thread/request.
 					   Do not use 'now' because it can be a fake clock */
-					g_cond_wait_until(wait_cond, &cache->lock,
+					g_cond_wait_until(wait_cond, &shard->lock,
 							g_get_monotonic_time() + _cache_period_cond_wait);
 
 					base->count_waiting --;
+					if (!want_shared)
+						base->count_waiting_writers --;
 					goto retry;
 				}
 				base->owner = g_thread_self();
@@ -735,7 +944,7 @@ retry:
 				EXTRA_ASSERT(base->owner != NULL);
 				/* Just wait for a notification then retry
 				   Do not use 'now' because it can be a fake clock */
-				g_cond_wait_until(wait_cond, &cache->lock,
+				g_cond_wait_until(wait_cond, &shard->lock,
 						g_get_monotonic_time() + _cache_period_cond_wait);
 				goto retry;
 
@@ -757,12 +966,17 @@ retry:
 
 		if (!err) {
 			sqlx_base_debug(__FUNCTION__, base);
-			EXTRA_ASSERT(base->owner == g_thread_self());
-			EXTRA_ASSERT(base->count_open > 0);
+			if (shared && *shared) {
+				EXTRA_ASSERT(base->owner == NULL);
+				EXTRA_ASSERT(base->count_readers > 0);
+			} else {
+				EXTRA_ASSERT(base->owner == g_thread_self());
+				EXTRA_ASSERT(base->count_open > 0);
+			}
 		}
 		_signal_base(base);
 	}
-	g_mutex_unlock(&cache->lock);
+	g_mutex_unlock(&shard->lock);
 	return err;
 }
 
@@ -778,9 +992,10 @@ sqlx_cache_unlock_and_close_base(sqlx_cache_t *cache, gint bd, guint32 flags)
 		return NEWERROR(CODE_INTERNAL_ERROR, "invalid base id=%d", bd);
 
 	gint64 lock_time = 0;
-	g_mutex_lock(&cache->lock);
+	sqlx_base_t *base = GET(cache,bd);
+	sqlx_cache_shard_t *shard = SHARD_BY_BASE(cache, base);
+	g_mutex_lock(&shard->lock);
 
-	sqlx_base_t *base; base = GET(cache,bd);
 	switch (base->status) {
 
 		case SQLX_BASE_FREE:
@@ -797,8 +1012,22 @@ sqlx_cache_unlock_and_close_base(sqlx_cache_t *cache, gint bd, guint32 flags)
 			break;
 
 		case SQLX_BASE_USED:
-			EXTRA_ASSERT(base->count_open > 0);
 			lock_time = oio_ext_monotonic_time() - base->last_update;
+			if (!base->owner) {
+				/* shared by several readers, including the current thread */
+				EXTRA_ASSERT(base->count_readers > 0);
+				EXTRA_ASSERT(base->count_open == 0);
+				if (!(-- base->count_readers)) {
+					if (base->heat >= _cache_heat_threshold)
+						sqlx_base_move_to_list(cache, base, SQLX_BASE_IDLE_HOT);
+					else
+						sqlx_base_move_to_list(cache, base, SQLX_BASE_IDLE);
+					if (_ram_exhausted() && _has_idle_unlocked(shard))
+						sqlx_expire_first_idle_base(cache, shard, 0);
+				}
+				break;
+			}
+			EXTRA_ASSERT(base->count_open > 0);
 			/* held by the current thread */
 			if (!(-- base->count_open)) {  /* to be closed */
 				if (flags & (SQLX_CLOSE_IMMEDIATELY|SQLX_CLOSE_FOR_DELETION)) {
@@ -816,8 +1045,8 @@ sqlx_cache_unlock_and_close_base(sqlx_cache_t *cache, gint bd, guint32 flags)
 					 * that will be expired won't return its memory pages to
 					 * the kernel but to the sqlite3 pool. The pages will
 					 * become available to other bases. */
-					if (_ram_exhausted() && _has_idle_unlocked(cache))
-						sqlx_expire_first_idle_base(cache, 0);
+					if (_ram_exhausted() && _has_idle_unlocked(shard))
+						sqlx_expire_first_idle_base(cache, shard, 0);
 				}
 			}
 			break;
@@ -841,7 +1070,7 @@ sqlx_cache_unlock_and_close_base(sqlx_cache_t *cache, gint bd, guint32 flags)
 		}
 	}
 	_signal_base(base),
-	g_mutex_unlock(&cache->lock);
+	g_mutex_unlock(&shard->lock);
 	return err;
 }
 
@@ -854,14 +1083,18 @@ sqlx_cache_debug(sqlx_cache_t *cache)
 		return;
 
 	GRID_DEBUG("--- REPO %p -----------------", (void*)cache);
-	GRID_DEBUG(" > used     [%d, %d]",
-			cache->beacon_used.first, cache->beacon_used.last);
-	GRID_DEBUG(" > idle     [%d, %d]",
-			cache->beacon_idle.first, cache->beacon_idle.last);
-	GRID_DEBUG(" > idle_hot [%d, %d]",
-			cache->beacon_idle_hot.first, cache->beacon_idle_hot.last);
-	GRID_DEBUG(" > free     [%d, %d]",
-			cache->beacon_free.first, cache->beacon_free.last);
+	for (guint i=0; i < cache->shards_count ;i++) {
+		sqlx_cache_shard_t *shard = cache->shards + i;
+		GRID_DEBUG(" # shard %u", i);
+		GRID_DEBUG(" > used     [%d, %d]",
+				shard->beacon_used.first, shard->beacon_used.last);
+		GRID_DEBUG(" > idle     [%d, %d]",
+				shard->beacon_idle.first, shard->beacon_idle.last);
+		GRID_DEBUG(" > idle_hot [%d, %d]",
+				shard->beacon_idle_hot.first, shard->beacon_idle_hot.last);
+		GRID_DEBUG(" > free     [%d, %d]",
+				shard->beacon_free.first, shard->beacon_free.last);
+	}
 
 	/* Dump all the bases */
 	for (guint bd=0; bd < cache->bases_max_hard ;bd++) {
@@ -874,19 +1107,28 @@ sqlx_cache_debug(sqlx_cache_t *cache)
 		GRID_DEBUG("REF %d <- %s", GPOINTER_TO_INT(v), hashstr_str(k));
 		return FALSE;
 	}
-	g_tree_foreach(cache->bases_by_name, runner, NULL);
+	for (guint i=0; i < cache->shards_count ;i++) {
+		sqlx_cache_shard_t *shard = cache->shards + i;
+		g_mutex_lock(&shard->lock);
+		g_tree_foreach(shard->bases_by_name, runner, NULL);
+		g_mutex_unlock(&shard->lock);
+	}
 }
 
 guint
 sqlx_cache_expire_all(sqlx_cache_t *cache)
 {
-	guint nb;
+	guint nb = 0;
 
 	EXTRA_ASSERT(cache != NULL);
 
-	g_mutex_lock(&cache->lock);
-	for (nb=0; sqlx_expire_first_idle_base(cache, 0) ;nb++) { }
-	g_mutex_unlock(&cache->lock);
+	for (guint i=0; i < cache->shards_count ;i++) {
+		sqlx_cache_shard_t *shard = cache->shards + i;
+		g_mutex_lock(&shard->lock);
+		while (sqlx_expire_first_idle_base(cache, shard, 0))
+			nb ++;
+		g_mutex_unlock(&shard->lock);
+	}
 
 	return nb;
 }
@@ -894,20 +1136,31 @@ sqlx_cache_expire_all(sqlx_cache_t *cache)
 guint
 sqlx_cache_expire(sqlx_cache_t *cache, guint max, gint64 duration)
 {
-	guint nb = 0;
+	guint nb = 0, idle_shards = 0;
 	gint64 deadline = oio_ext_monotonic_time () + duration;
 
 	EXTRA_ASSERT(cache != NULL);
 
-	g_mutex_lock(&cache->lock);
-
-	for (nb=0; !max || nb < max ; nb++) {
+	/* Round-robin on the shards, one base at a time, so that no shard is
+	 * favored when the number of expirations is bounded. We stop when
+	 * a whole round of shards expired nothing. */
+	guint i = (guint) g_atomic_int_add(&cache->shards_next, 1);
+	while ((!max || nb < max) && idle_shards < cache->shards_count) {
+		sqlx_cache_shard_t *shard = cache->shards + (i++ % cache->shards_count);
 		gint64 now = oio_ext_monotonic_time ();
-		if (now > deadline || !sqlx_expire_first_idle_base(cache, now))
+		if (now > deadline)
 			break;
+		g_mutex_lock(&shard->lock);
+		const gint rc = sqlx_expire_first_idle_base(cache, shard, now);
+		g_mutex_unlock(&shard->lock);
+		if (rc) {
+			nb ++;
+			idle_shards = 0;
+		} else {
+			idle_shards ++;
+		}
 	}
 
-	g_mutex_unlock(&cache->lock);
 	return nb;
 }
 
@@ -934,16 +1187,58 @@ sqlx_cache_set_handle(sqlx_cache_t *cache, gint bd, gpointer sq3)
 	base->handle = sq3;
 }
 
+gpointer
+sqlx_cache_pop_reader(sqlx_cache_t *cache, gint bd)
+{
+	gpointer handle = NULL;
+
+	EXTRA_ASSERT(cache != NULL);
+	EXTRA_ASSERT(!base_id_out(cache, bd));
+
+	sqlx_base_t *base = GET(cache, bd);
+	sqlx_cache_shard_t *shard = SHARD_BY_BASE(cache, base);
+	g_mutex_lock(&shard->lock);
+	EXTRA_ASSERT(base->status == SQLX_BASE_USED);
+	EXTRA_ASSERT(base->count_readers > 0);
+	if (base->readers) {
+		GSList *first = base->readers;
+		base->readers = first->next;
+		handle = first->data;
+		g_slist_free_1(first);
+	}
+	g_mutex_unlock(&shard->lock);
+	return handle;
+}
+
+gboolean
+sqlx_cache_push_reader(sqlx_cache_t *cache, gint bd, gpointer handle)
+{
+	gboolean kept = FALSE;
+
+	EXTRA_ASSERT(cache != NULL);
+	EXTRA_ASSERT(!base_id_out(cache, bd));
+
+	sqlx_base_t *base = GET(cache, bd);
+	sqlx_cache_shard_t *shard = SHARD_BY_BASE(cache, base);
+	g_mutex_lock(&shard->lock);
+	EXTRA_ASSERT(base->status == SQLX_BASE_USED);
+	EXTRA_ASSERT(base->count_readers > 0);
+	if (g_slist_length(base->readers) < _cache_readers_max) {
+		base->readers = g_slist_prepend(base->readers, handle);
+		kept = TRUE;
+	}
+	g_mutex_unlock(&shard->lock);
+	return kept;
+}
+
 static guint
 _count_beacon(sqlx_cache_t *cache, struct beacon_s *beacon)
 {
 	guint count = 0;
-	g_mutex_lock(&cache->lock);
 	for (gint idx = beacon->first; idx != -1 ;) {
 		++ count;
 		idx = GET(cache, idx)->link.next;
 	}
-	g_mutex_unlock(&cache->lock);
 	return count;
 }
 
@@ -956,9 +1251,14 @@ sqlx_cache_count(sqlx_cache_t *cache)
 	if (cache) {
 		count.max = cache->bases_max_hard;
 		count.soft_max = cache->bases_max_soft;
-		count.cold = _count_beacon(cache, &cache->beacon_idle);
-		count.hot = _count_beacon(cache, &cache->beacon_idle_hot);
-		count.used = _count_beacon(cache, &cache->beacon_used);
+		for (guint i=0; i < cache->shards_count ;i++) {
+			sqlx_cache_shard_t *shard = cache->shards + i;
+			g_mutex_lock(&shard->lock);
+			count.cold += _count_beacon(cache, &shard->beacon_idle);
+			count.hot += _count_beacon(cache, &shard->beacon_idle_hot);
+			count.used += _count_beacon(cache, &shard->beacon_used);
+			g_mutex_unlock(&shard->lock);
+		}
 	}
 
 	return count;
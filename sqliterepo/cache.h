@@ -51,7 +51,26 @@ GError * sqlx_cache_open_and_lock_base(sqlx_cache_t *cache,
 		const struct hashstr_s *key, gboolean urgent, gint *result,
 		gint64 deadline);
 
-/** The invert of sqlx_cache_open_and_lock_base() */
+/** Like sqlx_cache_open_and_lock_base(), but if <shared> points to TRUE,
+ * the base may be granted in shared mode, i.e. to several readers at once.
+ * <shared> is reset to FALSE when the lock has been granted exclusively (for
+ * example when the base was not open yet, or when the current thread already
+ * owns it). */
+GError * sqlx_cache_open_and_lock_base2(sqlx_cache_t *cache,
+		const struct hashstr_s *key, gboolean urgent, gboolean *shared,
+		gint *result, gint64 deadline);
+
+/** Returns a read-only handle kept in the cache for the base, or NULL if
+ * there is none. The base must be held in shared mode. */
+gpointer sqlx_cache_pop_reader(sqlx_cache_t *cache, gint bd);
+
+/** Keeps a read-only handle in the cache for a later use. The base must be
+ * held in shared mode. Returns FALSE when the handle has not been kept,
+ * then the caller is responsible for closing it. */
+gboolean sqlx_cache_push_reader(sqlx_cache_t *cache, gint bd, gpointer handle);
+
+/** The invert of sqlx_cache_open_and_lock_base(). Works for both exclusive
+ * and shared locks. */
 GError * sqlx_cache_unlock_and_close_base(sqlx_cache_t *cache, gint bd,
 		guint32 flags);
 
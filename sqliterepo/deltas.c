@@ -0,0 +1,262 @@
+/*
+OpenIO SDS sqliterepo
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <metautils/lib/metautils.h>
+#include <sqliterepo/sqliterepo_variables.h>
+
+#include "sqlx_remote.h"
+#include "version.h"
+#include "deltas.h"
+
+struct delta_s
+{
+	GTree *pre;
+	GTree *post;
+	GByteArray *raw;
+	/* The log of the base the delta belongs to */
+	struct base_log_s *log;
+};
+
+struct base_log_s
+{
+	gchar *key;
+	GQueue deltas;  /* <struct delta_s*>, oldest first */
+};
+
+struct sqlx_deltas_s
+{
+	GMutex lock;
+	GHashTable *logs;  /* <gchar*> -> <struct base_log_s*> */
+	/* All the deltas of all the bases, oldest first. Because the deltas
+	 * are appended in both queues at once, the oldest delta overall is
+	 * always the oldest delta of its base. */
+	GQueue all;
+	gsize size;
+};
+
+static void
+_delta_free(struct delta_s *d)
+{
+	if (!d)
+		return;
+	if (d->pre)
+		g_tree_destroy(d->pre);
+	if (d->post)
+		g_tree_destroy(d->post);
+	if (d->raw)
+		g_byte_array_unref(d->raw);
+	g_free(d);
+}
+
+static void
+_base_log_free(struct base_log_s *log)
+{
+	if (!log)
+		return;
+	EXTRA_ASSERT(g_queue_is_empty(&log->deltas));
+	g_free(log->key);
+	g_free(log);
+}
+
+static gchar *
+_key(const struct sqlx_name_s *n)
+{
+	return g_strdup_printf("%s.%s", n->base, n->type);
+}
+
+/* Drop the oldest delta overall. Call it under the lock. */
+static void
+_pop_oldest(struct sqlx_deltas_s *deltas)
+{
+	struct delta_s *d = g_queue_pop_head(&deltas->all);
+	if (!d)
+		return;
+	struct base_log_s *log = d->log;
+	struct delta_s *d0 = g_queue_pop_head(&log->deltas);
+	EXTRA_ASSERT(d0 == d);
+	(void) d0;
+	deltas->size -= d->raw->len;
+	if (g_queue_is_empty(&log->deltas))
+		g_hash_table_remove(deltas->logs, log->key);
+	_delta_free(d);
+}
+
+/* Drop all the deltas of `log`, and `log` itself. Call it under the lock. */
+static void
+_forget_log(struct sqlx_deltas_s *deltas, struct base_log_s *log)
+{
+	struct delta_s *d;
+	while (NULL != (d = g_queue_pop_head(&log->deltas))) {
+		g_queue_remove(&deltas->all, d);
+		deltas->size -= d->raw->len;
+		_delta_free(d);
+	}
+	g_hash_table_remove(deltas->logs, log->key);
+}
+
+struct sqlx_deltas_s *
+sqlx_deltas_create(void)
+{
+	struct sqlx_deltas_s *deltas = g_malloc0(sizeof(*deltas));
+	g_mutex_init(&deltas->lock);
+	deltas->logs = g_hash_table_new_full(g_str_hash, g_str_equal,
+			NULL, (GDestroyNotify)_base_log_free);
+	g_queue_init(&deltas->all);
+	return deltas;
+}
+
+void
+sqlx_deltas_destroy(struct sqlx_deltas_s *deltas)
+{
+	if (!deltas)
+		return;
+	while (!g_queue_is_empty(&deltas->all))
+		_pop_oldest(deltas);
+	g_hash_table_destroy(deltas->logs);
+	g_mutex_clear(&deltas->lock);
+	g_free(deltas);
+}
+
+void
+sqlx_deltas_push(struct sqlx_deltas_s *deltas,
+		const struct sqlx_name_s *n, GTree *pre, GTree *post,
+		const guint8 *raw, gsize rawsize)
+{
+	EXTRA_ASSERT(deltas != NULL);
+	EXTRA_ASSERT(pre != NULL);
+	EXTRA_ASSERT(post != NULL);
+
+	if (!sqliterepo_deltas_max || rawsize > (gsize)sqliterepo_deltas_max_size)
+		return sqlx_deltas_forget(deltas, n);
+
+	struct delta_s *d = g_malloc0(sizeof(*d));
+	d->pre = version_dup(pre);
+	d->post = version_dup(post);
+	d->raw = g_byte_array_sized_new(rawsize);
+	g_byte_array_append(d->raw, raw, rawsize);
+
+	gchar *k = _key(n);
+	g_mutex_lock(&deltas->lock);
+
+	struct base_log_s *log = g_hash_table_lookup(deltas->logs, k);
+	if (log) {
+		/* A gap in the chain: the previous deltas are useless */
+		struct delta_s *last = g_queue_peek_tail(&log->deltas);
+		if (!version_equal(last->post, pre)) {
+			_forget_log(deltas, log);
+			log = NULL;
+		}
+	}
+	if (!log) {
+		log = g_malloc0(sizeof(*log));
+		log->key = k;
+		k = NULL;
+		g_queue_init(&log->deltas);
+		g_hash_table_insert(deltas->logs, log->key, log);
+	}
+
+	d->log = log;
+	g_queue_push_tail(&log->deltas, d);
+	g_queue_push_tail(&deltas->all, d);
+	deltas->size += d->raw->len;
+
+	/* Honor the limits, the oldest deltas go first */
+	while (log->deltas.length > sqliterepo_deltas_max) {
+		struct delta_s *old = g_queue_pop_head(&log->deltas);
+		g_queue_remove(&deltas->all, old);
+		deltas->size -= old->raw->len;
+		_delta_free(old);
+	}
+	while (deltas->size > (gsize)sqliterepo_deltas_max_size)
+		_pop_oldest(deltas);
+
+	g_mutex_unlock(&deltas->lock);
+	g_free(k);
+}
+
+void
+sqlx_deltas_forget(struct sqlx_deltas_s *deltas, const struct sqlx_name_s *n)
+{
+	EXTRA_ASSERT(deltas != NULL);
+	gchar *k = _key(n);
+	g_mutex_lock(&deltas->lock);
+	struct base_log_s *log = g_hash_table_lookup(deltas->logs, k);
+	if (log)
+		_forget_log(deltas, log);
+	g_mutex_unlock(&deltas->lock);
+	g_free(k);
+}
+
+GError *
+sqlx_deltas_collect(struct sqlx_deltas_s *deltas,
+		const struct sqlx_name_s *n, GTree *from, GTree *current,
+		GPtrArray **result)
+{
+	EXTRA_ASSERT(deltas != NULL);
+	EXTRA_ASSERT(from != NULL);
+	EXTRA_ASSERT(current != NULL);
+	EXTRA_ASSERT(result != NULL);
+
+	*result = NULL;
+	if (version_equal(from, current)) {
+		*result = g_ptr_array_new();
+		return NULL;
+	}
+
+	GError *err = NULL;
+	gchar *k = _key(n);
+	g_mutex_lock(&deltas->lock);
+	struct base_log_s *log = g_hash_table_lookup(deltas->logs, k);
+	if (!log) {
+		err = NEWERROR(CODE_NOT_FOUND, "No delta");
+	} else {
+		struct delta_s *last = g_queue_peek_tail(&log->deltas);
+		if (!version_equal(last->post, current)) {
+			/* The base changed without a delta (e.g. a restoration) */
+			err = NEWERROR(CODE_NOT_FOUND, "Deltas outdated");
+			_forget_log(deltas, log);
+		} else {
+			GList *l = log->deltas.head;
+			while (l && !version_equal(((struct delta_s*)l->data)->pre, from))
+				l = l->next;
+			if (!l) {
+				err = NEWERROR(CODE_NOT_FOUND, "Deltas do not cover the gap");
+			} else {
+				*result = g_ptr_array_new_with_free_func(
+						(GDestroyNotify)g_byte_array_unref);
+				for (; l; l = l->next) {
+					struct delta_s *d = l->data;
+					g_ptr_array_add(*result, g_byte_array_ref(d->raw));
+				}
+			}
+		}
+	}
+	g_mutex_unlock(&deltas->lock);
+	g_free(k);
+	return err;
+}
+
+gsize
+sqlx_deltas_size(struct sqlx_deltas_s *deltas)
+{
+	EXTRA_ASSERT(deltas != NULL);
+	g_mutex_lock(&deltas->lock);
+	gsize size = deltas->size;
+	g_mutex_unlock(&deltas->lock);
+	return size;
+}
@@ -0,0 +1,58 @@
+/*
+OpenIO SDS sqliterepo
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#ifndef OIO_SDS__sqliterepo__deltas_h
+# define OIO_SDS__sqliterepo__deltas_h 1
+
+# include <glib.h>
+
+/* A bounded, in-memory log of the rowsets recently applied on each base.
+ * Each entry is tagged with the version of the base before and after the
+ * rowset, so that a peer lagging by a few transactions can be caught up with
+ * the missing rowsets instead of a whole DUMP. The entries of a base always
+ * form a continuous chain of versions: any gap empties the log of the base. */
+
+struct sqlx_name_s;
+struct sqlx_deltas_s;
+
+struct sqlx_deltas_s * sqlx_deltas_create(void);
+
+void sqlx_deltas_destroy(struct sqlx_deltas_s *deltas);
+
+/* Record the encoded TableSequence `raw` that turned the version `pre` of the
+ * base into `post`. `pre` and `post` are copied. */
+void sqlx_deltas_push(struct sqlx_deltas_s *deltas,
+		const struct sqlx_name_s *n, GTree *pre, GTree *post,
+		const guint8 *raw, gsize rawsize);
+
+/* Drop all the rowsets recorded for the base */
+void sqlx_deltas_forget(struct sqlx_deltas_s *deltas,
+		const struct sqlx_name_s *n);
+
+/* Collect the rowsets that bring the base from the version `from` to the
+ * version `current`. On success, `*result` is filled with a GPtrArray of
+ * GByteArray (possibly empty if both versions are equal). Fails with
+ * CODE_NOT_FOUND when the log does not cover the gap. */
+GError * sqlx_deltas_collect(struct sqlx_deltas_s *deltas,
+		const struct sqlx_name_s *n, GTree *from, GTree *current,
+		GPtrArray **result);
+
+/* Tells how many bytes of rowsets are held */
+gsize sqlx_deltas_size(struct sqlx_deltas_s *deltas);
+
+#endif /*OIO_SDS__sqliterepo__deltas_h*/
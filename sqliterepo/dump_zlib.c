@@ -0,0 +1,109 @@
+/*
+OpenIO SDS sqliterepo
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <glib.h>
+#include <zlib.h>
+
+#include <metautils/lib/metautils.h>
+
+#include "sqlx_remote.h"
+#include "dump_zlib.h"
+
+GError *
+sqlx_dump_deflate_part(z_stream *zs, GByteArray *in, gboolean last,
+		GByteArray **out)
+{
+	GByteArray *gba = g_byte_array_new();
+	gsize step = deflateBound(zs, in->len) + 16;
+	int rc;
+
+	zs->next_in = in->data;
+	zs->avail_in = in->len;
+	do {
+		const guint len = gba->len;
+		g_byte_array_set_size(gba, len + step);
+		zs->next_out = gba->data + len;
+		zs->avail_out = step;
+		rc = deflate(zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+		g_byte_array_set_size(gba, len + step - zs->avail_out);
+		step = 64 * 1024;
+	} while (rc == Z_OK && zs->avail_out == 0);
+
+	if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+		g_byte_array_free(gba, TRUE);
+		return SYSERR("Failed to compress the dump: (%d) %s",
+				rc, zs->msg ? zs->msg : "deflate error");
+	}
+	*out = gba;
+	return NULL;
+}
+
+GError *
+sqlx_dump_inflate_part(z_stream *zs, gboolean *end, guint8 *b, gsize bsize,
+		gint64 remaining, peer_dump_cb callback, gpointer cb_arg)
+{
+	/* Each piece is held until the next one is known, so that the last
+	 * piece of the part is passed with what remains, even when the part
+	 * inflates to an exact multiple of the size of a piece. */
+	GByteArray *held = NULL;
+	GError *err = NULL;
+
+	zs->next_in = b;
+	zs->avail_in = bsize;
+	while (!err && !*end) {
+		GByteArray *piece = g_byte_array_sized_new(SQLX_DUMP_INFLATE_PIECE);
+		g_byte_array_set_size(piece, SQLX_DUMP_INFLATE_PIECE);
+		zs->next_out = piece->data;
+		zs->avail_out = SQLX_DUMP_INFLATE_PIECE;
+
+		int rc = inflate(zs, Z_SYNC_FLUSH);
+		if (rc == Z_STREAM_END) {
+			*end = TRUE;
+		} else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+			g_byte_array_free(piece, TRUE);
+			err = NEWERROR(CODE_INTERNAL_ERROR, "Corrupted dump: (%d) %s",
+					rc, zs->msg ? zs->msg : "inflate error");
+			break;
+		}
+
+		g_byte_array_set_size(piece,
+				SQLX_DUMP_INFLATE_PIECE - zs->avail_out);
+		if (!piece->len) {
+			g_byte_array_free(piece, TRUE);
+			break;
+		}
+		if (held)
+			err = callback(held, -1, cb_arg);
+		held = piece;
+		/* The input is exhausted without filling the piece */
+		if (zs->avail_in == 0 && zs->avail_out > 0)
+			break;
+	}
+
+	if (held) {
+		if (!err)
+			err = callback(held, remaining, cb_arg);
+		else
+			g_byte_array_free(held, TRUE);
+	}
+	if (!err && *end && zs->avail_in > 0)
+		err = NEWERROR(CODE_INTERNAL_ERROR,
+				"Corrupted dump: %u bytes after the end of stream",
+				zs->avail_in);
+	return err;
+}
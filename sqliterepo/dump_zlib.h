@@ -0,0 +1,46 @@
+/*
+OpenIO SDS sqliterepo
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#ifndef OIO_SDS__sqliterepo__dump_zlib_h
+# define OIO_SDS__sqliterepo__dump_zlib_h 1
+
+# include <glib.h>
+# include <zlib.h>
+
+/* A compressed DUMP is a single zlib stream over all the parts of the
+ * chunked dump. Each part but the last ends with a sync flush, so that the
+ * receiver inflates it without waiting for the next one. The last one
+ * finishes the stream. Expects "sqlx_remote.h" for peer_dump_cb. */
+
+/* The size of the pieces of a compressed dump, once inflated */
+# define SQLX_DUMP_INFLATE_PIECE (1024 * 1024)
+
+/* Compress a part of a dump into a new `*out`, as the continuation of the
+ * stream managed by `zs`. */
+GError * sqlx_dump_deflate_part(z_stream *zs, GByteArray *in, gboolean last,
+		GByteArray **out);
+
+/* Inflate a part of a compressed dump, and pass it to `callback` by pieces
+ * of at most SQLX_DUMP_INFLATE_PIECE bytes, the last one with `remaining`.
+ * `*end` is set once the end of the stream has been met, any byte after it
+ * is an error. */
+GError * sqlx_dump_inflate_part(z_stream *zs, gboolean *end,
+		guint8 *b, gsize bsize, gint64 remaining,
+		peer_dump_cb callback, gpointer cb_arg);
+
+#endif /*OIO_SDS__sqliterepo__dump_zlib_h*/
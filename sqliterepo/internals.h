@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -65,6 +65,7 @@ License along with this library.
 } while (0)
 
 struct sqlx_cache_s;
+struct sqlx_deltas_s;
 
 struct sqlx_repository_s
 {
@@ -76,6 +77,9 @@ struct sqlx_repository_s
 	struct sqlx_cache_s *cache;
 	struct election_manager_s *election_manager;
 
+	/* Recent rowsets, to catch up the lagging peers */
+	struct sqlx_deltas_s *deltas;
+
 	/* Hooks */
 	sqlx_file_locator_f locator;
 	gpointer locator_data;
@@ -23,12 +23,14 @@ License along with this library.
 #include <metautils/lib/metautils.h>
 #include <metautils/lib/codec.h>
 #include <sqliterepo/sqliterepo_remote_variables.h>
+#include <sqliterepo/sqliterepo_variables.h>
 
 #include "sqliterepo.h"
 #include "election.h"
 #include "version.h"
 #include "sqlx_remote.h"
 #include "internals.h"
+#include "deltas.h"
 
 struct sqlx_repctx_s
 {
@@ -47,6 +49,11 @@ struct sqlx_repctx_s
 
 	GString *errors;
 
+	// The version of the base when the transaction started, and the rowset
+	// encoded for the peers. Only kept when the log of deltas is enabled.
+	GTree *pre_version;
+	GByteArray *rowsets;
+
 	// Count the explicit changes, those matched
 	int changes;
 	guint8 local_changes : 1;
@@ -63,6 +70,24 @@ struct sqlx_repctx_s
 	guint8 any_change : 1;
 };
 
+static GQuark gq_repli_req = 0;
+static GQuark gq_repli_tables = 0;
+static GQuark gq_repli_rows = 0;
+static GQuark gq_repli_time = 0;
+static GQuark gq_repli_cnx_reuse = 0;
+static GQuark gq_repli_cnx_create = 0;
+
+static void __attribute__ ((constructor))
+_constructor (void)
+{
+	gq_repli_req = g_quark_from_static_string("counter repli.req");
+	gq_repli_tables = g_quark_from_static_string("counter repli.tables");
+	gq_repli_rows = g_quark_from_static_string("counter repli.rows");
+	gq_repli_time = g_quark_from_static_string("counter repli.time");
+	gq_repli_cnx_reuse = g_quark_from_static_string("counter repli.cnx.reuse");
+	gq_repli_cnx_create = g_quark_from_static_string("counter repli.cnx.create");
+}
+
 static guint
 group_to_quorum(guint group_size)
 {
@@ -86,6 +111,51 @@ dump_request(const gchar *func, gchar **targets,
 	g_free(tmp);
 }
 
+/* Idle connections to the peers ------------------------------------------ */
+
+/* The REPLICATE requests are sent at each commit, always to the same few
+ * peers. Instead of paying a TCP handshake per commit and per peer, the
+ * keep-alive clients are parked in the pool of idle connections after a
+ * complete reply, then picked by the next transaction. */
+
+static struct gridd_client_s *
+_replicate_client(const gchar *url, GByteArray *encoded, const gint64 now,
+		gboolean *reused)
+{
+	struct gridd_client_s *client =
+		cnx_pool_take(url, OLDEST(now, oio_election_replicate_cnx_idle));
+	if (client) {
+		GError *err = gridd_client_request(client, encoded, NULL, NULL);
+		if (!err) {
+			*reused = TRUE;
+			return client;
+		}
+		GRID_DEBUG("Idle connection to [%s] not reusable: (%d) %s",
+				url, err->code, err->message);
+		g_clear_error(&err);
+		gridd_client_free(client);
+	}
+
+	*reused = FALSE;
+	client = gridd_client_create(url, encoded, NULL, NULL);
+	if (client)
+		gridd_client_set_keepalive(client, TRUE);
+	return client;
+}
+
+static GError *
+_replicate_clients_run(struct gridd_client_s **clients, gint64 deadline)
+{
+	gridd_clients_set_timeout_cnx(clients,
+			oio_clamp_timeout(oio_election_replicate_timeout_cnx, deadline));
+	gridd_clients_set_timeout(clients,
+			oio_clamp_timeout(oio_election_replicate_timeout_req, deadline));
+	gridd_clients_start(clients);
+	return gridd_clients_loop(clients);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static gint
 _compare_rowid(gconstpointer a, gconstpointer b, gpointer unused)
 {
@@ -307,18 +377,91 @@ _replicate_on_peers(gchar **peers, struct sqlx_repctx_s *ctx, gint64 deadline)
 	NAME2CONST(n, ctx->sq3->name);
 	dump_request(__FUNCTION__, peers, "SQLX_REPLICATE", &n);
 
-	GByteArray *encoded = sqlx_pack_REPLICATE(&n, &(ctx->sequence), deadline);
+	guint64 count_rows = 0;
+	for (int i = 0; i < ctx->sequence.list.count; i++)
+		count_rows += ctx->sequence.list.array[i]->rows.list.count;
+
+	const gint64 start = oio_ext_monotonic_time();
+	const guint max = g_strv_length(peers);
+	guint count_reused = 0, count_created = 0;
+	gboolean *reused = g_alloca(sizeof(gboolean) * (max + 1));
 	struct gridd_client_s **clients =
-		gridd_client_create_many(peers, encoded, NULL, NULL);
+		g_malloc0(sizeof(struct gridd_client_s*) * (max + 1));
+
+	GByteArray *body = sqlx_encode_TableSequence(&(ctx->sequence), NULL);
+	if (!body) {
+		g_free(clients);
+		return SYSERR("Failed to encode the rowset");
+	}
+	GByteArray *encoded = sqlx_pack_REPLICATE_body(&n, body, deadline);
+	if (ctx->pre_version)
+		ctx->rowsets = g_byte_array_ref(body);
+	g_byte_array_unref(body);
+
+	GError *err = NULL;
+	for (guint i = 0; i < max && !err; i++) {
+		clients[i] = _replicate_client(peers[i], encoded, start, reused + i);
+		if (!clients[i])
+			err = SYSERR("Failed to create a client to [%s]", peers[i]);
+		else if (reused[i])
+			++ count_reused;
+	}
+
+	if (!err)
+		err = _replicate_clients_run(clients, deadline);
+
+	/* The peer may have closed an idle connection just before we reused it.
+	 * Retry once those it closed before it replied anything, on a new
+	 * connection. Neither a timeout nor a partial reply is retried. */
+	if (!err && count_reused > 0) {
+		struct gridd_client_s **retry = g_alloca(
+				sizeof(struct gridd_client_s*) * (max + 1));
+		guint *retry_idx = g_alloca(sizeof(guint) * (max + 1));
+		guint count_retry = 0;
+		for (guint i = 0; i < max; i++) {
+			if (!reused[i])
+				continue;
+			GError *e = gridd_client_error(clients[i]);
+			if (e && gridd_client_stale(clients[i])) {
+				GRID_DEBUG("Stale connection to [%s]: (%d) %s",
+						peers[i], e->code, e->message);
+				struct gridd_client_s *c =
+					gridd_client_create(peers[i], encoded, NULL, NULL);
+				if (c) {
+					gridd_client_set_keepalive(c, TRUE);
+					retry[count_retry] = c;
+					retry_idx[count_retry] = i;
+					++ count_retry;
+				}
+			}
+			g_clear_error(&e);
+		}
+		retry[count_retry] = NULL;
+		if (count_retry > 0) {
+			err = _replicate_clients_run(retry, deadline);
+			for (guint j = 0; j < count_retry; j++) {
+				gridd_client_free(clients[retry_idx[j]]);
+				clients[retry_idx[j]] = retry[j];
+				reused[retry_idx[j]] = FALSE;
+			}
+		}
+	}
+	/* Only the connections actually established are accounted */
+	for (guint i = 0; i < max && clients[i]; i++) {
+		if (!reused[i] && gridd_client_connected(clients[i]))
+			++ count_created;
+	}
 	g_byte_array_unref(encoded);
 
-	gridd_clients_set_timeout_cnx(clients,
-			oio_clamp_timeout(oio_election_replicate_timeout_cnx, deadline));
-	gridd_clients_set_timeout(clients,
-			oio_clamp_timeout(oio_election_replicate_timeout_req, deadline));
+	oio_stats_add(
+			gq_repli_req, 1, gq_repli_tables, ctx->sequence.list.count,
+			gq_repli_rows, count_rows,
+			gq_repli_time, oio_ext_monotonic_time() - start);
+	oio_stats_add(
+			gq_repli_cnx_reuse, count_reused,
+			gq_repli_cnx_create, count_created,
+			0, 0, 0, 0);
 
-	gridd_clients_start(clients);
-	GError *err = gridd_clients_loop(clients);
 	if (!err) {
 		for (struct gridd_client_s **pc = clients; clients && *pc; pc++) {
 			GError *e = gridd_client_error(*pc);
@@ -368,7 +511,12 @@ _replicate_on_peers(gchar **peers, struct sqlx_repctx_s *ctx, gint64 deadline)
 		}
 	}
 
-	gridd_clients_free(clients);
+	const gint64 now = oio_ext_monotonic_time();
+	for (guint i = 0; i < max; i++) {
+		if (clients[i])
+			cnx_pool_give(clients[i], now, oio_election_replicate_cnx_max);
+	}
+	g_free(clients);
 	return err;
 }
 
@@ -519,6 +667,26 @@ sqlx_synchronous_resync(struct sqlx_repctx_s *ctx, gchar **peers)
 			ctx->sq3->name.base, ctx->sq3->name.type, oio_ext_get_reqid());
 }
 
+/* Keep the rowset just committed, to later catch up the peers that could
+ * have missed it. */
+static void
+_record_delta(struct sqlx_repctx_s *ctx)
+{
+	struct sqlx_deltas_s *deltas = ctx->sq3->repo->deltas;
+	NAME2CONST(n, ctx->sq3->name);
+
+	if (!deltas)
+		return;
+	if (ctx->huge) {
+		sqlx_deltas_forget(deltas, &n);
+	} else if (ctx->rowsets && ctx->pre_version) {
+		GTree *post = version_extract_from_admin(ctx->sq3);
+		sqlx_deltas_push(deltas, &n, ctx->pre_version, post,
+				ctx->rowsets->data, ctx->rowsets->len);
+		g_tree_destroy(post);
+	}
+}
+
 static void
 sqlx_replication_free_context(struct sqlx_repctx_s *ctx)
 {
@@ -531,6 +699,10 @@ sqlx_replication_free_context(struct sqlx_repctx_s *ctx)
 		g_ptr_array_free(ctx->resync_todo, TRUE);
 	if (ctx->errors)
 		g_string_free (ctx->errors, TRUE);
+	if (ctx->pre_version)
+		g_tree_destroy(ctx->pre_version);
+	if (ctx->rowsets)
+		g_byte_array_unref(ctx->rowsets);
 	g_slice_free(struct sqlx_repctx_s, ctx);
 }
 
@@ -550,6 +722,10 @@ sqlx_transaction_prepare(struct sqlx_sqlite3_s *sq3,
 	EXTRA_ASSERT(sq3->db != NULL);
 	*result = NULL;
 
+	if (sq3->shared)
+		return NEWERROR(CODE_INTERNAL_ERROR,
+				"Transaction on a read-only connection");
+
 	if (sq3->admin_dirty)
 		sqlx_alert_dirty_base (sq3, "new TNX on a dirty admin");
 
@@ -571,6 +747,8 @@ sqlx_transaction_prepare(struct sqlx_sqlite3_s *sq3,
 	repctx->local_changes = 0;
 
 	if (has) {
+		if (sqliterepo_deltas_max > 0)
+			repctx->pre_version = version_extract_from_admin(sq3);
 		repctx->resync_todo = g_ptr_array_sized_new(4);
 		g_ptr_array_set_free_func(repctx->resync_todo, g_free0);
 
@@ -706,6 +884,8 @@ sqlx_transaction_end(struct sqlx_repctx_s *ctx, GError *err)
 			}
 			// Restore the in-RAM cache
 			sqlx_admin_reload(ctx->sq3);
+		} else if (!ctx->hollow) {
+			_record_delta(ctx);
 		}
 		if (ctx->errors->len > 0) {
 			GRID_WARN("COMMIT errors on [%s.%s]:%s reqid=%s",
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -31,6 +31,7 @@ License along with this library.
 #include <arpa/inet.h>
 
 #include <glib.h>
+#include <zlib.h>
 
 #include <metautils/lib/metautils.h>
 #include <sqliterepo/sqliterepo_remote_variables.h>
@@ -38,6 +39,7 @@ License along with this library.
 #include "sqliterepo.h"
 #include "sqlx_remote.h"
 #include "internals.h"
+#include "dump_zlib.h"
 
 static GByteArray*
 _pack_RESTORE(struct sqlx_name_s *name, GByteArray *dump, gint64 deadline)
@@ -116,21 +118,45 @@ peer_dump(const gchar *target, struct sqlx_name_s *name, gboolean chunked,
 	struct gridd_client_s *client;
 	GByteArray *encoded;
 	GError *err = NULL;
+	z_stream zs = {0};
+	gboolean inflating = FALSE, inflated = FALSE;
 
 	gboolean on_reply(gpointer ctx, MESSAGE reply) {
 		GError *err2 = NULL;
 		gsize bsize = 0;
 		gint64 remaining = -1;
+		gchar compression[32] = {0};
 		(void) ctx;
 
 		err2 = metautils_message_extract_strint64(reply, "remaining", &remaining);
 		g_clear_error(&err2);
 
+		/* Only set by the peers asked for a compressed dump, and able to */
+		err2 = metautils_message_extract_string(reply, "compression",
+				compression, sizeof(compression));
+		g_clear_error(&err2);
+		if (*compression && strcmp(compression, "zlib") != 0) {
+			GRID_ERROR("Unexpected dump compression [%s]", compression);
+			return FALSE;
+		}
+
 		void *b = metautils_message_get_BODY(reply, &bsize);
 		if (b && bsize) {
-			GByteArray *dump = g_byte_array_new();
-			g_byte_array_append(dump, b, bsize);
-			err2 = callback(dump, remaining, cb_arg);
+			if (*compression) {
+				if (!inflating) {
+					if (inflateInit(&zs) != Z_OK) {
+						GRID_ERROR("Failed to init the inflate stream");
+						return FALSE;
+					}
+					inflating = TRUE;
+				}
+				err2 = sqlx_dump_inflate_part(&zs, &inflated, b, bsize,
+						remaining, callback, cb_arg);
+			} else {
+				GByteArray *dump = g_byte_array_new();
+				g_byte_array_append(dump, b, bsize);
+				err2 = callback(dump, remaining, cb_arg);
+			}
 		}
 		if (err2 != NULL) {
 			GRID_ERROR("Failed to use result of dump: (%d) %s",
@@ -147,7 +173,8 @@ peer_dump(const gchar *target, struct sqlx_name_s *name, gboolean chunked,
 	if (!target)
 		return SYSERR("No target URL");
 
-	encoded = sqlx_pack_DUMP(name, chunked, deadline);
+	encoded = sqlx_pack_DUMP(name, chunked,
+			chunked && oio_sqlx_dump_compress, deadline);
 	client = gridd_client_create(target, encoded, NULL, on_reply);
 	g_byte_array_unref(encoded);
 
@@ -165,5 +192,57 @@ peer_dump(const gchar *target, struct sqlx_name_s *name, gboolean chunked,
 
 	gridd_client_free(client);
 
+	if (inflating) {
+		if (!err && !inflated)
+			err = NEWERROR(CODE_INTERNAL_ERROR, "Truncated compressed dump");
+		inflateEnd(&zs);
+	}
+	return err;
+}
+
+GError *
+peer_deltas(const gchar *target, struct sqlx_name_s *name,
+		GByteArray *version, peer_dump_cb callback, gpointer cb_arg,
+		gint64 deadline)
+{
+	gboolean on_reply(gpointer ctx, MESSAGE reply) {
+		gsize bsize = 0;
+		(void) ctx;
+		void *b = metautils_message_get_BODY(reply, &bsize);
+		if (b && bsize) {
+			GByteArray *delta = g_byte_array_sized_new(bsize);
+			g_byte_array_append(delta, b, bsize);
+			GError *err2 = callback(delta, -1, cb_arg);
+			if (err2 != NULL) {
+				GRID_WARN("Failed to use the delta: (%d) %s",
+						err2->code, err2->message);
+				g_clear_error(&err2);
+				return FALSE;
+			}
+		}
+		return TRUE;
+	}
+
+	if (!target)
+		return SYSERR("No target URL");
+
+	GByteArray *encoded = sqlx_pack_DELTAS(name, version, deadline);
+	struct gridd_client_s *client =
+		gridd_client_create(target, encoded, NULL, on_reply);
+	g_byte_array_unref(encoded);
+
+	if (!client)
+		return SYSERR("Failed to create client to [%s], bad address?", target);
+
+	gridd_client_set_timeout_cnx(client,
+			oio_clamp_timeout(oio_election_replicate_timeout_cnx, deadline));
+	gridd_client_set_timeout(client,
+			oio_clamp_timeout(oio_election_replicate_timeout_req, deadline));
+
+	GError *err = NULL;
+	gridd_client_start(client);
+	if (!(err = gridd_client_loop(client)))
+		err = gridd_client_error(client);
+	gridd_client_free(client);
 	return err;
 }
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -22,6 +22,7 @@ License along with this library.
 
 #include <glib.h>
 #include <sqlite3.h>
+#include <zlib.h>
 
 #include <metautils/lib/metautils.h>
 #include <metautils/lib/codec.h>
@@ -41,6 +42,8 @@ License along with this library.
 #include "replication_dispatcher.h"
 #include "internals.h"
 #include "restoration.h"
+#include "deltas.h"
+#include "dump_zlib.h"
 
 #define EXTRACT_STRING(Name,Dst) do { \
 	err = metautils_message_extract_string(reply->request, Name, Dst, sizeof(Dst)); \
@@ -52,6 +55,16 @@ License along with this library.
 
 #define ADMIN "admin"
 
+static GQuark gq_resync_deltas = 0;
+static GQuark gq_resync_dump = 0;
+
+static void __attribute__ ((constructor))
+_constructor (void)
+{
+	gq_resync_deltas = g_quark_from_static_string("counter repli.resync.deltas");
+	gq_resync_dump = g_quark_from_static_string("counter repli.resync.dump");
+}
+
 /* ------------------------------------------------------------------------- */
 
 static void
@@ -322,7 +335,8 @@ _replicate_now(struct sqlx_sqlite3_s *sq3, TableSequence_t *seq)
 }
 
 static GError *
-replicate_body_manage(struct sqlx_sqlite3_s *sq3, TableSequence_t *seq)
+replicate_body_manage(struct sqlx_sqlite3_s *sq3, TableSequence_t *seq,
+		const guint8 *raw, gsize rawsize)
 {
 	gint rc;
 	GError *err = NULL;
@@ -385,6 +399,14 @@ label_rollback:
 			 * admin table. */
 			sqlx_admin_reload(sq3);
 			sqlx_repository_call_change_callback(sq3);
+
+			/* Keep the rowset, in case this base becomes MASTER and has to
+			 * catch a lagging peer up. */
+			if (sq3->repo->deltas) {
+				NAME2CONST(n, sq3->name);
+				sqlx_deltas_push(sq3->repo->deltas, &n, oldvers, postvers,
+						raw, rawsize);
+			}
 		}
 	}
 
@@ -411,7 +433,7 @@ replicate_body_parse(struct sqlx_sqlite3_s *sq3, guint8 *body, gsize bodysize)
 	if (rv.code != RC_OK)
 		return NEWERROR(CODE_BAD_REQUEST, "body decoding error");
 
-	err = replicate_body_manage(sq3, seq);
+	err = replicate_body_manage(sq3, seq, body, bodysize);
 	asn_DEF_TableSequence.free_struct(&asn_DEF_TableSequence, seq, FALSE);
 	return err;
 }
@@ -426,6 +448,8 @@ _restore(struct sqlx_repository_s *repo, struct sqlx_name_s *name,
 	if (NULL != err)
 		return err;
 
+	sqlx_deltas_forget(repo->deltas, name);
+
 	err = sqlx_repository_restore_base(sq3, dump, dump_size);
 	if (NULL != err) {
 		sqlx_repository_unlock_and_close_noerror(sq3);
@@ -452,6 +476,7 @@ _restore2(struct sqlx_repository_s *repo, struct sqlx_name_s *name,
 	GError *err = sqlx_repository_open_and_lock(repo, name,
 		SQLX_OPEN_LOCAL|SQLX_OPEN_NOREFCHECK|SQLX_OPEN_CREATE, &sq3, NULL);
 	if (!err) {
+		sqlx_deltas_forget(repo->deltas, name);
 		err = sqlx_repository_restore_from_file(sq3, path);
 		if (!err) {
 			/* See the comment in replicate_body_manage */
@@ -524,7 +549,7 @@ _dump(struct sqlx_repository_s *repo, struct sqlx_name_s *name,
 
 static GError *
 _dump_chunked(struct sqlx_repository_s *repo, struct sqlx_name_s *name,
-		void (*_send_chunk)(GByteArray *chunk, gint64 remaining))
+		GError* (*_send_chunk)(GByteArray *chunk, gint64 remaining))
 {
 	guint64 sent = 0;
 	struct sqlx_sqlite3_s *sq3 = NULL;
@@ -540,14 +565,18 @@ _dump_chunked(struct sqlx_repository_s *repo, struct sqlx_name_s *name,
 	GError *_dump_chunked_cb(GByteArray *gba, gint64 remaining, gpointer arg) {
 		(void) arg;
 		sent += gba->len;
-		_send_chunk(gba, remaining);
-		return NULL;
+		return _send_chunk(gba, remaining);
 	}
 
-	err = sqlx_repository_dump_base_chunked(sq3, sqliterepo_dump_chunk_size,
-			_dump_chunked_cb, NULL);
-
+	/* The parts are sent at the pace of the peer, that must not keep the
+	 * base locked: they are read from a copy. */
+	int fd = -1;
+	err = sqlx_repository_dump_base_snapshot(sq3, &fd);
 	sqlx_repository_unlock_and_close_noerror(sq3);
+	if (!err)
+		err = sqlx_repository_dump_fd_chunked(fd, sqliterepo_dump_chunk_size,
+				_dump_chunked_cb, NULL);
+	metautils_pclose(&fd);
 	return err;
 }
 
@@ -600,12 +629,80 @@ retry:
 	return peer_dump(source, name, TRUE, _pipe_from_cb, NULL, oio_ext_get_deadline());
 }
 
+/* Fetch from `source` the rowsets missed by the local base, then apply
+ * them. Fails if the source does not have them anymore, or if any of them
+ * does not apply on the local base. */
+static GError *
+_pipe_deltas_from(const gchar *source, struct sqlx_repository_s *repo,
+		struct sqlx_name_s *name)
+{
+	struct sqlx_sqlite3_s *sq3 = NULL;
+	GPtrArray *deltas = g_ptr_array_new_with_free_func(
+			(GDestroyNotify)g_byte_array_unref);
+
+	GError *_on_delta(GByteArray *delta, gint64 remaining UNUSED,
+			gpointer arg UNUSED) {
+		g_ptr_array_add(deltas, delta);
+		return NULL;
+	}
+
+	/* Get the local version without holding the base during the RPC */
+	GError *err = sqlx_repository_open_and_lock(repo, name,
+			SQLX_OPEN_LOCAL|SQLX_OPEN_NOREFCHECK|SQLX_OPEN_URGENT, &sq3, NULL);
+	if (!err) {
+		GTree *version = version_extract_from_admin(sq3);
+		sqlx_repository_unlock_and_close_noerror(sq3);
+		sq3 = NULL;
+		GByteArray *encoded = version_encode(version);
+		g_tree_destroy(version);
+		if (!encoded)
+			err = SYSERR("Failed to encode the local version");
+		else {
+			err = peer_deltas(source, name, encoded, _on_delta, NULL,
+					oio_ext_get_deadline());
+			g_byte_array_unref(encoded);
+		}
+	}
+
+	/* Then apply them in a row. Each one checks its own version. */
+	if (!err && deltas->len > 0) {
+		err = sqlx_repository_open_and_lock(repo, name,
+				SQLX_OPEN_LOCAL|SQLX_OPEN_NOREFCHECK|SQLX_OPEN_URGENT,
+				&sq3, NULL);
+		for (guint i = 0; !err && i < deltas->len; i++) {
+			GByteArray *delta = deltas->pdata[i];
+			err = replicate_body_parse(sq3, delta->data, delta->len);
+		}
+		if (sq3)
+			sqlx_repository_unlock_and_close_noerror(sq3);
+	}
+
+	if (!err)
+		GRID_INFO("PIPEFROM %s [%s.%s] caught up with %u deltas",
+				source, name->base, name->type, deltas->len);
+	g_ptr_array_free(deltas, TRUE);
+	return err;
+}
+
 static GError *
 _pipe_from(const gchar *source, struct sqlx_repository_s *repo,
 		struct sqlx_name_s *name)
 {
 	GError *err;
 	struct restore_ctx_s *ctx = NULL;
+
+	if (sqliterepo_deltas_max > 0) {
+		err = _pipe_deltas_from(source, repo, name);
+		if (!err) {
+			oio_stats_add(gq_resync_deltas, 1, 0, 0, 0, 0, 0, 0);
+			return NULL;
+		}
+		GRID_DEBUG("PIPEFROM %s [%s.%s] deltas not usable: (%d) %s",
+				source, name->base, name->type, err->code, err->message);
+		g_clear_error(&err);
+	}
+
+	oio_stats_add(gq_resync_dump, 1, 0, 0, 0, 0, 0, 0);
 	gint64 now = oio_ext_monotonic_time();
 	err = _pipe_base_from(source, repo, name, &ctx);
 	gint64 elapsed = oio_ext_monotonic_time();
@@ -656,6 +753,7 @@ _snapshot_from(const gchar *source, struct sqlx_repository_s *repo,
 #define FLAG_NOCHECK    0x08
 #define FLAG_CHUNKED    0x10
 #define FLAG_FLUSH      0x20
+#define FLAG_COMPRESS   0x40
 
 static GError *
 _load_sqlx_name (struct gridd_reply_ctx_s *ctx,
@@ -666,9 +764,9 @@ _load_sqlx_name (struct gridd_reply_ctx_s *ctx,
 		ns[LIMIT_LENGTH_NSNAME],
 		base[LIMIT_LENGTH_BASENAME],
 		type[LIMIT_LENGTH_BASETYPE];
-	gboolean flush, nocheck, local, chunked;
+	gboolean flush, nocheck, local, chunked, compress;
 
-	flush = local = nocheck = chunked = FALSE;
+	flush = local = nocheck = chunked = compress = FALSE;
 
 	err = metautils_message_extract_string(ctx->request,
 			NAME_MSGKEY_NAMESPACE, ns, sizeof(ns));
@@ -691,6 +789,8 @@ _load_sqlx_name (struct gridd_reply_ctx_s *ctx,
 			NAME_MSGKEY_CHUNKED, FALSE);
 	flush = metautils_message_extract_flag(ctx->request,
 			NAME_MSGKEY_FLUSH, FALSE);
+	compress = metautils_message_extract_flag(ctx->request,
+			NAME_MSGKEY_COMPRESS, FALSE);
 
 	ctx->subject("%s.%s%s", base, type, local?"|LOCAL":"");
 
@@ -705,6 +805,7 @@ _load_sqlx_name (struct gridd_reply_ctx_s *ctx,
 		*pflags |= (nocheck ? FLAG_NOCHECK : 0);
 		*pflags |= (chunked ? FLAG_CHUNKED : 0);
 		*pflags |= (flush ? FLAG_FLUSH : 0);
+		*pflags |= (compress ? FLAG_COMPRESS : 0);
 	}
 	return NULL;
 }
@@ -1010,6 +1111,21 @@ _handler_PIPETO(struct gridd_reply_ctx_s *reply,
 	EXTRACT_STRING("DST", target);
 	reply->subject("%s.%s|%s", name.base, name.type, target);
 
+	/* Let the target stream the base from the local service, so that it
+	 * is never entirely held in memory. */
+	const gchar *local = sqlx_repository_get_local_addr(repo);
+	if (local && *local) {
+		GByteArray *req = sqlx_pack_PIPEFROM(&n0, local, oio_ext_get_deadline());
+		err = gridd_client_exec(target,
+				oio_clamp_timeout(3600.0, oio_ext_get_deadline()), req);
+		g_byte_array_unref(req);
+		if (NULL != err)
+			reply->send_error(0, err);
+		else
+			reply->send_reply(CODE_FINAL_OK, "OK");
+		return TRUE;
+	}
+
 	/* Dump the base in a locked manner */
 	err = _dump(repo, &n0, &dump);
 	if (NULL != err) {
@@ -1064,6 +1180,7 @@ _handler_DUMP(struct gridd_reply_ctx_s *reply,
 {
 	GError *err = NULL;
 	guint32 flags = 0;
+	z_stream zs = {0};
 	struct sqlx_name_inline_s name;
 	NAME2CONST(n0, name);
 
@@ -1072,16 +1189,43 @@ _handler_DUMP(struct gridd_reply_ctx_s *reply,
 		return TRUE;
 	}
 
-	void _send_part(GByteArray *part, gint64 remaining)
+	/* Only a chunked dump may be compressed, as one zlib stream over all
+	 * the parts. */
+	const gboolean compress = BOOL(flags & FLAG_CHUNKED)
+		&& BOOL(flags & FLAG_COMPRESS);
+	if (compress && deflateInit(&zs, Z_BEST_SPEED) != Z_OK) {
+		reply->send_error(0, SYSERR("Failed to init the compression"));
+		return TRUE;
+	}
+
+	GError* _send_part(GByteArray *part, gint64 remaining)
 	{
 		gchar tmp[32] = {0};
 		g_snprintf(tmp, 32, "%"G_GINT64_FORMAT, remaining);
 		GRID_DEBUG("DUMP sending block of %u bytes, %"
 				G_GINT64_FORMAT" bytes remaining",
 				part->len, remaining);
+		if (compress) {
+			GByteArray *zpart = NULL;
+			GError *e = sqlx_dump_deflate_part(&zs, part,
+					remaining <= 0, &zpart);
+			g_byte_array_unref(part);
+			if (e)
+				return e;
+			part = zpart;
+			reply->add_header("compression", metautils_gba_from_string("zlib"));
+		}
 		reply->add_body(part);
 		reply->add_header("remaining", metautils_gba_from_string(tmp));
 		reply->send_reply(CODE_PARTIAL_CONTENT, "Partial content");
+
+		/* Do not read the base faster than the peer consumes it, so that
+		 * at most a few parts are held in memory. */
+		if (!network_client_drain_output(reply->client,
+					2 * sqliterepo_dump_chunk_size,
+					oio_ext_monotonic_time() + sqliterepo_dump_send_timeout))
+			return NEWERROR(CODE_NETWORK_ERROR, "Peer too slow or gone");
+		return NULL;
 	}
 
 	if (flags & FLAG_CHUNKED) {
@@ -1095,6 +1239,9 @@ _handler_DUMP(struct gridd_reply_ctx_s *reply,
 		}
 	}
 
+	if (compress)
+		deflateEnd(&zs);
+
 	if (NULL != err) {
 		reply->send_error(0, err);
 	} else {
@@ -1104,6 +1251,62 @@ _handler_DUMP(struct gridd_reply_ctx_s *reply,
 	return TRUE;
 }
 
+static GError *
+_collect_deltas(struct sqlx_repository_s *repo, struct sqlx_name_s *name,
+		GTree *from, GPtrArray **result)
+{
+	struct sqlx_sqlite3_s *sq3 = NULL;
+	GError *err = sqlx_repository_open_and_lock(repo, name,
+			SQLX_OPEN_LOCAL|SQLX_OPEN_NOREFCHECK|SQLX_OPEN_URGENT, &sq3, NULL);
+	if (NULL != err)
+		return err;
+
+	GTree *current = version_extract_from_admin(sq3);
+	err = sqlx_deltas_collect(repo->deltas, name, from, current, result);
+	g_tree_destroy(current);
+
+	sqlx_repository_unlock_and_close_noerror(sq3);
+	return err;
+}
+
+static gboolean
+_handler_DELTAS(struct gridd_reply_ctx_s *reply,
+		struct sqlx_repository_s *repo, gpointer ignored UNUSED)
+{
+	GError *err = NULL;
+	struct sqlx_name_inline_s name;
+	NAME2CONST(n0, name);
+
+	if (NULL != (err = _load_sqlx_name(reply, &name, NULL))) {
+		reply->send_error(0, err);
+		return TRUE;
+	}
+
+	gsize bsize = 0;
+	void *b = metautils_message_get_BODY(reply->request, &bsize);
+	GTree *from = b ? version_decode(b, bsize) : NULL;
+	if (!from) {
+		reply->send_error(0, BADREQ("Missing or invalid version"));
+		return TRUE;
+	}
+
+	GPtrArray *deltas = NULL;
+	err = _collect_deltas(repo, &n0, from, &deltas);
+	g_tree_destroy(from);
+
+	if (NULL != err) {
+		reply->send_error(0, err);
+	} else {
+		for (guint i = 0; i < deltas->len; i++) {
+			reply->add_body(g_byte_array_ref(deltas->pdata[i]));
+			reply->send_reply(CODE_PARTIAL_CONTENT, "Partial content");
+		}
+		reply->send_reply(CODE_FINAL_OK, "OK");
+		g_ptr_array_free(deltas, TRUE);
+	}
+	return TRUE;
+}
+
 static gboolean
 _handler_RESTORE(struct gridd_reply_ctx_s *reply,
 		struct sqlx_repository_s *repo, gpointer ignored UNUSED)
@@ -1401,8 +1604,8 @@ _handler_PROPGET(struct gridd_reply_ctx_s *reply,
 	}
 
 	/* Action */
-	const enum sqlx_open_type_e how = (flags&FLAG_LOCAL)
-		? (SQLX_OPEN_LOCAL|SQLX_OPEN_NOREFCHECK) : SQLX_OPEN_MASTERSLAVE;
+	const enum sqlx_open_type_e how = SQLX_OPEN_SHARED | ((flags&FLAG_LOCAL)
+		? (SQLX_OPEN_LOCAL|SQLX_OPEN_NOREFCHECK) : SQLX_OPEN_MASTERSLAVE);
 	err = sqlx_repository_open_and_lock(repo, &n0, how, &sq3, NULL);
 	if (err) {
 		reply->send_error(0, err);
@@ -1836,7 +2039,7 @@ _info_server(struct gridd_reply_ctx_s *reply, GString *gstr)
 {
 	g_string_append_static(gstr, "\"server\":{\"threads\":{");
 	oio_str_gstring_append_json_pair_int(gstr, "active",
-			g_thread_pool_get_num_threads(reply->client->server->pool_tcp));
+			network_server_count_threads(reply->client->server));
 	g_string_append_static(gstr, "},\"connections\":{");
 	oio_str_gstring_append_json_pair_int(gstr, "clients",
 			reply->client->server->cnx_clients);
@@ -1982,6 +2185,7 @@ sqlx_repli_gridd_get_requests(void)
 		{NAME_MSGNAME_SQLX_REMOVE,       (hook) sqlx_dispatch_all, _handler_REMOVE},
 		{NAME_MSGNAME_SQLX_SNAPSHOT,     (hook) sqlx_dispatch_all, _handler_SNAPSHOT},
 		{NAME_MSGNAME_SQLX_DUMP,         (hook) sqlx_dispatch_all, _handler_DUMP},
+		{NAME_MSGNAME_SQLX_DELTAS,       (hook) sqlx_dispatch_all, _handler_DELTAS},
 		{NAME_MSGNAME_SQLX_RESTORE,      (hook) sqlx_dispatch_all, _handler_RESTORE},
 		{NAME_MSGNAME_SQLX_REPLICATE,    (hook) sqlx_dispatch_all, _handler_REPLICATE},
 		{NAME_MSGNAME_SQLX_GETVERS,      (hook) sqlx_dispatch_all, _handler_GETVERS},
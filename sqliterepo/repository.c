@@ -40,6 +40,7 @@ License along with this library.
 #include "internals.h"
 #include "restoration.h"
 #include "sqlx_remote.h"
+#include "deltas.h"
 
 
 #define GSTR_APPEND_SEP(S) do { \
@@ -152,6 +153,16 @@ __close_base(struct sqlx_sqlite3_s *sq3)
 	GRID_TRACE2("DB being closed [%s][%s]", sq3->name.base,
 			sq3->name.type);
 
+	/* A read-only connection owns nothing but its sqlite3 handle and the
+	 * statements prepared on it */
+	if (sq3->shared) {
+		sqlx_stmt_cache_destroy(sq3->stmts);
+		_close_handle(&(sq3->db));
+		sq3->admin = NULL;
+		g_slice_free(struct sqlx_sqlite3_s, sq3);
+		return;
+	}
+
 	/* send a vacuum */
 	if (sq3->repo && sq3->repo->flag_autovacuum && !sq3->deleted)
 		sqlx_exec(sq3->db, "VACUUM");
@@ -186,6 +197,8 @@ __close_base(struct sqlx_sqlite3_s *sq3)
 		}
 	}
 
+	sqlx_stmt_cache_destroy(sq3->stmts);
+	sq3->stmts = NULL;
 	if (sq3->db)
 		_close_handle(&(sq3->db));
 
@@ -336,6 +349,8 @@ sqlx_repository_init(const gchar *vol, const struct sqlx_repo_config_s *cfg,
 				(sqlx_cache_close_hook)__close_base);
 	}
 
+	repo->deltas = sqlx_deltas_create();
+
 	repo->locator = _default_locator;
 	repo->locator_data = NULL;
 
@@ -427,6 +442,9 @@ sqlx_repository_clean(sqlx_repository_t *repo)
 	if (repo->schemas)
 		g_tree_destroy (repo->schemas);
 
+	if (repo->deltas)
+		sqlx_deltas_destroy(repo->deltas);
+
 	memset(repo, 0, sizeof(*repo));
 	g_free(repo);
 
@@ -613,6 +631,13 @@ sqlx_repository_get_local_addr(struct sqlx_repository_s *repo)
 	return NULL;
 }
 
+const gchar*
+sqlx_repository_get_basedir(struct sqlx_repository_s *repo)
+{
+	EXTRA_ASSERT(repo != NULL);
+	return repo->basedir;
+}
+
 /* ------------------------------------------------------------------------- */
 
 struct open_args_s
@@ -628,6 +653,7 @@ struct open_args_s
 	guint8 create;
 	guint8 no_refcheck;
 	guint8 urgent;
+	guint8 shared;
 	guint8 is_replicated;
 };
 
@@ -692,6 +718,9 @@ _open_clean_args(struct open_args_s *args)
 void
 sqlx_admin_reload(struct sqlx_sqlite3_s *sq3)
 {
+	/* The content of the base has been replaced, maybe its schema too */
+	sqlx_stmt_cache_flush(sq3->stmts);
+
 	if (sq3->admin)
 		g_tree_destroy(sq3->admin);
 	sq3->admin = g_tree_new_full(metautils_strcmp3, NULL, g_free, g_free);
@@ -775,6 +804,8 @@ __open_not_cached(struct open_args_s *args, struct sqlx_sqlite3_s **result)
 
 	struct sqlx_sqlite3_s *sq3 = g_slice_new0(struct sqlx_sqlite3_s);
 	sq3->db = handle;
+	sq3->stmts = sqlx_stmt_cache_create(handle, args->name.type,
+			sqliterepo_stmt_cache_size);
 	sq3->bd = -1;
 	sq3->repo = args->repo;
 	sq3->manager = args->repo->election_manager;
@@ -836,19 +867,93 @@ __open_not_cached(struct open_args_s *args, struct sqlx_sqlite3_s **result)
 	return NULL;
 }
 
+/* Get a read-only connection on a base held in shared mode. The connection
+ * borrows the ADMIN table of the main connection, that cannot change while
+ * the base is shared. */
+static GError*
+__open_shared(struct open_args_s *args, gint bd, struct sqlx_sqlite3_s **result)
+{
+	struct sqlx_cache_s *cache = args->repo->cache;
+	struct sqlx_sqlite3_s *main_sq3 = sqlx_cache_get_handle(cache, bd);
+	EXTRA_ASSERT(main_sq3 != NULL);
+
+	struct sqlx_sqlite3_s *sq3 = sqlx_cache_pop_reader(cache, bd);
+	if (!sq3) {
+		sqlite3 *handle = NULL;
+		const gint flags = SQLITE_OPEN_NOMUTEX|SQLITE_OPEN_PRIVATECACHE
+			|SQLITE_OPEN_READONLY;
+		int rc = sqlite3_open_v2(args->realpath, &handle, flags, NULL);
+		if (rc != SQLITE_OK) {
+			_close_handle(&handle);
+			GError *e1 = sqlx_cache_unlock_and_close_base(cache, bd, 0);
+			if (e1) {
+				GRID_WARN("BASE unlock/close error on bd=%d: (%d) %s",
+						bd, e1->code, e1->message);
+				g_clear_error(&e1);
+			}
+			return NEWERROR(CODE_UNAVAILABLE,
+					"sqlite3_open error (read-only): (rc=%d) %s",
+					rc, sqlite_strerror(rc));
+		}
+
+		sqlite3_busy_timeout(handle, 30000);
+		if (oio_sqliterepo_cache_kbytes_per_db > 0) {
+			gchar line[128] = {0};
+			g_snprintf(line, sizeof(line), "PRAGMA cache_size = -%u",
+					oio_sqliterepo_cache_kbytes_per_db);
+			sqlx_exec(handle, line);
+		}
+		sqlx_exec(handle, "PRAGMA temp_store = MEMORY");
+
+		sq3 = g_slice_new0(struct sqlx_sqlite3_s);
+		sq3->db = handle;
+		sq3->stmts = sqlx_stmt_cache_create(handle, args->name.type,
+				sqliterepo_stmt_cache_size);
+		sq3->repo = args->repo;
+		sq3->shared = 1;
+		NAMEFILL(sq3->name, args->name);
+		g_strlcpy(sq3->path_inline, args->realpath, sizeof(sq3->path_inline));
+	}
+
+	sq3->bd = bd;
+	sq3->manager = main_sq3->manager;
+	sq3->no_peers = main_sq3->no_peers;
+	sq3->admin = main_sq3->admin;
+	*result = sq3;
+	return NULL;
+}
+
+static GError*
+__close_shared(struct sqlx_sqlite3_s *sq3)
+{
+	struct sqlx_cache_s *cache = sq3->repo->cache;
+	const gint bd = sq3->bd;
+
+	sq3->admin = NULL;
+	sq3->election = 0;
+	/* The handle must be kept before the shared lock is released */
+	if (sq3->corrupted || !sqlx_cache_push_reader(cache, bd, sq3))
+		__close_base(sq3);
+	return sqlx_cache_unlock_and_close_base(cache, bd, 0);
+}
+
 static GError*
 __open_maybe_cached(struct open_args_s *args, struct sqlx_sqlite3_s **result)
 {
 	GError *e0;
 	gint bd = -1;
+	gboolean shared = args->shared;
 
-	e0 = sqlx_cache_open_and_lock_base(args->repo->cache, args->realname,
-		   args->urgent, &bd, args->deadline);
+	e0 = sqlx_cache_open_and_lock_base2(args->repo->cache, args->realname,
+		   args->urgent, &shared, &bd, args->deadline);
 	if (e0 != NULL) {
 		g_prefix_error(&e0, "cache error: ");
 		return e0;
 	}
 
+	if (shared)
+		return __open_shared(args, bd, result);
+
 	*result = sqlx_cache_get_handle(args->repo->cache, bd);
 	GRID_TRACE("Cache slot reserved bd=%d, base [%s][%s] %s open",
 				bd, args->name.base, args->name.type,
@@ -977,7 +1082,8 @@ _open_and_lock_base(struct open_args_s *args, enum election_status_e expected,
 		(*result)->election = status;
 	}
 
-	if (!err && args->is_replicated) {
+	/* The peers are saved by the writers only */
+	if (!err && args->is_replicated && !(*result)->shared) {
 		NAME2CONST(n, (*result)->name);
 		gchar **peers = NULL;
 		err = sqlx_repository_get_peers((*result)->repo, &n, &peers);
@@ -1028,7 +1134,9 @@ sqlx_repository_unlock_and_close2(struct sqlx_sqlite3_s *sq3, guint32 flags)
 	if (!sq3->repo->flag_delete_on)
 		sq3->deleted = FALSE;
 
-	if (sq3->repo->cache) {
+	if (sq3->shared) {
+		err = __close_shared(sq3);
+	} else if (sq3->repo->cache) {
 		if (sq3->deleted)
 			flags |= SQLX_CLOSE_FOR_DELETION;
 		else if (sq3->corrupted)
@@ -1102,6 +1210,7 @@ sqlx_repository_timed_open_and_lock(sqlx_repository_t *repo,
 	args.no_refcheck = BOOL(how & SQLX_OPEN_NOREFCHECK);
 	args.create = BOOL(how & SQLX_OPEN_CREATE);
 	args.urgent = BOOL(how & SQLX_OPEN_URGENT);
+	args.shared = BOOL(how & SQLX_OPEN_SHARED);
 	args.deadline = deadline;
 	args.peers = peers;
 
@@ -1137,10 +1246,10 @@ sqlx_repository_timed_open_and_lock(sqlx_repository_t *repo,
 			else if (flags == ADMIN_STATUS_DISABLED)
 				mode = SQLX_OPEN_DISABLED;
 
+			/* The base is closed below, with the other errors */
 			if (!(mode & expected_status)) {
 				err = NEWERROR(CODE_CONTAINER_FROZEN,
 						"Invalid status: %s", sqlx_admin_status2str(flags));
-				sqlx_repository_unlock_and_close_noerror(*result);
 			}
 		}
 
@@ -1406,21 +1515,21 @@ _read_file_chunk(int fd, guint64 chunk_size, GByteArray *gba)
 {
 	ssize_t r;
 	guint64 tot = 0;
-	guint8 *d = NULL;
 	GError *err = NULL;
 
-	d = g_malloc(SQLX_DUMP_BUFFER_SIZE);
+	/* Read in place, without any intermediate buffer */
 	do {
-		r = read(fd, d, MIN(chunk_size - tot, SQLX_DUMP_BUFFER_SIZE));
-		if (r < 0) {
+		const guint len = gba->len;
+		const gsize max = MIN(chunk_size - tot, SQLX_DUMP_BUFFER_SIZE);
+		g_byte_array_set_size(gba, len + max);
+		r = read(fd, gba->data + len, max);
+		g_byte_array_set_size(gba, len + MAX(r, 0));
+		if (r < 0)
 			err = NEWERROR(errno, "read error: %s", strerror(errno));
-		} else if (r > 0) {
+		else
 			tot += r;
-			g_byte_array_append(gba, d, r);
-		}
 	} while (r > 0 && tot < chunk_size && !err);
 
-	g_free(d);
 	return err;
 }
 
@@ -1665,6 +1774,51 @@ sqlx_repository_dump_base_gba(struct sqlx_sqlite3_s *sq3, GByteArray **dump)
 	return sqlx_repository_dump_base_fd_no_copy(sq3, TRUE, _monolytic_dump_cb, dump);
 }
 
+GError*
+sqlx_repository_dump_base_snapshot(struct sqlx_sqlite3_s *sq3, int *pfd)
+{
+	GError *_keep_fd(int fd, gpointer arg)
+	{
+		(void) arg;
+		if ((*pfd = dup(fd)) < 0)
+			return NEWERROR(errno, "Failed to keep the dump (fd=%d): %s",
+					fd, strerror(errno));
+		return NULL;
+	}
+	*pfd = -1;
+	return sqlx_repository_dump_base_fd(sq3, _keep_fd, NULL);
+}
+
+GError*
+sqlx_repository_dump_fd_chunked(int fd, gint chunk_size,
+		dump_base_chunked_cb callback, gpointer callback_arg)
+{
+	int rc;
+	gint64 bytes_read = 0;
+	struct stat st;
+	GError *err = NULL;
+
+	rc = fstat(fd, &st);
+	if (rc < 0)
+		return NEWERROR(errno,
+				"Failed to stat the database file (fd=%d)", fd);
+	do {
+		GByteArray *gba = g_byte_array_sized_new(
+				MIN(chunk_size, st.st_size - bytes_read));
+		err = _read_file_chunk(fd, chunk_size, gba);
+		if (!err && !gba->len && bytes_read < st.st_size)
+			err = NEWERROR(CODE_INTERNAL_ERROR,
+					"Database file truncated while dumped (fd=%d)", fd);
+		if (!err) {
+			bytes_read += gba->len;
+			err = callback(gba, st.st_size - bytes_read, callback_arg);
+		} else {
+			g_byte_array_free(gba, TRUE);
+		}
+	} while (!err && bytes_read < st.st_size);
+	return err;
+}
+
 GError*
 sqlx_repository_dump_base_chunked(struct sqlx_sqlite3_s *sq3,
 		gint chunk_size, dump_base_chunked_cb callback, gpointer callback_arg)
@@ -1672,24 +1826,8 @@ sqlx_repository_dump_base_chunked(struct sqlx_sqlite3_s *sq3,
 	GError *_chunked_dump_cb(int fd, gpointer arg)
 	{
 		(void) arg;
-		int rc;
-		gint64 bytes_read = 0;
-		struct stat st;
-		GError *err = NULL;
-
-		rc = fstat(fd, &st);
-		if (rc < 0)
-			return NEWERROR(errno,
-					"Failed to stat the database file (fd=%d)", fd);
-		do {
-			GByteArray *gba = g_byte_array_sized_new(128 * 1024);
-			err = _read_file_chunk(fd, chunk_size, gba);
-			if (!err) {
-				bytes_read += gba->len;
-				err = callback(gba, st.st_size - bytes_read, callback_arg);
-			}
-		} while (!err && bytes_read < st.st_size);
-		return err;
+		return sqlx_repository_dump_fd_chunked(fd, chunk_size,
+				callback, callback_arg);
 	}
 	return sqlx_repository_dump_base_fd_no_copy(sq3, FALSE, _chunked_dump_cb, NULL);
 }
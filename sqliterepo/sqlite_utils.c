@@ -258,8 +258,8 @@ sqlx_admin_ensure_versions (struct sqlx_sqlite3_s *sq3)
 {
 	int rc;
 	sqlite3_stmt *stmt = NULL;
-	sqlite3_prepare_debug(rc, sq3->db, "SELECT name FROM sqlite_master"
-			" WHERE type = 'table'", -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, "SELECT name FROM sqlite_master"
+			" WHERE type = 'table'", -1, &stmt);
 	if (rc == SQLITE_OK) {
 		EXTRA_ASSERT(stmt != NULL);
 		while (SQLITE_ROW == (rc = sqlite3_step(stmt))) {
@@ -268,7 +268,7 @@ sqlx_admin_ensure_versions (struct sqlx_sqlite3_s *sq3)
 					sqlite3_column_text(stmt, 0));
 			sqlx_admin_init_str (sq3, k, "1:0");
 		}
-		sqlite3_finalize(stmt);
+		sqlx_stmt_release(stmt);
 	}
 }
 
@@ -370,9 +370,10 @@ sqlx_admin_save (struct sqlx_sqlite3_s *sq3)
 	sqlite3_stmt *stmt = NULL;
 
 	EXTRA_ASSERT(sq3 != NULL);
+	EXTRA_ASSERT(!sq3->shared);
 
-	sqlite3_prepare_debug(rc, sq3->db,
-			"INSERT OR REPLACE INTO admin (k,v) VALUES (?,?)", -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db,
+			"INSERT OR REPLACE INTO admin (k,v) VALUES (?,?)", -1, &stmt);
 	if (rc != SQLITE_OK && rc != SQLITE_DONE)
 		err = SYSERR("DB error: (%d) %s", rc, sqlite3_errmsg(sq3->db));
 	else {
@@ -399,7 +400,7 @@ sqlx_admin_save (struct sqlx_sqlite3_s *sq3)
 			return err != NULL;
 		}
 		g_tree_foreach (sq3->admin, (GTraverseFunc)_save, NULL);
-		(void) sqlite3_finalize(stmt);
+		sqlx_stmt_release(stmt);
 	}
 
 	if (err) {
@@ -442,7 +443,7 @@ sqlx_admin_load(struct sqlx_sqlite3_s *sq3)
 	sqlite3_stmt *stmt = NULL;
 	int rc;
 
-	sqlite3_prepare_debug(rc, sq3->db, "SELECT k,v FROM admin", -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, "SELECT k,v FROM admin", -1, &stmt);
 	if (rc == SQLITE_OK) {
 		EXTRA_ASSERT(stmt != NULL);
 		while (SQLITE_ROW == (rc = sqlite3_step(stmt))) {
@@ -465,7 +466,7 @@ sqlx_admin_load(struct sqlx_sqlite3_s *sq3)
 						sqlite3_column_bytes(stmt, 1));
 			g_tree_replace(sq3->admin, g_strdup(k), v);
 		}
-		sqlite3_finalize(stmt);
+		sqlx_stmt_release(stmt);
 	}
 }
 
@@ -600,14 +601,14 @@ static gint64 _sqlx_get_number(struct sqlx_sqlite3_s *sq3, const gchar *req) {
 	gint rc;
 	sqlite3_stmt *stmt = NULL;
 
-	sqlite3_prepare_debug(rc, sq3->db, req, -1, &stmt, NULL);
+	sqlx_stmt_prepare_debug(rc, sq3->db, req, -1, &stmt);
 	if (rc == SQLITE_OK) {
 		EXTRA_ASSERT(stmt != NULL);
 		if (SQLITE_ROW == (rc = sqlite3_step(stmt))) {
 			result = sqlite3_column_int64(stmt, 0);
 		}
 	}
-	sqlite3_finalize(stmt);
+	sqlx_stmt_release(stmt);
 	return result;
 }
 
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -134,6 +134,54 @@ const char * sqlite_strerror(const int rc);
 
 int sqlx_exec(sqlite3 *handle, const gchar *sql);
 
+/* Prepared statements, cached per connection. The statements are looked up
+ * by their SQL text, then reset and reused instead of being prepared again.
+ * A cache is only used by the thread that holds its connection. */
+struct sqlx_stmt_cache_s;
+
+/* Attach to <db> a cache of at most <max> statements, accounted in the
+ * stats of the service type <srvtype>. With <max> at 0, nothing is cached
+ * but the lookups are still accounted. */
+struct sqlx_stmt_cache_s * sqlx_stmt_cache_create(sqlite3 *db,
+		const gchar *srvtype, guint max);
+
+/* Finalize all the statements not in use, e.g. when the schema changed */
+void sqlx_stmt_cache_flush(struct sqlx_stmt_cache_s *cache);
+
+/* Detach the cache from its connection and finalize its statements.
+ * Must be called before the connection is closed. */
+void sqlx_stmt_cache_destroy(struct sqlx_stmt_cache_s *cache);
+
+/* Like sqlite3_prepare_v2(), but from the cache of <db> when it has one.
+ * The statement must be given back with sqlx_stmt_release(). */
+int sqlx_stmt_prepare(sqlite3 *db, const gchar *sql, int len,
+		sqlite3_stmt **out);
+
+/* Reset and keep the statement in the cache it belongs to, or finalize
+ * it if it belongs to none. Like sqlite3_finalize(), returns the error of
+ * the last evaluation of the statement. */
+int sqlx_stmt_release(sqlite3_stmt *stmt);
+
+/** @see sqlx_stmt_prepare() */
+# define sqlx_stmt_prepare_debug(R,db,zSql,nByte,ppStmt) do { \
+	(R) = sqlx_stmt_prepare(db, zSql, nByte, ppStmt); \
+	if (!sqlx_code_good(R) || GRID_TRACE_ENABLED()) \
+		g_log(SQLX_QUERY_DOMAIN, \
+				sqlx_code_good(R) ? GRID_LOGLVL_TRACE : GRID_LOGLVL_WARN, \
+				"sqlx_stmt_prepare(%p,%p,\"%.*s\") = (%d/%s) %s", \
+				db, ppStmt, 64, zSql, (R), sqlite_strerror(R), sqlite3_errmsg(db)); \
+} while (0)
+
+/** @see sqlx_stmt_release() */
+# define sqlx_stmt_release_debug(R,S) do { \
+	(R) = sqlx_stmt_release(S); \
+	if (!sqlx_code_good(R) || GRID_TRACE2_ENABLED()) \
+		g_log(SQLX_QUERY_DOMAIN, \
+				sqlx_code_good(R) ? GRID_LOGLVL_TRACE2 : GRID_LOGLVL_WARN, \
+				"sqlx_stmt_release() = %s (%d)", \
+				sqlite_strerror(R), R); \
+} while (0)
+
 struct sqlx_sqlite3_s;
 
 struct oio_url_s* sqlx_admin_get_url (struct sqlx_sqlite3_s *sq3);
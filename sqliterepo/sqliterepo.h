@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -66,6 +66,10 @@ enum sqlx_open_type_e
 	SQLX_OPEN_CREATE      = 0x10,
 	SQLX_OPEN_NOREFCHECK  = 0x20,
 	SQLX_OPEN_URGENT      = 0x40,
+	/* The caller won't write in the base: it may share it with other
+	 * readers, through a read-only connection. No transaction can be
+	 * started on such a connection. */
+	SQLX_OPEN_SHARED      = 0x80,
 #define SQLX_OPEN_FLAGS     0x0F0
 
 	// Set an OR'ed combination of the following flags to require
@@ -106,6 +110,7 @@ struct sqlx_sqlite3_s
 	struct election_manager_s *manager;
 	GTree *admin; // <gchar*,GByteArray*>
 	sqlite3 *db;
+	struct sqlx_stmt_cache_s *stmts; // prepared statements of <db>
 
 	gint bd; // ID in cache
 	enum election_status_e election : 8; // set at open(), reset at close()
@@ -114,6 +119,7 @@ struct sqlx_sqlite3_s
 	guint8 deleted : 1;
 	guint8 no_peers : 1; // Prevent get_peers()
 	guint8 corrupted : 1; // Will rename the file when closing database.
+	guint8 shared : 1; // Read-only connection, the admin is borrowed.
 
 	struct sqlx_name_inline_s name;
 	gchar path_inline[128 + LIMIT_LENGTH_NSNAME + LIMIT_LENGTH_SRVTYPE];
@@ -157,6 +163,8 @@ struct election_manager_s* sqlx_repository_get_elections_manager(
 
 const gchar* sqlx_repository_get_local_addr(struct sqlx_repository_s *repo);
 
+const gchar* sqlx_repository_get_basedir(struct sqlx_repository_s *repo);
+
 gboolean sqlx_repository_replication_configured(
 		const struct sqlx_repository_s *r);
 
@@ -308,6 +316,17 @@ typedef GError*(*dump_base_chunked_cb)(GByteArray *gba, gint64 remaining_bytes,
 GError* sqlx_repository_dump_base_chunked(struct sqlx_sqlite3_s *sq3,
 		gint chunk_size, dump_base_chunked_cb callback, gpointer callback_arg);
 
+/** Copy the meaningful pages of the base into an unlinked temporary file,
+ *  whose descriptor is returned in <pfd>, so that the base may be unlocked
+ *  before the copy is read. The caller closes <pfd>. */
+GError* sqlx_repository_dump_base_snapshot(struct sqlx_sqlite3_s *sq3,
+		int *pfd);
+
+/** Send the whole file behind <fd> to a callback, by parts of <chunk_size>
+ *  bytes, as GByteArrays (must be cleaned by caller). */
+GError* sqlx_repository_dump_fd_chunked(int fd, gint chunk_size,
+		dump_base_chunked_cb callback, gpointer callback_arg);
+
 GError* sqlx_repository_restore_base(struct sqlx_sqlite3_s *sq3,
 		guint8 *raw, gsize rawsize);
 
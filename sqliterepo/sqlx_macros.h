@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -41,6 +41,7 @@ License along with this library.
 #define NAME_MSGNAME_SQLX_REMOVE             "DB_REMOVE"
 #define NAME_MSGNAME_SQLX_SNAPSHOT           "DB_SNAPSHOT"
 #define NAME_MSGNAME_SQLX_DUMP               "DB_DUMP"
+#define NAME_MSGNAME_SQLX_DELTAS             "DB_DELTAS"
 #define NAME_MSGNAME_SQLX_RESTORE            "DB_RESTORE"
 #define NAME_MSGNAME_SQLX_RESYNC             "DB_RESYNC"
 #define NAME_MSGNAME_SQLX_VACUUM             "DB_VACUUM"
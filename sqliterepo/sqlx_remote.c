@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -181,10 +181,13 @@ sqlx_pack_REMOVE(const struct sqlx_name_s *name, gint64 deadline)
 }
 
 GByteArray*
-sqlx_pack_DUMP(const struct sqlx_name_s *name, gboolean chunked, gint64 deadline)
+sqlx_pack_DUMP(const struct sqlx_name_s *name, gboolean chunked,
+		gboolean compress, gint64 deadline)
 {
 	MESSAGE req = make_request(NAME_MSGNAME_SQLX_DUMP, NULL, name, deadline);
 	metautils_message_add_field(req, NAME_MSGKEY_CHUNKED, &chunked, 1);
+	if (compress)
+		metautils_message_add_field(req, NAME_MSGKEY_COMPRESS, &compress, 1);
 	return message_marshall_gba_and_clean(req);
 }
 
@@ -207,6 +210,28 @@ sqlx_pack_REPLICATE(const struct sqlx_name_s *name, struct TableSequence *tabseq
 	return message_marshall_gba_and_clean(req);
 }
 
+GByteArray*
+sqlx_pack_REPLICATE_body(const struct sqlx_name_s *name, GByteArray *body,
+		gint64 deadline)
+{
+	EXTRA_ASSERT(name != NULL);
+	EXTRA_ASSERT(body != NULL);
+	MESSAGE req = make_request(NAME_MSGNAME_SQLX_REPLICATE, NULL, name, deadline);
+	metautils_message_set_BODY(req, body->data, body->len);
+	return message_marshall_gba_and_clean(req);
+}
+
+GByteArray*
+sqlx_pack_DELTAS(const struct sqlx_name_s *name, GByteArray *version,
+		gint64 deadline)
+{
+	EXTRA_ASSERT(name != NULL);
+	EXTRA_ASSERT(version != NULL);
+	MESSAGE req = make_request(NAME_MSGNAME_SQLX_DELTAS, NULL, name, deadline);
+	metautils_message_set_BODY(req, version->data, version->len);
+	return message_marshall_gba_and_clean(req);
+}
+
 GByteArray*
 sqlx_pack_GETVERS(const struct sqlx_name_s *name, const gchar *peers,
 		gint64 deadline)
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -103,11 +103,18 @@ GByteArray* sqlx_pack_PIPETO(const struct sqlx_name_s *name, const gchar *target
 GByteArray* sqlx_pack_REMOVE(const struct sqlx_name_s *name, gint64 deadline);
 GByteArray* sqlx_pack_RESYNC(const struct sqlx_name_s *name, gint64 deadline);
 GByteArray* sqlx_pack_VACUUM(const struct sqlx_name_s *name, gboolean local, gint64 deadline);
-GByteArray* sqlx_pack_DUMP(const struct sqlx_name_s *name, gboolean chunked, gint64 deadline);
+GByteArray* sqlx_pack_DUMP(const struct sqlx_name_s *name, gboolean chunked,
+		gboolean compress, gint64 deadline);
 GByteArray* sqlx_pack_RESTORE(const struct sqlx_name_s *name, const guint8 *raw, gsize rawsize, gint64 deadline);
 
 GByteArray* sqlx_pack_REPLICATE(const struct sqlx_name_s *name, struct TableSequence *tabseq, gint64 deadline);
 
+/* Same as sqlx_pack_REPLICATE() with a TableSequence already encoded */
+GByteArray* sqlx_pack_REPLICATE_body(const struct sqlx_name_s *name, GByteArray *body, gint64 deadline);
+
+/* Ask for the rowsets to apply on a base at the given (encoded) version */
+GByteArray* sqlx_pack_DELTAS(const struct sqlx_name_s *name, GByteArray *version, gint64 deadline);
+
 // service-wide requests
 GByteArray* sqlx_pack_LEANIFY(gint64 deadline);
 GByteArray* sqlx_pack_INFO(gint64 deadline);
@@ -127,7 +134,18 @@ GError * peer_restore(const gchar *target, struct sqlx_name_s *name,
 
 typedef GError* (*peer_dump_cb)(GByteArray *part, gint64 remaining, gpointer arg);
 
+/* When chunked, the dump may be received compressed (depending on
+ * sqliterepo.outgoing.dump.compress and on the peer), and `callback` is then
+ * given the inflated data, by pieces of bounded size. `remaining` is the
+ * (uncompressed) size still to be sent by the peer, -1 if unknown. */
 GError * peer_dump(const gchar *target, struct sqlx_name_s *name, gboolean chunked,
 		peer_dump_cb, gpointer cb_arg, gint64 deadline);
 
+/* Fetch from `target` the rowsets that bring the local base from `version`
+ * to the version of the remote base. `callback` is called once per rowset,
+ * with `remaining` set to -1. */
+GError * peer_deltas(const gchar *target, struct sqlx_name_s *name,
+		GByteArray *version, peer_dump_cb callback, gpointer cb_arg,
+		gint64 deadline);
+
 #endif /*OIO_SDS__sqliterepo__sqlx_remote_h*/
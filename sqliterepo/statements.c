@@ -0,0 +1,319 @@
+/*
+OpenIO SDS sqliterepo
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <string.h>
+
+#include <metautils/lib/metautils.h>
+
+#include "sqlite_utils.h"
+
+/* The lookups are accounted locally, then published by bulks */
+#define STMT_STATS_PERIOD 64
+
+/* The caches are registered by connection, in shards to keep the
+ * contention low between the worker threads. */
+#define STMT_SHARDS 16
+
+struct _stmt_key_s
+{
+	const gchar *sql;
+	gsize len;
+};
+
+struct _stmt_s
+{
+	GList link; /* in the LRU, the most recently used first */
+	struct _stmt_key_s key;
+	sqlite3_stmt *stmt;
+	gboolean busy;
+	gchar sql[];
+};
+
+/* One per service type, never freed */
+struct _stmt_stats_s
+{
+	GQuark q_hits;
+	GQuark q_misses;
+	GQuark q_rate;
+	guint64 hits;
+	guint64 misses;
+};
+
+struct sqlx_stmt_cache_s
+{
+	sqlite3 *db;
+	struct _stmt_stats_s *stats;
+	GHashTable *by_sql;  /* <struct _stmt_key_s*, struct _stmt_s*> */
+	GHashTable *by_stmt; /* <sqlite3_stmt*, struct _stmt_s*> */
+	GQueue lru;
+	guint max;
+	guint hits;
+	guint misses;
+};
+
+static struct {
+	GMutex lock;
+	GHashTable *caches; /* <sqlite3*, struct sqlx_stmt_cache_s*> */
+} shards[STMT_SHARDS];
+
+static GMutex stats_lock;
+static GHashTable *stats_by_type = NULL;
+
+static guint
+_key_hash(gconstpointer p)
+{
+	const struct _stmt_key_s *k = p;
+	guint h = 2166136261u;
+	for (gsize i = 0; i < k->len; i++)
+		h = (h ^ (guint8) k->sql[i]) * 16777619u;
+	return h;
+}
+
+static gboolean
+_key_equal(gconstpointer p0, gconstpointer p1)
+{
+	const struct _stmt_key_s *k0 = p0, *k1 = p1;
+	return k0->len == k1->len && !memcmp(k0->sql, k1->sql, k0->len);
+}
+
+static inline guint
+_shard(sqlite3 *db)
+{
+	return (((guintptr) db) >> 4) % STMT_SHARDS;
+}
+
+static struct sqlx_stmt_cache_s *
+_cache_lookup(sqlite3 *db)
+{
+	struct sqlx_stmt_cache_s *cache = NULL;
+	const guint i = _shard(db);
+	g_mutex_lock(&shards[i].lock);
+	if (shards[i].caches)
+		cache = g_hash_table_lookup(shards[i].caches, db);
+	g_mutex_unlock(&shards[i].lock);
+	return cache;
+}
+
+static struct _stmt_stats_s *
+_stats_get(const gchar *srvtype)
+{
+	if (!srvtype || !*srvtype)
+		srvtype = "unknown";
+
+	g_mutex_lock(&stats_lock);
+	if (!stats_by_type)
+		stats_by_type = g_hash_table_new(g_str_hash, g_str_equal);
+	struct _stmt_stats_s *st = g_hash_table_lookup(stats_by_type, srvtype);
+	if (!st) {
+		st = g_malloc0(sizeof(*st));
+		gchar k[256];
+		g_snprintf(k, sizeof(k), "counter stmt.%s.hits", srvtype);
+		st->q_hits = g_quark_from_string(k);
+		g_snprintf(k, sizeof(k), "counter stmt.%s.misses", srvtype);
+		st->q_misses = g_quark_from_string(k);
+		g_snprintf(k, sizeof(k), "gauge stmt.%s.hit_rate", srvtype);
+		st->q_rate = g_quark_from_string(k);
+		g_hash_table_insert(stats_by_type, g_strdup(srvtype), st);
+	}
+	g_mutex_unlock(&stats_lock);
+	return st;
+}
+
+static void
+_stats_publish(struct sqlx_stmt_cache_s *cache)
+{
+	if (!cache->hits && !cache->misses)
+		return;
+
+	struct _stmt_stats_s *st = cache->stats;
+	g_mutex_lock(&stats_lock);
+	st->hits += cache->hits;
+	st->misses += cache->misses;
+	/* In percent, since the start of the service */
+	const guint64 rate = (100 * st->hits) / (st->hits + st->misses);
+	g_mutex_unlock(&stats_lock);
+
+	oio_stats_add(st->q_hits, cache->hits, st->q_misses, cache->misses,
+			0, 0, 0, 0);
+	oio_stats_set(st->q_rate, rate, 0, 0, 0, 0, 0, 0);
+	cache->hits = cache->misses = 0;
+}
+
+static void
+_stats_account(struct sqlx_stmt_cache_s *cache, gboolean hit)
+{
+	if (hit)
+		cache->hits ++;
+	else
+		cache->misses ++;
+	if (cache->hits + cache->misses >= STMT_STATS_PERIOD)
+		_stats_publish(cache);
+}
+
+static void
+_stmt_forget(struct sqlx_stmt_cache_s *cache, struct _stmt_s *s)
+{
+	g_queue_unlink(&cache->lru, &s->link);
+	g_hash_table_remove(cache->by_sql, &s->key);
+	g_hash_table_remove(cache->by_stmt, s->stmt);
+}
+
+/* Finalize the least recently used statements not in use, until at most
+ * <max> remain. */
+static void
+_cache_trim(struct sqlx_stmt_cache_s *cache, guint max)
+{
+	GList *l = cache->lru.tail;
+	while (l && cache->lru.length > max) {
+		struct _stmt_s *s = l->data;
+		l = l->prev;
+		if (s->busy)
+			continue;
+		_stmt_forget(cache, s);
+		sqlite3_finalize(s->stmt);
+		g_free(s);
+	}
+}
+
+struct sqlx_stmt_cache_s *
+sqlx_stmt_cache_create(sqlite3 *db, const gchar *srvtype, guint max)
+{
+	EXTRA_ASSERT(db != NULL);
+
+	struct sqlx_stmt_cache_s *cache = g_malloc0(sizeof(*cache));
+	cache->db = db;
+	cache->max = max;
+	cache->stats = _stats_get(srvtype);
+	cache->by_sql = g_hash_table_new(_key_hash, _key_equal);
+	cache->by_stmt = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_queue_init(&cache->lru);
+
+	const guint i = _shard(db);
+	g_mutex_lock(&shards[i].lock);
+	if (!shards[i].caches)
+		shards[i].caches = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_hash_table_insert(shards[i].caches, db, cache);
+	g_mutex_unlock(&shards[i].lock);
+	return cache;
+}
+
+void
+sqlx_stmt_cache_flush(struct sqlx_stmt_cache_s *cache)
+{
+	if (!cache)
+		return;
+	_cache_trim(cache, 0);
+	/* The statements in use are forgotten, and will be finalized when
+	 * they are released. */
+	while (cache->lru.head) {
+		struct _stmt_s *s = cache->lru.head->data;
+		_stmt_forget(cache, s);
+		g_free(s);
+	}
+}
+
+void
+sqlx_stmt_cache_destroy(struct sqlx_stmt_cache_s *cache)
+{
+	if (!cache)
+		return;
+
+	const guint i = _shard(cache->db);
+	g_mutex_lock(&shards[i].lock);
+	g_hash_table_remove(shards[i].caches, cache->db);
+	g_mutex_unlock(&shards[i].lock);
+
+	if (cache->lru.length > 0) {
+		_cache_trim(cache, 0);
+		if (cache->lru.length > 0)
+			GRID_WARN("BUG: %u statements still in use on %p",
+					cache->lru.length, cache->db);
+		sqlx_stmt_cache_flush(cache);
+	}
+	_stats_publish(cache);
+
+	g_hash_table_destroy(cache->by_sql);
+	g_hash_table_destroy(cache->by_stmt);
+	g_free(cache);
+}
+
+int
+sqlx_stmt_prepare(sqlite3 *db, const gchar *sql, int len,
+		sqlite3_stmt **out)
+{
+	EXTRA_ASSERT(db != NULL);
+	EXTRA_ASSERT(sql != NULL);
+	EXTRA_ASSERT(out != NULL);
+
+	struct sqlx_stmt_cache_s *cache = _cache_lookup(db);
+	if (!cache)
+		return sqlite3_prepare_v2(db, sql, len, out, NULL);
+
+	struct _stmt_key_s key = {sql, len < 0 ? strlen(sql) : (gsize) len};
+	struct _stmt_s *s = g_hash_table_lookup(cache->by_sql, &key);
+	if (s && !s->busy) {
+		g_queue_unlink(&cache->lru, &s->link);
+		g_queue_push_head_link(&cache->lru, &s->link);
+		s->busy = TRUE;
+		*out = s->stmt;
+		_stats_account(cache, TRUE);
+		return SQLITE_OK;
+	}
+
+	_stats_account(cache, FALSE);
+	sqlite3_stmt *stmt = NULL;
+	int rc = sqlite3_prepare_v2(db, sql, len, &stmt, NULL);
+	*out = stmt;
+	/* A statement with the same SQL is already in use (e.g. in a nested
+	 * call), this one will be finalized when released. */
+	if (rc != SQLITE_OK || !stmt || s)
+		return rc;
+
+	_cache_trim(cache, cache->max > 0 ? cache->max - 1 : 0);
+	if (cache->lru.length < cache->max) {
+		s = g_malloc0(sizeof(*s) + key.len + 1);
+		memcpy(s->sql, sql, key.len);
+		s->key.sql = s->sql;
+		s->key.len = key.len;
+		s->stmt = stmt;
+		s->busy = TRUE;
+		s->link.data = s;
+		g_queue_push_head_link(&cache->lru, &s->link);
+		g_hash_table_insert(cache->by_sql, &s->key, s);
+		g_hash_table_insert(cache->by_stmt, stmt, s);
+	}
+	return rc;
+}
+
+int
+sqlx_stmt_release(sqlite3_stmt *stmt)
+{
+	if (!stmt)
+		return SQLITE_OK;
+
+	struct sqlx_stmt_cache_s *cache = _cache_lookup(sqlite3_db_handle(stmt));
+	struct _stmt_s *s = cache ? g_hash_table_lookup(cache->by_stmt, stmt) : NULL;
+	if (!s)
+		return sqlite3_finalize(stmt);
+
+	EXTRA_ASSERT(s->busy);
+	int rc = sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	s->busy = FALSE;
+	return rc;
+}
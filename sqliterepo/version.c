@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -173,6 +173,37 @@ version_decode(guint8 *raw, gsize rawsize)
 	}
 }
 
+GTree*
+version_dup(GTree *t)
+{
+	GTree *result = version_empty();
+	gboolean runner(gpointer k, gpointer v, gpointer u UNUSED) {
+		struct object_version_s *o = version_get(1, result, k);
+		*o = *OV(v);
+		return FALSE;
+	}
+	if (t)
+		g_tree_foreach(t, runner, NULL);
+	return result;
+}
+
+gboolean
+version_equal(GTree *t0, GTree *t1)
+{
+	gboolean diff = FALSE;
+	gboolean runner(gpointer k, gpointer v, gpointer u) {
+		struct object_version_s *o = g_tree_lookup(u, k);
+		diff = !o || o->version != OV(v)->version;
+		return diff;
+	}
+	if (!t0 || !t1)
+		return t0 == t1;
+	if (g_tree_nnodes(t0) != g_tree_nnodes(t1))
+		return FALSE;
+	g_tree_foreach(t0, runner, t1);
+	return !diff;
+}
+
 static GTree*
 version_extract_effective_diff(TableSequence_t *seq)
 {
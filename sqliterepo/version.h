@@ -1,7 +1,7 @@
 /*
 OpenIO SDS sqliterepo
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -60,6 +60,13 @@ GError* version_validate_diff(GTree *src, GTree *dst, gint64 *worst);
 
 GTree* version_empty(void);
 
+/** Returns a deep copy of the version `t` */
+GTree* version_dup(GTree *t);
+
+/** Tells if both versions have the same tables with the same version
+ * numbers. The timestamps are ignored. */
+gboolean version_equal(GTree *t0, GTree *t1);
+
 GByteArray* version_encode(GTree *t);
 
 GTree* version_decode(guint8 *raw, gsize rawsize);
@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <metautils/lib/common_variables.h>
 #include <server/server_variables.h>
 #include <sqliterepo/sqliterepo_variables.h>
+#include <sqliterepo/sqliterepo_remote_variables.h>
 
 #include <cluster/lib/gridcluster.h>
 #include <events/oio_events_queue.h>
@@ -65,6 +66,7 @@ static void _task_probe_repository(gpointer p);
 static void _task_malloc_trim(gpointer p);
 static void _task_expire_bases(gpointer p);
 static void _task_expire_resolver(gpointer p);
+static void _task_expire_cnx(gpointer p);
 static void _task_reload_nsinfo(gpointer p);
 static void _task_reload_peers(gpointer p);
 
@@ -620,6 +622,7 @@ _configure_tasks(struct sqlx_service_s *ss)
 
 	grid_task_queue_register(ss->gtq_admin, 1, _task_expire_bases, NULL, ss);
 	grid_task_queue_register(ss->gtq_admin, 1, _task_expire_resolver, NULL, ss);
+	grid_task_queue_register(ss->gtq_admin, 1, _task_expire_cnx, NULL, ss);
 	grid_task_queue_register(ss->gtq_admin, 1, _task_malloc_trim, NULL, ss);
 	grid_task_queue_register(ss->gtq_admin, 5, _task_probe_repository, NULL, ss);
 
@@ -1085,6 +1088,20 @@ _task_expire_resolver(gpointer p)
 	}
 }
 
+/* The idle connections to the peers are otherwise only expired when the
+ * same peer is asked again, and a former peer would keep them forever. */
+static void
+_task_expire_cnx(gpointer p UNUSED)
+{
+	if (!grid_main_is_running ())
+		return;
+
+	guint count = cnx_pool_expire(OLDEST(oio_ext_monotonic_time(),
+				oio_election_replicate_cnx_idle));
+	if (count)
+		GRID_DEBUG("Expired %u idle connections", count);
+}
+
 static void
 _task_reload_nsinfo(gpointer p)
 {
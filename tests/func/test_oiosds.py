@@ -1,7 +1,7 @@
 #!/usr/bin/env python
 
 # OpenIO SDS functional tests
-# Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+# Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 #
 # This library is free software; you can redistribute it and/or
 # modify it under the terms of the GNU Lesser General Public
@@ -18,14 +18,22 @@
 
 import sys
 import json
+import time
+import socket
+import hashlib
 import threading
 from ctypes import cdll
 from six import string_types
-from six.moves import BaseHTTPServer
+from six.moves import BaseHTTPServer, socketserver
 
 
 class DumbHttpMock(BaseHTTPServer.BaseHTTPRequestHandler):
     def reply(self):
+        length = int(self.headers.get('content-length') or 0)
+        body = self.rfile.read(length) if length > 0 else b''
+        if hasattr(self.server, 'bodies'):
+            self.server.bodies.append(body)
+
         if len(self.server.expectations) <= 0:
             return
         req, rep = self.server.expectations.pop(0)
@@ -72,6 +80,74 @@ class DumbHttpMock(BaseHTTPServer.BaseHTTPRequestHandler):
         return self.reply()
 
 
+class RawxMock(BaseHTTPServer.BaseHTTPRequestHandler):
+    """Stores the chunks uploaded, then replies after a delay"""
+
+    def _reply(self, code):
+        self.send_response(code)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def do_PUT(self):
+        body = []
+        while True:
+            size = int(self.rfile.readline().strip(), 16)
+            if size <= 0:
+                break
+            body.append(self.rfile.read(size))
+            self.rfile.readline()
+        # The trailers (of the EC fragments), up to an empty line
+        while self.rfile.readline().strip():
+            pass
+        self.server.received[self.path] = b''.join(body)
+        time.sleep(self.server.delay)
+        self._reply(self.server.status)
+
+    def do_DELETE(self):
+        self.server.deleted.append(self.path)
+        self._reply(204)
+
+
+class ThreadedHTTPServer(socketserver.ThreadingMixIn,
+                         BaseHTTPServer.HTTPServer):
+    daemon_threads = True
+
+
+class RangeRawxMock(BaseHTTPServer.BaseHTTPRequestHandler):
+    """Serves the ranges of its chunks, depending on its mode:
+    - "range": a proper 206 reply;
+    - "norange": the whole chunk with a 200, as if Range was ignored;
+    - "overflow": a 206 reply with the data beyond the range.
+    The requests after the first `fast` ones are delayed."""
+
+    def do_GET(self):
+        data = self.server.chunks[self.path]
+        rng = self.headers.get('Range')
+        with self.server.lock:
+            self.server.ranges.append(rng)
+            count = len(self.server.ranges)
+        if self.server.fast is not None and count > self.server.fast:
+            time.sleep(self.server.delay)
+
+        start, end = [int(x) for x in rng[len("bytes="):].split('-')]
+        if self.server.mode == "norange":
+            code, body = 200, data
+        elif self.server.mode == "overflow":
+            code, body = 206, data[start:]
+        else:
+            code, body = 206, data[start:end+1]
+        try:
+            self.send_response(code)
+            if code == 206:
+                self.send_header("Content-Range", "bytes %d-%d/%d" % (
+                    start, start + len(body) - 1, len(data)))
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        except socket.error:
+            pass  # The client gave up, e.g. a hedged request won
+
+
 def http2url(s):
     return '127.0.0.1:' + str(s.server_port)
 
@@ -321,6 +397,214 @@ def test_list_ok(lib):
     assert(0 == len(proxy.expectations))
 
 
+CHUNK_SIZE = 64
+
+
+EC_METHOD = "ec/algo=liberasurecode_rs_vand,k=2,m=2"
+
+
+def _put_services(statuses, method="plain/nb_copy=1"):
+    """One proxy, then one rawx per metachunk (or per fragment of the only
+    metachunk, with an EC method). The first chunk is the slowest to
+    complete, so that the next ones are in flight meanwhile."""
+    proxy = BaseHTTPServer.HTTPServer(("127.0.0.1", 0), DumbHttpMock)
+    proxy.bodies = []
+    rawx = []
+    for i, status in enumerate(statuses):
+        h = BaseHTTPServer.HTTPServer(("127.0.0.1", 0), RawxMock)
+        h.status, h.delay = status, (0.5 if i == 0 else 0.0)
+        h.received, h.deleted = {}, []
+        rawx.append(h)
+    pos = "0.%d" if method.startswith("ec/") else "%d"
+    chunks = [{"url": "http://%s/%064X" % (http2url(h), i),
+               "pos": pos % i, "size": CHUNK_SIZE,
+               "hash": "00000000000000000000000000000000"}
+              for i, h in enumerate(rawx)]
+    proxy.expectations = [
+        (("/v3.0/NS/content/prepare2?acct=ACCT&ref=JFS&path=plop", {}, ""),
+         (200, {"x-oio-content-meta-chunk-method": method},
+          json.dumps(chunks))),
+    ]
+    return proxy, rawx
+
+
+def _run_services(proxy, rawx, action):
+    services = [Service(h) for h in [proxy] + rawx]
+    for s in services:
+        s.start()
+    cfg = json.dumps({"NS": {"proxy": http2url(proxy)}}).encode('utf-8')
+    try:
+        action(cfg)
+    finally:
+        for h in [proxy] + rawx:
+            h.shutdown()
+        for s in services:
+            s.join()
+
+
+def _chunk_data(i):
+    return (chr(ord('a') + i) * CHUNK_SIZE).encode('utf-8')
+
+
+def test_put_success(lib, depth):
+    proxy, rawx = _put_services((201, 201, 201))
+    proxy.expectations.append(((None, {}, ""), (204, {}, "")))
+
+    def action(cfg):
+        lib.test_put_success(cfg, b"NS", b"NS/ACCT/JFS//plop",
+                             CHUNK_SIZE, len(rawx), depth)
+    _run_services(proxy, rawx, action)
+    assert(0 == len(proxy.expectations))
+
+    # Each chunk received the data of its own metachunk
+    paths = ["/%064X" % i for i in range(len(rawx))]
+    for i, h in enumerate(rawx):
+        assert(h.received == {paths[i]: _chunk_data(i)})
+        assert(h.deleted == [])
+
+    # The commit carries the metachunks in order, whatever the order of
+    # completion of their uploads.
+    saved = json.loads(proxy.bodies[-1].decode('utf-8'))
+    if isinstance(saved, dict):
+        saved = saved["chunks"]
+    assert(len(saved) == len(rawx))
+    for chunk in saved:
+        i = paths.index('/' + chunk["url"].rsplit('/', 1)[-1])
+        assert(chunk["pos"] == str(i))
+        assert(chunk["size"] == CHUNK_SIZE)
+        assert(chunk["hash"] ==
+               hashlib.md5(_chunk_data(i)).hexdigest().upper())
+
+
+def test_put_fail(lib, depth):
+    # The second metachunk fails while the first is still being uploaded
+    proxy, rawx = _put_services((201, 500, 201))
+
+    def action(cfg):
+        lib.test_put_fail(cfg, b"NS", b"NS/ACCT/JFS//plop",
+                          CHUNK_SIZE, len(rawx), depth)
+    _run_services(proxy, rawx, action)
+
+    # No commit, and the chunks uploaded are removed. With a pipeline, the
+    # third metachunk was in flight when the second failed.
+    assert(0 == len(proxy.expectations))
+    assert(len(proxy.bodies) == 1)
+    assert(rawx[0].deleted == ["/%064X" % 0])
+    assert(rawx[1].deleted == [])
+    if depth > 1:
+        assert(rawx[2].deleted == ["/%064X" % 2])
+    else:
+        assert(rawx[2].received == {})
+        assert(rawx[2].deleted == [])
+
+
+def test_put_ec(lib):
+    if not lib.test_ec_native():
+        return
+
+    # k=2 fragments stored, but no parity at all: refused, nothing committed
+    proxy, rawx = _put_services((201, 201, 500, 500), EC_METHOD)
+    _run_services(proxy, rawx, lambda cfg: lib.test_put_fail(
+        cfg, b"NS", b"NS/ACCT/JFS//plop", CHUNK_SIZE, 1, 1))
+    assert(0 == len(proxy.expectations))
+    assert(len(proxy.bodies) == 1)
+
+    # k fragments plus one parity: the quorum is reached
+    proxy, rawx = _put_services((201, 201, 201, 500), EC_METHOD)
+    proxy.expectations.append(((None, {}, ""), (204, {}, "")))
+    _run_services(proxy, rawx, lambda cfg: lib.test_put_success(
+        cfg, b"NS", b"NS/ACCT/JFS//plop", CHUNK_SIZE, 1, 1))
+    assert(0 == len(proxy.expectations))
+
+
+def test_put(lib):
+    for depth in (1, 3):
+        test_put_success(lib, depth)
+        test_put_fail(lib, depth)
+    test_put_ec(lib)
+
+
+PIECE_SIZE = 64 * 1024
+PREFETCH = 16
+
+
+def _pattern(size):
+    return bytes(bytearray(i % 251 for i in range(size)))
+
+
+def _pieces(size):
+    return sorted("bytes=%d-%d" % (o, min(o + PIECE_SIZE, size) - 1)
+                  for o in range(0, size, PIECE_SIZE))
+
+
+def _get_services(modes, size, downloads=1):
+    """One proxy, then one rawx per replica of a single metachunk"""
+    proxy = BaseHTTPServer.HTTPServer(("127.0.0.1", 0), DumbHttpMock)
+    rawx, chunks = [], []
+    for i, mode in enumerate(modes):
+        h = ThreadedHTTPServer(("127.0.0.1", 0), RangeRawxMock)
+        h.mode, h.fast, h.delay = mode, None, 0.0
+        h.lock, h.ranges = threading.Lock(), []
+        path = "/%064X" % (16 + i)
+        h.chunks = {path: _pattern(size)}
+        rawx.append(h)
+        chunks.append({"url": "http://%s%s" % (http2url(h), path),
+                       "pos": "0", "size": size,
+                       "hash": "00000000000000000000000000000000"})
+    proxy.expectations = [
+        (("/v3.0/NS/content/show?acct=ACCT&ref=JFS&path=plop", {}, ""),
+         (200, {"x-oio-content-meta-chunk-method": "plain"},
+          json.dumps(chunks)))
+    ] * downloads
+    return proxy, rawx
+
+
+def test_get_parallel(lib):
+    size = 3 * PIECE_SIZE + 1000
+
+    def run(modes, expect_success):
+        proxy, rawx = _get_services(modes, size)
+        _run_services(proxy, rawx, lambda cfg: lib.test_get_parallel(
+            cfg, b"NS", b"NS/ACCT/JFS//plop", size, PREFETCH,
+            expect_success))
+        assert(0 == len(proxy.expectations))
+        return rawx
+
+    # The range is split in pieces, all served by the first replica
+    rawx = run(("range", "range"), 1)
+    assert(sorted(rawx[0].ranges) == _pieces(size))
+    assert(rawx[1].ranges == [])
+
+    # A replica ignoring the range is not trusted, the other replica serves
+    # all the pieces.
+    rawx = run(("norange", "range"), 1)
+    assert(sorted(rawx[0].ranges) == _pieces(size))
+    assert(sorted(rawx[1].ranges) == _pieces(size))
+
+    # Neither is a replica sending more than the range. Only the last piece
+    # is served as expected.
+    rawx = run(("overflow", "range"), 1)
+    assert(sorted(rawx[0].ranges) == _pieces(size))
+    assert(sorted(rawx[1].ranges) == _pieces(size)[:-1])
+
+    # No replica to trust: the download fails instead of delivering garbage
+    run(("norange", "overflow"), 0)
+
+
+def test_get_hedged(lib):
+    # The pieces have the same size, so that their latencies compare. Each
+    # download requests 4 of them.
+    size = 4 * PIECE_SIZE
+    warmup = 4
+    proxy, rawx = _get_services(("range", "range"), size, warmup + 1)
+    rawx[0].fast, rawx[0].delay = 4 * warmup, 2.0
+    _run_services(proxy, rawx, lambda cfg: lib.test_get_hedged(
+        cfg, b"NS", b"NS/ACCT/JFS//plop", size, PREFETCH, warmup))
+    assert(0 == len(proxy.expectations))
+    assert(len(rawx[0].ranges) == 4 * (warmup + 1))
+    assert(len(rawx[1].ranges) > 0)
+
+
 def test_list(lib):
     test_list_fail(lib)
     test_list_ok(lib)
@@ -331,4 +615,7 @@ if __name__ == '__main__':
     lib.setup()
     test_has(lib)
     test_get(lib)
+    test_get_parallel(lib)
+    test_get_hedged(lib)
     test_list(lib)
+    test_put(lib)
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS functional tests
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -21,11 +21,13 @@ License along with this library.
 
 #include <glib.h>
 #include <json.h>
+#include <curl/curl.h>
 
 #include <core/client_variables.h>
 #include <core/oiolog.h>
 #include <core/oiourl.h>
 #include <core/oio_sds.h>
+#include <core/ec.h>
 #include <core/internals.h>
 
 void setup (void);
@@ -37,6 +39,17 @@ void test_get_fail (const char *strcfg, const char *ns, const char *url);
 void test_get_success (const char *strcfg, const char *ns, const char *url,
 		size_t count);
 
+void test_get_parallel (const char *strcfg, const char *ns, const char *url,
+		unsigned int size, unsigned int prefetch, int expect_success);
+void test_get_hedged (const char *strcfg, const char *ns, const char *url,
+		unsigned int size, unsigned int prefetch, unsigned int warmup);
+
+void test_put_success (const char *strcfg, const char *ns, const char *url,
+		unsigned int chunk_size, unsigned int count, unsigned int depth);
+void test_put_fail (const char *strcfg, const char *ns, const char *url,
+		unsigned int chunk_size, unsigned int count, unsigned int depth);
+int test_ec_native (void);
+
 void test_list_badarg (const char *strcfg, const char *ns);
 void test_list_fail (const char *strcfg, const char *ns, const char *url);
 void test_list_success_count (const char *strcfg, const char *ns,
@@ -287,6 +300,177 @@ test_get_success (const char *strcfg, const char *ns, const char *strurl,
 	_test_wrap_url (strcfg, ns, strurl, _hook);
 }
 
+/* The contents of the parallel downloads hold a known pattern */
+#define PATTERN(i) ((guint8)((i) % 251))
+
+struct _pattern_check_s
+{
+	size_t offset;
+	gboolean corrupted;
+};
+
+static gint
+_check_pattern (void *i, const unsigned char *b, size_t l)
+{
+	struct _pattern_check_s *check = i;
+	for (size_t k = 0; k < l; k++, check->offset++) {
+		if (b[k] != PATTERN(check->offset))
+			check->corrupted = TRUE;
+	}
+	return l;
+}
+
+static struct oio_error_s *
+_download_pattern (struct oio_sds_s *sds, struct oio_url_s *url,
+		struct _pattern_check_s *check)
+{
+	struct oio_sds_dl_src_s src = { .url = url, .ranges = NULL };
+	struct oio_sds_dl_dst_s dst = {
+		.type = OIO_DL_DST_HOOK_SEQUENTIAL,
+		.data = { .hook = {
+			.cb = _check_pattern,
+			.ctx = check,
+			.length = (size_t)-1,
+		} }
+	};
+	return oio_sds_download (sds, &src, &dst);
+}
+
+static void
+_configure_int (struct oio_sds_s *sds, enum oio_sds_config_e what, int v)
+{
+	int rc = oio_sds_configure (sds, what, &v, sizeof(v));
+	g_assert_cmpint (rc, ==, 0);
+}
+
+/* With the smallest buffer, each range downloaded holds at most 64KiB */
+#define DOWNLOAD_BUFFER (1024 * 1024)
+
+void
+test_get_parallel (const char *strcfg, const char *ns, const char *strurl,
+		unsigned int size, unsigned int prefetch, int expect_success)
+{
+	const gint64 buffer0 = oio_sds_download_buffer;
+	oio_sds_download_buffer = DOWNLOAD_BUFFER;
+
+	void _hook (struct oio_sds_s *sds, struct oio_url_s *url) {
+		_configure_int (sds, OIOSDS_CFG_DOWNLOAD_PREFETCH, prefetch);
+		struct _pattern_check_s check = {0};
+		struct oio_error_s *err = _download_pattern (sds, url, &check);
+		if (expect_success) {
+			g_assert_no_error ((GError*)err);
+			g_assert_cmpuint (check.offset, ==, size);
+			g_assert_false (check.corrupted);
+		} else {
+			g_assert_nonnull (err);
+		}
+		oio_error_pfree (&err);
+	}
+	_test_wrap_url (strcfg, ns, strurl, _hook);
+
+	oio_sds_download_buffer = buffer0;
+}
+
+void
+test_get_hedged (const char *strcfg, const char *ns, const char *strurl,
+		unsigned int size, unsigned int prefetch, unsigned int warmup)
+{
+	const gint64 buffer0 = oio_sds_download_buffer;
+	oio_sds_download_buffer = DOWNLOAD_BUFFER;
+
+	void _hook (struct oio_sds_s *sds, struct oio_url_s *url) {
+		_configure_int (sds, OIOSDS_CFG_DOWNLOAD_PREFETCH, prefetch);
+		_configure_int (sds, OIOSDS_CFG_DOWNLOAD_HEDGE_PERCENTILE, 50);
+
+		/* The first downloads teach the latencies of the replicas, the
+		 * last one meets a slow replica. */
+		for (guint i = 0; i <= warmup; i++) {
+			struct _pattern_check_s check = {0};
+			struct oio_error_s *err = _download_pattern (sds, url, &check);
+			g_assert_no_error ((GError*)err);
+			g_assert_cmpuint (check.offset, ==, size);
+			g_assert_false (check.corrupted);
+		}
+
+		int64_t fired = 0, won = 0;
+		int rc = oio_sds_configure (sds, OIOSDS_CFG_STAT_HEDGE_FIRED,
+				&fired, sizeof(fired));
+		g_assert_cmpint (rc, ==, 0);
+		rc = oio_sds_configure (sds, OIOSDS_CFG_STAT_HEDGE_WON,
+				&won, sizeof(won));
+		g_assert_cmpint (rc, ==, 0);
+		g_assert_cmpint (fired, >, 0);
+		g_assert_cmpint (won, >, 0);
+	}
+	_test_wrap_url (strcfg, ns, strurl, _hook);
+
+	oio_sds_download_buffer = buffer0;
+}
+
+/* Upload <count> metachunks of <chunk_size> bytes, with at most <depth> of
+ * them in flight. Each metachunk is filled with its own letter, so that the
+ * mocks may check which data reached which chunk. */
+static void
+_test_put (const char *strcfg, const char *ns, const char *strurl,
+		unsigned int chunk_size, unsigned int count, unsigned int depth,
+		gboolean expect_success)
+{
+	const guint depth0 = oio_sds_upload_pipeline_depth;
+	const gint64 min0 = oio_chunk_size_minimum;
+	oio_sds_upload_pipeline_depth = depth;
+	oio_chunk_size_minimum = 0;
+
+	void _hook (struct oio_sds_s *sds, struct oio_url_s *url) {
+		const gsize total = chunk_size * count;
+		guint8 *data = g_malloc (total);
+		for (gsize i = 0; i < total; i++)
+			data[i] = 'a' + i / chunk_size;
+
+		struct oio_sds_ul_dst_s dst = OIO_SDS_UPLOAD_DST_INIT;
+		dst.url = url;
+		dst.autocreate = 1;
+		dst.chunk_size = chunk_size;
+		struct oio_error_s *err =
+			oio_sds_upload_from_buffer (sds, &dst, data, total);
+		if (expect_success)
+			g_assert_no_error ((GError*)err);
+		else
+			g_assert_nonnull (err);
+		oio_error_pfree (&err);
+		g_free (data);
+	}
+	_test_wrap_url (strcfg, ns, strurl, _hook);
+
+	oio_sds_upload_pipeline_depth = depth0;
+	oio_chunk_size_minimum = min0;
+}
+
+void
+test_put_success (const char *strcfg, const char *ns, const char *strurl,
+		unsigned int chunk_size, unsigned int count, unsigned int depth)
+{
+	_test_put (strcfg, ns, strurl, chunk_size, count, depth, TRUE);
+}
+
+void
+test_put_fail (const char *strcfg, const char *ns, const char *strurl,
+		unsigned int chunk_size, unsigned int count, unsigned int depth)
+{
+	_test_put (strcfg, ns, strurl, chunk_size, count, depth, FALSE);
+}
+
+/* Tells if the EC contents are encoded by the client itself, i.e. if their
+ * fragments are uploaded straight to the rawx services. */
+int
+test_ec_native (void)
+{
+#if LIBCURL_VERSION_NUM >= 0x074000
+	return oio_ec_available ();
+#else
+	return 0;
+#endif
+}
+
 void
 test_list_badarg (const char *strcfg, const char *ns)
 {
@@ -15,6 +15,7 @@
 
 import math
 import random
+import time
 from mock import MagicMock as Mock
 
 from oio.rdir.client import RdirClient
@@ -368,23 +369,35 @@ class TestRdirClient(BaseTestCase):
         self._assert_chunk_status(
             expected_entries_cid[marker_index+1:], status, max=2)
 
-    def test_chunk_status_with_incident(self):
+    def _set_incident_counted(self):
+        """
+        Set the incident date, then wait for the rdir to count the chunks
+        to rebuild, that it does in the background.
+        """
         self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
+        for _ in range(20):
+            status = self.rdir.status(self.rawx_id)
+            if 'to_rebuild' in status['chunk']:
+                break
+            time.sleep(0.5)
+        else:
+            self.fail('The chunks to rebuild have not been counted')
         self.rdir._direct_request.reset_mock()
+
+    def test_chunk_status_with_incident(self):
+        self._set_incident_counted()
         status = self.rdir.status(self.rawx_id)
         self._assert_chunk_status(
             self.expected_entries, status, incident=True)
 
     def test_chunk_status_with_incident_max(self):
-        self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
-        self.rdir._direct_request.reset_mock()
+        self._set_incident_counted()
         status = self.rdir.status(self.rawx_id, max=2)
         self._assert_chunk_status(
             self.expected_entries, status, incident=True, max=2)
 
     def test_chunk_status_with_incident_prefix(self):
-        self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
-        self.rdir._direct_request.reset_mock()
+        self._set_incident_counted()
         cid = random.choice(self.expected_entries)[0]
         expected_entries_cid = [entry for entry in self.expected_entries
                                 if entry[0] == cid]
@@ -392,8 +405,7 @@ class TestRdirClient(BaseTestCase):
         self._assert_chunk_status(expected_entries_cid, status, incident=True)
 
     def test_chunk_status_with_incident_prefix_max(self):
-        self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
-        self.rdir._direct_request.reset_mock()
+        self._set_incident_counted()
         cid = random.choice(self.expected_entries)[0]
         expected_entries_cid = [entry for entry in self.expected_entries
                                 if entry[0] == cid]
@@ -403,8 +415,7 @@ class TestRdirClient(BaseTestCase):
             expected_entries_cid, status, incident=True, max=2)
 
     def test_chunk_status_with_incident_marker(self):
-        self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
-        self.rdir._direct_request.reset_mock()
+        self._set_incident_counted()
         marker_index = random.randrange(0, len(self.expected_entries))
         marker = '|'.join(self.expected_entries[marker_index][:3])
         status = self.rdir.status(
@@ -413,8 +424,7 @@ class TestRdirClient(BaseTestCase):
             self.expected_entries[marker_index+1:], status, incident=True)
 
     def test_chunk_status_with_incident_marker_max(self):
-        self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
-        self.rdir._direct_request.reset_mock()
+        self._set_incident_counted()
         marker_index = random.randrange(0, len(self.expected_entries))
         marker = '|'.join(self.expected_entries[marker_index][:3])
         status = self.rdir.status(
@@ -425,8 +435,7 @@ class TestRdirClient(BaseTestCase):
             incident=True, max=2)
 
     def test_chunk_status_with_incident_marker_prefix(self):
-        self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
-        self.rdir._direct_request.reset_mock()
+        self._set_incident_counted()
         cid = random.choice(self.expected_entries)[0]
         expected_entries_cid = [entry for entry in self.expected_entries
                                 if entry[0] == cid]
@@ -440,8 +449,7 @@ class TestRdirClient(BaseTestCase):
             expected_entries_cid[marker_index+1:], status, incident=True)
 
     def test_chunk_status_with_incident_marker_prefix_max(self):
-        self.rdir.admin_incident_set(self.rawx_id, self.incident_date)
-        self.rdir._direct_request.reset_mock()
+        self._set_incident_counted()
         cid = random.choice(self.expected_entries)[0]
         expected_entries_cid = [entry for entry in self.expected_entries
                                 if entry[0] == cid]
@@ -1,4 +1,4 @@
-# Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+# Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 #
 # This library is free software; you can redistribute it and/or
 # modify it under the terms of the GNU Lesser General Public
@@ -97,6 +97,20 @@ class RdirTestCase(CommonTestCase):
     def _delete(self, url, **kwargs):
         return self.request('DELETE', self._rdir_url(url), **kwargs)
 
+    def _counted_status(self):
+        """
+        Get the status of the volume, once the chunks to rebuild have been
+        counted for the current incident date.
+        """
+        for _ in range(20):
+            resp = self._get("/v1/rdir/status", params={'vol': self.vol})
+            self.assertEqual(resp.status, 200)
+            status = self.json_loads(resp.data)
+            if not status.get('rebuild', {}).get('counting'):
+                return status
+            time.sleep(0.5)
+        self.fail('The chunks to rebuild have not been counted')
+
 
 class TestRdirServer(RdirTestCase):
     def setUp(self):
@@ -438,10 +452,14 @@ class TestRdirServer(RdirTestCase):
                           data=json.dumps({'date': incident_date}))
         self.assertEqual(resp.status, 204)
 
-        # Status with 1 entries and incident
+        # Status with 1 entries and incident, the totals are known while
+        # the chunks to rebuild are counted.
         resp = self._get("/v1/rdir/status", params={'vol': self.vol})
         self.assertEqual(resp.status, 200)
-        self.assertDictEqual(self.json_loads(resp.data),
+        status = self.json_loads(resp.data)
+        self.assertEqual(status['chunk']['total'], 1)
+        self.assertEqual(status['rebuild']['incident_date'], incident_date)
+        self.assertDictEqual(self._counted_status(),
                              {'chunk': {'total': 1, 'to_rebuild': 1},
                               'container': {
                                   rec['container_id']: {'total': 1,
@@ -481,6 +499,64 @@ class TestRdirServer(RdirTestCase):
                                   rec2['container_id']: {'total': 1}}})
 
 
+    def test_vol_status_counters(self):
+        resp = self._post("/v1/rdir/create", params={'vol': self.vol})
+        self.assertEqual(resp.status, 201)
+
+        # 3 chunks in 2 containers, one pushed twice
+        rec0, rec1 = self._record(), self._record()
+        rec2 = self._record()
+        rec2['container_id'] = rec0['container_id']
+        for rec in (rec0, rec1, rec2, rec2):
+            resp = self._post("/v1/rdir/push", params={'vol': self.vol},
+                              data=json.dumps(rec))
+            self.assertEqual(resp.status, 204)
+        resp = self._get("/v1/rdir/status", params={'vol': self.vol})
+        self.assertEqual(resp.status, 200)
+        self.assertDictEqual(self.json_loads(resp.data),
+                             {'chunk': {'total': 3}, 'container': {
+                                 rec0['container_id']: {'total': 2},
+                                 rec1['container_id']: {'total': 1}}})
+
+        # a deleted chunk is not counted anymore, nor its empty container
+        resp = self._delete("/v1/rdir/delete", params={'vol': self.vol},
+                            data=json.dumps(rec1))
+        self.assertEqual(resp.status, 204)
+        resp = self._get("/v1/rdir/status", params={'vol': self.vol})
+        self.assertDictEqual(self.json_loads(resp.data),
+                             {'chunk': {'total': 2}, 'container': {
+                                 rec0['container_id']: {'total': 2}}})
+
+        # the chunks to rebuild follow the re-dating of the incident
+        for date, to_rebuild in ((rec0['mtime'] - 1, 0),
+                                 (rec0['mtime'] + 1, 2)):
+            resp = self._post("/v1/rdir/admin/incident",
+                              params={'vol': self.vol},
+                              data=json.dumps({'date': date}))
+            self.assertEqual(resp.status, 204)
+            expected = {'total': 2}
+            if to_rebuild:
+                expected['to_rebuild'] = to_rebuild
+            self.assertDictEqual(
+                self._counted_status(),
+                {'chunk': {'total': 2, 'to_rebuild': to_rebuild},
+                 'container': {rec0['container_id']: expected},
+                 'rebuild': {'incident_date': date}})
+
+        # the chunks pushed again are counted once, with their new mtime
+        rec2['mtime'] = rec0['mtime'] + 2
+        resp = self._post("/v1/rdir/push", params={'vol': self.vol},
+                          data=json.dumps(rec2))
+        self.assertEqual(resp.status, 204)
+        resp = self._get("/v1/rdir/status", params={'vol': self.vol})
+        self.assertDictEqual(
+            self.json_loads(resp.data),
+            {'chunk': {'total': 2, 'to_rebuild': 1},
+             'container': {rec0['container_id']: {'total': 2,
+                                                  'to_rebuild': 1}},
+             'rebuild': {'incident_date': rec0['mtime'] + 1}})
+
+
 class TestRdirServer2(RdirTestCase):
     def setUp(self):
         super(TestRdirServer2, self).setUp()
@@ -0,0 +1,357 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <metautils/lib/metautils.h>
+
+/* What a connection of the fake service does once it served its replies */
+enum peer_mode_e
+{
+	PEER_CLOSE,  /* close the connection, as if it was idle for too long */
+	PEER_HANG,  /* read the next request and never reply */
+	PEER_PARTIAL,  /* read the next request and reply half the size */
+};
+
+struct peer_s
+{
+	int fd;
+	gchar url[STRLEN_ADDRINFO];
+	GThread *acceptor;
+	GPtrArray *handlers;  /* <GThread*> */
+	enum peer_mode_e mode;
+	guint replies;  /* replies served per connection */
+	volatile gint accepted;
+	volatile gint closed;
+};
+
+struct cnx_s
+{
+	struct peer_s *peer;
+	int fd;
+};
+
+static gboolean
+_read_all(int fd, guint8 *buf, gsize len)
+{
+	while (len > 0) {
+		ssize_t r = read(fd, buf, len);
+		if (r <= 0)
+			return FALSE;
+		buf += r;
+		len -= r;
+	}
+	return TRUE;
+}
+
+static gboolean
+_read_request(int fd)
+{
+	guint32 size = 0;
+	if (!_read_all(fd, (guint8*)&size, 4))
+		return FALSE;
+	size = g_ntohl(size);
+	guint8 *body = g_malloc(size);
+	const gboolean rc = _read_all(fd, body, size);
+	g_free(body);
+	return rc;
+}
+
+static GByteArray *
+_generate_message(const gchar *name)
+{
+	MESSAGE m = metautils_message_create_named(name, 0);
+	if (!strcmp(name, NAME_MSGNAME_METAREPLY)) {
+		metautils_message_add_field_struint(m, NAME_MSGKEY_STATUS, CODE_FINAL_OK);
+		metautils_message_add_field_str(m, NAME_MSGKEY_MESSAGE, "OK");
+	}
+	return message_marshall_gba_and_clean(m);
+}
+
+static gpointer
+_peer_handle(gpointer p)
+{
+	struct cnx_s *cnx = p;
+	struct peer_s *peer = cnx->peer;
+	GByteArray *reply = _generate_message(NAME_MSGNAME_METAREPLY);
+
+	for (guint i = 0; i < peer->replies; i++) {
+		if (!_read_request(cnx->fd))
+			goto exit;
+		if (write(cnx->fd, reply->data, reply->len) != (ssize_t)reply->len)
+			goto exit;
+	}
+
+	switch (peer->mode) {
+		case PEER_CLOSE:
+			break;
+		case PEER_HANG:
+			if (_read_request(cnx->fd)) {
+				guint8 c;
+				while (read(cnx->fd, &c, 1) > 0) {}
+			}
+			break;
+		case PEER_PARTIAL:
+			if (_read_request(cnx->fd)) {
+				const ssize_t w = write(cnx->fd, reply->data, 2);
+				g_assert_cmpint(w, ==, 2);
+			}
+			break;
+	}
+
+exit:
+	metautils_pclose(&cnx->fd);
+	g_atomic_int_inc(&peer->closed);
+	g_byte_array_unref(reply);
+	g_free(cnx);
+	return NULL;
+}
+
+static gpointer
+_peer_accept(gpointer p)
+{
+	struct peer_s *peer = p;
+	int fd;
+	while ((fd = accept(peer->fd, NULL, NULL)) >= 0) {
+		g_atomic_int_inc(&peer->accepted);
+		struct cnx_s *cnx = g_malloc0(sizeof(*cnx));
+		cnx->peer = peer;
+		cnx->fd = fd;
+		g_ptr_array_add(peer->handlers,
+				g_thread_new("handler", _peer_handle, cnx));
+	}
+	return NULL;
+}
+
+/* A fresh service for each test, so that the errors met by the clients with
+ * one of them do not get it avoided in the next test. */
+static struct peer_s *
+_peer_start(enum peer_mode_e mode, guint replies)
+{
+	struct peer_s *peer = g_malloc0(sizeof(*peer));
+	peer->mode = mode;
+	peer->replies = replies;
+	peer->handlers = g_ptr_array_new();
+	g_strlcpy(peer->url, "127.0.0.1:0", sizeof(peer->url));
+
+	GError *err = NULL;
+	struct sockaddr_storage ss = {};
+	socklen_t ss_len = sizeof(ss);
+	gsize sz = sizeof(ss);
+	peer->fd = sock_build_for_url(peer->url, &err, &ss, &sz);
+	g_assert_no_error(err);
+	g_assert_cmpint(peer->fd, >=, 0);
+	g_assert_cmpint(bind(peer->fd, (struct sockaddr*)&ss, sz), ==, 0);
+	g_assert_cmpint(listen(peer->fd, 8), ==, 0);
+	g_assert_cmpint(getsockname(peer->fd, (struct sockaddr*)&ss, &ss_len), ==, 0);
+	g_assert_cmpint(grid_sockaddr_to_string(
+			(struct sockaddr*)&ss, peer->url, sizeof(peer->url)), >, 0);
+
+	peer->acceptor = g_thread_new("acceptor", _peer_accept, peer);
+	return peer;
+}
+
+static void
+_peer_stop(struct peer_s *peer)
+{
+	cnx_pool_forget(peer->url);
+	shutdown(peer->fd, SHUT_RDWR);
+	g_thread_join(peer->acceptor);
+	for (guint i = 0; i < peer->handlers->len; i++)
+		g_thread_join(peer->handlers->pdata[i]);
+	g_ptr_array_free(peer->handlers, TRUE);
+	metautils_pclose(&peer->fd);
+	g_free(peer);
+}
+
+static void
+_wait_closed(struct peer_s *peer, gint count)
+{
+	for (guint i = 0; i < 500 && g_atomic_int_get(&peer->closed) < count; i++)
+		g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+	g_assert_cmpint(g_atomic_int_get(&peer->closed), >=, count);
+}
+
+static GError *
+_request(struct peer_s *peer, struct gridd_client_s **pclient,
+		struct cnx_pool_stats_s *stats)
+{
+	GByteArray *req = _generate_message("REQ_PING");
+	GError *err = cnx_pool_request(peer->url, req, NULL, NULL, FALSE,
+			0.5, 0, 0, pclient, stats);
+	g_byte_array_unref(req);
+	return err;
+}
+
+/* Run a request and park its connection */
+static void
+_request_and_give(struct peer_s *peer, struct cnx_pool_stats_s *stats)
+{
+	struct gridd_client_s *client = NULL;
+	g_assert_no_error(_request(peer, &client, stats));
+	g_assert_nonnull(client);
+	cnx_pool_give(client, oio_ext_monotonic_time(), 4);
+}
+
+static void
+test_pool(void)
+{
+	struct peer_s *peer = _peer_start(PEER_CLOSE, G_MAXUINT);
+	struct cnx_pool_stats_s stats = {0};
+	guint peers = 0, idle = 0;
+
+	/* A new connection, then parked and reused */
+	_request_and_give(peer, &stats);
+	cnx_pool_count(&peers, &idle);
+	g_assert_cmpuint(peers, ==, 1);
+	g_assert_cmpuint(idle, ==, 1);
+	_request_and_give(peer, &stats);
+	g_assert_cmpuint(stats.created, ==, 1);
+	g_assert_cmpuint(stats.reused, ==, 1);
+	g_assert_cmpuint(stats.stale, ==, 0);
+	g_assert_cmpint(g_atomic_int_get(&peer->accepted), ==, 1);
+
+	/* Too old to be taken, it is closed on the way */
+	g_assert_null(cnx_pool_take(peer->url, oio_ext_monotonic_time() + 1));
+	cnx_pool_count(&peers, &idle);
+	g_assert_cmpuint(idle, ==, 0);
+
+	/* Two connections busy at once, only one may be parked */
+	struct gridd_client_s *c0 = NULL, *c1 = NULL;
+	g_assert_no_error(_request(peer, &c0, &stats));
+	g_assert_no_error(_request(peer, &c1, &stats));
+	g_assert_cmpuint(stats.created, ==, 3);
+	cnx_pool_give(c0, oio_ext_monotonic_time(), 1);
+	cnx_pool_give(c1, oio_ext_monotonic_time(), 1);
+	cnx_pool_count(&peers, &idle);
+	g_assert_cmpuint(idle, ==, 1);
+
+	/* A connection with a request pending is never parked */
+	struct gridd_client_s *client = cnx_pool_take(peer->url, 0);
+	g_assert_nonnull(client);
+	GByteArray *req = _generate_message("REQ_PING");
+	g_assert_no_error(gridd_client_request(client, req, NULL, NULL));
+	g_byte_array_unref(req);
+	cnx_pool_give(client, oio_ext_monotonic_time(), 4);
+	cnx_pool_count(&peers, &idle);
+	g_assert_cmpuint(idle, ==, 0);
+
+	/* Expiration, then forgetting */
+	_request_and_give(peer, &stats);
+	g_assert_cmpuint(cnx_pool_expire(0), ==, 0);
+	g_assert_cmpuint(cnx_pool_expire(oio_ext_monotonic_time() + 1), ==, 1);
+	_request_and_give(peer, &stats);
+	cnx_pool_forget(peer->url);
+	cnx_pool_count(&peers, &idle);
+	g_assert_cmpuint(peers, ==, 0);
+	g_assert_cmpuint(idle, ==, 0);
+
+	_peer_stop(peer);
+}
+
+static void
+test_retry_stale(void)
+{
+	struct peer_s *peer = _peer_start(PEER_CLOSE, 1);
+	struct cnx_pool_stats_s stats = {0};
+
+	_request_and_give(peer, &stats);
+	_wait_closed(peer, 1);
+
+	/* The idle connection has been closed by the service: the request is
+	 * sent again, on a new connection. */
+	_request_and_give(peer, &stats);
+	g_assert_cmpuint(stats.reused, ==, 1);
+	g_assert_cmpuint(stats.stale, ==, 1);
+	g_assert_cmpuint(stats.created, ==, 2);
+	g_assert_cmpint(g_atomic_int_get(&peer->accepted), ==, 2);
+
+	_peer_stop(peer);
+}
+
+static void
+test_no_retry(enum peer_mode_e mode, gint code)
+{
+	struct peer_s *peer = _peer_start(mode, 1);
+	struct cnx_pool_stats_s stats = {0};
+
+	_request_and_give(peer, &stats);
+
+	/* The service read the request: sending it again could apply it twice */
+	struct gridd_client_s *client = NULL;
+	GError *err = _request(peer, &client, &stats);
+	g_assert_error(err, g_quark_from_static_string("oio.utils"), code);
+	g_clear_error(&err);
+	g_assert_nonnull(client);
+	g_assert(!gridd_client_stale(client));
+	cnx_pool_give(client, oio_ext_monotonic_time(), 4);
+
+	g_assert_cmpuint(stats.reused, ==, 1);
+	g_assert_cmpuint(stats.stale, ==, 0);
+	g_assert_cmpuint(stats.created, ==, 1);
+	g_assert_cmpint(g_atomic_int_get(&peer->accepted), ==, 1);
+
+	_peer_stop(peer);
+}
+
+static void
+test_no_retry_timeout(void)
+{
+	test_no_retry(PEER_HANG, ERRCODE_READ_TIMEOUT);
+}
+
+static void
+test_no_retry_partial(void)
+{
+	test_no_retry(PEER_PARTIAL, CODE_NETWORK_ERROR);
+}
+
+static void
+test_no_connect(void)
+{
+	/* Nobody listens there anymore */
+	struct peer_s *peer = _peer_start(PEER_CLOSE, 1);
+	gchar url[STRLEN_ADDRINFO];
+	g_strlcpy(url, peer->url, sizeof(url));
+	_peer_stop(peer);
+
+	struct cnx_pool_stats_s stats = {0};
+	struct gridd_client_s *client = NULL;
+	GByteArray *req = _generate_message("REQ_PING");
+	GError *err = cnx_pool_request(url, req, NULL, NULL, FALSE,
+			0.5, 0, 0, &client, &stats);
+	g_byte_array_unref(req);
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+	gridd_client_free(client);
+	g_assert_cmpuint(stats.created, ==, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc,argv);
+	g_test_add_func("/metautils/cnx_pool/pool", test_pool);
+	g_test_add_func("/metautils/cnx_pool/retry_stale", test_retry_stale);
+	g_test_add_func("/metautils/cnx_pool/no_retry_timeout", test_no_retry_timeout);
+	g_test_add_func("/metautils/cnx_pool/no_retry_partial", test_no_retry_partial);
+	g_test_add_func("/metautils/cnx_pool/no_connect", test_no_connect);
+	return g_test_run();
+}
@@ -0,0 +1,267 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <glib.h>
+#include <metautils/lib/metautils.h>
+
+/* The conscience is a program, its main() is renamed to reach the
+ * service types it manages. */
+#define main conscience_main
+#include "../../cluster/module/server.c"
+#undef main
+
+#define TYPE "rawx"
+
+static struct service_info_s *
+_make_service(guint port, gint64 cpu, const char *loc)
+{
+	struct service_info_s *si = g_malloc0(sizeof(*si));
+	g_strlcpy(si->ns_name, "NS", sizeof(si->ns_name));
+	g_strlcpy(si->type, TYPE, sizeof(si->type));
+	gchar url[STRLEN_ADDRINFO];
+	g_snprintf(url, sizeof(url), "127.0.0.1:%u", port);
+	g_assert_true(grid_string_to_addrinfo(url, &si->addr));
+	si->score.value = SCORE_UNSET;
+	si->tags = g_ptr_array_new();
+	service_tag_set_value_string(
+			service_info_ensure_tag(si->tags, "tag.loc"), loc);
+	service_tag_set_value_i64(
+			service_info_ensure_tag(si->tags, "stat.cpu"), cpu);
+	return si;
+}
+
+static void
+_push(guint port, gint64 cpu, const char *loc)
+{
+	struct service_info_s *si = _make_service(port, cpu, loc);
+	service_info_dated_free(push_service(si));
+	service_info_clean(si);
+}
+
+static void
+_remove(guint port)
+{
+	struct service_info_s *si = _make_service(port, 0, "");
+	service_info_dated_free(rm_service(si));
+	service_info_clean(si);
+}
+
+struct changes_s
+{
+	GSList *ports;  /* the ports of the services changed */
+	GSList *removed;  /* <struct service_info_s*> */
+	gint64 generation;
+	gboolean delta;
+};
+
+static void
+_changes_clean(struct changes_s *c)
+{
+	g_slist_free(c->ports);
+	g_slist_free_full(c->removed, (GDestroyNotify)service_info_clean);
+	memset(c, 0, sizeof(*c));
+}
+
+static gboolean
+_collect_port(struct conscience_srv_s *srv, gpointer u)
+{
+	struct changes_s *c = u;
+	const guint port = g_ntohs(srv->addr.port);
+	c->ports = g_slist_prepend(c->ports, GUINT_TO_POINTER(port));
+	return TRUE;
+}
+
+static void
+_changes(gint64 since, struct changes_s *c)
+{
+	_changes_clean(c);
+	GError *err = conscience_run_srvtype_changes(TYPE, since,
+			_collect_port, c, &c->removed, &c->generation, &c->delta);
+	g_assert_no_error(err);
+}
+
+static void
+_setup(void)
+{
+	g_rw_lock_init(&rwlock_srv);
+	srvtypes = g_tree_new_full(metautils_strcmp3, NULL,
+			g_free, (GDestroyNotify) conscience_srvtype_destroy);
+	nsname = g_strdup("NS");
+	epoch = oio_ext_real_time();
+
+	/* A constant score, whatever the variations */
+	struct conscience_srvtype_s *srvtype = conscience_get_srvtype(TYPE, TRUE);
+	srvtype->score_variation_bound = 0;
+}
+
+static void
+_teardown(void)
+{
+	g_tree_destroy(srvtypes);
+	srvtypes = NULL;
+	g_rw_lock_clear(&rwlock_srv);
+	oio_str_clean(&nsname);
+}
+
+static void
+test_changes_generation(void)
+{
+	_setup();
+	struct changes_s c = {};
+
+	_push(6000, 10, "a");
+	_push(6001, 10, "b");
+	_changes(0, &c);
+	g_assert_false(c.delta);
+	g_assert_cmpuint(2, ==, g_slist_length(c.ports));
+	const gint64 g0 = c.generation;
+	g_assert_cmpint(g0, >, 0);
+
+	/* Nothing changed, nothing sent */
+	_push(6000, 10, "a");
+	_changes(g0, &c);
+	g_assert_true(c.delta);
+	g_assert_cmpint(g0, ==, c.generation);
+	g_assert_null(c.ports);
+	g_assert_null(c.removed);
+
+	/* A new "tag." tag then a new "stat." tag are both sent */
+	_push(6000, 10, "c");
+	_changes(g0, &c);
+	g_assert_true(c.delta);
+	g_assert_cmpint(g0, <, c.generation);
+	g_assert_cmpuint(1, ==, g_slist_length(c.ports));
+	g_assert_cmpuint(6000, ==, GPOINTER_TO_UINT(c.ports->data));
+	const gint64 g1 = c.generation;
+
+	_push(6001, 20, "b");
+	_changes(g1, &c);
+	g_assert_true(c.delta);
+	g_assert_cmpuint(1, ==, g_slist_length(c.ports));
+	g_assert_cmpuint(6001, ==, GPOINTER_TO_UINT(c.ports->data));
+	const gint64 g2 = c.generation;
+
+	/* A removal only lists the service removed */
+	_remove(6000);
+	_changes(g2, &c);
+	g_assert_true(c.delta);
+	g_assert_null(c.ports);
+	g_assert_cmpuint(1, ==, g_slist_length(c.removed));
+	struct service_info_s *rm = c.removed->data;
+	g_assert_cmpuint(6000, ==, g_ntohs(rm->addr.port));
+	g_assert_cmpstr(TYPE, ==, rm->type);
+
+	/* Since an older generation, all the changes are cumulated */
+	_changes(g0, &c);
+	g_assert_true(c.delta);
+	g_assert_cmpuint(1, ==, g_slist_length(c.ports));
+	g_assert_cmpuint(1, ==, g_slist_length(c.removed));
+
+	/* A generation from the future cannot be trusted */
+	_changes(c.generation + 1, &c);
+	g_assert_false(c.delta);
+	g_assert_cmpuint(1, ==, g_slist_length(c.ports));
+	g_assert_null(c.removed);
+
+	_changes_clean(&c);
+	_teardown();
+}
+
+static void
+test_changes_removed_floor(void)
+{
+	_setup();
+	struct changes_s c = {};
+
+	_push(6000, 10, "a");
+	_changes(0, &c);
+	const gint64 g0 = c.generation;
+
+	/* Fill the list of the removed services, until its oldest half is
+	 * forgotten. */
+	for (guint i = 0; i <= LIMIT_REMOVED_SERVICES; i++) {
+		_push(7000 + i, 10, "a");
+		_remove(7000 + i);
+	}
+	struct conscience_srvtype_s *srvtype = conscience_get_srvtype(TYPE, FALSE);
+	g_assert_cmpuint(srvtype->removed->len, ==,
+			(LIMIT_REMOVED_SERVICES + 1) - (LIMIT_REMOVED_SERVICES + 1) / 2);
+	g_assert_cmpint(srvtype->removed_floor, >, g0);
+
+	/* The clients knowing an older generation receive the full list */
+	_changes(g0, &c);
+	g_assert_false(c.delta);
+	g_assert_cmpuint(1, ==, g_slist_length(c.ports));
+	g_assert_null(c.removed);
+
+	/* Those knowing the floor receive the removals they missed */
+	_changes(srvtype->removed_floor, &c);
+	g_assert_true(c.delta);
+	g_assert_null(c.ports);
+	g_assert_cmpuint(srvtype->removed->len, ==, g_slist_length(c.removed));
+
+	/* A flush forgets all the removals */
+	const gint64 g1 = c.generation;
+	conscience_srvtype_flush(srvtype);
+	_changes(g1, &c);
+	g_assert_false(c.delta);
+	g_assert_null(c.ports);
+	g_assert_null(c.removed);
+
+	_changes_clean(&c);
+	_teardown();
+}
+
+static void
+test_changes_epoch(void)
+{
+	_setup();
+
+	void _check(gint64 e, gint64 g, gint64 expected) {
+		MESSAGE req = metautils_message_create_named("CS_SRV", 0);
+		if (e)
+			metautils_message_add_field_strint64(req, NAME_MSGKEY_EPOCH, e);
+		if (g)
+			metautils_message_add_field_strint64(
+					req, NAME_MSGKEY_GENERATION, g);
+		g_assert_cmpint(expected, ==, _cs_request_since(req));
+		metautils_message_destroy(req);
+	}
+
+	_check(0, 0, 0);
+	_check(epoch, 0, 0);
+	_check(0, 12, 0);
+	_check(epoch, 12, 12);
+	/* Numbered by another run of the conscience: a full reload */
+	_check(epoch - 1, 12, 0);
+
+	_teardown();
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc, argv);
+	g_test_add_func("/cluster/conscience/changes/generation",
+			test_changes_generation);
+	g_test_add_func("/cluster/conscience/changes/removed_floor",
+			test_changes_removed_floor);
+	g_test_add_func("/cluster/conscience/changes/epoch",
+			test_changes_epoch);
+	return g_test_run();
+}
@@ -0,0 +1,306 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <math.h>
+
+#include <glib.h>
+#include <metautils/lib/metautils.h>
+#include <cluster/module/expr.h>
+
+/* The values of the "stat." accessors. "stat.none" is undefined. */
+static const struct { const char *name; double value; } stats[] = {
+	{"stat.cpu", 42.5},
+	{"stat.io", 7},
+	{"stat.zero", 0},
+	{"stat.neg", -3},
+	{"stat.big", 1e300},
+	{"stat.nan", NAN},
+	{"stat.inf", INFINITY},
+	{NULL, 0}
+};
+
+static gboolean
+_get_stat(const char *name, double *pD)
+{
+	for (guint i = 0; stats[i].name; i++) {
+		if (!strcmp(name, stats[i].name)) {
+			*pD = stats[i].value;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static int
+_interpret(struct expr_s *pE, double *pD)
+{
+	gchar *getStat(const char *f) {
+		gchar name[64];
+		double d = 0;
+		g_snprintf(name, sizeof(name), "stat.%s", f);
+		if (!_get_stat(name, &d))
+			return NULL;
+		return g_strdup_printf("%.17g", d);
+	}
+	accessor_f *getAcc(const char *b) {
+		return strcmp(b, "stat") ? NULL : getStat;
+	}
+	return expr_evaluate(pD, pE, getAcc);
+}
+
+static int
+_run(struct expr_program_s *prog, double *pD)
+{
+	const guint max = expr_program_count_vars(prog);
+	double vars[max + 1];
+	guint8 defined[max + 1];
+	for (guint i = 0; i < max; i++)
+		defined[i] = _get_stat(expr_program_get_var(prog, i), vars + i);
+	return expr_program_run(prog, vars, defined, pD);
+}
+
+/* Check the program compiled from <pE> computes what the interpreter does,
+ * then free <pE>. */
+static void
+_check(struct expr_s *pE)
+{
+	g_assert_nonnull(pE);
+	struct expr_program_s *prog = expr_compile(pE);
+	g_assert_nonnull(prog);
+
+	double d0 = 0, d1 = 0;
+	const int rc0 = _interpret(pE, &d0);
+	const int rc1 = _run(prog, &d1);
+	g_assert_cmpint(rc0, ==, rc1);
+	if (rc0 == EXPR_EVAL_DEF) {
+		if (isnan(d0))
+			g_assert_true(isnan(d1));
+		else
+			g_assert_cmpfloat(d0, ==, d1);
+	}
+
+	expr_program_free(prog);
+	expr_clean(pE);
+}
+
+static struct expr_s *
+_num(double d)
+{
+	struct expr_s *pE = g_malloc0(sizeof(*pE));
+	pE->type = VAL_NUM_ET;
+	pE->expr.num = d;
+	return pE;
+}
+
+static struct expr_s *
+_str(const char *s)
+{
+	struct expr_s *pE = g_malloc0(sizeof(*pE));
+	pE->type = VAL_STR_ET;
+	pE->expr.str = g_strdup(s);
+	return pE;
+}
+
+static struct expr_s *
+_acc(const char *field)
+{
+	struct expr_s *pE = g_malloc0(sizeof(*pE));
+	pE->type = ACC_ET;
+	pE->expr.acc.base = g_strdup("stat");
+	pE->expr.acc.field = g_strdup(field);
+	return pE;
+}
+
+static struct expr_s *
+_unary(enum expr_type_e type, struct expr_s *p)
+{
+	struct expr_s *pE = g_malloc0(sizeof(*pE));
+	pE->type = type;
+	pE->expr.unary = p;
+	return pE;
+}
+
+static struct expr_s *
+_binary(enum expr_type_e type, struct expr_s *p1, struct expr_s *p2)
+{
+	struct expr_s *pE = g_malloc0(sizeof(*pE));
+	pE->type = type;
+	pE->expr.bin.p1 = p1;
+	pE->expr.bin.p2 = p2;
+	return pE;
+}
+
+/* The operands, from the safest to the wildest. Those before
+ * INTEGER_OPERANDS may be converted to an int, those before
+ * NONZERO_OPERANDS are not zero once converted. */
+#define NONZERO_OPERANDS 7
+#define INTEGER_OPERANDS 10
+#define ALL_OPERANDS 14
+
+static struct expr_s *
+_operand(guint i)
+{
+	switch (i) {
+		case 0: return _num(1);
+		case 1: return _num(-2.5);
+		case 2: return _num(42.5);
+		case 3: return _unary(UN_STRNUM_ET, _acc("cpu"));
+		case 4: return _unary(UN_STRNUM_ET, _acc("neg"));
+		case 5: return _unary(UN_STRNUM_ET, _acc("none"));
+		case 6: return _str("12");
+		case 7: return _num(0);
+		case 8: return _unary(UN_STRNUM_ET, _acc("zero"));
+		case 9: return _unary(UN_STRNUM_ET, _str("0.25"));
+		case 10: return _unary(UN_STRNUM_ET, _acc("big"));
+		case 11: return _unary(UN_STRNUM_ET, _acc("nan"));
+		case 12: return _unary(UN_STRNUM_ET, _acc("inf"));
+		case 13: return _unary(UN_STRNUM_ET, _num(-0.5));
+	}
+	g_assert_not_reached();
+	return NULL;
+}
+
+static void
+test_unary(void)
+{
+	for (guint i = 0; i < ALL_OPERANDS; i++) {
+		_check(_operand(i));
+		_check(_unary(UN_NUMSUP_ET, _operand(i)));
+		_check(_unary(UN_NUMINF_ET, _operand(i)));
+	}
+	for (guint i = 0; i < INTEGER_OPERANDS; i++)
+		_check(_unary(UN_NUMNOT_ET, _operand(i)));
+}
+
+static void
+test_binary(void)
+{
+	static const enum expr_type_e types[] = {
+		BIN_NUMCMP_ET, BIN_NUMEQ_ET, BIN_NUMNEQ_ET,
+		BIN_NUMLT_ET, BIN_NUMLE_ET, BIN_NUMGT_ET, BIN_NUMGE_ET,
+		BIN_NUMADD_ET, BIN_NUMSUB_ET, BIN_NUMMUL_ET, BIN_NUMDIV_ET,
+		BIN_NUMAND_ET, BIN_NUMOR_ET, BIN_ROOT_ET,
+	};
+	for (guint t = 0; t < G_N_ELEMENTS(types); t++) {
+		for (guint i = 0; i < ALL_OPERANDS; i++) {
+			for (guint j = 0; j < ALL_OPERANDS; j++)
+				_check(_binary(types[t], _operand(i), _operand(j)));
+		}
+	}
+}
+
+/* The operations on integers are only checked with operands that can be
+ * converted to an int, and the interpreter traps on a modulo by zero. */
+static void
+test_binary_int(void)
+{
+	for (guint i = 0; i < INTEGER_OPERANDS; i++) {
+		for (guint j = 0; j < INTEGER_OPERANDS; j++)
+			_check(_binary(BIN_NUMXOR_ET, _operand(i), _operand(j)));
+		for (guint j = 0; j < NONZERO_OPERANDS; j++)
+			_check(_binary(BIN_NUMMOD_ET, _operand(i), _operand(j)));
+	}
+
+	struct expr_s *pE = _binary(BIN_NUMMOD_ET, _num(7), _num(0));
+	struct expr_program_s *prog = expr_compile(pE);
+	double d = -1;
+	g_assert_cmpint(EXPR_EVAL_DEF, ==, expr_program_run(prog, NULL, NULL, &d));
+	g_assert_cmpfloat(0, ==, d);
+	expr_program_free(prog);
+	expr_clean(pE);
+}
+
+static void
+test_strings(void)
+{
+	_check(_unary(UN_STRLEN_ET, _str("abc")));
+	_check(_unary(UN_STRNUM_ET, _str("12.5")));
+	_check(_binary(BIN_STRCMP_ET, _str("abc"), _str("abc")));
+	_check(_binary(BIN_STRCMP_ET, _str("abc"), _str("abd")));
+	_check(_binary(BIN_NUMADD_ET, _str("abc"), _num(1)));
+}
+
+static void
+test_parsed(void)
+{
+	static const char *expressions[] = {
+		"100",
+		"root(2,((num stat.cpu)*(num stat.io)))",
+		"root(3,((num stat.cpu)*(num stat.io)*(num stat.zero)))",
+		"root(3,((num stat.cpu)*(num stat.nan)*(num stat.io)))",
+		"root(num stat.zero,(num stat.cpu))",
+		"((num stat.cpu) - 50) / ((num stat.io) - 7)",
+		"((num stat.big) * (num stat.big)) - (num stat.inf)",
+		"(num stat.cpu) + (num stat.none)",
+		"((num stat.cpu) <= 50) * 100",
+		"((num stat.cpu) == (num stat.cpu)) + ((num stat.nan) != 0)",
+		"num \"12\"",
+		"\"abc\" + 1",
+		NULL
+	};
+	for (const char **p = expressions; *p; p++) {
+		struct expr_s *pE = NULL;
+		g_assert_cmpint(0, ==, expr_parse(*p, &pE));
+		_check(pE);
+	}
+}
+
+static void
+test_errors(void)
+{
+	/* The accessors used as strings cannot be compiled */
+	struct expr_s *uncompilable[] = {
+		_acc("cpu"),
+		_unary(UN_STRLEN_ET, _acc("cpu")),
+		_binary(BIN_STRCMP_ET, _acc("cpu"), _str("42.5")),
+		_binary(BIN_NUMADD_ET, _num(1), _acc("cpu")),
+		_unary(UN_STRNUM_ET, _str("abc")),
+		NULL
+	};
+	for (struct expr_s **ppE = uncompilable; *ppE; ppE++) {
+		g_assert_null(expr_compile(*ppE));
+		expr_clean(*ppE);
+	}
+	g_assert_null(expr_compile(NULL));
+
+	/* Both fail alike on invalid arguments */
+	double d = 0;
+	g_assert_cmpint(EXPR_EVAL_ERROR, ==,
+			expr_program_run(NULL, NULL, NULL, &d));
+	struct expr_s *pE = _num(1);
+	struct expr_program_s *prog = expr_compile(pE);
+	g_assert_cmpint(EXPR_EVAL_ERROR, ==,
+			expr_program_run(prog, NULL, NULL, NULL));
+	g_assert_cmpint(EXPR_EVAL_ERROR, ==, expr_evaluate(&d, pE, NULL));
+	g_assert_cmpint(EXPR_EVAL_ERROR, ==, expr_evaluate(NULL, pE, NULL));
+	expr_program_free(prog);
+	expr_clean(pE);
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc, argv);
+	g_test_add_func("/cluster/expr/unary", test_unary);
+	g_test_add_func("/cluster/expr/binary", test_binary);
+	g_test_add_func("/cluster/expr/binary_int", test_binary_int);
+	g_test_add_func("/cluster/expr/strings", test_strings);
+	g_test_add_func("/cluster/expr/parsed", test_parsed);
+	g_test_add_func("/cluster/expr/errors", test_errors);
+	return g_test_run();
+}
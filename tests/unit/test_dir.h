@@ -0,0 +1,60 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#ifndef OIO_SDS__tests__unit__test_dir_h
+# define OIO_SDS__tests__unit__test_dir_h 1
+
+# include <glib.h>
+# include <glib/gstdio.h>
+
+/* Creates a new temporary directory, to be removed with test_remove_dir() */
+static inline gchar *
+test_make_dir(void)
+{
+	GError *err = NULL;
+	gchar *path = g_dir_make_tmp("test-oio-XXXXXX", &err);
+	g_assert_no_error(err);
+	return path;
+}
+
+/* Removes <path> and everything under it */
+static inline void
+test_remove_tree(const gchar *path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if (dir) {
+		for (const gchar *name; (name = g_dir_read_name(dir));) {
+			gchar *p = g_build_filename(path, name, NULL);
+			test_remove_tree(p);
+			g_free(p);
+		}
+		g_dir_close(dir);
+		g_rmdir(path);
+	} else {
+		g_remove(path);
+	}
+}
+
+static inline void
+test_remove_dir(gchar *path)
+{
+	test_remove_tree(path);
+	g_free(path);
+}
+
+#endif /*OIO_SDS__tests__unit__test_dir_h*/
@@ -0,0 +1,152 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <core/oioext.h>
+#include <core/oiostr.h>
+#include <core/ec.h>
+
+#define CHUNK_METHOD "ec/algo=liberasurecode_rs_vand,k=6,m=3"
+
+static void
+test_create(void)
+{
+	struct oio_ec_s *ec = NULL;
+	GError *err = oio_ec_create(CHUNK_METHOD, &ec);
+	if (!oio_ec_available()) {
+		g_assert_nonnull(err);
+		g_assert_null(ec);
+		g_clear_error(&err);
+		return;
+	}
+	g_assert_no_error(err);
+	g_assert_nonnull(ec);
+	g_assert_cmpuint(6, ==, oio_ec_get_k(ec));
+	g_assert_cmpuint(3, ==, oio_ec_get_m(ec));
+	g_assert_cmpuint(7, ==, oio_ec_get_quorum(ec));
+	oio_ec_destroy(ec);
+
+	static const char *invalid[] = {
+		"ec/algo=liberasurecode_rs_vand,m=3",
+		"ec/algo=liberasurecode_rs_vand,k=6",
+		"ec/k=6,m=3",
+		"ec/algo=nope,k=6,m=3",
+		NULL
+	};
+	for (const char **p = invalid; *p; ++p) {
+		err = oio_ec_create(*p, &ec);
+		g_assert_nonnull(err);
+		g_assert_null(ec);
+		g_clear_error(&err);
+	}
+}
+
+static void
+_test_round_trip(gsize len)
+{
+	struct oio_ec_s *ec = NULL;
+	GError *err = oio_ec_create(CHUNK_METHOD, &ec);
+	g_assert_no_error(err);
+
+	const guint k = oio_ec_get_k(ec), m = oio_ec_get_m(ec);
+	guint8 *data = g_malloc(len);
+	oio_buf_randomize(data, len);
+
+	GByteArray *fragments[k + m];
+	err = oio_ec_encode(ec, data, len, fragments);
+	g_assert_no_error(err);
+	const gsize frag_size = oio_ec_fragment_size(ec, len);
+	for (guint i = 0; i < k + m; ++i)
+		g_assert_cmpuint(fragments[i]->len, ==, frag_size);
+
+	/* Lose the first m fragments, i.e. only data fragments */
+	guint8 *available[k];
+	for (guint i = 0; i < k; ++i)
+		available[i] = fragments[m + i]->data;
+
+	GByteArray *decoded = g_byte_array_new();
+	err = oio_ec_decode(ec, available, k, frag_size, decoded);
+	g_assert_no_error(err);
+	g_assert_cmpuint(decoded->len, ==, len);
+	g_assert_true(0 == memcmp(data, decoded->data, len));
+
+	/* Not enough fragments */
+	g_byte_array_set_size(decoded, 0);
+	err = oio_ec_decode(ec, available, k - 1, frag_size, decoded);
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+
+	g_byte_array_free(decoded, TRUE);
+	for (guint i = 0; i < k + m; ++i)
+		g_byte_array_free(fragments[i], TRUE);
+	g_free(data);
+	oio_ec_destroy(ec);
+}
+
+static void
+test_round_trip(void)
+{
+	if (!oio_ec_available()) {
+		g_test_skip("built without liberasurecode");
+		return;
+	}
+	_test_round_trip(1);
+	_test_round_trip(4097);
+	_test_round_trip(OIO_EC_SEGMENT_SIZE);
+}
+
+/* The upload of a metachunk with exactly k chunks stored has no parity at
+ * all, it is refused as by the other SDKs. */
+static void
+test_quorum(void)
+{
+	if (!oio_ec_available()) {
+		g_test_skip("built without liberasurecode");
+		return;
+	}
+	static const char *methods[] = {
+		"ec/algo=liberasurecode_rs_vand,k=6,m=3",
+		"ec/algo=liberasurecode_rs_vand,k=2,m=1",
+		"ec/algo=liberasurecode_rs_vand,k=12,m=4",
+		NULL
+	};
+	for (const char **p = methods; *p; ++p) {
+		struct oio_ec_s *ec = NULL;
+		g_assert_no_error(oio_ec_create(*p, &ec));
+		const guint k = oio_ec_get_k(ec), m = oio_ec_get_m(ec);
+		const guint quorum = oio_ec_get_quorum(ec);
+		g_assert_cmpuint(k, <, quorum);
+		g_assert_cmpuint(k + 1, ==, quorum);
+		g_assert_cmpuint(quorum, <=, k + m);
+		oio_ec_destroy(ec);
+	}
+	g_assert_cmpuint(0, ==, oio_ec_get_quorum(NULL));
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc,argv);
+	g_test_add_func("/core/ec/create", test_create);
+	g_test_add_func("/core/ec/round_trip", test_round_trip);
+	g_test_add_func("/core/ec/quorum", test_quorum);
+	return g_test_run();
+}
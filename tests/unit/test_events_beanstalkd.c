@@ -1,6 +1,6 @@
 /*
 OpenIO SDS unit tests
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -35,6 +35,8 @@ License along with this library.
 
 #include "../../events/oio_events_queue_beanstalkd.c"
 
+#include "test_dir.h"
+
 #define BAD_FORMAT_STR "BAD_FORMAT\r\n"
 #define OUT_OF_MEMORY_STR "OUT_OF_MEMORY\r\n"
 #define INTERNAL_ERROR_STR "INTERNAL_ERROR\r\n"
@@ -54,6 +56,7 @@ _intercept_running_hook(struct _queue_BEANSTALKD_s *q)
 
 static void
 _wrap_with_beanstalkd (gchar ** requests, gchar ** replies,
+		void (*prepare_hook) (struct oio_events_queue_s *q),
 		void (*test_hook) (struct oio_events_queue_s *q))
 {
 	gchar ** next_request = requests;
@@ -174,6 +177,9 @@ retry:
 
 	intercept_running = _intercept_running_hook;
 
+	if (prepare_hook)
+		(*prepare_hook)(q);
+
 	oio_events_queue__start (q);
 
 	if (test_hook)
@@ -249,7 +255,8 @@ test_with_check (void)
 	}
 
 	oio_events_beanstalkd_check_period = G_TIME_SPAN_SECOND; /* != 0 */
-	_wrap_with_beanstalkd(requests, replies, t);
+	oio_events_beanstalkd_window = 1;
+	_wrap_with_beanstalkd(requests, replies, NULL, t);
 }
 
 static void
@@ -306,7 +313,183 @@ test_without_check (void)
 	}
 
 	oio_events_beanstalkd_check_period = 0;
-	_wrap_with_beanstalkd(requests, replies, t);
+	oio_events_beanstalkd_window = 1;
+	_wrap_with_beanstalkd(requests, replies, NULL, t);
+}
+
+static void
+test_pipelined (void)
+{
+	gchar *requests[] = {
+		"use [A-Za-z0-9]+\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "1\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "2\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "3\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "4\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "5\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "6\\R",
+
+		/* Only the event that has not been acknowledged is sent again */
+		"use [A-Za-z0-9]+\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "3\\R",
+		NULL
+	};
+	gchar *replies[] = {
+		"USING oio\r\n",
+
+		"", "INSERTED 1\r\n",
+		"", "INSERTED 2\r\n",
+		"", "OUT_OF_MEMORY\r\n",
+		"", "INSERTED 4\r\n",
+		"", "ARGL 5\r\n",
+		"", "INSERTED 6\r\n",
+
+		"USING oio\r\n",
+		"", "INSERTED 3\r\n",
+		NULL
+	};
+
+	void check_return (GError *err) {
+		static volatile guint i = 0;
+		gboolean expected[] = {
+			TRUE,
+			TRUE, TRUE, FALSE, TRUE, FALSE, TRUE,
+			TRUE, TRUE,
+		};
+		if (expected[i++])
+			g_assert_no_error(err);
+		else
+			g_assert_nonnull(err);
+	}
+	void t(struct oio_events_queue_s *self) {
+		struct _queue_BEANSTALKD_s *q = (struct _queue_BEANSTALKD_s*) self;
+		intercept_errors = check_return;
+		/* All the events are available at once, they are sent in the
+		 * same window */
+		g_async_queue_lock(q->queue);
+		g_async_queue_push_unlocked(q->queue, g_strdup("1"));
+		g_async_queue_push_unlocked(q->queue, g_strdup("2"));
+		g_async_queue_push_unlocked(q->queue, g_strdup("3"));
+		g_async_queue_push_unlocked(q->queue, g_strdup("4"));
+		g_async_queue_push_unlocked(q->queue, g_strdup("5"));
+		g_async_queue_push_unlocked(q->queue, g_strdup("6"));
+		g_async_queue_unlock(q->queue);
+	}
+
+	oio_events_beanstalkd_check_period = 0;
+	oio_events_beanstalkd_window = 8;
+	_wrap_with_beanstalkd(requests, replies, NULL, t);
+}
+
+static void
+test_spool (void)
+{
+	gchar *requests[] = {
+		"use [A-Za-z0-9]+\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "1\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "2\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "3\\R",
+		"put [[:digit:]]+ [[:digit:]]+ [[:digit:]]+ [[:digit:]]+\\R", "4\\R",
+		NULL
+	};
+	gchar *replies[] = {
+		"USING fake\r\n",
+		"", "INSERTED 1\r\n",
+		"", "INSERTED 2\r\n",
+		"", "INSERTED 3\r\n",
+		"", "INSERTED 4\r\n",
+		NULL
+	};
+
+	gchar *dir = test_make_dir();
+	gchar *path = NULL;
+
+	void prepare(struct oio_events_queue_s *self) {
+		struct _queue_BEANSTALKD_s *q = (struct _queue_BEANSTALKD_s*) self;
+		gchar *name = g_strdup_printf("%s@%s", q->tube, q->endpoint);
+		path = g_build_filename(dir, name, NULL);
+		g_free(name);
+
+		/* A previous run spooled two events, and exited after it read the
+		 * first one, before it acknowledged it */
+		struct oio_events_spool_s *sp = NULL;
+		g_assert_no_error(oio_events_spool_open(path, &sp));
+		g_assert_no_error(oio_events_spool_append(sp, "1", 1));
+		g_assert_no_error(oio_events_spool_append(sp, "2", 1));
+		GPtrArray *batch = g_ptr_array_new_with_free_func(g_free);
+		g_assert_cmpuint(1, ==, oio_events_spool_read(sp, batch, 1));
+		g_ptr_array_free(batch, TRUE);
+		oio_events_spool_close(sp);
+
+		/* Both are replayed. The new events are appended to the spool, the
+		 * worker is woken up only once. */
+		g_assert_no_error(oio_events_queue__set_spool(self, dir));
+		oio_events_queue__send(self, g_strdup("3"));
+		oio_events_queue__send(self, g_strdup("4"));
+		g_assert_cmpint(1, ==, g_async_queue_length(q->queue));
+		struct oio_events_spool_stats_s st = {};
+		oio_events_spool_get_stats(q->spool, &st);
+		g_assert_cmpuint(4, ==, st.backlog);
+	}
+
+	void t(struct oio_events_queue_s *self) {
+		struct _queue_BEANSTALKD_s *q = (struct _queue_BEANSTALKD_s*) self;
+		/* The events are acknowledged in the spool once all have been put */
+		const gint64 deadline =
+			oio_ext_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+		for (;;) {
+			struct oio_events_spool_stats_s st = {};
+			oio_events_spool_get_stats(q->spool, &st);
+			if (!st.backlog)
+				break;
+			g_assert_cmpint(oio_ext_monotonic_time(), <, deadline);
+			g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+		}
+	}
+
+	oio_events_beanstalkd_check_period = 0;
+	oio_events_beanstalkd_window = 8;
+	_wrap_with_beanstalkd(requests, replies, prepare, t);
+
+	/* Nothing is replayed at the next start */
+	struct oio_events_spool_s *sp = NULL;
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+	GPtrArray *batch = g_ptr_array_new_with_free_func(g_free);
+	g_assert_cmpuint(0, ==, oio_events_spool_read(sp, batch, 16));
+	g_ptr_array_free(batch, TRUE);
+	oio_events_spool_close(sp);
+
+	test_remove_dir(dir);
+	g_free(path);
+}
+
+static void
+test_spool_lost (void)
+{
+	gchar *dir = test_make_dir();
+	struct oio_events_queue_s *self = NULL;
+	g_assert_no_error(oio_events_queue_factory__create_beanstalkd(
+				"127.0.0.1:6014", "fake", &self));
+	struct _queue_BEANSTALKD_s *q = (struct _queue_BEANSTALKD_s*) self;
+	g_assert_no_error(oio_events_queue__set_spool(self, dir));
+
+	/* One event in the spool, one kept in memory after a failed append */
+	oio_events_queue__send(self, g_strdup("1"));
+	gchar *msg = g_strdup("2");
+	_q_keep_unspooled(q, msg);
+	g_async_queue_push(q->queue, msg);
+
+	/* Only the latter is lost when the worker exits */
+	struct _running_ctx_s ctx = {};
+	g_queue_init(&ctx.inflight);
+	g_assert_cmpuint(1, ==, _q_flush_pending(q, &ctx));
+	g_assert_cmpint(0, ==, g_atomic_int_get(&q->unspooled_count));
+	struct oio_events_spool_stats_s st = {};
+	oio_events_spool_get_stats(q->spool, &st);
+	g_assert_cmpuint(1, ==, st.backlog);
+
+	oio_events_queue__destroy(self);
+	test_remove_dir(dir);
 }
 
 int
@@ -315,6 +498,9 @@ main(int argc, char **argv)
 	HC_TEST_INIT(argc, argv);
 	g_test_add_func("/event/beanstalkd/with_check", test_with_check);
 	g_test_add_func("/event/beanstalkd/without_check", test_without_check);
+	g_test_add_func("/event/beanstalkd/pipelined", test_pipelined);
+	g_test_add_func("/event/beanstalkd/spool", test_spool);
+	g_test_add_func("/event/beanstalkd/spool_lost", test_spool_lost);
 	server_fd_max_passive = metautils_syscall_count_maxfd();
 	return g_test_run();
 }
@@ -20,9 +20,12 @@ License along with this library.
 #include <zmq.h>
 
 #include <core/oio_core.h>
+#include <core/internals.h>
 #include <events/events_variables.h>
 #include <events/oio_events_queue.h>
 
+#include "test_dir.h"
+
 static void
 test_queue_stalled (void)
 {
@@ -62,11 +65,46 @@ test_queue_init (void)
 	g_slist_free_full (l, (GDestroyNotify)oio_events_queue__destroy);
 }
 
+/* Two queues of a service, to the same tube, both spooled under the same
+ * directory, as the notifiers of meta1 are by default */
+static void
+test_queue_spool_named (void)
+{
+	gchar *dir = test_make_dir();
+	struct oio_events_queue_s *q0 = NULL, *q1 = NULL;
+	g_assert_no_error(oio_events_queue_factory__create(
+				"beanstalk://127.0.0.1:1", "oio", &q0));
+	g_assert_no_error(oio_events_queue_factory__create(
+				"beanstalk://127.0.0.1:1", "oio", &q1));
+
+	/* The same spool cannot be shared */
+	g_assert_no_error(oio_events_queue__set_spool(q0, dir));
+	GError *err = oio_events_queue__set_spool(q1, dir);
+	g_assert_nonnull(err);
+	g_assert_cmpint(err->code, ==, CODE_UNAVAILABLE);
+	g_clear_error(&err);
+	oio_events_queue__destroy(q0);
+	oio_events_queue__destroy(q1);
+
+	q0 = q1 = NULL;
+	g_assert_no_error(oio_events_queue_factory__create(
+				"beanstalk://127.0.0.1:1", "oio", &q0));
+	g_assert_no_error(oio_events_queue_factory__create(
+				"beanstalk://127.0.0.1:1", "oio", &q1));
+	g_assert_no_error(oio_events_queue__set_spool_named(q0, dir, "services"));
+	g_assert_no_error(oio_events_queue__set_spool_named(q1, dir, "references"));
+	oio_events_queue__destroy(q0);
+	oio_events_queue__destroy(q1);
+
+	test_remove_dir(dir);
+}
+
 int
 main(int argc, char **argv)
 {
 	HC_TEST_INIT(argc,argv);
 	g_test_add_func("/events/queue/init", test_queue_init);
 	g_test_add_func("/events/queue/clogged", test_queue_stalled);
+	g_test_add_func("/events/queue/spool_named", test_queue_spool_named);
 	return g_test_run();
 }
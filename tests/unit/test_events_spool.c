@@ -0,0 +1,234 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <core/oio_core.h>
+#include <core/internals.h>
+#include <events/events_variables.h>
+#include <events/oio_events_spool.h>
+
+#include "test_dir.h"
+
+static guint
+_count_segments(const gchar *path)
+{
+	guint count = 0;
+	GDir *dir = g_dir_open(path, 0, NULL);
+	g_assert_nonnull(dir);
+	for (const gchar *name; (name = g_dir_read_name(dir));)
+		count += g_str_has_suffix(name, ".seg");
+	g_dir_close(dir);
+	return count;
+}
+
+static void
+_append(struct oio_events_spool_s *sp, guint i)
+{
+	gchar msg[64];
+	g_snprintf(msg, sizeof(msg), "{\"event\":%u}", i);
+	g_assert_no_error(oio_events_spool_append(sp, msg, strlen(msg)));
+}
+
+/* Read <count> events and check they are the next ones expected */
+static void
+_check_read(struct oio_events_spool_s *sp, guint first, guint count)
+{
+	GPtrArray *out = g_ptr_array_new_with_free_func(g_free);
+	g_assert_cmpuint(oio_events_spool_read(sp, out, count), ==, count);
+	for (guint i = 0; i < count; ++i) {
+		gchar msg[64];
+		g_snprintf(msg, sizeof(msg), "{\"event\":%u}", first + i);
+		g_assert_cmpstr(out->pdata[i], ==, msg);
+	}
+	g_ptr_array_free(out, TRUE);
+}
+
+static void
+_check_empty(struct oio_events_spool_s *sp)
+{
+	GPtrArray *out = g_ptr_array_new_with_free_func(g_free);
+	g_assert_cmpuint(oio_events_spool_read(sp, out, 16), ==, 0);
+	g_ptr_array_free(out, TRUE);
+}
+
+static void
+test_append_read(void)
+{
+	gchar *path = test_make_dir();
+	struct oio_events_spool_s *sp = NULL;
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+
+	_check_empty(sp);
+	for (guint i = 0; i < 100; ++i)
+		_append(sp, i);
+	_check_read(sp, 0, 40);
+	g_assert_no_error(oio_events_spool_ack(sp));
+	_check_read(sp, 40, 60);
+	_check_empty(sp);
+
+	struct oio_events_spool_stats_s st = {};
+	oio_events_spool_get_stats(sp, &st);
+	g_assert_cmpuint(st.drained, ==, 40);
+	g_assert_cmpuint(st.backlog, ==, 60);
+	g_assert_cmpuint(st.bytes_written, >, st.bytes_in);
+
+	g_assert_no_error(oio_events_spool_ack(sp));
+	oio_events_spool_get_stats(sp, &st);
+	g_assert_cmpuint(st.drained, ==, 100);
+	g_assert_cmpuint(st.backlog, ==, 0);
+	g_assert_cmpuint(st.backlog_size, ==, 0);
+
+	oio_events_spool_close(sp);
+	test_remove_dir(path);
+}
+
+static void
+test_replay(void)
+{
+	gchar *path = test_make_dir();
+	struct oio_events_spool_s *sp = NULL;
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+	for (guint i = 0; i < 10; ++i)
+		_append(sp, i);
+	_check_read(sp, 0, 5);
+	g_assert_no_error(oio_events_spool_ack(sp));
+	/* Read but not acknowledged, it must be replayed */
+	_check_read(sp, 5, 3);
+	oio_events_spool_close(sp);
+
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+	struct oio_events_spool_stats_s st = {};
+	oio_events_spool_get_stats(sp, &st);
+	g_assert_cmpuint(st.backlog, ==, 5);
+	_append(sp, 10);
+	_check_read(sp, 5, 6);
+	_check_empty(sp);
+	g_assert_no_error(oio_events_spool_ack(sp));
+	oio_events_spool_close(sp);
+
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+	_check_empty(sp);
+	oio_events_spool_close(sp);
+	test_remove_dir(path);
+}
+
+static void
+test_segments(void)
+{
+	oio_events_spool_segment_size = 64 * 1024;
+
+	gchar *path = test_make_dir();
+	struct oio_events_spool_s *sp = NULL;
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+	for (guint i = 0; i < 10000; ++i)
+		_append(sp, i);
+	g_assert_cmpuint(_count_segments(path), >, 1);
+
+	/* An event larger than a segment gets a segment of its own */
+	gsize big_size = 2 * oio_events_spool_segment_size;
+	gchar *big = g_malloc(big_size + 1);
+	memset(big, 'x', big_size);
+	big[big_size] = 0;
+	g_assert_no_error(oio_events_spool_append(sp, big, big_size));
+	_append(sp, 10000);
+
+	for (guint i = 0; i < 10000; i += 1000) {
+		_check_read(sp, i, 1000);
+		g_assert_no_error(oio_events_spool_ack(sp));
+	}
+	GPtrArray *out = g_ptr_array_new_with_free_func(g_free);
+	g_assert_cmpuint(oio_events_spool_read(sp, out, 1), ==, 1);
+	g_assert_cmpstr(out->pdata[0], ==, big);
+	g_ptr_array_free(out, TRUE);
+	_check_read(sp, 10000, 1);
+	g_assert_no_error(oio_events_spool_ack(sp));
+
+	/* Only the segment being written remains */
+	g_assert_cmpuint(_count_segments(path), ==, 1);
+
+	g_free(big);
+	oio_events_spool_close(sp);
+	test_remove_dir(path);
+}
+
+static void
+test_torn_write(void)
+{
+	gchar *path = test_make_dir();
+	struct oio_events_spool_s *sp = NULL;
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+	for (guint i = 0; i < 3; ++i)
+		_append(sp, i);
+	oio_events_spool_close(sp);
+
+	/* Damage the last record, as if its write was interrupted.
+	 * Each record is an 8 bytes header and 16 bytes for "{"event":N}". */
+	gchar *seg = g_build_filename(path, "0000000000000000.seg", NULL);
+	gchar *content = NULL;
+	gsize len = 0;
+	g_assert_true(g_file_get_contents(seg, &content, &len, NULL));
+	content[2 * 24 + 8] = '#';
+	g_assert_true(g_file_set_contents(seg, content, len, NULL));
+	g_free(content);
+	g_free(seg);
+
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+	struct oio_events_spool_stats_s st = {};
+	oio_events_spool_get_stats(sp, &st);
+	g_assert_cmpuint(st.backlog, ==, 2);
+	_append(sp, 2);
+	_check_read(sp, 0, 3);
+	_check_empty(sp);
+	oio_events_spool_close(sp);
+	test_remove_dir(path);
+}
+
+static void
+test_exclusive(void)
+{
+	gchar *path = test_make_dir();
+	struct oio_events_spool_s *sp = NULL, *sp2 = NULL;
+	g_assert_no_error(oio_events_spool_open(path, &sp));
+
+	/* A second reader would replay and remove the records of the first */
+	GError *err = oio_events_spool_open(path, &sp2);
+	g_assert_nonnull(err);
+	g_assert_cmpint(err->code, ==, CODE_UNAVAILABLE);
+	g_assert_null(sp2);
+	g_clear_error(&err);
+
+	oio_events_spool_close(sp);
+	g_assert_no_error(oio_events_spool_open(path, &sp2));
+	oio_events_spool_close(sp2);
+	test_remove_dir(path);
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc,argv);
+	g_test_add_func("/events/spool/append_read", test_append_read);
+	g_test_add_func("/events/spool/replay", test_replay);
+	g_test_add_func("/events/spool/segments", test_segments);
+	g_test_add_func("/events/spool/torn_write", test_torn_write);
+	g_test_add_func("/events/spool/exclusive", test_exclusive);
+	return g_test_run();
+}
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS unit tests
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -261,6 +261,108 @@ test_down_peer(void)
 	metautils_pclose(&fd);
 }
 
+static void
+test_keepalive_not_connected(void)
+{
+	void test(const gchar *url) {
+		GByteArray *req = _generate_request();
+		struct gridd_client_s *client = gridd_client_create_empty();
+		g_assert(client != NULL);
+
+		/* Without the flag, a client is never reusable */
+		g_assert(!gridd_client_reusable(client));
+		gridd_client_set_keepalive(client, TRUE);
+
+		GError *err = gridd_client_request(client, req, NULL, NULL);
+		g_assert_no_error(err);
+		err = gridd_client_connect_url(client, url);
+		g_assert_no_error(err);
+
+		/* Armed but never connected: nothing to reuse */
+		g_assert(!gridd_client_reusable(client));
+
+		g_byte_array_unref(req);
+		gridd_client_free(client);
+	}
+
+	test_on_urlv(good_urls, test);
+}
+
+static GByteArray *
+_generate_reply(guint status)
+{
+	MESSAGE m = metautils_message_create_named(NAME_MSGNAME_METAREPLY, 0);
+	metautils_message_add_field_struint(m, NAME_MSGKEY_STATUS, status);
+	metautils_message_add_field_str(m, NAME_MSGKEY_MESSAGE, "test");
+	return message_marshall_gba_and_clean(m);
+}
+
+static void
+test_keepalive_final_reply(void)
+{
+	gchar url[STRLEN_ADDRINFO] = "127.0.0.1:0";
+	GError *err = NULL;
+
+	struct sockaddr_storage ss = {};
+	socklen_t ss_len = sizeof(ss);
+	gsize sz = sizeof(ss);
+	int fd = sock_build_for_url(url, &err, &ss, &sz);
+	g_assert_no_error(err);
+	g_assert_cmpint(fd, >=, 0);
+	g_assert_cmpint(bind(fd, (struct sockaddr*)&ss, sz), ==, 0);
+	g_assert_cmpint(listen(fd, 8), ==, 0);
+	g_assert_cmpint(getsockname(fd, (struct sockaddr*)&ss, &ss_len), ==, 0);
+	g_assert_cmpint(grid_sockaddr_to_string(
+			(struct sockaddr*)&ss, url, sizeof(url)), >, 0);
+
+	gboolean _fail_on_partial(gpointer ctx UNUSED, MESSAGE reply) {
+		guint status = 0;
+		GError *e = metautils_message_extract_struint(
+				reply, NAME_MSGKEY_STATUS, &status);
+		g_assert_no_error(e);
+		return status != CODE_PARTIAL_CONTENT;
+	}
+
+	/* The replies are written before the request is even read, they wait in
+	 * the socket buffers. */
+	gboolean test(client_on_reply cb, guint first, guint second) {
+		GByteArray *req = _generate_request();
+		struct gridd_client_s *client = gridd_client_create_empty();
+		gridd_client_set_keepalive(client, TRUE);
+		g_assert_no_error(gridd_client_request(client, req, NULL, cb));
+		g_assert_no_error(gridd_client_connect_url(client, url));
+		g_assert(gridd_client_start(client));
+
+		int cnx = accept(fd, NULL, NULL);
+		g_assert_cmpint(cnx, >=, 0);
+		for (guint i = 0; i < 2; i++) {
+			GByteArray *rep = _generate_reply(i ? second : first);
+			g_assert_cmpint(write(cnx, rep->data, rep->len), ==, rep->len);
+			g_byte_array_unref(rep);
+		}
+
+		GError *e = gridd_client_loop(client);
+		if (!e)
+			e = gridd_client_error(client);
+		g_clear_error(&e);
+		const gboolean reusable = gridd_client_reusable(client);
+
+		metautils_pclose(&cnx);
+		g_byte_array_unref(req);
+		gridd_client_free(client);
+		return reusable;
+	}
+
+	/* A complete reply has been consumed */
+	g_assert(test(NULL, CODE_PARTIAL_CONTENT, CODE_FINAL_OK));
+	/* The handler failed on a partial reply, the final one is still unread */
+	g_assert(!test(_fail_on_partial, CODE_PARTIAL_CONTENT, CODE_FINAL_OK));
+	/* An error status is never kept */
+	g_assert(!test(NULL, CODE_CONTAINER_NOTFOUND, CODE_FINAL_OK));
+
+	metautils_pclose(&fd);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -275,6 +377,10 @@ main(int argc, char **argv)
 			test_failed_start_on_ignored_connect_error);
 	g_test_add_func("/metautils/gridd_client/ignored_connect_loop",
 			test_loop_on_ignored_start_error);
+	g_test_add_func("/metautils/gridd_client/keepalive_not_connected",
+			test_keepalive_not_connected);
+	g_test_add_func("/metautils/gridd_client/keepalive_final_reply",
+			test_keepalive_final_reply);
 	return g_test_run();
 }
 
@@ -0,0 +1,175 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <string.h>
+
+#include <metautils/lib/metautils.h>
+#include <proxy/http_parser.h>
+
+/* What the parser reported, one string per request */
+static GString *trace = NULL;
+static gboolean in_body = FALSE;
+
+static void
+_command(const gchar *c, const gchar *s, const gchar *v)
+{
+	g_string_append_printf(trace, "%s|%s|%s", c, s, v);
+	in_body = FALSE;
+}
+
+static void
+_header(const gchar *k, const gchar *v)
+{
+	g_string_append_printf(trace, "|%s=%s", k, v);
+}
+
+static void
+_body(const guint8 *data, gsize data_len)
+{
+	if (!in_body)
+		g_string_append_c(trace, '|');
+	in_body = TRUE;
+	g_string_append_len(trace, (const gchar*)data, data_len);
+}
+
+/* Feed <src> in inputs of <step> bytes, returns the traces of the requests
+ * parsed, separated with '\n', or NULL upon a parsing error. */
+static gchar *
+_parse(const gchar *src, gsize step)
+{
+	struct http_parser_s *parser = http_parser_create();
+	parser->command_provider = _command;
+	parser->header_provider = _header;
+	parser->body_provider = _body;
+	trace = g_string_new("");
+
+	gboolean ok = TRUE;
+	const gsize total = strlen(src);
+	for (gsize off = 0; ok && off < total; off += step) {
+		gsize len = MIN(step, total - off);
+		guint8 *input = g_memdup(src + off, len);
+		for (guint8 *p = input; ok && len > 0;) {
+			struct http_parsing_result_s rc = http_parse(parser, p, len);
+			if (rc.status == HPRC_ERROR) {
+				g_assert_nonnull(parser->error);
+				ok = FALSE;
+				break;
+			}
+			g_assert_cmpuint(rc.consumed, <=, len);
+			p += rc.consumed;
+			len -= rc.consumed;
+			if (rc.status == HPRC_SUCCESS) {
+				g_string_append_c(trace, '\n');
+				http_parser_reset(parser);
+			}
+		}
+		g_free(input);
+	}
+
+	http_parser_destroy(parser);
+	GString *out = trace;
+	trace = NULL;
+	if (!ok) {
+		g_string_free(out, TRUE);
+		return NULL;
+	}
+	return g_string_free(out, FALSE);
+}
+
+static void
+_check(const gchar *src, const gchar *expected)
+{
+	/* The result must not depend on how the input is cut */
+	for (gsize step = 1; step <= strlen(src); step++) {
+		gchar *result = _parse(src, step);
+		g_assert_cmpstr(result, ==, expected);
+		g_free(result);
+	}
+}
+
+static void
+test_simple(void)
+{
+	_check("GET /status HTTP/1.1\r\n\r\n", "GET|/status|HTTP/1.1\n");
+	_check("GET /status HTTP/1.1\r\nHost: 127.0.0.1\r\nX-Oio-Req-Id: AB\r\n\r\n",
+			"GET|/status|HTTP/1.1|host=127.0.0.1|x-oio-req-id=AB\n");
+	/* The optional whitespaces around the values are trimmed */
+	_check("GET / HTTP/1.0\r\nA:b\r\nC: \td \r\n\r\n",
+			"GET|/|HTTP/1.0|a=b|c=d\n");
+	/* The selector may contain spaces */
+	_check("GET /a b HTTP/1.1\r\n\r\n", "GET|/a b|HTTP/1.1\n");
+}
+
+static void
+test_body(void)
+{
+	_check("POST /x HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello",
+			"POST|/x|HTTP/1.1|content-length=5|hello\n");
+	_check("POST /x HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+			"POST|/x|HTTP/1.1|content-length=0\n");
+}
+
+static void
+test_pipelined(void)
+{
+	_check("POST /a HTTP/1.1\r\nContent-Length: 2\r\n\r\nab"
+			"GET /b HTTP/1.1\r\n\r\n"
+			"GET /c HTTP/1.1\r\nConnection: close\r\n\r\n",
+			"POST|/a|HTTP/1.1|content-length=2|ab\n"
+			"GET|/b|HTTP/1.1\n"
+			"GET|/c|HTTP/1.1|connection=close\n");
+}
+
+static void
+test_incomplete(void)
+{
+	const gchar *src = "GET /a HTTP/1.1\r\nHost: x\r\n\r";
+	gchar *result = _parse(src, strlen(src));
+	g_assert_cmpstr(result, ==, "");
+	g_free(result);
+}
+
+static void
+test_errors(void)
+{
+	static const gchar *requests[] = {
+		"\r\n\r\n",
+		"GET\r\n\r\n",
+		"GET /\r\n\r\n",
+		"GET / HTTP/1.1\n\r\n\r\n",
+		"GET / HTTP/1.1\r\nHost\r\n\r\n",
+		"GET / HTTP/1.1\r\n: x\r\n\r\n",
+		NULL
+	};
+	for (const gchar **p = requests; *p; p++) {
+		for (gsize step = 1; step <= strlen(*p); step++)
+			g_assert_null(_parse(*p, step));
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc,argv);
+	g_test_add_func("/proxy/http/simple", test_simple);
+	g_test_add_func("/proxy/http/body", test_body);
+	g_test_add_func("/proxy/http/pipelined", test_pipelined);
+	g_test_add_func("/proxy/http/incomplete", test_incomplete);
+	g_test_add_func("/proxy/http/errors", test_errors);
+	return g_test_run();
+}
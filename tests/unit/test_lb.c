@@ -1,6 +1,6 @@
 /*
 OpenIO SDS unit tests
-Copyright (C) 2016-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2016-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -129,6 +129,178 @@ test_local_poll_same_low_bits(void)
 	oio_lb_world__destroy(world);
 }
 
+static void
+_test_local_poll_sets(int services, gboolean disjoint)
+{
+	struct oio_lb_world_s *world = oio_lb_local__create_world();
+	oio_lb_world__create_slot(world, "*");
+	struct oio_lb_item_s srv;
+	for (int i = 0; i < services; ++i) {
+		_srv(i, &srv);
+		oio_lb_world__feed_slot(world, "*", &srv);
+	}
+	oio_lb_world__purge_old_generations(world);
+
+	struct oio_lb_pool_s *pool = oio_lb_world__create_pool(world, "pool-test");
+	oio_lb_world__add_pool_targets(pool, "3,*");
+
+	const guint sets = 16;
+	GPtrArray *polled = g_ptr_array_new_with_free_func(g_free);
+	guint counts[sets];
+	memset(counts, 0, sizeof(counts));
+	void _on_id(guint set, struct oio_lb_selected_item_s *sel) {
+		g_assert_cmpuint(set, <, sets);
+		/* The sets are forwarded one after the other */
+		g_assert_cmpuint(polled->len, ==, set * 3 + counts[set]);
+		g_ptr_array_add(polled, g_strdup(sel->item->id));
+		counts[set] ++;
+	}
+	GError *err = oio_lb_pool__poll_sets(pool, sets, NULL, _on_id, NULL);
+	g_assert_no_error(err);
+	g_assert_cmpuint(polled->len, ==, 3 * sets);
+
+	for (guint set = 0; set < sets; set++) {
+		g_assert_cmpuint(counts[set], ==, 3);
+		if (!disjoint || !set)
+			continue;
+		/* Consecutive sets do not share any service */
+		for (guint i = 0; i < 3; i++) {
+			for (guint j = 0; j < 3; j++) {
+				g_assert_cmpstr(polled->pdata[set * 3 + i], !=,
+						polled->pdata[(set - 1) * 3 + j]);
+			}
+		}
+	}
+
+	g_ptr_array_free(polled, TRUE);
+	oio_lb_pool__destroy(pool);
+	oio_lb_world__destroy(world);
+}
+
+static void
+test_local_poll_sets(void)
+{
+	_test_local_poll_sets(64, TRUE);
+	/* Not enough services to avoid the previous set: still works */
+	_test_local_poll_sets(4, FALSE);
+}
+
+/* Time the polls in a large world, services spread on racks of 20 hosts
+ * with 4 volumes each. Run with "-m perf" to get significant numbers. */
+static void
+test_local_poll_perf(gconstpointer p)
+{
+	const int services = GPOINTER_TO_INT(p);
+	const int polls = g_test_perf() ? 100000 : 1000;
+
+	struct oio_lb_world_s *world = oio_lb_local__create_world();
+	oio_lb_world__create_slot(world, "*");
+	struct oio_lb_item_s srv;
+	for (int i = 0; i < services; ++i) {
+		memset(&srv, 0, sizeof(srv));
+		srv.location = ((oio_location_t)(i / 80 + 1) << 32)
+				| ((oio_location_t)(i / 4 + 1) << 16) | (i % 4 + 1);
+		srv.weight = 70 + i % 30;
+		sprintf(srv.id, "ID-%06d", i);
+		oio_lb_world__feed_slot(world, "*", &srv);
+	}
+	oio_lb_world__purge_old_generations(world);
+
+	struct oio_lb_pool_s *pool = oio_lb_world__create_pool(world, "pool-test");
+	oio_lb_world__add_pool_targets(pool, "9,*");
+
+	guint count = 0;
+	void _on_item(struct oio_lb_selected_item_s *sel UNUSED,
+			gpointer u UNUSED) {
+		++count;
+	}
+	g_test_timer_start();
+	for (int i = 0; i < polls; i++) {
+		GError *err = oio_lb_pool__poll(pool, NULL, _on_item, NULL);
+		g_assert_no_error(err);
+	}
+	const gdouble elapsed = g_test_timer_elapsed();
+	g_assert_cmpuint(count, ==, 9 * polls);
+	g_test_minimized_result(elapsed * G_TIME_SPAN_SECOND / polls,
+			"%d services: %.3fus per poll of 9 services", services,
+			elapsed * G_TIME_SPAN_SECOND / polls);
+
+	oio_lb_pool__destroy(pool);
+	oio_lb_world__destroy(world);
+}
+
+struct poll_during_reload_s
+{
+	struct oio_lb_pool_s *pool;
+	volatile gint running;
+	volatile gint polls;
+	guint errors;
+};
+
+static gpointer
+_poll_during_reload_worker(gpointer p)
+{
+	struct poll_during_reload_s *ctx = p;
+	void _on_item(struct oio_lb_selected_item_s *sel UNUSED,
+			gpointer u UNUSED) {
+	}
+	while (g_atomic_int_get(&ctx->running)) {
+		GError *err = oio_lb_pool__poll(ctx->pool, NULL, _on_item, NULL);
+		if (err) {
+			ctx->errors ++;
+			g_clear_error(&err);
+		}
+		g_atomic_int_inc(&ctx->polls);
+	}
+	return NULL;
+}
+
+/* The pollers work on a snapshot, they must neither fail nor crash while
+ * the world is reloaded, even when the services come and go. */
+static void
+test_local_poll_during_reload(void)
+{
+	struct oio_lb_world_s *world = oio_lb_local__create_world();
+	oio_lb_world__create_slot(world, "*");
+	struct oio_lb_item_s srv;
+	for (int i = 0; i < 64; ++i) {
+		_srv(i, &srv);
+		oio_lb_world__feed_slot(world, "*", &srv);
+	}
+	oio_lb_world__purge_old_generations(world);
+
+	struct poll_during_reload_s ctx = {};
+	ctx.pool = oio_lb_world__create_pool(world, "pool-test");
+	oio_lb_world__add_pool_targets(ctx.pool, "3,*");
+	ctx.running = 1;
+	GThread *th = g_thread_new("poller", _poll_during_reload_worker, &ctx);
+
+	for (int round = 0; round < 256; ++round) {
+		oio_lb_world__increment_generation(world);
+		/* Always keep enough services for the pool */
+		for (int i = 0; i < 64; ++i) {
+			if (i < 8 || (i + round) % 3) {
+				_srv(i, &srv);
+				srv.weight = 10 + (round + i) % 90;
+				oio_lb_world__feed_slot(world, "*", &srv);
+			}
+		}
+		if (round % 2)
+			oio_lb_world__purge_old_generations(world);
+		else
+			oio_lb_world__rehash_all_slots(world);
+	}
+
+	while (!g_atomic_int_get(&ctx.polls))
+		g_usleep(1000);
+	g_atomic_int_set(&ctx.running, 0);
+	g_thread_join(th);
+	g_assert_cmpuint(ctx.errors, ==, 0);
+
+	oio_lb_pool__destroy(ctx.pool);
+	oio_lb_world__destroy(world);
+}
+
 static struct oio_lb_item_s *
 _srv2(int i, int svc_per_slot)
 {
@@ -746,6 +918,15 @@ main(int argc, char **argv)
 	g_test_add_func("/core/lb/local/poll", test_local_poll);
 	g_test_add_func("/core/lb/local/poll_same_low",
 			test_local_poll_same_low_bits);
+	g_test_add_func("/core/lb/local/poll_during_reload",
+			test_local_poll_during_reload);
+	g_test_add_func("/core/lb/local/poll_sets", test_local_poll_sets);
+	g_test_add_data_func("/core/lb/perf/1000services",
+			GINT_TO_POINTER(1000), test_local_poll_perf);
+	g_test_add_data_func("/core/lb/perf/10000services",
+			GINT_TO_POINTER(10000), test_local_poll_perf);
+	g_test_add_data_func("/core/lb/perf/50000services",
+			GINT_TO_POINTER(50000), test_local_poll_perf);
 
 	_add_repartition_test(30, 1, 1);
 	_add_repartition_test(30, 1, 3);
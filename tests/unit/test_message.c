@@ -0,0 +1,181 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <string.h>
+
+#include <metautils/lib/metautils.h>
+
+static MESSAGE
+_make(gsize body_size)
+{
+	MESSAGE m = metautils_message_create_named("TEST_REQ", 0);
+	metautils_message_set_ID(m, "ID", 2);
+	metautils_message_add_field_str(m, "K0", "v0");
+	metautils_message_add_field_str(m, "K1", "");
+	metautils_message_add_field_strint64(m, "K2", G_MAXINT64);
+	if (body_size) {
+		GByteArray *body = g_byte_array_sized_new(body_size);
+		g_byte_array_set_size(body, body_size);
+		for (gsize i = 0; i < body_size; i++)
+			body->data[i] = i;
+		metautils_message_add_body_unref(m, body);
+	}
+	return m;
+}
+
+static void
+_check_str(MESSAGE m, const char *k, const char *expected)
+{
+	gchar *v = metautils_message_extract_string_copy(m, k);
+	g_assert_cmpstr(v, ==, expected);
+	g_free(v);
+}
+
+static void
+_check(MESSAGE m, gsize body_size)
+{
+	g_assert_nonnull(m);
+
+	gsize l = 0;
+	void *b = metautils_message_get_NAME(m, &l);
+	g_assert_cmpuint(l, ==, 8);
+	g_assert_true(!memcmp(b, "TEST_REQ", 8));
+
+	_check_str(m, "K0", "v0");
+	_check_str(m, "K1", "");
+	_check_str(m, "K2", "9223372036854775807");
+	g_assert_null(metautils_message_get_field(m, "K3", &l));
+
+	b = metautils_message_get_BODY(m, &l);
+	g_assert_cmpuint(l, ==, body_size);
+	for (gsize i = 0; i < body_size; i++)
+		g_assert_cmpuint(((guint8*)b)[i], ==, (guint8)i);
+}
+
+static void
+test_roundtrip(void)
+{
+	static const gsize sizes[] = {0, 1, 1024, 1024*1024, (gsize)-1};
+	for (const gsize *ps = sizes; *ps != (gsize)-1; ps++) {
+		GByteArray *ber = message_marshall_gba_and_clean(_make(*ps));
+		GByteArray *bin = message_marshall_binary_and_clean(_make(*ps));
+		g_assert_false(message_is_binary(ber->data, ber->len));
+		g_assert_true(message_is_binary(bin->data, bin->len));
+		g_assert_cmpuint(bin->len, <=, ber->len);
+
+		/* The BER requests advertise the binary framing */
+		MESSAGE m = message_unmarshall(ber->data, ber->len, NULL);
+		_check(m, *ps);
+		gsize l = 0;
+		g_assert_nonnull(metautils_message_get_field(m, NAME_MSGKEY_WIRE, &l));
+		metautils_message_destroy(m);
+
+		m = message_unmarshall_inplace(ber->data, ber->len, NULL);
+		_check(m, *ps);
+		metautils_message_destroy(m);
+
+		m = message_unmarshall(bin->data, bin->len, NULL);
+		_check(m, *ps);
+		metautils_message_destroy(m);
+
+		m = message_unmarshall_inplace(bin->data, bin->len, NULL);
+		_check(m, *ps);
+		metautils_message_destroy(m);
+
+		g_byte_array_unref(ber);
+		g_byte_array_unref(bin);
+	}
+}
+
+static void
+test_copy_outlives_buffer(void)
+{
+	GByteArray *bin = message_marshall_binary_and_clean(_make(64));
+	MESSAGE m = message_unmarshall(bin->data, bin->len, NULL);
+	memset(bin->data, 0, bin->len);
+	g_byte_array_unref(bin);
+	_check(m, 64);
+	metautils_message_destroy(m);
+}
+
+static void
+test_borrowed_mutation(void)
+{
+	GByteArray *bin = message_marshall_binary_and_clean(_make(64));
+	MESSAGE m = message_unmarshall_inplace(bin->data, bin->len, NULL);
+	_check(m, 64);
+
+	/* The borrowed parts must be replaced, never freed */
+	metautils_message_set_NAME(m, "OTHER", 5);
+	metautils_message_set_BODY(m, "xyz", 3);
+	metautils_message_add_field_str(m, "K3", "v3");
+	_check_str(m, "K0", "v0");
+	_check_str(m, "K3", "v3");
+
+	/* And the mutated message can be encoded again */
+	GByteArray *again = message_marshall_binary(m, NULL);
+	metautils_message_destroy(m);
+	g_byte_array_unref(bin);
+
+	m = message_unmarshall(again->data, again->len, NULL);
+	g_assert_nonnull(m);
+	_check_str(m, "K3", "v3");
+	gsize l = 0;
+	void *b = metautils_message_get_BODY(m, &l);
+	g_assert_cmpuint(l, ==, 3);
+	g_assert_true(!memcmp(b, "xyz", 3));
+	metautils_message_destroy(m);
+	g_byte_array_unref(again);
+}
+
+static void
+test_truncated(void)
+{
+	GByteArray *bin = message_marshall_binary_and_clean(_make(64));
+	for (guint len = 5; len < bin->len; len++) {
+		GError *err = NULL;
+		/* Keep the announced size consistent with the truncated frame */
+		guint8 *copy = g_memdup(bin->data, len);
+		const guint32 size = g_htonl(len - 4);
+		memcpy(copy, &size, 4);
+		MESSAGE m = message_unmarshall_inplace(copy, len, &err);
+		g_assert_null(m);
+		g_assert_nonnull(err);
+		g_clear_error(&err);
+		g_free(copy);
+	}
+	/* The length announced does not match the buffer */
+	GError *err = NULL;
+	MESSAGE m = message_unmarshall(bin->data, bin->len - 1, &err);
+	g_assert_null(m);
+	g_assert_nonnull(err);
+	g_clear_error(&err);
+	g_byte_array_unref(bin);
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc,argv);
+	oio_var_value_one("gridd.wire.binary", "true");
+	g_test_add_func("/metautils/message/roundtrip", test_roundtrip);
+	g_test_add_func("/metautils/message/copy", test_copy_outlives_buffer);
+	g_test_add_func("/metautils/message/borrowed", test_borrowed_mutation);
+	g_test_add_func("/metautils/message/truncated", test_truncated);
+	return g_test_run();
+}
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS unit tests
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -1500,6 +1500,189 @@ test_props_set_simple()
 	_container_wraper_allversions("NS", test);
 }
 
+static void
+test_content_list_prefix(void)
+{
+	void test(struct meta2_backend_s *m2, struct oio_url_s *u, gint64 maxver) {
+		GError *err;
+		(void) maxver;
+
+		/* more aliases than in a batch of headers and properties, around
+		 * other aliases that do not match the prefix */
+		const guint nb_aliases = 300;
+		const gchar *paths[] = {"a", NULL, "b0", "c"};
+		for (guint i = 0; i < G_N_ELEMENTS(paths); i++) {
+			const guint max = paths[i] ? 1 : nb_aliases;
+			for (guint j = 0; j < max; j++) {
+				gchar path[32];
+				if (paths[i])
+					g_strlcpy(path, paths[i], sizeof(path));
+				else
+					g_snprintf(path, sizeof(path), "b/%04u", j);
+				struct oio_url_s *u1 = oio_url_dup(u);
+				oio_url_set(u1, OIOURL_PATH, path);
+				_set_content_id(u1);
+				GSList *beans = _create_alias(m2, u1, NULL);
+				err = meta2_backend_put_alias(m2, u1, beans, 0,
+						NULL, NULL, NULL, NULL);
+				g_assert_no_error(err);
+				_bean_cleanl2(beans);
+
+				GSList *modified = NULL;
+				beans = _props_generate(u1, 1, 2);
+				err = meta2_backend_set_properties(m2, u1, FALSE, beans,
+						&modified);
+				g_assert_no_error(err);
+				_bean_cleanl2(beans);
+				_bean_cleanl2(modified);
+				oio_url_pclean(&u1);
+			}
+		}
+
+		guint nb_alias = 0, nb_header = 0, nb_prop = 0;
+		gchar *last = NULL;
+		void _check(gpointer u0, gpointer bean) {
+			(void) u0;
+			if (DESCR(bean) == &descr_struct_ALIASES) {
+				const gchar *name = ALIASES_get_alias(bean)->str;
+				g_assert_true(g_str_has_prefix(name, "b/"));
+				g_assert_true(!last || strcmp(last, name) < 0);
+				g_free(last);
+				last = g_strdup(name);
+				/* its header and properties came just before */
+				g_assert_cmpuint(nb_header, ==, nb_alias + 1);
+				g_assert_cmpuint(nb_prop, ==, 2 * (nb_alias + 1));
+				nb_alias ++;
+			} else if (DESCR(bean) == &descr_struct_CONTENTS_HEADERS) {
+				nb_header ++;
+			} else if (DESCR(bean) == &descr_struct_PROPERTIES) {
+				g_assert_true(g_str_has_prefix(
+							PROPERTIES_get_alias(bean)->str, "b/"));
+				nb_prop ++;
+			}
+			_bean_clean(bean);
+		}
+
+		struct list_params_s lp = {0};
+		lp.prefix = "b/";
+		lp.flag_headers = 1;
+		lp.flag_properties = 1;
+		err = meta2_backend_list_aliases(m2, u, &lp, NULL, _check, NULL, NULL);
+		g_assert_no_error(err);
+		g_assert_cmpuint(nb_alias, ==, nb_aliases);
+
+		/* paginated */
+		nb_alias = nb_header = nb_prop = 0;
+		g_free(last);
+		last = NULL;
+		lp.maxkeys = 7;
+		err = meta2_backend_list_aliases(m2, u, &lp, NULL, _check, NULL, NULL);
+		g_assert_no_error(err);
+		g_assert_cmpuint(nb_alias, ==, 7);
+		g_free(last);
+	}
+	_container_wraper("NS", 0, test);
+}
+
+static void
+test_content_list_versions(void)
+{
+	void test(struct meta2_backend_s *m2, struct oio_url_s *u, gint64 maxver) {
+		GError *err;
+		(void) maxver;
+
+		CLOCK_START = CLOCK = oio_ext_rand_int();
+
+		/* several versions of each alias, each version with its own count
+		 * of properties, for more versions than in a batch */
+		const guint nb_paths = 100, nb_versions = 3;
+		GHashTable *expected = g_hash_table_new_full(
+				g_str_hash, g_str_equal, g_free, NULL);
+		for (guint j = 0; j < nb_paths; j++) {
+			gchar path[32];
+			g_snprintf(path, sizeof(path), "v/%04u", j);
+			struct oio_url_s *u1 = oio_url_dup(u);
+			oio_url_set(u1, OIOURL_PATH, path);
+			for (guint i = 0; i < nb_versions; i++) {
+				CLOCK ++;
+				_set_content_id(u1);
+				GSList *beans = _create_alias(m2, u1, NULL);
+				err = meta2_backend_put_alias(m2, u1, beans, 0,
+						NULL, NULL, NULL, NULL);
+				g_assert_no_error(err);
+				_bean_cleanl2(beans);
+
+				/* set on the latest version */
+				GSList *modified = NULL;
+				beans = _props_generate(u1, 1, i + 1);
+				err = meta2_backend_set_properties(m2, u1, FALSE, beans,
+						&modified);
+				g_assert_no_error(err);
+				const gint64 version = PROPERTIES_get_version(beans->data);
+				g_hash_table_insert(expected,
+						g_strdup_printf("%s|%"G_GINT64_FORMAT, path, version),
+						GUINT_TO_POINTER(i + 1));
+				_bean_cleanl2(beans);
+				_bean_cleanl2(modified);
+			}
+			oio_url_pclean(&u1);
+		}
+		g_assert_cmpuint(g_hash_table_size(expected), ==,
+				nb_paths * nb_versions);
+
+		/* Each version comes after its header and its own properties */
+		guint nb_alias = 0, nb_header = 0;
+		GSList *props = NULL;
+		void _check(gpointer u0, gpointer bean) {
+			(void) u0;
+			if (DESCR(bean) == &descr_struct_ALIASES) {
+				const gchar *name = ALIASES_get_alias(bean)->str;
+				const gint64 version = ALIASES_get_version(bean);
+				gchar *k = g_strdup_printf("%s|%"G_GINT64_FORMAT,
+						name, version);
+				gpointer count = NULL;
+				g_assert_true(g_hash_table_lookup_extended(
+							expected, k, NULL, &count));
+				g_hash_table_remove(expected, k);
+				g_free(k);
+				g_assert_cmpuint(g_slist_length(props), ==,
+						GPOINTER_TO_UINT(count));
+				for (GSList *l = props; l; l = l->next) {
+					g_assert_cmpstr(PROPERTIES_get_alias(l->data)->str,
+							==, name);
+					g_assert_cmpint(PROPERTIES_get_version(l->data),
+							==, version);
+				}
+				g_assert_cmpuint(nb_header, ==, nb_alias + 1);
+				_bean_cleanl2(props);
+				props = NULL;
+				nb_alias ++;
+				_bean_clean(bean);
+			} else if (DESCR(bean) == &descr_struct_CONTENTS_HEADERS) {
+				nb_header ++;
+				_bean_clean(bean);
+			} else if (DESCR(bean) == &descr_struct_PROPERTIES) {
+				props = g_slist_prepend(props, bean);
+			} else {
+				_bean_clean(bean);
+			}
+		}
+
+		struct list_params_s lp = {0};
+		lp.prefix = "v/";
+		lp.flag_allversion = 1;
+		lp.flag_headers = 1;
+		lp.flag_properties = 1;
+		err = meta2_backend_list_aliases(m2, u, &lp, NULL, _check, NULL, NULL);
+		g_assert_no_error(err);
+		g_assert_cmpuint(nb_alias, ==, nb_paths * nb_versions);
+		g_assert_null(props);
+		g_assert_cmpuint(g_hash_table_size(expected), ==, 0);
+		g_hash_table_destroy(expected);
+	}
+	_container_wraper("NS", -1, test);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -1527,6 +1710,10 @@ main(int argc, char **argv)
 			test_content_put_lower_version);
 	g_test_add_func("/meta2v2/backend/content/put_prop_get",
 			test_content_put_prop_get);
+	g_test_add_func("/meta2v2/backend/content/list_prefix",
+			test_content_list_prefix);
+	g_test_add_func("/meta2v2/backend/content/list_versions",
+			test_content_list_versions);
 	g_test_add_func("/meta2v2/backend/content/append_empty",
 			test_content_append_empty);
 	g_test_add_func("/meta2v2/backend/props/set_simple",
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS unit tests
-Copyright (C) 2018 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2018-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -17,13 +17,18 @@ License along with this library.
 */
 
 #include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include <glib.h>
 
 #include <core/oio_core.h>
 #include <core/internals.h>
+#include <metautils/lib/metautils.h>
 
 #include <server/network_server.h>
+#include <server/server_variables.h>
 
 #define GQ_SERVER() g_quark_from_static_string("oio.srv")
 
@@ -70,6 +75,296 @@ test_bad_bind_address_empty_brackets(void)
 	_test_bad_bind_address("[]:12345");
 }
 
+static void
+test_loops_share_endpoint(void)
+{
+	const guint loops = server_loops;
+	server_loops = 4;
+
+	struct network_server_s *srv = network_server_init();
+	g_assert_nonnull(srv);
+	network_server_bind_host(srv, "127.0.0.1:0", NULL, _do_nothing);
+	GError *err = network_server_open_servers(srv);
+	g_assert_no_error(err);
+
+	/* The sockets of the additional loops are not exposed */
+	gchar **urls = network_server_endpoints(srv);
+	g_assert_nonnull(urls);
+	g_assert_cmpuint(g_strv_length(urls), ==, 1);
+	for (int i=0; i<8 ;++i) {
+		int fd = sock_connect(urls[0], &err);
+		g_assert_no_error(err);
+		g_assert_cmpint(fd, >=, 0);
+		metautils_pclose(&fd);
+	}
+	g_strfreev(urls);
+
+	network_server_close_servers(srv);
+	network_server_clean(srv);
+	server_loops = loops;
+}
+
+/* Builds a reply that looks like a listing: a small header, then a sequence
+ * of chunks referenced as GBytes */
+static const gchar reply_header[] = "HEADER-HEADER-HEADER-HEADER-HEADER";
+
+static void
+_build_reply(struct data_slab_sequence_s *dss, guint nb_chunks, gsize chunk)
+{
+	data_slab_sequence_append(dss, data_slab_make_static_string(reply_header));
+	for (guint i=0; i<nb_chunks ;++i) {
+		guint8 *b = g_malloc(chunk);
+		memset(b, 'A' + (i % 26), chunk);
+		data_slab_sequence_append(dss,
+				data_slab_make_gbytes(g_bytes_new_take(b, chunk)));
+	}
+}
+
+/* The bytes of the reply built by _build_reply(), in order */
+static GByteArray *
+_expected_reply(guint nb_chunks, gsize chunk)
+{
+	GByteArray *gba = g_byte_array_new();
+	g_byte_array_append(gba, (guint8*)reply_header, sizeof(reply_header) - 1);
+	guint8 *b = g_malloc(chunk);
+	for (guint i=0; i<nb_chunks ;++i) {
+		memset(b, 'A' + (i % 26), chunk);
+		g_byte_array_append(gba, b, chunk);
+	}
+	g_free(b);
+	return gba;
+}
+
+static void
+_assert_same_bytes(GByteArray *expected, GByteArray *received)
+{
+	g_assert_cmpuint(expected->len, ==, received->len);
+	g_assert_cmpint(0, ==,
+			memcmp(expected->data, received->data, expected->len));
+}
+
+static gsize
+_drain(int fd, GByteArray *out)
+{
+	guint8 buf[65536];
+	gsize total = 0;
+	for (;;) {
+		ssize_t r = read(fd, buf, sizeof(buf));
+		if (r <= 0)
+			return total;
+		g_byte_array_append(out, buf, r);
+		total += r;
+	}
+}
+
+/* Sends the whole reply, either slab per slab (the former behavior) or with
+ * the scatter/gather call, checks the peer received it intact, and returns
+ * the number of syscalls that wrote something. */
+static guint
+_bench_reply(int fdv[2], gboolean gather, guint nb_chunks, gsize chunk,
+		GByteArray *expected)
+{
+	struct data_slab_sequence_s dss = {NULL, NULL};
+	_build_reply(&dss, nb_chunks, chunk);
+	const gsize total = data_slab_sequence_size(&dss);
+	g_assert_cmpuint(total, ==, expected->len);
+
+	GByteArray *received = g_byte_array_sized_new(total);
+	guint calls = 0;
+	gsize sent = 0;
+	while (data_slab_sequence_has_data(&dss)) {
+		gboolean rc = gather
+			? data_slab_sequence_send(&dss, fdv[0])
+			: data_slab_send(dss.first, fdv[0]);
+		g_assert_true(rc || errno == EAGAIN);
+		if (rc)
+			++ calls;
+		sent += _drain(fdv[1], received);
+		g_assert_cmpuint(sent + data_slab_sequence_size(&dss), ==, total);
+	}
+	_assert_same_bytes(expected, received);
+	g_byte_array_free(received, TRUE);
+	data_slab_sequence_clean_data(&dss);
+	return calls;
+}
+
+static void
+test_slab_writev(void)
+{
+	const guint rounds = g_test_perf() ? 10000 : 10;
+	const guint nb_chunks = 32;
+	const gsize chunk = 1024;
+	GByteArray *expected = _expected_reply(nb_chunks, chunk);
+
+	int fdv[2] = {-1, -1};
+	g_assert_cmpint(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fdv));
+	sock_set_non_blocking(fdv[0], TRUE);
+	sock_set_non_blocking(fdv[1], TRUE);
+
+	for (int gather=0; gather<2 ;++gather) {
+		guint calls = 0;
+		const gint64 start = g_get_monotonic_time();
+		for (guint i=0; i<rounds ;++i) {
+			const guint c = _bench_reply(fdv, gather, nb_chunks, chunk, expected);
+			/* The reply fits in the socket buffer: one writev() sends it all */
+			if (gather)
+				g_assert_cmpuint(c, ==, 1);
+			else
+				g_assert_cmpuint(c, >=, nb_chunks + 1);
+			calls += c;
+		}
+		const gint64 elapsed = g_get_monotonic_time() - start;
+
+		g_test_message("%s replies=%u syscalls/reply=%.2f bytes/syscall=%.0f "
+				"elapsed=%"G_GINT64_FORMAT"us", gather ? "writev" : "write",
+				rounds, (gdouble)calls / rounds,
+				(gdouble)(rounds * expected->len) / MAX(calls,1), elapsed);
+	}
+
+	g_byte_array_free(expected, TRUE);
+	metautils_pclose(fdv + 0);
+	metautils_pclose(fdv + 1);
+}
+
+/* Tells if the first slab with data has already been partially sent */
+static gboolean
+_first_slab_started(struct data_slab_sequence_s *dss)
+{
+	struct data_slab_s *ds = dss->first;
+	switch (ds->type) {
+		case STYPE_BUFFER:
+		case STYPE_BUFFER_STATIC:
+			return ds->data.buffer.start > 0;
+		case STYPE_GBYTES:
+			return ds->data.gbytes.offset > 0;
+		case STYPE_EOF:
+			return FALSE;
+	}
+	g_assert_not_reached();
+	return FALSE;
+}
+
+static void
+test_slab_writev_partial(void)
+{
+	/* A reply much larger than the socket buffer, with chunks whose size
+	 * won't match the pieces accepted by the kernel. */
+	const guint nb_chunks = 128;
+	const gsize chunk = 16381;
+	GByteArray *expected = _expected_reply(nb_chunks, chunk);
+
+	int fdv[2] = {-1, -1};
+	g_assert_cmpint(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fdv));
+	sock_set_non_blocking(fdv[0], TRUE);
+	sock_set_non_blocking(fdv[1], TRUE);
+	int opt = 32768;
+	g_assert_cmpint(0, ==,
+			setsockopt(fdv[0], SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt)));
+
+	struct data_slab_sequence_s dss = {NULL, NULL};
+	_build_reply(&dss, nb_chunks, chunk);
+	g_assert_cmpuint(data_slab_sequence_size(&dss), ==, expected->len);
+
+	GByteArray *received = g_byte_array_sized_new(expected->len);
+	guint calls = 0, resumed = 0;
+	while (data_slab_sequence_has_data(&dss)) {
+		if (_first_slab_started(&dss))
+			++ resumed;
+		/* The peer drained everything, some room is available */
+		g_assert_true(data_slab_sequence_send(&dss, fdv[0]));
+		++ calls;
+		_drain(fdv[1], received);
+		g_assert_cmpuint(received->len + data_slab_sequence_size(&dss), ==,
+				expected->len);
+	}
+
+	/* The writev() calls stopped in the middle of a slab, and the next
+	 * ones resumed there without losing nor repeating a byte. */
+	g_assert_cmpuint(calls, >, 1);
+	g_assert_cmpuint(resumed, >, 0);
+	_assert_same_bytes(expected, received);
+
+	g_byte_array_free(received, TRUE);
+	g_byte_array_free(expected, TRUE);
+	data_slab_sequence_clean_data(&dss);
+	metautils_pclose(fdv + 0);
+	metautils_pclose(fdv + 1);
+}
+
+struct slow_reader_s
+{
+	int fd;
+	gsize total;
+};
+
+/* Reads small pieces with a pause in between, until EOF */
+static gpointer
+_slow_reader(gpointer p)
+{
+	struct slow_reader_s *r = p;
+	guint8 buf[16384];
+	for (;;) {
+		ssize_t n = read(r->fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return NULL;
+		r->total += n;
+		g_usleep(G_TIME_SPAN_MILLISECOND);
+	}
+}
+
+static void
+test_drain_output(void)
+{
+	int fdv[2] = {-1, -1};
+	g_assert_cmpint(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fdv));
+	sock_set_non_blocking(fdv[0], TRUE);
+
+	struct network_client_s clt = {};
+	clt.fd = fdv[0];
+	g_strlcpy(clt.peer_name, "slow-reader", sizeof(clt.peer_name));
+	_build_reply(&clt.output, 256, 16384);
+	const gsize total = data_slab_sequence_size(&clt.output);
+
+	/* Nobody reads, the deadline is reached with the output kept */
+	gint64 start = oio_ext_monotonic_time();
+	g_assert_false(network_client_drain_output(&clt, 0,
+				start + 100 * G_TIME_SPAN_MILLISECOND));
+	g_assert_cmpint(oio_ext_monotonic_time() - start, >=,
+			100 * G_TIME_SPAN_MILLISECOND);
+	g_assert_cmpuint(data_slab_sequence_size(&clt.output), >, 0);
+
+	/* A slow reader, the output shrinks down to the limit, not below */
+	struct slow_reader_s reader = {.fd = fdv[1], .total = 0};
+	GThread *th = g_thread_new("reader", _slow_reader, &reader);
+	const gsize max = 256 * 1024;
+	start = oio_ext_monotonic_time();
+	g_assert_true(network_client_drain_output(&clt, max,
+				start + 30 * G_TIME_SPAN_SECOND));
+	g_assert_cmpuint(data_slab_sequence_size(&clt.output), <=, max);
+	g_assert_true(network_client_drain_output(&clt, 0,
+				start + 30 * G_TIME_SPAN_SECOND));
+	g_assert_false(data_slab_sequence_has_data(&clt.output));
+	g_assert_cmpint(0, ==, shutdown(fdv[0], SHUT_WR));
+	g_thread_join(th);
+	g_assert_cmpuint(reader.total, ==, total);
+	metautils_pclose(fdv + 0);
+	metautils_pclose(fdv + 1);
+
+	/* The reader is gone, the output is dropped */
+	signal(SIGPIPE, SIG_IGN);
+	g_assert_cmpint(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fdv));
+	sock_set_non_blocking(fdv[0], TRUE);
+	clt.fd = fdv[0];
+	_build_reply(&clt.output, 16, 16384);
+	metautils_pclose(fdv + 1);
+	g_assert_false(network_client_drain_output(&clt, 0,
+				oio_ext_monotonic_time() + 5 * G_TIME_SPAN_SECOND));
+	g_assert_false(data_slab_sequence_has_data(&clt.output));
+	metautils_pclose(fdv + 0);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -82,5 +377,9 @@ main(int argc, char **argv)
 			test_bad_bind_address_quotes);
 	g_test_add_func("/server/core/bad_bind_address/257",
 			test_bad_bind_address_257);
+	g_test_add_func("/server/core/loops", test_loops_share_endpoint);
+	g_test_add_func("/server/slab/writev", test_slab_writev);
+	g_test_add_func("/server/slab/writev_partial", test_slab_writev_partial);
+	g_test_add_func("/server/client/drain_output", test_drain_output);
 	return g_test_run();
 }
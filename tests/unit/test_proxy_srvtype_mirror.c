@@ -0,0 +1,182 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <glib.h>
+#include <metautils/lib/metautils.h>
+#include <proxy/srvtype_mirror.h>
+
+static struct service_info_s *
+_make_service(guint port, gint32 score, const char *slots, gint64 cpu)
+{
+	struct service_info_s *si = g_malloc0(sizeof(*si));
+	g_strlcpy(si->ns_name, "NS", sizeof(si->ns_name));
+	g_strlcpy(si->type, "rawx", sizeof(si->type));
+	gchar url[STRLEN_ADDRINFO];
+	g_snprintf(url, sizeof(url), "127.0.0.1:%u", port);
+	g_assert_true(grid_string_to_addrinfo(url, &si->addr));
+	si->score.value = score;
+	si->tags = g_ptr_array_new();
+	service_tag_set_value_string(
+			service_info_ensure_tag(si->tags, NAME_TAGNAME_SLOTS), slots);
+	service_tag_set_value_i64(
+			service_info_ensure_tag(si->tags, "stat.cpu"), cpu);
+	return si;
+}
+
+static guint
+_port(const struct service_info_s *si)
+{
+	return g_ntohs(si->addr.port);
+}
+
+static struct srvtype_update_s *
+_apply(struct srvtype_mirror_s *mirror, gboolean delta, gint64 generation,
+		GSList *services, GSList *removed)
+{
+	struct conscience_changes_s changes = {};
+	changes.epoch = 1;
+	changes.generation = generation;
+	changes.delta = delta;
+	changes.services = services;
+	changes.removed = removed;
+	struct srvtype_update_s *update = srvtype_mirror_apply(mirror, &changes);
+	g_assert_null(changes.services);
+	g_assert_null(changes.removed);
+	g_assert_cmpint(generation, ==, mirror->generation);
+	g_assert_cmpuint(g_hash_table_size(mirror->services), ==,
+			g_slist_length(update->all));
+	return update;
+}
+
+static void
+test_mirror_full(void)
+{
+	struct srvtype_mirror_s *mirror = srvtype_mirror_create();
+
+	GSList *l = NULL;
+	l = g_slist_prepend(l, _make_service(6000, 50, "a", 10));
+	l = g_slist_prepend(l, _make_service(6001, 50, "a", 10));
+	struct srvtype_update_s *u = _apply(mirror, FALSE, 3, l, NULL);
+	g_assert_false(u->delta);
+	g_assert_cmpuint(2, ==, g_slist_length(u->all));
+	g_assert_cmpuint(2, ==, g_slist_length(u->changed));
+	g_assert_null(u->refreshed);
+	g_assert_null(u->stale);
+	srvtype_update_destroy(u);
+
+	/* A full list replaces the whole mirror, and resets the count of the
+	 * incremental refreshes. */
+	u = _apply(mirror, TRUE, 4, NULL, NULL);
+	srvtype_update_destroy(u);
+	g_assert_cmpuint(1, ==, mirror->deltas);
+	l = g_slist_prepend(NULL, _make_service(6002, 50, "a", 10));
+	u = _apply(mirror, FALSE, 5, l, NULL);
+	g_assert_cmpuint(0, ==, mirror->deltas);
+	g_assert_cmpuint(1, ==, g_slist_length(u->all));
+	g_assert_cmpuint(6002, ==, _port(u->all->data));
+	g_assert_null(u->stale);
+	srvtype_update_destroy(u);
+
+	srvtype_mirror_destroy(mirror);
+}
+
+static void
+test_mirror_delta(void)
+{
+	struct srvtype_mirror_s *mirror = srvtype_mirror_create();
+
+	GSList *l = NULL;
+	l = g_slist_prepend(l, _make_service(6000, 50, "a", 10));
+	l = g_slist_prepend(l, _make_service(6001, 50, "a", 10));
+	l = g_slist_prepend(l, _make_service(6002, 50, "a", 10));
+	srvtype_update_destroy(_apply(mirror, FALSE, 3, l, NULL));
+
+	/* Nothing changed */
+	struct srvtype_update_s *u = _apply(mirror, TRUE, 3, NULL, NULL);
+	g_assert_true(u->delta);
+	g_assert_cmpuint(3, ==, g_slist_length(u->all));
+	g_assert_null(u->changed);
+	g_assert_null(u->refreshed);
+	g_assert_null(u->stale);
+	srvtype_update_destroy(u);
+
+	/* A removed service is fed again with a zero score, so that it leaves
+	 * the slots of the load-balancers. */
+	l = g_slist_prepend(NULL, _make_service(6001, 0, "", 0));
+	u = _apply(mirror, TRUE, 4, NULL, l);
+	g_assert_cmpuint(2, ==, g_slist_length(u->all));
+	g_assert_null(u->changed);
+	g_assert_cmpuint(1, ==, g_slist_length(u->stale));
+	const struct service_info_s *si = u->stale->data;
+	g_assert_cmpuint(6001, ==, _port(si));
+	g_assert_cmpint(SCORE_DOWN, ==, si->score.value);
+	g_assert_cmpstr("a", ==,
+			service_info_get_tag_value(si, NAME_TAGNAME_SLOTS, NULL));
+	srvtype_update_destroy(u);
+
+	/* Removing an unknown service changes nothing */
+	l = g_slist_prepend(NULL, _make_service(6009, 0, "", 0));
+	u = _apply(mirror, TRUE, 5, NULL, l);
+	g_assert_cmpuint(2, ==, g_slist_length(u->all));
+	g_assert_null(u->stale);
+	srvtype_update_destroy(u);
+
+	/* A new score must be fed to the load-balancers, the "stat." tags
+	 * alone must only be refreshed. */
+	l = NULL;
+	l = g_slist_prepend(l, _make_service(6000, 60, "a", 10));
+	l = g_slist_prepend(l, _make_service(6002, 50, "a", 20));
+	u = _apply(mirror, TRUE, 7, l, NULL);
+	g_assert_cmpuint(2, ==, g_slist_length(u->all));
+	g_assert_cmpuint(1, ==, g_slist_length(u->changed));
+	g_assert_cmpuint(6000, ==, _port(u->changed->data));
+	g_assert_cmpuint(1, ==, g_slist_length(u->refreshed));
+	g_assert_cmpuint(6002, ==, _port(u->refreshed->data));
+	si = u->refreshed->data;
+	g_assert_cmpint(20, ==,
+			service_info_get_tag(si->tags, "stat.cpu")->value.i);
+	g_assert_null(u->stale);
+	srvtype_update_destroy(u);
+
+	/* A service leaving its slots is first removed from them */
+	l = g_slist_prepend(NULL, _make_service(6000, 60, "b", 10));
+	u = _apply(mirror, TRUE, 8, l, NULL);
+	g_assert_cmpuint(2, ==, g_slist_length(u->all));
+	g_assert_cmpuint(1, ==, g_slist_length(u->changed));
+	g_assert_cmpuint(1, ==, g_slist_length(u->stale));
+	si = u->stale->data;
+	g_assert_cmpint(SCORE_DOWN, ==, si->score.value);
+	g_assert_cmpstr("a", ==,
+			service_info_get_tag_value(si, NAME_TAGNAME_SLOTS, NULL));
+	si = u->changed->data;
+	g_assert_cmpstr("b", ==,
+			service_info_get_tag_value(si, NAME_TAGNAME_SLOTS, NULL));
+	srvtype_update_destroy(u);
+
+	g_assert_cmpuint(5, ==, mirror->deltas);
+	srvtype_mirror_destroy(mirror);
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc, argv);
+	g_test_add_func("/proxy/srvtype_mirror/full", test_mirror_full);
+	g_test_add_func("/proxy/srvtype_mirror/delta", test_mirror_delta);
+	return g_test_run();
+}
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS unit tests
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -168,6 +168,214 @@ test_limit (void)
 	}
 }
 
+/* Open <max> new bases, all must succeed whatever the shard of their name */
+static void
+_open_bases (sqlx_cache_t *cache, const char *prefix, guint max, gint *ids)
+{
+	for (guint i=0; i<max ;++i) {
+		gchar name[32];
+		g_snprintf(name, sizeof(name), "%s-%u", prefix, i);
+		hashstr_t *hname = hashstr_create(name);
+		GError *err = sqlx_cache_open_and_lock_base (
+				cache, hname, FALSE, ids+i, 0);
+		g_assert_no_error(err);
+		g_assert_cmpint(ids[i], >=, 0);
+		g_free(hname);
+	}
+}
+
+static void
+test_limit_sharded (void)
+{
+	const guint saved_shards = _cache_shards;
+	const guint saved_hard = sqliterepo_repo_max_bases_hard;
+	const guint saved_soft = sqliterepo_repo_max_bases_soft;
+	const guint max = 256;
+
+	_cache_shards = 4;
+	sqliterepo_repo_max_bases_hard = max;
+	sqliterepo_repo_max_bases_soft = max;
+	sqlx_cache_t *cache = sqlx_cache_init();
+	g_assert_nonnull(cache);
+	gint ids[max];
+
+	/* The names are not evenly spread among the shards, the shards that
+	 * ran out of free bases must get some from the others. */
+	_test_cache_limit (cache, max);
+
+	/* All the bases are idle, and the new names must recycle them even
+	 * if they belong to other shards. */
+	_open_bases (cache, "other", max, ids);
+	struct cache_counts_s counts = sqlx_cache_count(cache);
+	g_assert_cmpuint(counts.used, ==, max);
+	for (guint i=0; i<max ;++i)
+		g_assert_no_error(sqlx_cache_unlock_and_close_base(cache, ids[i], 0));
+
+	/* Same with a soft limit under the hard one */
+	sqlx_cache_expire_all(cache);
+	sqliterepo_repo_max_bases_soft = max / 2;
+	sqlx_cache_reconfigure(cache);
+	_test_cache_limit (cache, max / 2);
+	_open_bases (cache, "again", max / 2, ids);
+	for (guint i=0; i<max / 2 ;++i)
+		g_assert_no_error(sqlx_cache_unlock_and_close_base(cache, ids[i], 0));
+
+	sqlx_cache_expire_all(cache);
+	sqlx_cache_clean(cache);
+
+	_cache_shards = saved_shards;
+	sqliterepo_repo_max_bases_hard = saved_hard;
+	sqliterepo_repo_max_bases_soft = saved_soft;
+}
+
+static void
+test_shared (void)
+{
+	hashstr_t *hn0 = NULL;
+	HASHSTR_ALLOCA(hn0, name0);
+
+	sqlx_cache_t *cache = sqlx_cache_init();
+	g_assert_nonnull(cache);
+	sqlx_cache_set_close_hook(cache, sqlite_close);
+
+	/* The first open is exclusive, even if a shared access is wanted,
+	 * because the base is not open yet. */
+	gint id0 = -1;
+	gboolean shared = TRUE;
+	GError *err = sqlx_cache_open_and_lock_base2(cache, hn0, FALSE,
+			&shared, &id0, 0);
+	g_assert_no_error(err);
+	g_assert_false(shared);
+	sqlx_cache_set_handle(cache, id0, GINT_TO_POINTER(1));
+	err = sqlx_cache_unlock_and_close_base(cache, id0, 0);
+	g_assert_no_error(err);
+
+	/* Now several readers can share it */
+	for (int i=0; i<2 ;i++) {
+		gint id = -1;
+		shared = TRUE;
+		err = sqlx_cache_open_and_lock_base2(cache, hn0, FALSE,
+				&shared, &id, 0);
+		g_assert_no_error(err);
+		g_assert_true(shared);
+		g_assert_cmpint(id0, ==, id);
+	}
+	g_assert_null(sqlx_cache_pop_reader(cache, id0));
+	g_assert_true(sqlx_cache_push_reader(cache, id0, GINT_TO_POINTER(2)));
+	g_assert_cmpint(GPOINTER_TO_INT(sqlx_cache_pop_reader(cache, id0)), ==, 2);
+	g_assert_true(sqlx_cache_push_reader(cache, id0, GINT_TO_POINTER(2)));
+	g_assert_cmpuint(sqlx_cache_count(cache).used, ==, 1);
+
+	/* ... and the same thread cannot get an exclusive lock meanwhile */
+	gint id1 = -1;
+	err = sqlx_cache_open_and_lock_base(cache, hn0, FALSE, &id1,
+			oio_ext_monotonic_time() + 10 * G_TIME_SPAN_MILLISECOND);
+	g_assert_error(err, GQ(), CODE_UNAVAILABLE);
+	g_clear_error(&err);
+
+	for (int i=0; i<2 ;i++) {
+		err = sqlx_cache_unlock_and_close_base(cache, id0, 0);
+		g_assert_no_error(err);
+	}
+	err = sqlx_cache_unlock_and_close_base(cache, id0, 0);
+	g_assert_error(err, GQ(), CODE_INTERNAL_ERROR);
+	g_clear_error(&err);
+
+	/* Once released by all the readers, the base can be locked */
+	err = sqlx_cache_open_and_lock_base(cache, hn0, FALSE, &id1, 0);
+	g_assert_no_error(err);
+	g_assert_cmpint(id0, ==, id1);
+	err = sqlx_cache_unlock_and_close_base(cache, id1, 0);
+	g_assert_no_error(err);
+
+	g_assert_cmpuint(sqlx_cache_expire_all(cache), ==, 1);
+	sqlx_cache_clean(cache);
+}
+
+struct bench_ctx_s
+{
+	sqlx_cache_t *cache;
+	guint thread_id;
+	guint rounds;
+};
+
+static gpointer
+_bench_worker(gpointer p)
+{
+	struct bench_ctx_s *ctx = p;
+	gchar name[32];
+
+	/* Each worker hits its own set of bases, so that the only contention
+	 * left is the one on the cache's internal locks. */
+	for (guint i=0; i<ctx->rounds ;++i) {
+		gint bd = -1;
+		g_snprintf(name, sizeof(name), "bench-%u-%u", ctx->thread_id, i % 64);
+		hashstr_t *hn = hashstr_create(name);
+		GError *err = sqlx_cache_open_and_lock_base(ctx->cache, hn, FALSE, &bd, 0);
+		g_assert_no_error(err);
+		err = sqlx_cache_unlock_and_close_base(ctx->cache, bd, 0);
+		g_assert_no_error(err);
+		g_free(hn);
+	}
+	return ctx;
+}
+
+static gint64
+_bench_contention(guint shards, guint nb_threads, guint rounds)
+{
+	_cache_shards = shards;
+	sqlx_cache_t *cache = sqlx_cache_init();
+	g_assert_nonnull(cache);
+	sqlx_cache_set_close_hook(cache, sqlite_close);
+
+	struct bench_ctx_s ctx[nb_threads];
+	GThread *threads[nb_threads];
+
+	const gint64 start = g_get_monotonic_time();
+	for (guint i=0; i<nb_threads ;++i) {
+		ctx[i].cache = cache;
+		ctx[i].thread_id = i;
+		ctx[i].rounds = rounds;
+		threads[i] = g_thread_new("bench", _bench_worker, ctx + i);
+	}
+	for (guint i=0; i<nb_threads ;++i)
+		g_thread_join(threads[i]);
+	const gint64 elapsed = g_get_monotonic_time() - start;
+
+	struct cache_counts_s counts = sqlx_cache_count(cache);
+	g_assert_cmpuint(counts.used, ==, 0);
+
+	sqlx_cache_expire_all(cache);
+	sqlx_cache_clean(cache);
+	return elapsed;
+}
+
+static void
+test_contention (void)
+{
+	const guint nb_threads = 8;
+	const guint rounds = g_test_perf() ? 200000 : 2000;
+	const guint saved_shards = _cache_shards;
+	const guint saved_hard = sqliterepo_repo_max_bases_hard;
+	const guint saved_soft = sqliterepo_repo_max_bases_soft;
+
+	sqliterepo_repo_max_bases_hard = 8192;
+	sqliterepo_repo_max_bases_soft = 8192;
+
+	guint all_shards[] = {1, 4, 16, 64, 0};
+	for (guint i=0; all_shards[i] != 0 ;++i) {
+		gint64 elapsed = _bench_contention(all_shards[i], nb_threads, rounds);
+		g_test_message("shards=%u threads=%u ops=%u elapsed=%"G_GINT64_FORMAT
+				"us rate=%.0f op/s", all_shards[i], nb_threads,
+				nb_threads * rounds, elapsed,
+				(nb_threads * rounds) / ((gdouble)MAX(elapsed,1) / G_TIME_SPAN_SECOND));
+	}
+
+	_cache_shards = saved_shards;
+	sqliterepo_repo_max_bases_hard = saved_hard;
+	sqliterepo_repo_max_bases_soft = saved_soft;
+}
+
 int
 main(int argc, char ** argv)
 {
@@ -175,6 +383,9 @@ main(int argc, char ** argv)
 	g_test_add_func("/sqliterepo/cache/init", test_init);
 	g_test_add_func("/sqliterepo/cache/lock", test_lock);
 	g_test_add_func("/sqliterepo/cache/limit", test_limit);
+	g_test_add_func("/sqliterepo/cache/limit_sharded", test_limit_sharded);
+	g_test_add_func("/sqliterepo/cache/shared", test_shared);
+	g_test_add_func("/sqliterepo/cache/contention", test_contention);
 	return g_test_run();
 }
 
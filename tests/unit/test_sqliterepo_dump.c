@@ -0,0 +1,193 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <string.h>
+#include <zlib.h>
+
+#include <metautils/lib/metautils.h>
+
+#include <sqliterepo/sqlx_remote.h>
+#include <sqliterepo/dump_zlib.h>
+
+#undef GQ
+#define GQ() g_quark_from_static_string("oio.sqlite")
+
+struct pieces_s
+{
+	GByteArray *out;  /* the pieces received, concatenated */
+	guint count;
+	guint with_remaining;  /* the pieces received with what remains */
+	gint64 remaining;  /* the last value received */
+};
+
+static GError *
+_collect(GByteArray *piece, gint64 remaining, gpointer arg)
+{
+	struct pieces_s *p = arg;
+	g_assert_cmpuint(piece->len, >, 0);
+	g_assert_cmpuint(piece->len, <=, SQLX_DUMP_INFLATE_PIECE);
+	g_byte_array_append(p->out, piece->data, piece->len);
+	++ p->count;
+	if (remaining >= 0)
+		++ p->with_remaining;
+	p->remaining = remaining;
+	g_byte_array_unref(piece);
+	return NULL;
+}
+
+/* Data that compresses a bit, so that several pieces come out of a part */
+static GByteArray *
+_make_part(GRand *r, gsize len)
+{
+	GByteArray *gba = g_byte_array_sized_new(len);
+	g_byte_array_set_size(gba, len);
+	for (gsize i = 0; i < len; ++i)
+		gba->data[i] = 'a' + g_rand_int_range(r, 0, 16);
+	return gba;
+}
+
+static GByteArray *
+_deflate_whole(GRand *r, gsize len, GByteArray **zpart)
+{
+	z_stream zs = {0};
+	g_assert_cmpint(Z_OK, ==, deflateInit(&zs, Z_BEST_SPEED));
+	GByteArray *part = _make_part(r, len);
+	g_assert_no_error(sqlx_dump_deflate_part(&zs, part, TRUE, zpart));
+	deflateEnd(&zs);
+	return part;
+}
+
+static void
+test_roundtrip(void)
+{
+	const gsize sizes[] = {
+		1000,
+		SQLX_DUMP_INFLATE_PIECE,
+		3 * SQLX_DUMP_INFLATE_PIECE,
+		SQLX_DUMP_INFLATE_PIECE + 1,
+		17,
+		/* The last part finishes the stream */
+		2 * SQLX_DUMP_INFLATE_PIECE,
+	};
+	const guint nb = G_N_ELEMENTS(sizes);
+
+	gint64 remaining = 0;
+	for (guint i = 0; i < nb; ++i)
+		remaining += sizes[i];
+
+	GRand *r = g_rand_new_with_seed(42);
+	z_stream zd = {0}, zi = {0};
+	g_assert_cmpint(Z_OK, ==, deflateInit(&zd, Z_BEST_SPEED));
+	g_assert_cmpint(Z_OK, ==, inflateInit(&zi));
+
+	gboolean end = FALSE;
+	for (guint i = 0; i < nb; ++i) {
+		const gboolean last = i == nb - 1;
+		GByteArray *part = _make_part(r, sizes[i]);
+		remaining -= part->len;
+
+		GByteArray *zpart = NULL;
+		g_assert_no_error(sqlx_dump_deflate_part(&zd, part, last, &zpart));
+		g_assert_nonnull(zpart);
+		g_assert_cmpuint(zpart->len, >, 0);
+
+		struct pieces_s p = {g_byte_array_new(), 0, 0, -2};
+		g_assert_no_error(sqlx_dump_inflate_part(&zi, &end,
+					zpart->data, zpart->len, remaining, _collect, &p));
+
+		/* Each part inflates alone, in full pieces but the last one, that
+		 * alone tells what remains. */
+		g_assert_cmpuint(p.out->len, ==, part->len);
+		g_assert_cmpint(0, ==, memcmp(p.out->data, part->data, part->len));
+		g_assert_cmpuint(p.count, ==,
+				(part->len + SQLX_DUMP_INFLATE_PIECE - 1) / SQLX_DUMP_INFLATE_PIECE);
+		g_assert_cmpuint(p.with_remaining, ==, 1);
+		g_assert_cmpint(p.remaining, ==, remaining);
+		g_assert_cmpint(end, ==, last);
+
+		g_byte_array_free(p.out, TRUE);
+		g_byte_array_free(zpart, TRUE);
+		g_byte_array_free(part, TRUE);
+	}
+	g_assert_cmpint(remaining, ==, 0);
+
+	deflateEnd(&zd);
+	inflateEnd(&zi);
+	g_rand_free(r);
+}
+
+static void
+test_garbage_after_end(void)
+{
+	GRand *r = g_rand_new_with_seed(42);
+	GByteArray *zpart = NULL;
+	GByteArray *part = _deflate_whole(r, 1000, &zpart);
+	g_byte_array_append(zpart, (guint8*)"garbage", 7);
+
+	z_stream zi = {0};
+	g_assert_cmpint(Z_OK, ==, inflateInit(&zi));
+	struct pieces_s p = {g_byte_array_new(), 0, 0, -2};
+	gboolean end = FALSE;
+	GError *err = sqlx_dump_inflate_part(&zi, &end,
+			zpart->data, zpart->len, 0, _collect, &p);
+	g_assert_error(err, GQ(), CODE_INTERNAL_ERROR);
+	g_clear_error(&err);
+	g_assert_true(end);
+	g_assert_cmpuint(p.out->len, ==, part->len);
+	inflateEnd(&zi);
+
+	g_byte_array_free(p.out, TRUE);
+	g_byte_array_free(zpart, TRUE);
+	g_byte_array_free(part, TRUE);
+	g_rand_free(r);
+}
+
+static void
+test_corrupted(void)
+{
+	GRand *r = g_rand_new_with_seed(42);
+	GByteArray *zpart = NULL;
+	GByteArray *part = _deflate_whole(r, 1000, &zpart);
+	for (guint i = zpart->len / 2; i < zpart->len; ++i)
+		zpart->data[i] ^= 0xFF;
+
+	z_stream zi = {0};
+	g_assert_cmpint(Z_OK, ==, inflateInit(&zi));
+	struct pieces_s p = {g_byte_array_new(), 0, 0, -2};
+	gboolean end = FALSE;
+	GError *err = sqlx_dump_inflate_part(&zi, &end,
+			zpart->data, zpart->len, 0, _collect, &p);
+	g_assert_error(err, GQ(), CODE_INTERNAL_ERROR);
+	g_clear_error(&err);
+	inflateEnd(&zi);
+
+	g_byte_array_free(p.out, TRUE);
+	g_byte_array_free(zpart, TRUE);
+	g_byte_array_free(part, TRUE);
+	g_rand_free(r);
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc, argv);
+	g_test_add_func("/sqliterepo/dump/roundtrip", test_roundtrip);
+	g_test_add_func("/sqliterepo/dump/garbage", test_garbage_after_end);
+	g_test_add_func("/sqliterepo/dump/corrupted", test_corrupted);
+	return g_test_run();
+}
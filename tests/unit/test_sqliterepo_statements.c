@@ -0,0 +1,180 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <metautils/lib/metautils.h>
+#include <sqliterepo/sqlite_utils.h>
+
+#define SQL_INSERT "INSERT INTO t (k,v) VALUES (?,?)"
+#define SQL_SELECT "SELECT v FROM t WHERE k = ?"
+#define SQL_COUNT  "SELECT COUNT(*) FROM t"
+
+static sqlite3 *
+_open(void)
+{
+	sqlite3 *db = NULL;
+	int rc = sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_NOMUTEX
+			|SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, NULL);
+	g_assert_cmpint(rc, ==, SQLITE_OK);
+	g_assert_cmpint(sqlx_exec(db, "CREATE TABLE t (k TEXT PRIMARY KEY, v TEXT)"),
+			==, SQLITE_OK);
+	return db;
+}
+
+static sqlite3_stmt *
+_prepare(sqlite3 *db, const char *sql)
+{
+	sqlite3_stmt *stmt = NULL;
+	g_assert_cmpint(sqlx_stmt_prepare(db, sql, -1, &stmt), ==, SQLITE_OK);
+	g_assert_nonnull(stmt);
+	return stmt;
+}
+
+static void
+_insert(sqlite3 *db, const char *k, const char *v)
+{
+	sqlite3_stmt *stmt = _prepare(db, SQL_INSERT);
+	sqlite3_bind_text(stmt, 1, k, -1, NULL);
+	sqlite3_bind_text(stmt, 2, v, -1, NULL);
+	g_assert_cmpint(sqlite3_step(stmt), ==, SQLITE_DONE);
+	g_assert_cmpint(sqlx_stmt_release(stmt), ==, SQLITE_OK);
+}
+
+static guint64
+_stat(const char *name)
+{
+	guint64 value = 0;
+	GQuark q = g_quark_try_string(name);
+	GArray *all = network_server_stat_getall();
+	for (guint i = 0; q && i < all->len; i++) {
+		struct stat_record_s *st = &g_array_index(all, struct stat_record_s, i);
+		if (st->which == q)
+			value = st->value;
+	}
+	g_array_free(all, TRUE);
+	return value;
+}
+
+static void
+test_reuse(void)
+{
+	sqlite3 *db = _open();
+	struct sqlx_stmt_cache_s *cache = sqlx_stmt_cache_create(db, "test", 4);
+
+	sqlite3_stmt *s0 = _prepare(db, SQL_SELECT);
+	sqlx_stmt_release(s0);
+	sqlite3_stmt *s1 = _prepare(db, SQL_SELECT);
+	g_assert_true(s0 == s1);
+
+	/* The statement given back has been reset and unbound */
+	g_assert_cmpint(sqlite3_step(s1), ==, SQLITE_DONE);
+	sqlx_stmt_release(s1);
+	_insert(db, "k0", "v0");
+	_insert(db, "k1", "v1");
+	s1 = _prepare(db, SQL_SELECT);
+	sqlite3_bind_text(s1, 1, "k1", -1, NULL);
+	g_assert_cmpint(sqlite3_step(s1), ==, SQLITE_ROW);
+	g_assert_cmpstr((const char*)sqlite3_column_text(s1, 0), ==, "v1");
+	sqlx_stmt_release(s1);
+
+	/* A constraint violation is reported at the release, like a finalize */
+	sqlite3_stmt *s2 = _prepare(db, SQL_INSERT);
+	sqlite3_bind_text(s2, 1, "k0", -1, NULL);
+	g_assert_cmpint(sqlite3_step(s2), ==, SQLITE_CONSTRAINT);
+	g_assert_cmpint(sqlx_stmt_release(s2), ==, SQLITE_CONSTRAINT);
+	_insert(db, "k2", "v2");
+
+	sqlx_stmt_cache_destroy(cache);
+	g_assert_cmpint(sqlite3_close(db), ==, SQLITE_OK);
+}
+
+static void
+test_nested(void)
+{
+	sqlite3 *db = _open();
+	struct sqlx_stmt_cache_s *cache = sqlx_stmt_cache_create(db, "test", 4);
+	_insert(db, "k0", "v0");
+
+	/* The same SQL while the cached statement is in use */
+	sqlite3_stmt *s0 = _prepare(db, SQL_COUNT);
+	sqlite3_stmt *s1 = _prepare(db, SQL_COUNT);
+	g_assert_true(s0 != s1);
+	g_assert_cmpint(sqlite3_step(s0), ==, SQLITE_ROW);
+	g_assert_cmpint(sqlite3_step(s1), ==, SQLITE_ROW);
+	sqlx_stmt_release(s1);
+	sqlx_stmt_release(s0);
+	g_assert_true(s0 == _prepare(db, SQL_COUNT));
+	sqlx_stmt_release(s0);
+
+	sqlx_stmt_cache_destroy(cache);
+	g_assert_cmpint(sqlite3_close(db), ==, SQLITE_OK);
+}
+
+static void
+test_eviction(void)
+{
+	sqlite3 *db = _open();
+	struct sqlx_stmt_cache_s *cache = sqlx_stmt_cache_create(db, "test", 2);
+
+	sqlite3_stmt *s0 = _prepare(db, SQL_COUNT);
+	sqlx_stmt_release(s0);
+	sqlx_stmt_release(_prepare(db, SQL_SELECT));
+	sqlx_stmt_release(_prepare(db, SQL_INSERT));
+	/* Only the 2 most recently used remain */
+	sqlite3_stmt *next = NULL;
+	guint count = 0;
+	while ((next = sqlite3_next_stmt(db, next)))
+		count ++;
+	g_assert_cmpuint(count, ==, 2);
+
+	/* A flush keeps the statements in use */
+	s0 = _prepare(db, SQL_COUNT);
+	sqlx_stmt_cache_flush(cache);
+	g_assert_true(s0 == sqlite3_next_stmt(db, NULL));
+	g_assert_null(sqlite3_next_stmt(db, s0));
+	sqlx_stmt_release(s0);
+	g_assert_null(sqlite3_next_stmt(db, NULL));
+
+	sqlx_stmt_cache_destroy(cache);
+	g_assert_cmpint(sqlite3_close(db), ==, SQLITE_OK);
+}
+
+static void
+test_stats(void)
+{
+	sqlite3 *db = _open();
+	struct sqlx_stmt_cache_s *cache = sqlx_stmt_cache_create(db, "stats", 4);
+	for (guint i = 0; i < 10; i++)
+		sqlx_stmt_release(_prepare(db, SQL_COUNT));
+	sqlx_stmt_cache_destroy(cache);
+	g_assert_cmpint(sqlite3_close(db), ==, SQLITE_OK);
+
+	g_assert_cmpuint(_stat("counter stmt.stats.hits"), ==, 9);
+	g_assert_cmpuint(_stat("counter stmt.stats.misses"), ==, 1);
+	g_assert_cmpuint(_stat("gauge stmt.stats.hit_rate"), ==, 90);
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc,argv);
+	g_test_add_func("/sqliterepo/statements/reuse", test_reuse);
+	g_test_add_func("/sqliterepo/statements/nested", test_nested);
+	g_test_add_func("/sqliterepo/statements/eviction", test_eviction);
+	g_test_add_func("/sqliterepo/statements/stats", test_stats);
+	return g_test_run();
+}
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS unit tests
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -20,6 +20,8 @@ License along with this library.
 #include <metautils/lib/metautils.h>
 
 #include <sqliterepo/version.h>
+#include <sqliterepo/deltas.h>
+#include <sqliterepo/sqlx_remote.h>
 
 #undef GQ
 #define GQ() g_quark_from_static_string("oio.sqlite")
@@ -207,6 +209,100 @@ test_schema_concurrent(void)
 	test_concurrent_version(cfg1, cfg0);
 }
 
+static void
+test_dup_equal(void)
+{
+	struct cfg_s cfg0[] = {
+		{"main.admin", 2, 0},
+		{"main.test", 3, 0},
+		{NULL, 0, 0}
+	};
+	struct cfg_s cfg1[] = {
+		{"main.admin", 2, 0},
+		{"main.test", 4, 0},
+		{NULL, 0, 0}
+	};
+	GTree *v0 = build_version(cfg0);
+	GTree *v1 = build_version(cfg1);
+	GTree *v2 = version_dup(v0);
+	g_assert_true(version_equal(v0, v2));
+	g_assert_true(version_equal(v2, v0));
+	g_assert_false(version_equal(v0, v1));
+	g_tree_destroy(v0);
+	g_tree_destroy(v1);
+	g_tree_destroy(v2);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void
+test_deltas_chain(void)
+{
+	struct sqlx_name_s n = {"NS", "base", "type"};
+	struct cfg_s cfg[4][3] = {
+		{{"main.admin", 1, 0}, {"main.test", 1, 0}, {NULL, 0, 0}},
+		{{"main.admin", 2, 0}, {"main.test", 2, 0}, {NULL, 0, 0}},
+		{{"main.admin", 3, 0}, {"main.test", 3, 0}, {NULL, 0, 0}},
+		{{"main.admin", 5, 0}, {"main.test", 5, 0}, {NULL, 0, 0}},
+	};
+	GTree *v[4];
+	for (int i = 0; i < 4; i++)
+		v[i] = build_version(cfg[i]);
+
+	struct sqlx_deltas_s *deltas = sqlx_deltas_create();
+	GPtrArray *result = NULL;
+	GError *err;
+
+	/* Nothing known yet */
+	err = sqlx_deltas_collect(deltas, &n, v[0], v[1], &result);
+	g_assert_error(err, GQ(), CODE_NOT_FOUND);
+	g_clear_error(&err);
+	g_assert_null(result);
+
+	sqlx_deltas_push(deltas, &n, v[0], v[1], (guint8*)"0", 1);
+	sqlx_deltas_push(deltas, &n, v[1], v[2], (guint8*)"1", 1);
+	g_assert_cmpuint(sqlx_deltas_size(deltas), ==, 2);
+
+	/* Up to date */
+	err = sqlx_deltas_collect(deltas, &n, v[2], v[2], &result);
+	g_assert_no_error(err);
+	g_assert_cmpuint(result->len, ==, 0);
+	g_ptr_array_free(result, TRUE);
+
+	/* Lagging by one, then by two */
+	err = sqlx_deltas_collect(deltas, &n, v[1], v[2], &result);
+	g_assert_no_error(err);
+	g_assert_cmpuint(result->len, ==, 1);
+	g_ptr_array_free(result, TRUE);
+	err = sqlx_deltas_collect(deltas, &n, v[0], v[2], &result);
+	g_assert_no_error(err);
+	g_assert_cmpuint(result->len, ==, 2);
+	g_assert_cmpint(((GByteArray*)result->pdata[0])->data[0], ==, '0');
+	g_assert_cmpint(((GByteArray*)result->pdata[1])->data[0], ==, '1');
+	g_ptr_array_free(result, TRUE);
+
+	/* The base moved without a delta: the log is useless */
+	err = sqlx_deltas_collect(deltas, &n, v[0], v[3], &result);
+	g_assert_error(err, GQ(), CODE_NOT_FOUND);
+	g_clear_error(&err);
+	g_assert_cmpuint(sqlx_deltas_size(deltas), ==, 0);
+
+	/* A gap in the chain drops the previous deltas */
+	sqlx_deltas_push(deltas, &n, v[0], v[1], (guint8*)"0", 1);
+	sqlx_deltas_push(deltas, &n, v[2], v[3], (guint8*)"2", 1);
+	g_assert_cmpuint(sqlx_deltas_size(deltas), ==, 1);
+	err = sqlx_deltas_collect(deltas, &n, v[0], v[3], &result);
+	g_assert_error(err, GQ(), CODE_NOT_FOUND);
+	g_clear_error(&err);
+
+	sqlx_deltas_forget(deltas, &n);
+	g_assert_cmpuint(sqlx_deltas_size(deltas), ==, 0);
+
+	sqlx_deltas_destroy(deltas);
+	for (int i = 0; i < 4; i++)
+		g_tree_destroy(v[i]);
+}
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -221,6 +317,8 @@ main(int argc, char **argv)
 	g_test_add_func("/sqliterepo/version/schema/diff", test_schema_diff);
 	g_test_add_func("/sqliterepo/version/schema/concurrent",
 			test_schema_concurrent);
+	g_test_add_func("/sqliterepo/version/dup", test_dup_equal);
+	g_test_add_func("/sqliterepo/version/deltas", test_deltas_chain);
 	return g_test_run();
 }
 
@@ -1,7 +1,7 @@
 /*
 OpenIO SDS unit tests
 Copyright (C) 2014 Worldline, as part of Redcurrant
-Copyright (C) 2015-2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2015-2020 OpenIO SAS, as part of OpenIO SDS
 
 This library is free software; you can redistribute it and/or
 modify it under the terms of the GNU Lesser General Public
@@ -40,11 +40,91 @@ test_rrd (void)
 		_round_rrd ();
 }
 
+static guint64
+_stat(const char *name)
+{
+	guint64 value = G_MAXUINT64;
+	GQuark q = g_quark_try_string(name);
+	GArray *all = network_server_stat_getall();
+	for (guint i = 0; q && i < all->len; i++) {
+		struct stat_record_s *st = &g_array_index(all, struct stat_record_s, i);
+		if (st->which == q)
+			value = st->value;
+	}
+	g_array_free(all, TRUE);
+	return value;
+}
+
+static void
+test_shards (void)
+{
+	GQuark q0 = g_quark_from_static_string("counter test.shards.0");
+	GQuark q1 = g_quark_from_static_string("counter test.shards.1");
+
+	gpointer _worker(gpointer p UNUSED) {
+		for (guint i = 0; i < 1000; i++)
+			oio_stats_add(q0, 1, q1, 2, 0, 0, 0, 0);
+		return NULL;
+	}
+
+	GThread *threads[32];
+	for (guint i = 0; i < G_N_ELEMENTS(threads); i++)
+		threads[i] = g_thread_new("test", _worker, NULL);
+	for (guint i = 0; i < G_N_ELEMENTS(threads); i++)
+		g_thread_join(threads[i]);
+	g_assert_cmpuint(_stat("counter test.shards.0"), ==, 32000);
+	g_assert_cmpuint(_stat("counter test.shards.1"), ==, 64000);
+
+	/* A value set overrides the increments of all the threads */
+	oio_stats_set(q0, 7, 0, 0, 0, 0, 0, 0);
+	g_assert_cmpuint(_stat("counter test.shards.0"), ==, 7);
+	oio_stats_add(q0, 1, 0, 0, 0, 0, 0, 0);
+	g_assert_cmpuint(_stat("counter test.shards.0"), ==, 8);
+	g_assert_cmpuint(_stat("counter test.shards.1"), ==, 64000);
+}
+
+static void
+test_histo (void)
+{
+	GQuark q = g_quark_from_static_string("counter test.histo");
+	g_assert_cmpuint(_stat("latency test.histo.p50"), ==, G_MAXUINT64);
+
+	/* 1..1000, then a single outlier */
+	for (guint64 v = 1; v <= 1000; v++)
+		oio_stats_histo_add(q, v, 0, 0);
+	oio_stats_histo_add(q, 1000000, 0, 0);
+
+	/* The error is bounded by the width of the buckets (1/8) */
+	const guint64 p50 = _stat("latency test.histo.p50");
+	g_assert_cmpuint(p50, >=, 500);
+	g_assert_cmpuint(p50, <=, 500 + 500 / 8);
+	const guint64 p90 = _stat("latency test.histo.p90");
+	g_assert_cmpuint(p90, >=, 900);
+	g_assert_cmpuint(p90, <=, 900 + 900 / 8);
+	const guint64 p99 = _stat("latency test.histo.p99");
+	g_assert_cmpuint(p99, >=, 990);
+	g_assert_cmpuint(p99, <=, 990 + 990 / 8);
+	const guint64 p999 = _stat("latency test.histo.p999");
+	g_assert_cmpuint(p999, >=, 999);
+	g_assert_cmpuint(p999, <=, 999 + 999 / 8);
+
+	/* The small values are exact, the huge ones are capped */
+	GQuark q_small = g_quark_from_static_string("counter test.histo.small");
+	GQuark q_huge = g_quark_from_static_string("counter test.histo.huge");
+	for (guint i = 0; i < 10; i++)
+		oio_stats_histo_add(q_small, 3, q_huge, G_MAXUINT64);
+	g_assert_cmpuint(_stat("latency test.histo.small.p99"), ==, 3);
+	g_assert_cmpuint(_stat("latency test.histo.huge.p50"), ==,
+			(1ULL << 40) - 1);
+}
+
 int
 main (int argc, char **argv)
 {
 	HC_TEST_INIT(argc,argv);
 	g_test_add_func("/server/rrd", test_rrd);
+	g_test_add_func("/server/stats/shards", test_shards);
+	g_test_add_func("/server/stats/histo", test_histo);
 	return g_test_run();
 }
 
@@ -0,0 +1,174 @@
+/*
+OpenIO SDS unit tests
+Copyright (C) 2020 OpenIO SAS, as part of OpenIO SDS
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3.0 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library.
+*/
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <core/oio_core.h>
+#include <metautils/lib/metautils.h>
+#include <metautils/lib/common_variables.h>
+
+#include <server/network_server.h>
+#include <server/transport_gridd.h>
+
+/* A gridd service only serving the common requests, in its own thread */
+static struct network_server_s *srv = NULL;
+static struct gridd_request_dispatcher_s *disp = NULL;
+static GThread *th_srv = NULL;
+static gchar *url = NULL;
+
+static gpointer
+_server(gpointer p)
+{
+	GError *err = network_server_run(p, NULL);
+	g_assert_no_error(err);
+	return NULL;
+}
+
+static void
+_setup(void)
+{
+	disp = transport_gridd_build_empty_dispatcher();
+	g_assert_no_error(transport_gridd_dispatcher_add_requests(
+				disp, gridd_get_common_requests(), NULL));
+	srv = network_server_init();
+	grid_daemon_bind_host(srv, "127.0.0.1:0", disp);
+	g_assert_no_error(network_server_open_servers(srv));
+	gchar **urlv = network_server_endpoints(srv);
+	g_assert_nonnull(urlv);
+	url = g_strdup(urlv[0]);
+	g_strfreev(urlv);
+	th_srv = g_thread_new("server", _server, srv);
+}
+
+static void
+_teardown(void)
+{
+	network_server_stop(srv);
+	g_thread_join(th_srv);
+	network_server_close_servers(srv);
+	network_server_clean(srv);
+	gridd_request_dispatcher_clean(disp);
+	oio_str_clean(&url);
+	oio_wire_binary = TRUE;
+}
+
+static int
+_connect(void)
+{
+	GError *err = NULL;
+	int fd = sock_connect(url, &err);
+	g_assert_no_error(err);
+	g_assert_cmpint(fd, >=, 0);
+	sock_set_non_blocking(fd, FALSE);
+	return fd;
+}
+
+static void
+_read_all(int fd, guint8 *buf, gsize len)
+{
+	while (len > 0) {
+		ssize_t r = read(fd, buf, len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		g_assert_cmpint(r, >, 0);
+		buf += r;
+		len -= r;
+	}
+}
+
+/* Sends a PING, encoded as a peer that advertises (or not) the binary
+ * framing would do, then tells the framing of the reply. */
+static gboolean
+_ping(int fd, gboolean advertise)
+{
+	const gboolean enabled = oio_wire_binary;
+	oio_wire_binary = advertise;
+	GByteArray *req = message_marshall_gba_and_clean(
+			metautils_message_create_named("REQ_PING", 0));
+	oio_wire_binary = enabled;
+	g_assert_false(message_is_binary(req->data, req->len));
+	g_assert_cmpint(write(fd, req->data, req->len), ==, req->len);
+	g_byte_array_unref(req);
+
+	guint32 size = 0;
+	_read_all(fd, (guint8*)&size, sizeof(size));
+	const gsize len = sizeof(size) + g_ntohl(size);
+	guint8 *frame = g_malloc(len);
+	memcpy(frame, &size, sizeof(size));
+	_read_all(fd, frame + sizeof(size), len - sizeof(size));
+	const gboolean binary = message_is_binary(frame, len);
+
+	GError *err = NULL;
+	MESSAGE reply = message_unmarshall(frame, len, &err);
+	g_assert_no_error(err);
+	guint code = 0;
+	g_assert_no_error(metautils_message_extract_struint(
+				reply, NAME_MSGKEY_STATUS, &code));
+	g_assert_cmpuint(code, ==, CODE_FINAL_OK);
+	metautils_message_destroy(reply);
+	g_free(frame);
+	return binary;
+}
+
+/* A peer ignoring the binary framing keeps receiving BER, even while the
+ * peers that advertised it are served in binary by the same service. */
+static void
+test_old_client(void)
+{
+	_setup();
+	int fd_old = _connect(), fd_new = _connect();
+
+	g_assert_false(_ping(fd_old, FALSE));
+	g_assert_true(_ping(fd_new, TRUE));
+	g_assert_false(_ping(fd_old, FALSE));
+	/* Once advertised, the framing sticks to the connection */
+	g_assert_true(_ping(fd_new, FALSE));
+	g_assert_false(_ping(fd_old, FALSE));
+
+	metautils_pclose(&fd_old);
+	metautils_pclose(&fd_new);
+	_teardown();
+}
+
+/* A service that does not know the binary framing ignores the capability
+ * advertised, and its BER replies are understood. */
+static void
+test_old_service(void)
+{
+	_setup();
+	int fd = _connect();
+
+	oio_wire_binary = FALSE;
+	g_assert_false(_ping(fd, TRUE));
+	g_assert_false(_ping(fd, TRUE));
+
+	metautils_pclose(&fd);
+	_teardown();
+}
+
+int
+main(int argc, char **argv)
+{
+	HC_TEST_INIT(argc, argv);
+	g_test_add_func("/server/gridd/wire/old_client", test_old_client);
+	g_test_add_func("/server/gridd/wire/old_service", test_old_service);
+	return g_test_run();
+}
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS oio-event-benchmark
-Copyright (C) 2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2017-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -20,6 +20,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 
 #include <metautils/lib/metautils.h>
+#include <events/events_variables.h>
 
 #include "event_benchmark.h"
 #include "fake_service.h"
@@ -184,6 +185,11 @@ grid_main_get_options(void)
 			"MaxWaiting", OT_INT64, {.i64 = &max_waiting},
 			"Maximum waiting to receive a event (microseconds)"
 		},
+		{
+			"Window", OT_UINT, {.u = &oio_events_beanstalkd_window},
+			"Maximum number of events sent to the beanstalkd and waiting "
+			"for their acknowledgement"
+		},
 		{NULL, 0, {.i=0}, NULL}
 	};
 
@@ -1,6 +1,6 @@
 /*
 OpenIO SDS oio-event-benchmark
-Copyright (C) 2017 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2017-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -221,6 +221,24 @@ send_event()
 	}
 }
 
+/* Print what the events queue reports about the publishing of the events
+ * to the beanstalkd: the counters, the occupancy of the window of puts and
+ * the throughput. */
+static void
+_print_publish_stats(void)
+{
+	GArray *stats = network_server_stat_getall();
+	for (guint i = 0; i < stats->len; i++) {
+		struct stat_record_s *st =
+			&g_array_index(stats, struct stat_record_s, i);
+		const char *name = g_quark_to_string(st->which);
+		if (g_str_has_prefix(name, "counter event.beanstalkd.")
+				|| g_str_has_prefix(name, "gauge event.beanstalkd."))
+			printf("%s %"G_GUINT64_FORMAT"\n", name, st->value);
+	}
+	g_array_free(stats, TRUE);
+}
+
 static void
 send_events()
 {
@@ -300,6 +318,7 @@ event_sender_run(void)
 		} else {
 			sent_events = MIN_SENT_EVENTS;
 		}
+		_print_publish_stats();
 		printf("Sending %d fake events\n", sent_events);
 		send_events();
 	}
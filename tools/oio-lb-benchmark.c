@@ -1,6 +1,6 @@
 /*
 OpenIO SDS oio-lb-benchmark
-Copyright (C) 2019 OpenIO SAS, as part of OpenIO SDS
+Copyright (C) 2019-2020 OpenIO SAS, as part of OpenIO SDS
 
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU Affero General Public License as
@@ -21,15 +21,106 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 static guint iterations = 50000;
+static gboolean reload = FALSE;
+static guint services = 0;
 static const char *input_path = NULL;
 static const char *pool_descr = NULL;
 
+static volatile gint reloading = 0;
+static volatile gint reloads = 0;
+
+static gint
+_cmp_latency(gconstpointer p0, gconstpointer p1)
+{
+	return CMP(*(const gint64*)p0, *(const gint64*)p1);
+}
+
+static void
+_on_item_noop(struct oio_lb_selected_item_s *sel UNUSED, gpointer u UNUSED)
+{
+}
+
+/* Services spread on racks of 20 hosts, each host with 4 volumes */
+static gchar *
+_generate_services(guint count)
+{
+	GString *out = g_string_sized_new(count * 32);
+	for (guint i = 0; i < count; i++) {
+		g_string_append_printf(out, "ID-%06u rack%u.host%u.vol%u %u\n",
+				i, i / 80, i / 4, i % 4, 70 + i % 30);
+	}
+	return g_string_free(out, FALSE);
+}
+
+static GError *
+_feed_world(struct oio_lb_world_s *world)
+{
+	if (!services)
+		return oio_lb_world__feed_from_file(world, "rawx", input_path);
+	gchar *str = _generate_services(services);
+	oio_lb_world__feed_from_string(world, "rawx", str);
+	g_free(str);
+	return NULL;
+}
+
+static gpointer
+_reload_worker(gpointer p)
+{
+	struct oio_lb_world_s *world = p;
+	while (g_atomic_int_get(&reloading)) {
+		oio_lb_world__increment_generation(world);
+		GError *err = _feed_world(world);
+		if (err) {
+			GRID_WARN("Reload failed: (%d) %s", err->code, err->message);
+			g_clear_error(&err);
+			break;
+		}
+		g_atomic_int_inc(&reloads);
+	}
+	return NULL;
+}
+
+/* Measure the latency of each poll while another thread keeps on reloading
+ * the world, as the proxy and the meta1 do when the conscience is refreshed */
+static void
+_bench_reload(struct oio_lb_world_s *world, struct oio_lb_pool_s *pool)
+{
+	if (!iterations)
+		return;
+
+	gint64 *latencies = g_malloc0(iterations * sizeof(gint64));
+	guint errors = 0;
+
+	g_atomic_int_set(&reloading, 1);
+	GThread *th = g_thread_new("reload", _reload_worker, world);
+	for (guint i = 0; i < iterations; i++) {
+		const gint64 start = oio_ext_monotonic_time();
+		GError *err = oio_lb_pool__poll(pool, NULL, _on_item_noop, NULL);
+		latencies[i] = oio_ext_monotonic_time() - start;
+		if (err) {
+			errors++;
+			g_clear_error(&err);
+		}
+	}
+	g_atomic_int_set(&reloading, 0);
+	g_thread_join(th);
+
+	qsort(latencies, iterations, sizeof(gint64), _cmp_latency);
+	GRID_NOTICE("%u polls (%u errors) during %d reloads, latency in us: "
+			"p50=%"G_GINT64_FORMAT" p99=%"G_GINT64_FORMAT
+			" p999=%"G_GINT64_FORMAT" max=%"G_GINT64_FORMAT,
+			iterations, errors, g_atomic_int_get(&reloads),
+			latencies[iterations / 2], latencies[(iterations * 99) / 100],
+			latencies[(iterations * 999) / 1000], latencies[iterations - 1]);
+	g_free(latencies);
+}
+
 static void
 cli_action(void)
 {
 	struct oio_lb_world_s *world = oio_lb_local__create_world();
 	struct oio_lb_pool_s *pool = oio_lb_world__create_pool(world, "main");
-	GError *err = oio_lb_world__feed_from_file(world, "rawx", input_path);
+	GError *err = _feed_world(world);
 	if (!err) {
 		oio_lb_world__add_pool_targets(pool, pool_descr);
 		GString *pool_dump = oio_lb_world__dump_pool_options(pool);
@@ -39,6 +130,11 @@ cli_action(void)
 
 		oio_lb_world__debug(world);
 
+		if (reload) {
+			_bench_reload(world, pool);
+			goto exit;
+		}
+
 		int unbalanced = 0;
 		GHashTable *counts = g_hash_table_new_full(
 				g_str_hash, g_str_equal, g_free, NULL);
@@ -54,6 +150,7 @@ cli_action(void)
 		GRID_NOTICE("%.3fs, %"G_GINT64_FORMAT"us per iteration",
 				duration_seconds, (end - start) / iterations);
 	}
+exit:
 	g_clear_error(&err);
 	oio_lb_pool__destroy(pool);
 	oio_lb_world__destroy(world);
@@ -65,6 +162,12 @@ cli_get_options(void)
 	static struct grid_main_option_s cli_options[] = {
 		{"iterations", OT_UINT, {.u=&iterations},
 			"Number of iterations for the benchmark."},
+		{"reload", OT_BOOL, {.b=&reload},
+			"Measure the latency of the polls while the world is "
+			"continuously reloaded."},
+		{"services", OT_UINT, {.u=&services},
+			"Generate that many services, spread on racks and hosts, "
+			"instead of loading SERVICE_FILE."},
 		{NULL, 0, {.i=0}, NULL}
 	};
 
@@ -92,11 +195,12 @@ cli_specific_stop(void)
 static const gchar *
 cli_usage(void)
 {
-	return "SERVICE_FILE POOL_DESCR\n\n"
+	return "[SERVICE_FILE] POOL_DESCR\n\n"
 			"    SERVICE_FILE\n"
 			"        A file with one service description per line.\n"
 			"        Each line must have 1 to 4 fields:\n"
-			"            ID [LOC [SCORE [SLOT]]]\n\n"
+			"            ID [LOC [SCORE [SLOT]]]\n"
+			"        Not expected when the 'services' option is set.\n\n"
 			"    POOL_DESCR\n"
 			"        The description of the service pool to test.\n"
 			"        Example:\n"
@@ -106,7 +210,7 @@ cli_usage(void)
 static gboolean
 cli_configure(int argc, char **argv)
 {
-	if (argc < 2) {
+	if (argc < (services? 1 : 2)) {
 		GRID_ERROR("Expected service file and pool description");
 		return FALSE;
 	}
@@ -114,8 +218,12 @@ cli_configure(int argc, char **argv)
 		g_printerr("Unknown NS [%s]\n", g_getenv("OIO_NS"));
 		return FALSE;
 	}
-	input_path = argv[0];
-	pool_descr = argv[1];
+	if (services) {
+		pool_descr = argv[0];
+	} else {
+		input_path = argv[0];
+		pool_descr = argv[1];
+	}
 	return TRUE;
 }
 